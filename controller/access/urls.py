@@ -20,6 +20,9 @@ urlpatterns = [
 
 	# Internal APIs
 
+	url(r'^canMap/batch$', api.query_can_map_batch,
+		name="batched canMap queries"),
+
 	url(r'^canMap/' + gateway("from_gateway") + r'/' + device_id("from_id")
 		+ r'/' + gateway("to_gateway") + r'/' + device_id("to_id") + r'$',
 		api.query_can_map,
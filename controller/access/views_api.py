@@ -1,12 +1,15 @@
 
 import cronex
 import dateutil.parser
+import json
 
-from django.http import JsonResponse
+from django.core.exceptions import ObjectDoesNotExist
+from django.http import JsonResponse, HttpResponse
 from django.db.models import Q
 from django.utils import timezone
+from django.views.decorators.csrf import csrf_exempt
 from django.views.decorators.gzip import gzip_page
-from django.views.decorators.http import require_GET
+from django.views.decorators.http import require_GET, require_POST
 
 from .lookup import query_can_map_static
 from .models import DynamicAuth, AdminAuth, UserAuth, \
@@ -101,18 +104,9 @@ def __evaluate_cron(rule, timestamp, cached_cron):
 	cached_cron[rule.id] = result
 	return result
 
-@require_api_port
-@gzip_page
-@require_GET
-def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
-	"""Return whether fromId at fromGateway can connect to toId at toGateway"""
-
-	if "timestamp" in request.GET:
-		timestamp = dateutil.parser.parse(request.GET["timestamp"])
-	else:
-		timestamp = timezone.now()
+def __can_map_helper(from_gateway, from_id, to_gateway, to_id, timestamp):
+	"""Returns the canMap response for one pair as a dict"""
 
-	from_id = int(from_id)
 	from_gateway, from_principal, _, conn_from_principal = \
 		get_gateway_and_device_helper(from_gateway, from_id)
 
@@ -126,12 +120,13 @@ def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
 	response = {}
 	if not can_map:
 		response["result"] = False
-		return JsonResponse(response)
+		return response
 
 	# Response format:
 	# ================
 	# {
 	# 	"result" : True,
+	# 	"ttl" : 60,					# Seconds the gateway may cache this
 	# 	"access" : {
 	# 		"rules" : {
 	# 			1 : {					# Spec of the rule
@@ -157,6 +152,10 @@ def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
 	cached_relations = {}
 	cached_cron = {}
 
+	# The decision holds until the shortest lease expires, or until the next
+	# minute if it depends on a cron window
+	ttl = None
+
 	services = {}
 	rules = {}
 	for service_instance in ServiceInstance.objects.filter(
@@ -181,6 +180,8 @@ def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
 				#####################################
 
 				# Evaluate the cron expression
+				if str(char_rule.cron_expression) != "* * * * *":
+					ttl = __min_ttl(ttl, 60 - timestamp.second)
 				if not __evaluate_cron(char_rule, timestamp, cached_cron):
 					continue
 
@@ -200,6 +201,9 @@ def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
  					else:
  						exclusive_id = Exclusive.NULL
 
+					ttl = __min_ttl(ttl,
+						int(char_rule.lease_duration.total_seconds()))
+
 					# Put the rule in the result
 					rules[char_rule.id] = {
 						"prop" : char_rule.properties,
@@ -222,4 +226,55 @@ def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
 			"rules" : rules,
 			"services" : services,
 		}
-	return JsonResponse(response)
+	if ttl is not None:
+		response["ttl"] = ttl
+	return response
+
+def __min_ttl(ttl, seconds):
+	seconds = max(seconds, 0)
+	if ttl is None:
+		return seconds
+	return min(ttl, seconds)
+
+def __get_timestamp(request):
+	if "timestamp" in request.GET:
+		return dateutil.parser.parse(request.GET["timestamp"])
+	else:
+		return timezone.now()
+
+@require_api_port
+@gzip_page
+@require_GET
+def query_can_map(request, from_gateway, from_id, to_gateway, to_id):
+	"""Return whether fromId at fromGateway can connect to toId at toGateway"""
+
+	timestamp = __get_timestamp(request)
+	return JsonResponse(__can_map_helper(from_gateway, int(from_id),
+		to_gateway, int(to_id), timestamp))
+
+@csrf_exempt
+@require_api_port
+@gzip_page
+@require_POST
+def query_can_map_batch(request):
+	"""Same as query_can_map, for many pairs in one request.
+
+	Request body: {"pairs" : [[from_gateway, from_id, to_gateway, to_id], ...]}
+	Response: {"results" : [...]}, in the order of the pairs.
+	"""
+
+	timestamp = __get_timestamp(request)
+	try:
+		pairs = json.loads(request.body)["pairs"]
+	except (ValueError, KeyError):
+		return HttpResponse(status=400)
+
+	results = []
+	for from_gateway, from_id, to_gateway, to_id in pairs:
+		try:
+			results.append(__can_map_helper(from_gateway, int(from_id),
+				to_gateway, int(to_id), timestamp))
+		except ObjectDoesNotExist:
+			# Not yet reported by the gateway, so do not cache
+			results.append({"result" : False, "ttl" : 0})
+	return JsonResponse({"results" : results})
@@ -133,6 +133,9 @@ class Manager(object):
 				self.__send_mapping_command(from_device, to_device)
 			except ConnectedDevice.DoesNotExist:
 				pass
+		elif command[0] == "invalidate":
+			for gateway in self._gateways.values():
+				gateway.command(["invalidate-discovery"])
 
 	def __send_mapping_command(self, from_device, to_device):
 		print "command:", from_device, to_device
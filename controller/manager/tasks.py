@@ -77,6 +77,15 @@ def _make_mappings(device_instance, serve_to=None, client_to=None):
 	s.shutdown(socket.SHUT_RDWR)
 	s.close()
 
+def _invalidate_discovery():
+	"""Tell gateways to drop cached discovery results"""
+
+	s = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+	s.connect(IPC_COMMAND_PATH)
+	s.send("invalidate")
+	s.shutdown(socket.SHUT_RDWR)
+	s.close()
+
 def _get_discoverers(device_instance):
 
 	disc_by, disc_by_all = _expand_principal_list(
@@ -108,6 +117,7 @@ def connect_device_evt(device_instance_id):
 	client_to = _get_device_instances(client_to)
 
 	_make_mappings(device_instance, serve_to=serve_to, client_to=client_to)
+	_invalidate_discovery()
 
 @task(name="update_device")
 def update_device_evt(device_instance_id):
@@ -125,6 +135,13 @@ def update_device_evt(device_instance_id):
 	_filter_not_mapped_already_to(client_to, device_instance)
 
 	_make_mappings(device_instance, serve_to=serve_to, client_to=client_to)
+	_invalidate_discovery()
+
+@task(name="disconnect_device")
+def disconnect_device_evt():
+	"""Devices have left the network."""
+
+	_invalidate_discovery()
 
 @task(name="register_device_interest")
 def register_interest_service_evt(device_instance_id, service_uuid):
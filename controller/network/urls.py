@@ -49,6 +49,9 @@ urlpatterns = [
 		+ r'$',
 		api.map_devices, name='update mappings on device'),
 
+	url(r'^batch$', api.report_batch,
+		name='apply batched device and mapping updates'),
+
 	url(r'^registerInterest/service/' + device_id("remote_id") + r'$',
 		api.register_interest,
 		{"is_service" : True},
@@ -1,8 +1,9 @@
 
 import json
 
+from django.core.exceptions import ObjectDoesNotExist
 from django.db import transaction
-from django.http import HttpResponse
+from django.http import HttpResponse, JsonResponse
 from django.views.decorators.http import require_http_methods, \
 	require_POST
 from django.views.decorators.csrf import csrf_exempt
@@ -18,7 +19,7 @@ from gatt.models import Service, Characteristic
 from gatt.uuid import convert_uuid, check_uuid
 
 from manager.tasks import connect_device_evt, update_device_evt, \
-	register_interest_service_evt
+	disconnect_device_evt, register_interest_service_evt
 
 from utils.decorators import require_api_port
 
@@ -67,6 +68,9 @@ def disconnect_gateway(request):
 		session_token=__get_session_token(request))
 	gateway_conn.delete()
 
+	# Asynchronous task
+	disconnect_device_evt.delay()
+
 	return HttpResponse("disconnected")
 
 def __load_services_and_characteristics(services, device_conn):
@@ -189,6 +193,9 @@ def update_device(request, remote_id):
 			remote_id=remote_id)
 		device_conns.delete()
 
+		# Asynchronous task
+		disconnect_device_evt.delay()
+
 		return HttpResponse("disconnected")
 
 	else:
@@ -225,6 +232,92 @@ def map_devices(request, from_gateway, from_id, to_gateway, to_id):
 
 	return HttpResponse(status=405)
 
+def __upsert_device(gateway_conn, name, remote_id):
+	"""Returns the connected device and whether it was created"""
+
+	device, _ = VirtualDevice.objects.get_or_create(name=name)
+
+	device_conn = ConnectedDevice.objects.filter(
+		gateway_instance=gateway_conn,
+		remote_id=remote_id).first()
+	if device_conn is None:
+		device_conn = ConnectedDevice(
+			device=device,
+			gateway_instance=gateway_conn,
+			remote_id=remote_id)
+		created = True
+	else:
+		device_conn.device = device
+		created = False
+	device_conn.save()
+
+	return device_conn, created
+
+@csrf_exempt
+@require_api_port
+@require_POST
+@transaction.atomic
+def report_batch(request):
+	"""Apply coalesced device and mapping changes from a gateway"""
+
+	gateway_conn = ConnectedGateway.objects.get(
+		session_token=__get_session_token(request))
+	gateway_conn.save()
+
+	batch = json.loads(request.body)
+	errors = []
+
+	connected = []
+	updated = []
+	for device_obj in batch.get("devices", []):
+		remote_id = int(device_obj["id"])
+		device_conn, created = __upsert_device(gateway_conn,
+			device_obj["name"], remote_id)
+		response = __load_services_and_characteristics(
+			device_obj["services"], device_conn)
+		if response is not None:
+			errors.append("device %d: %s" % (remote_id, response.content))
+		if created:
+			connected.append(device_conn.id)
+		else:
+			updated.append(device_conn.id)
+
+	# unmaps first, in case a device was remapped
+	for is_map, key in [(False, "unmapped"), (True, "mapped")]:
+		for from_gateway, from_id, to_gateway, to_id in batch.get(key, []):
+			try:
+				_, _, _, conn_from_device = \
+					get_gateway_and_device_helper(from_gateway, int(from_id))
+				_, _, _, conn_to_device = \
+					get_gateway_and_device_helper(to_gateway, int(to_id))
+			except ObjectDoesNotExist:
+				errors.append("%s: %s/%d -> %s/%d not connected" % (key,
+					from_gateway, from_id, to_gateway, to_id))
+				continue
+			if is_map:
+				DeviceMapping.objects.get_or_create(
+					from_device=conn_from_device,
+					to_device=conn_to_device)
+			else:
+				DeviceMapping.objects.filter(
+					from_device=conn_from_device,
+					to_device=conn_to_device).delete()
+
+	removed = [int(x) for x in batch.get("removed", [])]
+	if removed:
+		ConnectedDevice.objects.filter(
+			gateway_instance=gateway_conn,
+			remote_id__in=removed).delete()
+		disconnect_device_evt.delay()
+
+	# Asynchronous tasks
+	for device_conn_id in connected:
+		connect_device_evt.delay(device_conn_id)
+	for device_conn_id in updated:
+		update_device_evt.delay(device_conn_id)
+
+	return JsonResponse({"errors" : errors})
+
 @csrf_exempt
 @require_api_port
 @require_POST
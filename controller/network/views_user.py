@@ -72,6 +72,7 @@ def discover_with_uuid(request, uuid, is_service=True):
 	###
 	gateway = request.GET.get("gateway", None)
 	remote_id = request.GET.get("remote_id", None)
+	exclude_gateway = request.GET.get("exclude_gateway", None)
 	gateway_conn = None
 	device_conn = None
 	if gateway is not None and remote_id is not None:
@@ -89,6 +90,11 @@ def discover_with_uuid(request, uuid, is_service=True):
 	else:
 		qs = CharInstance.objects.filter(characteristic__uuid=uuid)
 
+	if exclude_gateway is not None:
+		# the gateway answers for its own devices
+		qs = qs.exclude(
+			device_instance__gateway_instance__gateway__name=exclude_gateway)
+
 	for x in qs:
 
 		if gateway_conn is not None and device_conn is not None:
@@ -4,5 +4,5 @@
 
 USER_OBJS :=
 
-LIBS := -lbluetooth -lpthread -lboost_thread -lboost_system -lboost_program_options -lcppnetlib-uri -lcppnetlib-client-connections -lssl -lcrypto
+LIBS := -lbluetooth -lpthread -lboost_thread -lboost_system -lboost_program_options -lssl -lcrypto
 
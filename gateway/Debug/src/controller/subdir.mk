@@ -7,6 +7,9 @@ CPP_SRCS += \
 ../src/controller/AccessControl.cpp \
 ../src/controller/ControllerClient.cpp \
 ../src/controller/ControllerConnection.cpp \
+../src/controller/ControllerResponse.cpp \
+../src/controller/HttpConnectionPool.cpp \
+../src/controller/JsonReader.cpp \
 ../src/controller/NetworkDiscoveryClient.cpp \
 ../src/controller/NetworkStateClient.cpp 
 
@@ -14,6 +17,9 @@ OBJS += \
 ./src/controller/AccessControl.o \
 ./src/controller/ControllerClient.o \
 ./src/controller/ControllerConnection.o \
+./src/controller/ControllerResponse.o \
+./src/controller/HttpConnectionPool.o \
+./src/controller/JsonReader.o \
 ./src/controller/NetworkDiscoveryClient.o \
 ./src/controller/NetworkStateClient.o 
 
@@ -21,6 +27,9 @@ CPP_DEPS += \
 ./src/controller/AccessControl.d \
 ./src/controller/ControllerClient.d \
 ./src/controller/ControllerConnection.d \
+./src/controller/ControllerResponse.d \
+./src/controller/HttpConnectionPool.d \
+./src/controller/JsonReader.d \
 ./src/controller/NetworkDiscoveryClient.d \
 ./src/controller/NetworkStateClient.d 
 
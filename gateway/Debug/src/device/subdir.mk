@@ -5,14 +5,17 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
 ../src/device/BeetleInternal.cpp \
+../src/device/InProcessApplication.cpp \
 ../src/device/VirtualDevice.cpp 
 
 OBJS += \
 ./src/device/BeetleInternal.o \
+./src/device/InProcessApplication.o \
 ./src/device/VirtualDevice.o 
 
 CPP_DEPS += \
 ./src/device/BeetleInternal.d \
+./src/device/InProcessApplication.d \
 ./src/device/VirtualDevice.d 
 
 
@@ -5,14 +5,17 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
 ../src/hat/BlockAllocator.cpp \
+../src/hat/IntervalAllocator.cpp \
 ../src/hat/SingleAllocator.cpp 
 
 OBJS += \
 ./src/hat/BlockAllocator.o \
+./src/hat/IntervalAllocator.o \
 ./src/hat/SingleAllocator.o 
 
 CPP_DEPS += \
 ./src/hat/BlockAllocator.d \
+./src/hat/IntervalAllocator.d \
 ./src/hat/SingleAllocator.d 
 
 
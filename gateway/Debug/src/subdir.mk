@@ -7,36 +7,57 @@ CPP_SRCS += \
 ../src/Beetle.cpp \
 ../src/BeetleConfig.cpp \
 ../src/CLI.cpp \
+../src/Capture.cpp \
+../src/ConnIntervalController.cpp \
+../src/Debug.cpp \
 ../src/Device.cpp \
 ../src/HCI.cpp \
 ../src/Handle.cpp \
+../src/Metrics.cpp \
 ../src/Router.cpp \
+../src/ServiceIndex.cpp \
 ../src/StaticTopo.cpp \
+../src/Trace.cpp \
 ../src/UUID.cpp \
+../src/UUIDTable.cpp \
 ../src/main.cpp 
 
 OBJS += \
 ./src/Beetle.o \
 ./src/BeetleConfig.o \
 ./src/CLI.o \
+./src/Capture.o \
+./src/ConnIntervalController.o \
+./src/Debug.o \
 ./src/Device.o \
 ./src/HCI.o \
 ./src/Handle.o \
+./src/Metrics.o \
 ./src/Router.o \
+./src/ServiceIndex.o \
 ./src/StaticTopo.o \
+./src/Trace.o \
 ./src/UUID.o \
+./src/UUIDTable.o \
 ./src/main.o 
 
 CPP_DEPS += \
 ./src/Beetle.d \
 ./src/BeetleConfig.d \
 ./src/CLI.d \
+./src/Capture.d \
+./src/ConnIntervalController.d \
+./src/Debug.d \
 ./src/Device.d \
 ./src/HCI.d \
 ./src/Handle.d \
+./src/Metrics.d \
 ./src/Router.d \
+./src/ServiceIndex.d \
 ./src/StaticTopo.d \
+./src/Trace.d \
 ./src/UUID.d \
+./src/UUIDTable.d \
 ./src/main.d 
 
 
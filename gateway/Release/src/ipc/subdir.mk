@@ -4,12 +4,15 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/ipc/ShmRing.cpp \
 ../src/ipc/UnixDomainSocketServer.cpp 
 
 OBJS += \
+./src/ipc/ShmRing.o \
 ./src/ipc/UnixDomainSocketServer.o 
 
 CPP_DEPS += \
+./src/ipc/ShmRing.d \
 ./src/ipc/UnixDomainSocketServer.d 
 
 
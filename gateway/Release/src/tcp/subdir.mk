@@ -4,22 +4,34 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
+../src/tcp/GatewaySession.cpp \
+../src/tcp/HostResolver.cpp \
+../src/tcp/MetricsServer.cpp \
 ../src/tcp/RemoteCLI.cpp \
 ../src/tcp/SSLConfig.cpp \
 ../src/tcp/TCPConnParams.cpp \
-../src/tcp/TCPDeviceServer.cpp 
+../src/tcp/TCPDeviceServer.cpp \
+../src/tcp/TCPFraming.cpp 
 
 OBJS += \
+./src/tcp/GatewaySession.o \
+./src/tcp/HostResolver.o \
+./src/tcp/MetricsServer.o \
 ./src/tcp/RemoteCLI.o \
 ./src/tcp/SSLConfig.o \
 ./src/tcp/TCPConnParams.o \
-./src/tcp/TCPDeviceServer.o 
+./src/tcp/TCPDeviceServer.o \
+./src/tcp/TCPFraming.o 
 
 CPP_DEPS += \
+./src/tcp/GatewaySession.d \
+./src/tcp/HostResolver.d \
+./src/tcp/MetricsServer.d \
 ./src/tcp/RemoteCLI.d \
 ./src/tcp/SSLConfig.d \
 ./src/tcp/TCPConnParams.d \
-./src/tcp/TCPDeviceServer.d 
+./src/tcp/TCPDeviceServer.d \
+./src/tcp/TCPFraming.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -0,0 +1,249 @@
+/*
+ * ControlPlaneBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * Load test of the gateway's control-plane requests against an in-process
+ * controller stub: device registration, map/unmap reporting, canMap and
+ * discovery. Requests go through HttpConnectionPool, as ControllerClient
+ * sends them, since ControllerClient itself needs a running Beetle.
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O2 -Iinclude -Ilib/include bench/ControlPlaneBenchmark.cpp bench/ControllerStub.cpp \
+ *       src/controller/HttpConnectionPool.cpp src/Metrics.cpp -lboost_system -lboost_program_options \
+ *       -lssl -lcrypto -lpthread -o control_bench
+ */
+
+#include <boost/program_options.hpp>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <json/json.hpp>
+
+#include "controller/HttpConnectionPool.h"
+#include "ControllerStub.h"
+
+bool debug;
+bool debug_scan;
+bool debug_topology;
+bool debug_discovery;
+bool debug_router;
+bool debug_socket;
+bool debug_controller;
+bool debug_performance;
+bool debug_advertise;
+
+namespace po = boost::program_options;
+using json = nlohmann::json;
+
+static const std::string GATEWAY = "bench";
+static const int BATCH_SIZE = 32;
+
+static HttpConnectionPool *pool;
+static http_headers_t headers;
+
+static http_response_t request(std::string method, std::string target, std::string body = "",
+		std::string contentType = "application/json") {
+	http_headers_t h = headers;
+	if (body != "") {
+		h.push_back(std::make_pair("Content-Type", contentType));
+	}
+	http_response_t response = pool->request(method, target, h, body);
+	if (response.status >= 400) {
+		std::stringstream ss;
+		ss << method << " " << target << ": " << response.status << " " << response.body;
+		throw std::runtime_error(ss.str());
+	}
+	return response;
+}
+
+/*
+ * Issue n requests at once and wait for all of them.
+ */
+static void requestAll(std::string method, const std::vector<std::string> &targets) {
+	std::promise<void> done;
+	std::atomic<int> remaining(targets.size());
+	std::atomic<int> errors(0);
+	for (auto &target : targets) {
+		pool->asyncRequest(method, target, headers, "",
+				[&](const boost::system::error_code &ec, const http_response_t &response) {
+					if (ec || response.status >= 400) {
+						errors++;
+					}
+					if (--remaining == 0) {
+						done.set_value();
+					}
+				});
+	}
+	done.get_future().wait();
+	if (errors > 0) {
+		throw std::runtime_error(std::to_string(errors) + " " + method + " requests failed");
+	}
+}
+
+static json serviceJson(int i) {
+	std::stringstream uuid;
+	uuid << std::hex << std::uppercase << (0x1800 + i % 16);
+	json service;
+	service["uuid"] = uuid.str();
+	service["chars"] = { "2A00", "2A01" };
+	return json::array( { service });
+}
+
+template<class F>
+static void run(std::string name, long ops, F f) {
+	auto start = std::chrono::steady_clock::now();
+	f();
+	auto end = std::chrono::steady_clock::now();
+	double us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	std::cout << name << "\t" << (us / 1000) << " ms\t" << (us / ops) << " us/op\t" << (ops * 1e6 / us)
+			<< " ops/s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	controller_stub_config_t config;
+	int numDevices;
+	int numMappings;
+	int maxConnections;
+	int pipelineDepth;
+
+	po::options_description desc("Options");
+	desc.add_options()
+		("help,h", "Display this help message")
+		("devices", po::value<int>(&numDevices)->default_value(100), "Devices to register")
+		("mappings", po::value<int>(&numMappings)->default_value(300), "Mappings to report")
+		("connections", po::value<int>(&maxConnections)->default_value(4), "Pool connections")
+		("pipeline", po::value<int>(&pipelineDepth)->default_value(4), "Pool pipeline depth")
+		("port", po::value<int>(&config.apiPort)->default_value(config.apiPort), "Stub api port")
+		("ctrl-port", po::value<int>(&config.ctrlPort)->default_value(config.ctrlPort), "Stub control port")
+		("cert", po::value<std::string>(&config.cert)->default_value("certs/cert.pem"), "Certificate")
+		("key", po::value<std::string>(&config.key)->default_value("certs/key.pem"), "Private key")
+		("latency", po::value<int>(&config.latency)->default_value(1), "Stub response latency (ms)")
+		("jitter", po::value<int>(&config.jitter)->default_value(0), "Stub latency jitter (ms)")
+		("rules", po::value<std::string>(&config.rulesFile), "Access rules (json)");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	} catch (po::error &e) {
+		std::cerr << e.what() << std::endl;
+		std::cerr << desc << std::endl;
+		return 1;
+	}
+
+	if (vm.count("help")) {
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	try {
+		ControllerStub stub(config);
+		HttpConnectionPool p("localhost", config.apiPort, false, config.cert, config.key, config.cert,
+				maxConnections, pipelineDepth, 10, 60);
+		pool = &p;
+
+		std::string token = request("POST", "/network/connectGateway/" + GATEWAY, "port=3002",
+				"application/x-www-form-urlencoded").body;
+		headers.push_back(std::make_pair("Beetle-Gateway-Session", token));
+
+		std::cout << "latency " << config.latency << " ms, " << numDevices << " devices, " << numMappings
+				<< " mappings, " << maxConnections << " connections" << std::endl;
+
+		run("register sequential", numDevices, [&] {
+			for (int i = 0; i < numDevices; i++) {
+				request("POST", "/network/connectDevice/dev" + std::to_string(i) + "/" + std::to_string(i),
+						serviceJson(i).dump());
+			}
+		});
+		run("register batch", numDevices, [&] {
+			json batch;
+			batch["devices"] = json::array();
+			batch["removed"] = json::array();
+			batch["mapped"] = json::array();
+			batch["unmapped"] = json::array();
+			for (int i = 0; i < numDevices; i++) {
+				json d;
+				d["id"] = numDevices + i;
+				d["name"] = "dev" + std::to_string(numDevices + i);
+				d["services"] = serviceJson(i);
+				batch["devices"].push_back(d);
+			}
+			request("POST", "/network/batch", batch.dump());
+		});
+
+		std::vector<std::string> mapTargets;
+		std::vector<std::string> canMapTargets;
+		std::vector<json> pairs;
+		for (int i = 0; i < numMappings; i++) {
+			int from = i % (2 * numDevices);
+			int to = (i * 7 + 1) % (2 * numDevices);
+			std::stringstream ss;
+			ss << GATEWAY << "/" << from << "/" << GATEWAY << "/" << to;
+			mapTargets.push_back("/network/map/" + ss.str());
+			canMapTargets.push_back("/access/canMap/" + ss.str());
+			pairs.push_back( { GATEWAY, from, GATEWAY, to });
+		}
+
+		run("map sequential", numMappings, [&] {
+			for (auto &t : mapTargets) {
+				request("POST", t);
+			}
+		});
+		run("unmap sequential", numMappings, [&] {
+			for (auto &t : mapTargets) {
+				request("DELETE", t);
+			}
+		});
+		run("map concurrent", numMappings, [&] {
+			requestAll("POST", mapTargets);
+		});
+		run("unmap concurrent", numMappings, [&] {
+			requestAll("DELETE", mapTargets);
+		});
+
+		run("canMap sequential", numMappings, [&] {
+			for (auto &t : canMapTargets) {
+				request("GET", t);
+			}
+		});
+		run("canMap concurrent", numMappings, [&] {
+			requestAll("GET", canMapTargets);
+		});
+		run("canMap batch", numMappings, [&] {
+			for (size_t i = 0; i < pairs.size(); i += BATCH_SIZE) {
+				json batch;
+				batch["pairs"] = json::array();
+				for (size_t j = i; j < std::min(i + BATCH_SIZE, pairs.size()); j++) {
+					batch["pairs"].push_back(pairs[j]);
+				}
+				request("POST", "/access/canMap/batch", batch.dump());
+			}
+		});
+
+		int numQueries = 100;
+		run("discover service", numQueries, [&] {
+			for (int i = 0; i < numQueries; i++) {
+				request("GET", "/network/discover/service/18" + std::to_string(10 + i % 6));
+			}
+		});
+
+		request("DELETE", "/network/connectGateway/");
+
+		std::cout << "devices " << stub.getNumDevices() << ", mappings " << stub.getNumMappings() << std::endl;
+		http_pool_stats_t stats = p.getPoolStats();
+		std::cout << "connections " << stats.connections << ", resumed " << stats.resumed << ", reused "
+				<< stats.reused << ", pipelined " << stats.pipelined << ", retried " << stats.retried << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,698 @@
+/*
+ * ControllerStub.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "ControllerStub.h"
+
+#include <boost/asio/buffers_iterator.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/ssl/stream.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace boost::asio;
+using json = nlohmann::json;
+typedef boost::system::error_code error_code;
+
+static const std::string SESSION_HEADER = "beetle-gateway-session";
+static const int SESSION_TOKEN_LEN = 32;
+
+static std::string toLower(std::string s) {
+	std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+	return s;
+}
+
+static std::string toUpper(std::string s) {
+	std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+	return s;
+}
+
+static std::vector<std::string> split(const std::string &s, char sep) {
+	std::vector<std::string> ret;
+	std::stringstream ss(s);
+	std::string item;
+	while (std::getline(ss, item, sep)) {
+		ret.push_back(item);
+	}
+	return ret;
+}
+
+static std::string statusText(int status) {
+	switch (status) {
+	case 200:
+		return "OK";
+	case 202:
+		return "Accepted";
+	case 400:
+		return "Bad Request";
+	case 404:
+		return "Not Found";
+	case 405:
+		return "Method Not Allowed";
+	case 409:
+		return "Conflict";
+	case 503:
+		return "Service Unavailable";
+	default:
+		return "Error";
+	}
+}
+
+/*
+ * One keep-alive api connection. Requests are answered in order.
+ */
+class ControllerStub::Session: public std::enable_shared_from_this<Session> {
+public:
+	Session(ControllerStub &stub) :
+			stream(stub.io, stub.ctx), stub(stub), timer(stub.io), keepAlive(true) {
+	}
+
+	ssl::stream<ip::tcp::socket> stream;
+
+	void start() {
+		auto self = shared_from_this();
+		stream.async_handshake(ssl::stream_base::server, [self](const error_code &ec) {
+			if (!ec) {
+				self->readHeaders();
+			}
+		});
+	}
+
+private:
+	ControllerStub &stub;
+	steady_timer timer;
+	streambuf buf;
+
+	std::string method;
+	std::string target;
+	std::string session;
+	bool keepAlive;
+	std::string out;
+
+	void readHeaders() {
+		auto self = shared_from_this();
+		async_read_until(stream, buf, "\r\n\r\n", [self](const error_code &ec, size_t n) {
+			if (ec) {
+				return;
+			}
+			std::string head(buffers_begin(self->buf.data()), buffers_begin(self->buf.data()) + n);
+			self->buf.consume(n);
+
+			std::stringstream ss(head);
+			std::string line;
+			std::getline(ss, line);
+			std::stringstream rl(line);
+			std::string version;
+			rl >> self->method >> self->target >> version;
+
+			size_t length = 0;
+			self->session = "";
+			self->keepAlive = true;
+			while (std::getline(ss, line) && line != "\r") {
+				size_t colon = line.find(':');
+				if (colon == std::string::npos) {
+					continue;
+				}
+				std::string name = toLower(line.substr(0, colon));
+				std::string value = line.substr(colon + 1);
+				value.erase(0, value.find_first_not_of(" \t"));
+				value.erase(value.find_last_not_of(" \t\r") + 1);
+				if (name == "content-length") {
+					length = std::stoul(value);
+				} else if (name == SESSION_HEADER) {
+					self->session = value;
+				} else if (name == "connection" && toLower(value) == "close") {
+					self->keepAlive = false;
+				}
+			}
+			self->readBody(length);
+		});
+	}
+
+	void readBody(size_t length) {
+		if (buf.size() >= length) {
+			std::string body(buffers_begin(buf.data()), buffers_begin(buf.data()) + length);
+			buf.consume(length);
+			respond(body);
+			return;
+		}
+
+		auto self = shared_from_this();
+		async_read(stream, buf, transfer_exactly(length - buf.size()), [self, length](const error_code &ec, size_t n) {
+			if (!ec) {
+				self->readBody(length);
+			}
+		});
+	}
+
+	void respond(std::string body) {
+		response_t r;
+		if (stub.shouldFail()) {
+			r = { 503, "stub error", "text/plain" };
+		} else {
+			std::string remoteIp;
+			error_code ec;
+			auto endpoint = stream.lowest_layer().remote_endpoint(ec);
+			if (!ec) {
+				remoteIp = endpoint.address().to_string();
+			}
+			try {
+				r = stub.handle(method, target, session, body, remoteIp);
+			} catch (std::exception &e) {
+				r = { 400, e.what(), "text/plain" };
+			}
+		}
+
+		std::stringstream ss;
+		ss << "HTTP/1.1 " << r.status << " " << statusText(r.status) << "\r\n";
+		ss << "Content-Type: " << r.contentType << "\r\n";
+		ss << "Content-Length: " << r.body.length() << "\r\n";
+		ss << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+		ss << r.body;
+		out = ss.str();
+
+		int delay = stub.getDelay();
+		if (delay > 0) {
+			auto self = shared_from_this();
+			timer.expires_from_now(std::chrono::milliseconds(delay));
+			timer.async_wait([self](const error_code &ec) {
+				self->write();
+			});
+		} else {
+			write();
+		}
+	}
+
+	void write() {
+		auto self = shared_from_this();
+		async_write(stream, buffer(out), [self](const error_code &ec, size_t n) {
+			if (!ec && self->keepAlive) {
+				self->readHeaders();
+			}
+		});
+	}
+};
+
+ControllerStub::ControllerStub(const controller_stub_config_t &config_) :
+		config(config_), ctx(ssl::context::sslv23_server), apiAcceptor(io), ctrlAcceptor(io), rng(
+				std::random_device()()) {
+	ctx.set_options(ssl::context::default_workarounds | ssl::context::no_sslv2 | ssl::context::no_sslv3);
+	ctx.use_certificate_chain_file(config.cert);
+	ctx.use_private_key_file(config.key, ssl::context::pem);
+
+	if (config.rulesFile != "") {
+		std::ifstream ifs(config.rulesFile);
+		if (!ifs) {
+			throw std::runtime_error("could not open " + config.rulesFile);
+		}
+		json j;
+		ifs >> j;
+		for (auto &r : j["rules"]) {
+			stub_rule_t rule;
+			rule.from = r.value("from", "*");
+			rule.to = r.value("to", "*");
+			rule.allow = r.value("allow", true);
+			rule.prop = r.value("prop", "rwni");
+			rule.exclusive = r.value("exclusive", 0);
+			rule.lease = r.value("lease", 3600);
+			rules.push_back(rule);
+		}
+	} else {
+		rules.push_back( { "*", "*", true, "rwni", 0, 3600 });
+	}
+
+	for (auto acceptor : { std::make_pair(&apiAcceptor, config.apiPort),
+			std::make_pair(&ctrlAcceptor, config.ctrlPort) }) {
+		ip::tcp::endpoint endpoint(ip::tcp::v4(), acceptor.second);
+		acceptor.first->open(endpoint.protocol());
+		acceptor.first->set_option(ip::tcp::acceptor::reuse_address(true));
+		acceptor.first->bind(endpoint);
+		acceptor.first->listen();
+	}
+
+	acceptApi();
+	acceptControl();
+
+	work = std::make_unique<io_service::work>(io);
+	for (int i = 0; i < config.threads; i++) {
+		threads.push_back(std::thread([this] {
+			io.run();
+		}));
+	}
+}
+
+ControllerStub::~ControllerStub() {
+	work.reset();
+	io.stop();
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+void ControllerStub::acceptApi() {
+	auto session = std::make_shared<Session>(*this);
+	apiAcceptor.async_accept(session->stream.lowest_layer(), [this, session](const error_code &ec) {
+		if (!ec) {
+			session->stream.lowest_layer().set_option(ip::tcp::no_delay(true));
+			session->start();
+		}
+		acceptApi();
+	});
+}
+
+void ControllerStub::acceptControl() {
+	auto socket = std::make_shared<ip::tcp::socket>(io);
+	ctrlAcceptor.async_accept(*socket, [this, socket](const error_code &ec) {
+		if (!ec) {
+			auto token = std::make_shared<std::string>(SESSION_TOKEN_LEN * 2, '\0');
+			async_read(*socket, buffer(&(*token)[0], token->size()), [this, socket, token](const error_code &ec, size_t n) {
+				if (ec) {
+					return;
+				}
+				std::lock_guard<std::mutex> lg(stateMutex);
+				auto it = sessions.find(*token);
+				if (it == sessions.end()) {
+					error_code ignored;
+					socket->close(ignored);
+					return;
+				}
+				controlSockets[it->second] = socket;
+			});
+		}
+		acceptControl();
+	});
+}
+
+void ControllerStub::sendCommand(std::string gateway, std::string line) {
+	auto it = controlSockets.find(gateway);
+	if (it == controlSockets.end()) {
+		return;
+	}
+	error_code ec;
+	write(*it->second, buffer(line + "\n"), ec);
+	if (ec) {
+		controlSockets.erase(it);
+	}
+}
+
+void ControllerStub::broadcast(std::string line) {
+	std::lock_guard<std::mutex> lg(stateMutex);
+	std::vector<std::string> names;
+	for (auto &kv : controlSockets) {
+		names.push_back(kv.first);
+	}
+	for (auto &name : names) {
+		sendCommand(name, line);
+	}
+}
+
+std::map<std::string, uint64_t> ControllerStub::getRequestCounts() {
+	std::lock_guard<std::mutex> lg(stateMutex);
+	return requestCounts;
+}
+
+size_t ControllerStub::getNumDevices() {
+	std::lock_guard<std::mutex> lg(stateMutex);
+	return devices.size();
+}
+
+size_t ControllerStub::getNumMappings() {
+	std::lock_guard<std::mutex> lg(stateMutex);
+	return mappings.size();
+}
+
+int ControllerStub::getDelay() {
+	if (config.jitter <= 0) {
+		return config.latency;
+	}
+	std::lock_guard<std::mutex> lg(stateMutex);
+	return config.latency + std::uniform_int_distribution<int>(0, config.jitter)(rng);
+}
+
+bool ControllerStub::shouldFail() {
+	if (config.errorRate <= 0) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lg(stateMutex);
+	return std::uniform_real_distribution<double>(0, 1)(rng) < config.errorRate;
+}
+
+ControllerStub::response_t ControllerStub::handle(std::string method, std::string target, std::string session,
+		std::string body, std::string remoteIp) {
+	std::string path = target;
+	std::map<std::string, std::string> query;
+	size_t q = target.find('?');
+	if (q != std::string::npos) {
+		path = target.substr(0, q);
+		for (auto &kv : split(target.substr(q + 1), '&')) {
+			size_t eq = kv.find('=');
+			if (eq != std::string::npos) {
+				query[kv.substr(0, eq)] = kv.substr(eq + 1);
+			}
+		}
+	}
+
+	std::vector<std::string> segments = split(path.substr(1), '/');
+	if (path.back() == '/') {
+		segments.push_back("");
+	}
+	if (segments.size() < 2) {
+		return {404, "", "text/plain"};
+	}
+
+	std::lock_guard<std::mutex> lg(stateMutex);
+	requestCounts[method + " " + segments[0] + "/" + segments[1]]++;
+
+	std::string gateway;
+	auto sit = sessions.find(session);
+	if (sit != sessions.end()) {
+		gateway = sit->second;
+	}
+
+	if (segments[0] == "network") {
+		return handleNetwork(method, segments, query, gateway, body, remoteIp);
+	} else if (segments[0] == "access") {
+		return handleAccess(method, segments, body);
+	} else if (segments[0] == "state") {
+		return handleState(method, segments);
+	}
+	return {404, "", "text/plain"};
+}
+
+ControllerStub::response_t ControllerStub::handleNetwork(std::string method, const std::vector<std::string> &path,
+		const std::map<std::string, std::string> &query, std::string gateway, std::string body,
+		std::string remoteIp) {
+	const std::string &resource = path[1];
+	if (resource == "connectGateway" && method == "POST" && path.size() == 3) {
+		size_t eq = body.find('=');
+		int port = std::stoi(body.substr(eq + 1));
+		removeGateway(path[2]);
+
+		std::string token;
+		std::uniform_int_distribution<int> hex(0, 15);
+		for (int i = 0; i < SESSION_TOKEN_LEN * 2; i++) {
+			token += "0123456789abcdef"[hex(rng)];
+		}
+		sessions[token] = path[2];
+		gateways[path[2]] = std::make_pair(remoteIp, port);
+		return {200, token, "text/plain"};
+	}
+
+	if (gateway == "" && resource != "discover" && resource != "find") {
+		return {400, "no session", "text/plain"};
+	}
+
+	if (resource == "connectGateway" && method == "DELETE") {
+		removeGateway(gateway);
+		return {200, "disconnected", "text/plain"};
+	} else if (resource == "connectDevice" && method == "POST" && path.size() == 4) {
+		upsertDevice(gateway, std::stoi(path[3]), path[2], json::parse(body));
+		return {200, "connected", "text/plain"};
+	} else if (resource == "updateDevice" && path.size() == 3) {
+		device_key_t key(gateway, std::stoi(path[2]));
+		if (method == "PUT") {
+			auto it = devices.find(key);
+			if (it == devices.end()) {
+				return {400, "no such device", "text/plain"};
+			}
+			upsertDevice(gateway, key.second, it->second.name, json::parse(body));
+			return {200, "updated", "text/plain"};
+		} else if (method == "DELETE") {
+			removeDevice(key);
+			return {200, "disconnected", "text/plain"};
+		}
+	} else if (resource == "batch" && method == "POST") {
+		json batch = json::parse(body);
+		json errors = json::array();
+		for (auto &d : batch["devices"]) {
+			upsertDevice(gateway, d["id"], d["name"], d["services"]);
+		}
+		for (std::string key : { "unmapped", "mapped" }) {
+			for (auto &m : batch[key]) {
+				auto mapping = std::make_tuple(m[0].get<std::string>(), m[1].get<int>(), m[2].get<std::string>(),
+						m[3].get<int>());
+				if (key == "mapped") {
+					mappings.insert(mapping);
+				} else {
+					mappings.erase(mapping);
+				}
+			}
+		}
+		for (auto &d : batch["removed"]) {
+			removeDevice(device_key_t(gateway, d.get<int>()));
+		}
+		json response;
+		response["errors"] = errors;
+		return {200, response.dump(), "application/json"};
+	} else if (resource == "map" && path.size() == 6) {
+		auto mapping = std::make_tuple(path[2], std::stoi(path[3]), path[4], std::stoi(path[5]));
+		if (method == "POST") {
+			mappings.insert(mapping);
+		} else if (method == "DELETE") {
+			mappings.erase(mapping);
+		} else {
+			return {405, "", "text/plain"};
+		}
+		return {200, "", "text/plain"};
+	} else if (resource == "registerInterest" && method == "POST" && path.size() == 5) {
+		device_key_t client(gateway, std::stoi(path[3]));
+		bool isService = (path[2] == "service");
+		std::string uuid = toUpper(path[4]);
+		if (interests.insert(std::make_tuple(client, uuid, isService)).second && isService) {
+			mapInterested(client, uuid);
+		}
+		return {200, "", "text/plain"};
+	} else if (resource == "discover" && method == "GET") {
+		auto it = query.find("exclude_gateway");
+		std::string exclude = (it == query.end()) ? "" : it->second;
+		if (path.size() == 3 && path[2] == "devices") {
+			return {200, discover("", true, exclude).dump(), "application/json"};
+		} else if (path.size() == 4) {
+			return {200, discover(toUpper(path[3]), path[2] == "service", exclude).dump(), "application/json"};
+		}
+	} else if (resource == "find" && method == "GET" && path.size() == 4 && path[2] == "gateway") {
+		auto it = gateways.find(path[3]);
+		if (it == gateways.end()) {
+			return {400, "no gateway named " + path[3], "text/plain"};
+		}
+		json j;
+		j["ip"] = it->second.first;
+		j["port"] = it->second.second;
+		return {200, j.dump(), "application/json"};
+	}
+	return {404, "", "text/plain"};
+}
+
+ControllerStub::response_t ControllerStub::handleAccess(std::string method, const std::vector<std::string> &path,
+		std::string body) {
+	if (path[1] != "canMap") {
+		return {404, "", "text/plain"};
+	}
+
+	if (path.size() == 3 && path[2] == "batch" && method == "POST") {
+		json request = json::parse(body);
+		json results = json::array();
+		for (auto &p : request["pairs"]) {
+			results.push_back(canMap(p[0], p[1], p[2], p[3]));
+		}
+		json j;
+		j["results"] = results;
+		return {200, j.dump(), "application/json"};
+	} else if (path.size() == 6 && method == "GET") {
+		json j = canMap(path[2], std::stoi(path[3]), path[4], std::stoi(path[5]));
+		return {200, j.dump(), "application/json"};
+	}
+	return {404, "", "text/plain"};
+}
+
+ControllerStub::response_t ControllerStub::handleState(std::string method, const std::vector<std::string> &path) {
+	if (path[1] != "exclusive" || path.size() != 5) {
+		return {404, "", "text/plain"};
+	}
+
+	int exclusiveId = std::stoi(path[2]);
+	device_key_t holder(path[3], std::stoi(path[4]));
+	time_t now = time(NULL);
+
+	auto it = leases.find(exclusiveId);
+	if (method == "POST") {
+		if (it != leases.end() && it->second.first != holder && it->second.second > now) {
+			return {409, "lease held by another device", "text/plain"};
+		}
+		time_t expire = now + 3600;
+		leases[exclusiveId] = std::make_pair(holder, expire);
+		return {202, std::to_string(expire), "text/plain"};
+	} else if (method == "DELETE") {
+		if (it != leases.end() && it->second.first == holder) {
+			leases.erase(it);
+		}
+		return {200, "released", "text/plain"};
+	}
+	return {405, "", "text/plain"};
+}
+
+json ControllerStub::canMap(std::string fromGateway, int fromId, std::string toGateway, int toId) {
+	json j;
+	auto from = devices.find(device_key_t(fromGateway, fromId));
+	auto to = devices.find(device_key_t(toGateway, toId));
+	if (from == devices.end() || to == devices.end()) {
+		j["result"] = false;
+		j["ttl"] = 0;
+		return j;
+	}
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		const stub_rule_t &rule = rules[i];
+		if ((rule.from != "*" && rule.from != from->second.name) || (rule.to != "*" && rule.to != to->second.name)) {
+			continue;
+		}
+		if (!rule.allow) {
+			break;
+		}
+
+		std::string ruleId = std::to_string(i + 1);
+		json r;
+		r["prop"] = rule.prop;
+		r["excl"] = rule.exclusive;
+		r["int"] = false;
+		r["enc"] = false;
+		r["lease"] = std::to_string(time(NULL) + rule.lease);
+		r["dauth"] = json::array();
+
+		json services = json::object();
+		for (auto &service : from->second.services) {
+			json chars = json::object();
+			for (auto &c : service["chars"]) {
+				chars[c.get<std::string>()] = { i + 1 };
+			}
+			services[service["uuid"].get<std::string>()] = chars;
+		}
+
+		j["result"] = true;
+		j["ttl"] = rule.lease;
+		j["access"]["rules"][ruleId] = r;
+		j["access"]["services"] = services;
+		return j;
+	}
+
+	j["result"] = false;
+	return j;
+}
+
+json ControllerStub::discover(std::string uuid, bool isService, std::string excludeGateway) {
+	json ret = json::array();
+	for (auto &kv : devices) {
+		const std::string &gateway = kv.first.first;
+		if (gateway == excludeGateway) {
+			continue;
+		}
+
+		bool match = (uuid == "");
+		for (auto &service : kv.second.services) {
+			if (isService && toUpper(service["uuid"]) == uuid) {
+				match = true;
+			}
+			for (auto &c : service["chars"]) {
+				if (!isService && toUpper(c) == uuid) {
+					match = true;
+				}
+			}
+		}
+		if (!match) {
+			continue;
+		}
+
+		json j;
+		j["device"]["name"] = kv.second.name;
+		j["device"]["id"] = kv.second.id;
+		j["gateway"]["name"] = gateway;
+		j["gateway"]["ip"] = gateways[gateway].first;
+		j["gateway"]["port"] = gateways[gateway].second;
+		ret.push_back(j);
+	}
+	return ret;
+}
+
+void ControllerStub::upsertDevice(std::string gateway, int id, std::string name, json services) {
+	stub_device_t &d = devices[device_key_t(gateway, id)];
+	d.id = id;
+	d.name = name;
+	d.services = services;
+}
+
+void ControllerStub::removeDevice(const device_key_t &key) {
+	devices.erase(key);
+	for (auto it = mappings.begin(); it != mappings.end();) {
+		if ((std::get<0>(*it) == key.first && std::get<1>(*it) == key.second)
+				|| (std::get<2>(*it) == key.first && std::get<3>(*it) == key.second)) {
+			mappings.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	for (auto it = interests.begin(); it != interests.end();) {
+		if (std::get<0>(*it) == key) {
+			interests.erase(it++);
+		} else {
+			++it;
+		}
+	}
+}
+
+void ControllerStub::removeGateway(std::string gateway) {
+	for (auto it = sessions.begin(); it != sessions.end();) {
+		if (it->second == gateway) {
+			sessions.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	std::vector<device_key_t> keys;
+	for (auto &kv : devices) {
+		if (kv.first.first == gateway) {
+			keys.push_back(kv.first);
+		}
+	}
+	for (auto &key : keys) {
+		removeDevice(key);
+	}
+	gateways.erase(gateway);
+	controlSockets.erase(gateway);
+}
+
+void ControllerStub::mapInterested(const device_key_t &client, std::string uuid) {
+	for (auto &kv : devices) {
+		if (kv.first == client) {
+			continue;
+		}
+		bool offers = false;
+		for (auto &service : kv.second.services) {
+			offers |= (toUpper(service["uuid"]) == uuid);
+		}
+		if (!offers || mappings.count(std::make_tuple(kv.first.first, kv.first.second, client.first, client.second))) {
+			continue;
+		}
+
+		std::stringstream cmd;
+		if (kv.first.first == client.first) {
+			cmd << "map-local " << kv.first.second << " " << client.second;
+		} else {
+			auto &server = gateways[kv.first.first];
+			cmd << "map-remote " << server.first << " " << server.second << " " << kv.first.second << " "
+					<< client.second;
+		}
+		sendCommand(client.first, cmd.str());
+	}
+}
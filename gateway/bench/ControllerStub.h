@@ -0,0 +1,150 @@
+/*
+ * ControllerStub.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef BENCH_CONTROLLERSTUB_H_
+#define BENCH_CONTROLLERSTUB_H_
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <json/json.hpp>
+
+typedef struct {
+	int apiPort = 3003;
+	int ctrlPort = 3004;
+	std::string cert;
+	std::string key;
+	int threads = 2;
+	int latency = 0;			// milliseconds added before every response
+	int jitter = 0;				// up to this many more milliseconds
+	double errorRate = 0;		// fraction of requests answered with 503
+	std::string rulesFile;		// allow everything if empty
+} controller_stub_config_t;
+
+/*
+ * Access rule. Names are device names, or "*".
+ */
+typedef struct {
+	std::string from;
+	std::string to;
+	bool allow;
+	std::string prop;
+	int exclusive;				// exclusive group, or 0
+	int lease;					// seconds
+} stub_rule_t;
+
+/*
+ * Stand-in for the Django controller, for exercising the gateway's
+ * control-plane without it. Implements the api endpoints called through
+ * ControllerClient and the line protocol read by ControllerConnection.
+ *
+ * State is kept in memory and is not checked as strictly as the controller.
+ */
+class ControllerStub {
+public:
+	ControllerStub(const controller_stub_config_t &config);
+	virtual ~ControllerStub();
+
+	/*
+	 * Send a command line to every gateway on the control port.
+	 */
+	void broadcast(std::string line);
+
+	/*
+	 * Requests served, by method and the first two path segments.
+	 */
+	std::map<std::string, uint64_t> getRequestCounts();
+
+	size_t getNumDevices();
+	size_t getNumMappings();
+
+private:
+	class Session;
+	friend class Session;
+
+	typedef struct {
+		int id;
+		std::string name;
+		nlohmann::json services;
+	} stub_device_t;
+
+	/*
+	 * (gateway, id) pairs
+	 */
+	typedef std::pair<std::string, int> device_key_t;
+
+	typedef struct {
+		int status;
+		std::string body;
+		std::string contentType;
+	} response_t;
+
+	controller_stub_config_t config;
+	std::vector<stub_rule_t> rules;
+
+	boost::asio::io_service io;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	boost::asio::ssl::context ctx;
+	boost::asio::ip::tcp::acceptor apiAcceptor;
+	boost::asio::ip::tcp::acceptor ctrlAcceptor;
+
+	/*
+	 * Protected by stateMutex.
+	 */
+	std::map<std::string, std::string> sessions;							// token to gateway
+	std::map<std::string, std::pair<std::string, int>> gateways;			// name to ip, port
+	std::map<device_key_t, stub_device_t> devices;
+	std::set<std::tuple<std::string, int, std::string, int>> mappings;
+	std::set<std::tuple<device_key_t, std::string, bool>> interests;
+	std::map<int, std::pair<device_key_t, time_t>> leases;
+	std::map<std::string, std::shared_ptr<boost::asio::ip::tcp::socket>> controlSockets;	// by gateway
+	std::map<std::string, uint64_t> requestCounts;
+	std::mt19937 rng;
+	std::mutex stateMutex;
+
+	void acceptApi();
+	void acceptControl();
+
+	/*
+	 * Must hold stateMutex.
+	 */
+	void sendCommand(std::string gateway, std::string line);
+	void removeGateway(std::string gateway);
+	void removeDevice(const device_key_t &key);
+	void mapInterested(const device_key_t &client, std::string uuid);
+
+	response_t handle(std::string method, std::string target, std::string session, std::string body,
+			std::string remoteIp);
+	response_t handleNetwork(std::string method, const std::vector<std::string> &path,
+			const std::map<std::string, std::string> &query, std::string gateway, std::string body,
+			std::string remoteIp);
+	response_t handleAccess(std::string method, const std::vector<std::string> &path, std::string body);
+	response_t handleState(std::string method, const std::vector<std::string> &path);
+
+	nlohmann::json canMap(std::string fromGateway, int fromId, std::string toGateway, int toId);
+	nlohmann::json discover(std::string uuid, bool isService, std::string excludeGateway);
+	void upsertDevice(std::string gateway, int id, std::string name, nlohmann::json services);
+
+	int getDelay();
+	bool shouldFail();
+
+	std::vector<std::thread> threads;
+};
+
+#endif /* BENCH_CONTROLLERSTUB_H_ */
@@ -0,0 +1,81 @@
+/*
+ * ControllerStubMain.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * Runs the controller stub on its own, for pointing real gateways at. Lines
+ * read from stdin are sent to every connected gateway, e.g.
+ * "invalidate-discovery" or "map-local 1 2".
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O2 -Iinclude -Ilib/include bench/ControllerStubMain.cpp bench/ControllerStub.cpp \
+ *       -lboost_system -lboost_program_options -lssl -lcrypto -lpthread -o controller_stub
+ */
+
+#include <boost/program_options.hpp>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "ControllerStub.h"
+
+namespace po = boost::program_options;
+
+int main(int argc, char *argv[]) {
+	controller_stub_config_t config;
+
+	po::options_description desc("Options");
+	desc.add_options()
+		("help,h", "Display this help message")
+		("port", po::value<int>(&config.apiPort)->default_value(config.apiPort), "Api port")
+		("ctrl-port", po::value<int>(&config.ctrlPort)->default_value(config.ctrlPort), "Control port")
+		("cert", po::value<std::string>(&config.cert)->default_value("certs/cert.pem"), "Server certificate")
+		("key", po::value<std::string>(&config.key)->default_value("certs/key.pem"), "Server private key")
+		("threads", po::value<int>(&config.threads)->default_value(config.threads), "Worker threads")
+		("latency", po::value<int>(&config.latency)->default_value(config.latency),
+				"Milliseconds added to every response")
+		("jitter", po::value<int>(&config.jitter)->default_value(config.jitter),
+				"Up to this many more milliseconds")
+		("error-rate", po::value<double>(&config.errorRate)->default_value(config.errorRate),
+				"Fraction of requests answered with 503")
+		("rules", po::value<std::string>(&config.rulesFile), "Access rules (json)");
+
+	po::variables_map vm;
+	try {
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	} catch (po::error &e) {
+		std::cerr << e.what() << std::endl;
+		std::cerr << desc << std::endl;
+		return 1;
+	}
+
+	if (vm.count("help")) {
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	try {
+		ControllerStub stub(config);
+		std::cout << "listening on " << config.apiPort << " (api) and " << config.ctrlPort << " (control)"
+				<< std::endl;
+
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			if (line == "stats") {
+				std::cout << "devices: " << stub.getNumDevices() << ", mappings: " << stub.getNumMappings()
+						<< std::endl;
+				for (auto &kv : stub.getRequestCounts()) {
+					std::cout << "  " << kv.first << "\t" << kv.second << std::endl;
+				}
+			} else if (line != "") {
+				stub.broadcast(line);
+			}
+		}
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * HandshakeBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * Latency and CPU time of gateway TLS handshakes over loopback, full and
+ * resumed, using the SSLConfig of each side. CPU time covers both sides.
+ * With ktls, the stats show how many connections the kernel took over.
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O2 -Iinclude bench/HandshakeBenchmark.cpp src/tcp/SSLConfig.cpp \
+ *       -lssl -lcrypto -lpthread -o handshake_bench
+ *   ./handshake_bench certs/cert.pem certs/key.pem [ktls]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <openssl/ssl.h>
+
+#include "tcp/SSLConfig.h"
+
+bool debug;
+bool debug_scan;
+bool debug_topology;
+bool debug_discovery;
+bool debug_router;
+bool debug_socket;
+bool debug_controller;
+bool debug_performance;
+bool debug_advertise;
+
+static const int ITERATIONS = 200;
+
+static double cpuSeconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+			+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/*
+ * Accept, handshake, and send a byte so that TLS 1.3 tickets reach the client.
+ */
+static void serve(SSLConfig &config, int serverFd, int n) {
+	for (int i = 0; i < n; i++) {
+		int fd = accept(serverFd, NULL, NULL);
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		SSL *ssl = SSL_new(config.getCtx());
+		SSL_set_fd(ssl, fd);
+		if (config.handshake(ssl) > 0) {
+			uint8_t b = 0;
+			SSL_write(ssl, &b, 1);
+			SSL_read(ssl, &b, 1);
+		}
+		SSL_shutdown(ssl);
+		SSL_free(ssl);
+		close(fd);
+	}
+}
+
+static void run(std::string name, SSLConfig &client, struct sockaddr_in addr, bool resume) {
+	double cpu = cpuSeconds();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+			std::cerr << "connect failed" << std::endl;
+			exit(1);
+		}
+		SSL *ssl = SSL_new(client.getCtx());
+		SSL_set_fd(ssl, fd);
+		if (resume) {
+			client.resumeSession(ssl, "server");
+		}
+		if (client.handshake(ssl) <= 0) {
+			std::cerr << "handshake failed" << std::endl;
+			exit(1);
+		}
+		uint8_t b;
+		SSL_read(ssl, &b, 1);
+		client.saveSession(ssl, "server");
+		SSL_write(ssl, &b, 1);
+		SSL_shutdown(ssl);
+		SSL_free(ssl);
+		close(fd);
+	}
+	double us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	std::cout << name << "\t" << (us / ITERATIONS) << " us/connection\t"
+			<< ((cpuSeconds() - cpu) * 1e6 / ITERATIONS) << " us cpu/connection" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	std::string cert = (argc > 2) ? argv[1] : "certs/cert.pem";
+	std::string key = (argc > 2) ? argv[2] : "certs/key.pem";
+
+	SSLConfig server(false, true, cert, key, cert);
+	SSLConfig client(false, false, cert, key, cert);
+	if (argc > 3 && std::string(argv[3]) == "ktls") {
+		if (!server.setKtls(true) || !client.setKtls(true)) {
+			std::cerr << "openssl built without kernel tls" << std::endl;
+		}
+	}
+
+	int serverFd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(serverFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(serverFd, 16) < 0
+			|| getsockname(serverFd, (struct sockaddr *) &addr, &len) < 0) {
+		std::cerr << "could not listen" << std::endl;
+		return 1;
+	}
+
+	std::thread serverThread(serve, std::ref(server), serverFd, 2 * ITERATIONS);
+	run("full", client, addr, false);
+	run("resumed", client, addr, true);
+	serverThread.join();
+	close(serverFd);
+
+	std::cout << SSLConfig::getAllHandshakeStats();
+	return 0;
+}
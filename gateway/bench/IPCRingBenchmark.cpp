@@ -0,0 +1,223 @@
+/*
+ * IPCRingBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * Notifications delivered to local applications, over SOCK_SEQPACKET as
+ * IPCApplication writes them, and over a ShmRing with eventfd doorbells.
+ * The ring run publishes each value to a shared slot, as the gateway does
+ * for applications of one user, with every subscriber reading the same
+ * slots. CPU time covers both sides.
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O2 -Iinclude bench/IPCRingBenchmark.cpp src/ipc/ShmRing.cpp \
+ *       -lpthread -o ipc_ring_bench
+ *   ./ipc_ring_bench [subscribers]
+ */
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ipc/ShmRing.h"
+
+static const int NOTIFICATIONS = 200000;
+static const int PDU_LEN = 23;
+static const uint32_t RING_CAPACITY = 1 << 18;
+
+static double cpuSeconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+			+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void makePdu(uint8_t *pdu, int i) {
+	pdu[0] = 0x1B;
+	pdu[1] = 0x10;
+	pdu[2] = 0x00;
+	for (int j = 3; j < PDU_LEN; j++) {
+		pdu[j] = i + j;
+	}
+}
+
+static void report(std::string name, int subscribers, double cpu,
+		std::chrono::steady_clock::time_point start) {
+	double us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	int n = NOTIFICATIONS * subscribers;
+	std::cout << name << "\t" << (n / us * 1e6) << " pdus/s\t"
+			<< ((cpuSeconds() - cpu) * 1e9 / n) << " ns cpu/pdu" << std::endl;
+}
+
+static void runSocket(int subscribers) {
+	std::vector<int> fds;
+	std::vector<std::thread> readers;
+	for (int s = 0; s < subscribers; s++) {
+		int sv[2];
+		socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv);
+		fds.push_back(sv[0]);
+		readers.emplace_back([sv] {
+			uint8_t buf[256];
+			for (int i = 0; i < NOTIFICATIONS; i++) {
+				if (read(sv[1], buf, sizeof(buf)) != PDU_LEN || buf[3] != (uint8_t) (i + 3)) {
+					std::cerr << "socket: bad pdu" << std::endl;
+					exit(1);
+				}
+			}
+			close(sv[1]);
+		});
+	}
+
+	double cpu = cpuSeconds();
+	auto start = std::chrono::steady_clock::now();
+	uint8_t pdu[PDU_LEN];
+	for (int i = 0; i < NOTIFICATIONS; i++) {
+		makePdu(pdu, i);
+		for (int fd : fds) {
+			/* IPCApplication copies each write for its writer */
+			std::unique_ptr<uint8_t[]> copy(new uint8_t[PDU_LEN]);
+			memcpy(copy.get(), pdu, PDU_LEN);
+			if (write(fd, copy.get(), PDU_LEN) != PDU_LEN) {
+				std::cerr << "socket: write failed" << std::endl;
+				exit(1);
+			}
+		}
+	}
+	for (auto &t : readers) {
+		t.join();
+	}
+	report("socket", subscribers, cpu, start);
+	for (int fd : fds) {
+		close(fd);
+	}
+}
+
+struct ring_app {
+	void *region;
+	std::unique_ptr<ShmRing> ring;
+	int toApp;
+	std::vector<std::pair<uint32_t, int>> refs;
+	size_t refsDone;
+};
+
+static void runRing(int subscribers) {
+	ShmSlotPool slots(1024);
+	const uint8_t *slotRegion = (const uint8_t *) mmap(NULL, slots.getNumSlots() * slots.getSlotSize(),
+			PROT_READ, MAP_SHARED, slots.getFd(), 0);
+
+	std::vector<std::unique_ptr<ring_app>> apps;
+	std::vector<std::thread> readers;
+	for (int s = 0; s < subscribers; s++) {
+		std::unique_ptr<ring_app> app(new ring_app());
+		app->region = mmap(NULL, ShmRing::regionSize(RING_CAPACITY), PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		app->ring.reset(new ShmRing(app->region, RING_CAPACITY));
+		app->toApp = eventfd(0, EFD_NONBLOCK);
+		app->refsDone = 0;
+
+		void *region = app->region;
+		int toApp = app->toApp;
+		uint16_t slotSize = slots.getSlotSize();
+		readers.emplace_back([region, toApp, slotRegion, slotSize] {
+			ShmRing ring(region, RING_CAPACITY);
+			int i = 0;
+			while (i < NOTIFICATIONS) {
+				ring_record_t record;
+				uint8_t *buf;
+				if (!ring.peek(record, buf)) {
+					struct pollfd pfd = { toApp, POLLIN, 0 };
+					poll(&pfd, 1, 1000);
+					uint64_t count;
+					if (read(toApp, &count, sizeof(count)) < 0) {
+						// spurious
+					}
+					continue;
+				}
+				const uint8_t *value = slotRegion + record.slot * slotSize;
+				if (record.type != RING_RECORD_SLOT || record.slotLen != PDU_LEN - 3
+						|| value[0] != (uint8_t) (i + 3)) {
+					std::cerr << "ring: bad pdu" << std::endl;
+					exit(1);
+				}
+				ring.pop();
+				i++;
+			}
+		});
+		apps.push_back(std::move(app));
+	}
+
+	double cpu = cpuSeconds();
+	auto start = std::chrono::steady_clock::now();
+	uint8_t pdu[PDU_LEN];
+	uint64_t full = 0;
+	for (int i = 0; i < NOTIFICATIONS; i++) {
+		makePdu(pdu, i);
+		for (auto &app : apps) {
+			uint32_t tail = app->ring->getTail();
+			while (app->refsDone < app->refs.size() && (int32_t) (tail - app->refs[app->refsDone].first) >= 0) {
+				slots.release(app->refs[app->refsDone++].second);
+			}
+
+			int slot;
+			while ((slot = slots.publish(pdu + 3, PDU_LEN - 3)) < 0) {
+				std::this_thread::yield();
+				for (auto &other : apps) {
+					uint32_t otherTail = other->ring->getTail();
+					while (other->refsDone < other->refs.size()
+							&& (int32_t) (otherTail - other->refs[other->refsDone].first) >= 0) {
+						slots.release(other->refs[other->refsDone++].second);
+					}
+				}
+			}
+
+			ring_record_t record = { 0 };
+			record.type = RING_RECORD_SLOT;
+			record.len = 3;
+			record.slot = slot;
+			record.slotLen = PDU_LEN - 3;
+			bool wake;
+			while (!app->ring->push(record, pdu, wake)) {
+				full++;
+				std::this_thread::yield();
+			}
+			app->refs.push_back(std::make_pair(app->ring->getHead(), slot));
+			if (wake) {
+				uint64_t one = 1;
+				if (write(app->toApp, &one, sizeof(one)) < 0) {
+					std::cerr << "ring: signal failed" << std::endl;
+				}
+			}
+		}
+	}
+	for (auto &t : readers) {
+		t.join();
+	}
+	report("ring", subscribers, cpu, start);
+	if (full > 0) {
+		std::cout << "ring full " << full << " times" << std::endl;
+	}
+	for (auto &app : apps) {
+		close(app->toApp);
+		munmap(app->region, ShmRing::regionSize(RING_CAPACITY));
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int subscribers = (argc > 1) ? std::stoi(argv[1]) : 1;
+	runSocket(subscribers);
+	runRing(subscribers);
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * ResponseParseBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * Time and heap usage of parsing controller responses with JsonReader,
+ * against building a json.hpp tree and walking it, as was done before.
+ * Payloads in bench/data are in the controller's response format.
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O3 -Iinclude -Ilib/include bench/ResponseParseBenchmark.cpp \
+ *       src/controller/ControllerResponse.cpp src/controller/JsonReader.cpp src/UUID.cpp src/UUIDTable.cpp \
+ *       -lboost_thread -lboost_system -lpthread -o parse_bench
+ *   ./parse_bench bench/data
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <json/json.hpp>
+
+#include "controller/ControllerResponse.h"
+
+bool debug;
+bool debug_scan;
+bool debug_topology;
+bool debug_discovery;
+bool debug_router;
+bool debug_socket;
+bool debug_controller;
+bool debug_performance;
+bool debug_advertise;
+
+using json = nlohmann::json;
+
+static const int ITERATIONS = 2000;
+
+/*
+ * Count heap allocations made while parsing.
+ */
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+static void *countedMalloc(size_t n) {
+	allocations++;
+	allocatedBytes += n;
+	void *p = malloc(n);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+/*
+ * Not inlined, so that the compiler does not match malloc() and free() against
+ * new and delete.
+ */
+__attribute__((noinline)) void *operator new(size_t n) {
+	return countedMalloc(n);
+}
+
+__attribute__((noinline)) void *operator new[](size_t n) {
+	return countedMalloc(n);
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept {
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t n) noexcept {
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void *p, size_t n) noexcept {
+	free(p);
+}
+
+/*
+ * Previous implementation: parse a tree from a stringstream, then walk it.
+ */
+static void legacyCanMap(json &j, can_map_response_t &ret) {
+	ret.result = j["result"];
+	if (j.count("ttl")) {
+		ret.hasTtl = true;
+		ret.ttl = j["ttl"];
+	}
+	json access = j["access"];
+	json rules = access["rules"];
+	json services = access["services"];
+	for (json::iterator it = rules.begin(); it != rules.end(); ++it) {
+		json ruleValue = it.value();
+		rule_spec_t spec;
+		spec.id = std::stoi(it.key());
+		spec.rule.properties = 0;
+		spec.rule.setProperties(ruleValue["prop"]);
+		spec.rule.encryption = ruleValue["enc"];
+		spec.rule.integrity = ruleValue["int"];
+		spec.rule.exclusiveId = ruleValue["excl"];
+		std::string tStr = ruleValue["lease"];
+		spec.rule.lease = static_cast<time_t>(std::stod(tStr));
+		json dAuthValues = ruleValue["dauth"];
+		for (json::iterator it2 = dAuthValues.begin(); it2 != dAuthValues.end(); ++it2) {
+			json dAuthValue = *it2;
+			dauth_spec_t d;
+			d.type = dAuthValue["type"].get<std::string>();
+			d.when = dAuthValue["when"];
+			if (d.type == "network") {
+				d.ip = dAuthValue["ip"].get<std::string>();
+				d.isPrivate = dAuthValue["priv"];
+			}
+			spec.dauth.push_back(d);
+		}
+		ret.rules.push_back(spec);
+	}
+	for (json::iterator it = services.begin(); it != services.end(); ++it) {
+		std::string tmp = it.key();
+		json chars = it.value();
+		std::vector<char_rules_spec_t> charRules;
+		for (json::iterator it2 = chars.begin(); it2 != chars.end(); ++it2) {
+			tmp = it2.key();
+			char_rules_spec_t c = { UUID(tmp), std::vector<rule_t>() };
+			json ruleIds = it2.value();
+			for (json::iterator it3 = ruleIds.begin(); it3 != ruleIds.end(); ++it3) {
+				rule_t ruleId = *it3;
+				c.ruleIds.push_back(ruleId);
+			}
+			charRules.push_back(c);
+		}
+		ret.services.push_back(std::make_pair(UUID(it.key()), charRules));
+	}
+}
+
+static size_t legacyParseCanMap(const std::string &body) {
+	std::stringstream ss;
+	ss << body;
+	json j;
+	j << ss;
+	can_map_response_t ret;
+	legacyCanMap(j, ret);
+	return ret.rules.size() + ret.services.size();
+}
+
+static size_t legacyParseBatch(const std::string &body) {
+	std::stringstream ss;
+	ss << body;
+	json results;
+	results << ss;
+	results = results["results"];
+	size_t n = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		/* Each result was dumped and parsed again */
+		std::stringstream rs;
+		rs << results[i].dump();
+		n += legacyParseCanMap(rs.str());
+	}
+	return n;
+}
+
+static size_t legacyParseDiscovery(const std::string &body) {
+	std::stringstream ss;
+	ss << body;
+	json j;
+	j << ss;
+	std::list<discovery_result_t> results;
+	for (auto &it : j) {
+		discovery_result_t result;
+		result.name = it["device"]["name"];
+		result.id = it["device"]["id"];
+		result.gateway = it["gateway"]["name"];
+		result.ip = it["gateway"]["ip"];
+		result.port = it["gateway"]["port"];
+		results.push_back(result);
+	}
+	return results.size();
+}
+
+static size_t parseCanMap(const std::string &body) {
+	can_map_response_t ret;
+	parseCanMapResponse(body, ret);
+	return ret.rules.size() + ret.services.size();
+}
+
+static size_t parseBatch(const std::string &body) {
+	std::vector<can_map_response_t> ret;
+	parseCanMapBatchResponse(body, ret);
+	size_t n = 0;
+	for (auto &r : ret) {
+		n += r.rules.size() + r.services.size();
+	}
+	return n;
+}
+
+static size_t parseDiscovery(const std::string &body) {
+	std::list<discovery_result_t> ret;
+	parseDiscoveryResponse(body, ret);
+	return ret.size();
+}
+
+static std::string readFile(std::string path) {
+	std::ifstream ifs(path);
+	if (!ifs) {
+		std::cerr << "could not open " << path << std::endl;
+		exit(1);
+	}
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	return ss.str();
+}
+
+template<class F>
+static void run(std::string name, const std::string &body, F f) {
+	size_t sink = f(body);
+
+	uint64_t allocs = allocations;
+	uint64_t bytes = allocatedBytes;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		sink += f(body);
+	}
+	auto end = std::chrono::steady_clock::now();
+	double us = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 1000.0;
+	std::cout << name << "\t" << (us / ITERATIONS) << " us/parse\t" << (allocations - allocs) / ITERATIONS
+			<< " allocs\t" << (allocatedBytes - bytes) / ITERATIONS << " bytes\t(" << sink << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	std::string dir = (argc > 1) ? argv[1] : "bench/data";
+
+	std::string small = readFile(dir + "/canMap_small.json");
+	std::string large = readFile(dir + "/canMap_large.json");
+	std::string batch = readFile(dir + "/canMap_batch.json");
+	std::string discover = readFile(dir + "/discover.json");
+
+	if (legacyParseCanMap(large) != parseCanMap(large) || legacyParseBatch(batch) != parseBatch(batch)
+			|| legacyParseDiscovery(discover) != parseDiscovery(discover)) {
+		std::cerr << "mismatch" << std::endl;
+		return 1;
+	}
+
+	std::cout << "canMap small: " << small.length() << " bytes" << std::endl;
+	run("  legacy", small, legacyParseCanMap);
+	run("  reader", small, parseCanMap);
+	std::cout << "canMap large: " << large.length() << " bytes" << std::endl;
+	run("  legacy", large, legacyParseCanMap);
+	run("  reader", large, parseCanMap);
+	std::cout << "canMap batch: " << batch.length() << " bytes" << std::endl;
+	run("  legacy", batch, legacyParseBatch);
+	run("  reader", batch, parseBatch);
+	std::cout << "discover: " << discover.length() << " bytes" << std::endl;
+	run("  legacy", discover, legacyParseDiscovery);
+	run("  reader", discover, parseDiscovery);
+	return 0;
+}
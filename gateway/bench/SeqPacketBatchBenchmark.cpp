@@ -0,0 +1,153 @@
+/*
+ * SeqPacketBatchBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * ATT sized packets over a SOCK_SEQPACKET pair, one syscall per packet as
+ * SeqPacketConnection used to, and in batches with sendmmsg and recvmmsg as
+ * it does now. The reader waits for readiness with select, as the readers
+ * do. CPU time covers both sides.
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O2 -Iinclude bench/SeqPacketBatchBenchmark.cpp -lpthread -o seqpacket_bench
+ *   ./seqpacket_bench
+ */
+
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static const int PACKETS = 200000;
+static const int PDU_LEN = 23;
+static const int READ_BATCH = 16;
+static const int WRITE_BATCH = 64;
+static const int MAX_PACKET_LEN = 256;
+
+static double cpuSeconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+			+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void waitReadable(int fd) {
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	select(fd + 1, &fds, NULL, NULL, NULL);
+}
+
+static void readSingle(int fd, int &wakeups) {
+	uint8_t buf[MAX_PACKET_LEN];
+	for (int i = 0; i < PACKETS; i++) {
+		waitReadable(fd);
+		wakeups++;
+		if (read(fd, buf, sizeof(buf)) != PDU_LEN) {
+			std::cerr << "bad read" << std::endl;
+			exit(1);
+		}
+	}
+}
+
+static void readBatched(int fd, int &wakeups) {
+	static uint8_t bufs[READ_BATCH][MAX_PACKET_LEN];
+	struct mmsghdr msgs[READ_BATCH];
+	struct iovec iovs[READ_BATCH];
+	int received = 0;
+	while (received < PACKETS) {
+		waitReadable(fd);
+		wakeups++;
+		while (true) {
+			memset(msgs, 0, sizeof(msgs));
+			for (int i = 0; i < READ_BATCH; i++) {
+				iovs[i].iov_base = bufs[i];
+				iovs[i].iov_len = MAX_PACKET_LEN;
+				msgs[i].msg_hdr.msg_iov = &iovs[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			int n = recvmmsg(fd, msgs, READ_BATCH, MSG_DONTWAIT, NULL);
+			if (n <= 0) {
+				break;
+			}
+			received += n;
+			if (n < READ_BATCH) {
+				break;
+			}
+		}
+	}
+}
+
+static void writeSingle(int fd, uint8_t *pdu) {
+	for (int i = 0; i < PACKETS; i++) {
+		if (write(fd, pdu, PDU_LEN) != PDU_LEN) {
+			std::cerr << "bad write" << std::endl;
+			exit(1);
+		}
+	}
+}
+
+static void writeBatched(int fd, uint8_t *pdu) {
+	struct mmsghdr msgs[WRITE_BATCH];
+	struct iovec iov;
+	iov.iov_base = pdu;
+	iov.iov_len = PDU_LEN;
+	memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < WRITE_BATCH; i++) {
+		msgs[i].msg_hdr.msg_iov = &iov;
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int sent = 0;
+	while (sent < PACKETS) {
+		int n = sendmmsg(fd, msgs, std::min(WRITE_BATCH, PACKETS - sent), MSG_NOSIGNAL);
+		if (n <= 0) {
+			std::cerr << "bad sendmmsg" << std::endl;
+			exit(1);
+		}
+		sent += n;
+	}
+}
+
+static void run(std::string name, bool batched) {
+	int sv[2];
+	socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv);
+	uint8_t pdu[PDU_LEN] = { 0x1B, 0x10, 0x00 };
+
+	int wakeups = 0;
+	double cpu = cpuSeconds();
+	auto start = std::chrono::steady_clock::now();
+	std::thread reader([&] {
+		if (batched) {
+			readBatched(sv[1], wakeups);
+		} else {
+			readSingle(sv[1], wakeups);
+		}
+	});
+	if (batched) {
+		writeBatched(sv[0], pdu);
+	} else {
+		writeSingle(sv[0], pdu);
+	}
+	reader.join();
+
+	double us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	std::cout << name << "\t" << (PACKETS / us * 1e6) << " pdus/s\t"
+			<< ((cpuSeconds() - cpu) * 1e9 / PACKETS) << " ns cpu/pdu\t"
+			<< ((double) PACKETS / wakeups) << " pdus/wakeup" << std::endl;
+	close(sv[0]);
+	close(sv[1]);
+}
+
+int main() {
+	run("single", false);
+	run("batched", true);
+	return 0;
+}
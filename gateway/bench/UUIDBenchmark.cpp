@@ -0,0 +1,214 @@
+/*
+ * UUIDBenchmark.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ *
+ * Microbenchmark of UUID comparison, short form detection and formatting,
+ * against the previous memcmp and boost::format implementations.
+ *
+ * Build from the gateway directory:
+ *   g++ -std=c++1y -O3 -Iinclude bench/UUIDBenchmark.cpp src/UUID.cpp src/UUIDTable.cpp \
+ *       -lboost_thread -lboost_system -lpthread -o uuid_bench
+ */
+
+#include <boost/format.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ble/gatt.h"
+#include "UUID.h"
+#include "UUIDTable.h"
+
+static const int NUM_UUIDS = 256;
+static const int ITERATIONS = 2000;
+
+/*
+ * Previous implementations, operating on the printed byte order.
+ */
+static bool legacyEquals(const uint8_t *a, const uint8_t *b) {
+	return memcmp(a, b, UUID_LEN) == 0;
+}
+
+static bool legacyIsShort(const uint8_t *v) {
+	return v[0] == 0 && v[1] == 0 && memcmp(v + 4, BLUETOOTH_BASE_UUID, 12) == 0;
+}
+
+static std::string legacyStr(const uint8_t *v) {
+	std::stringstream ss;
+	if (legacyIsShort(v)) {
+		ss << boost::format("%02X") % static_cast<int>(v[2]);
+		ss << boost::format("%02X") % static_cast<int>(v[3]);
+	} else {
+		for (int i = 0; i < UUID_LEN; i++) {
+			if (i == 4 || i == 6 || i == 8 || i == 10) {
+				ss << '-';
+			}
+			ss << boost::format("%02X") % static_cast<int>(v[i]);
+		}
+	}
+	return ss.str();
+}
+
+template<class F>
+static void run(std::string name, long ops, F f) {
+	auto start = std::chrono::steady_clock::now();
+	size_t sink = f();
+	auto end = std::chrono::steady_clock::now();
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	std::cout << name << "\t" << (ns / ops) << " ns/op\t(" << sink << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	std::mt19937 rng(42);
+	std::vector<std::vector<uint8_t>> raw;
+	std::vector<UUID> uuids;
+	for (int i = 0; i < NUM_UUIDS; i++) {
+		std::vector<uint8_t> v(UUID_LEN);
+		if (i % 2 == 0) {
+			v[2] = rng();
+			v[3] = rng();
+			memcpy(v.data() + 4, BLUETOOTH_BASE_UUID, 12);
+		} else {
+			for (int j = 0; j < UUID_LEN; j++) {
+				v[j] = rng();
+			}
+		}
+		uuids.push_back(UUID(v.data(), UUID_LEN, false));
+		raw.push_back(v);
+	}
+
+	for (int i = 0; i < NUM_UUIDS; i++) {
+		if (uuids[i].isShort() != legacyIsShort(raw[i].data()) || uuids[i].str() != legacyStr(raw[i].data())) {
+			std::cerr << "mismatch: " << uuids[i].str() << " != " << legacyStr(raw[i].data()) << std::endl;
+			return 1;
+		}
+	}
+
+	long ops = (long) NUM_UUIDS * ITERATIONS;
+
+	run("legacy isShort", ops, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (auto &v : raw) {
+				n += legacyIsShort(v.data());
+			}
+		}
+		return n;
+	});
+	run("sse2 isShort", ops, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (auto &u : uuids) {
+				n += u.isShort();
+			}
+		}
+		return n;
+	});
+
+	run("legacy equals", ops, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (int i = 0; i < NUM_UUIDS; i++) {
+				n += legacyEquals(raw[i].data(), raw[(i + it) % NUM_UUIDS].data());
+			}
+		}
+		return n;
+	});
+	run("sse2 equals", ops, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (int i = 0; i < NUM_UUIDS; i++) {
+				n += uuids[i] == uuids[(i + it) % NUM_UUIDS];
+			}
+		}
+		return n;
+	});
+
+	long strOps = (long) NUM_UUIDS * (ITERATIONS / 10);
+	run("legacy str", strOps, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS / 10; it++) {
+			for (auto &v : raw) {
+				n += legacyStr(v.data()).size();
+			}
+		}
+		return n;
+	});
+	run("table str", strOps, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS / 10; it++) {
+			for (auto &u : uuids) {
+				n += u.str().size();
+			}
+		}
+		return n;
+	});
+
+	/* Only the short uuids are interned */
+	std::vector<uuid_id_t> ids;
+	for (auto &u : uuids) {
+		uuid_id_t id;
+		if (UUIDTable::intern(u, id)) {
+			ids.push_back(id);
+		}
+	}
+	long idOps = (long) ids.size() * ITERATIONS;
+	run("interned str", idOps, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (uuid_id_t id : ids) {
+				n += UUIDTable::str(id).size();
+			}
+		}
+		return n;
+	});
+
+	std::map<UUID, int> ordered;
+	std::unordered_map<UUID, int> hashed;
+	std::unordered_map<uuid_id_t, int> byId;
+	for (int i = 0; i < NUM_UUIDS; i++) {
+		ordered[uuids[i]] = i;
+		hashed[uuids[i]] = i;
+	}
+	for (size_t i = 0; i < ids.size(); i++) {
+		byId[ids[i]] = i;
+	}
+	run("std::map<UUID> find", ops, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (auto &u : uuids) {
+				n += ordered.find(u)->second;
+			}
+		}
+		return n;
+	});
+	run("unordered_map<UUID> find", ops, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (auto &u : uuids) {
+				n += hashed.find(u)->second;
+			}
+		}
+		return n;
+	});
+	run("unordered_map<id> find", idOps, [&] {
+		size_t n = 0;
+		for (int it = 0; it < ITERATIONS; it++) {
+			for (uuid_id_t id : ids) {
+				n += byId.find(id)->second;
+			}
+		}
+		return n;
+	});
+
+	return 0;
+}
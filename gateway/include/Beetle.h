@@ -21,12 +21,14 @@
 
 #include "BeetleTypes.h"
 #include "HCI.h"
+#include "Metrics.h"
 
 /* Forward declarations */
 class AccessControl;
 class BeetleInternal;
 class NetworkDiscoveryClient;
 class Router;
+class ServiceIndex;
 
 /* Defaults parallelism */
 const int DEFAULT_NUM_WORKERS = 8;
@@ -53,6 +55,11 @@ public:
 	 */
 	void updateDevice(device_t device);
 
+	/*
+	 * Resize the handle ranges allotted to the device in the devices it is mapped to.
+	 */
+	void resizeMappings(device_t device);
+
 	/*
 	 * Removes a device from Beetle's mappings and unsubscribes the device from all characteristics.
 	 */
@@ -71,6 +78,12 @@ public:
 		mapDevices(from, to, unused);
 	};
 
+	/*
+	 * Maps handles from device 1 to device 2 without blocking on access control.
+	 * The handler, if any, may run in the calling thread.
+	 */
+	void mapDevicesAsync(device_t from, device_t to, MapResultHandler h = NULL);
+
 	/*
 	 * Unmaps handles from device 1 to device 2.
 	 */
@@ -115,6 +128,12 @@ public:
 	 */
 	std::function<void()> getDaemon();
 
+	/*
+	 * Metrics of this instance. Declared before the devices, which remove
+	 * their series when they are destroyed.
+	 */
+	MetricsRegistry metrics;
+
 	/*
 	 * Global map of all devices at this instance.
 	 */
@@ -153,6 +172,12 @@ public:
 	void setDiscoveryClient(std::shared_ptr<NetworkDiscoveryClient> nd);
 	std::shared_ptr<NetworkDiscoveryClient> discoveryClient;
 
+	/*
+	 * Set the index of services offered by local devices.
+	 */
+	void setServiceIndex(std::shared_ptr<ServiceIndex> si);
+	std::shared_ptr<ServiceIndex> serviceIndex;
+
 	/*
 	 * Workers for callbacks.
 	 */
@@ -167,6 +192,18 @@ public:
 	 * Threads used for reading.
 	 */
 	SocketSelect readers;
+
+private:
+	/*
+	 * Checks the arguments to mapDevices and looks up the devices.
+	 */
+	bool getMappingDevices(device_t from, device_t to, std::shared_ptr<Device> &fromD,
+			std::shared_ptr<Device> &toD, std::string &err);
+
+	/*
+	 * Allocates the handle range once the mapping has been permitted.
+	 */
+	bool reserveMapping(device_t from, device_t to, std::string &err);
 };
 
 #endif /* INCLUDE_BEETLE_H_ */
@@ -67,12 +67,23 @@ public:
 	 */
 	bool tcpEnabled = false;
 	int tcpPort = 3002;
+	int tcpBacklog = 128;						// pending connections to queue
+	int tcpMaxHandshakes = 64;					// concurrent tls handshakes
+	int tcpHandshakeTimeout = 10;				// seconds to finish a handshake
 
 	/*
 	 * Unix domain socket settings
 	 */
 	bool ipcEnabled = false;
 	std::string ipcPath = "/tmp/beetle";
+	int ipcRingSize = 1 << 18;					// bytes per direction, 0 to disable rings
+	int ipcRingSlots = 1024;					// notification slots per user
+
+	/*
+	 * Metrics endpoint settings
+	 */
+	int metricsPort = 0;						// loopback http port, 0 to disable
+	std::string metricsPath = "";				// unix domain socket, empty to disable
 
 	/*
 	 * Peripheral settings
@@ -80,6 +91,22 @@ public:
 	bool advertiseEnabled = false;
 	std::string advertiseDev = "";
 
+	/*
+	 * Connection interval settings, in units of 1.25ms
+	 */
+	bool connIntervalEnabled = false;
+	int connIntervalPeriod = 2;					// seconds between adjustments
+	int connIntervalFastMin = 6;
+	int connIntervalFastMax = 12;
+	int connIntervalSlowMin = 80;
+	int connIntervalSlowMax = 160;
+	int connIntervalSlowLatency = 0;			// slave latency in slow profile
+	int connIntervalFastQueueDepth = 2;			// queued transactions to go fast
+	int connIntervalFastLatency = 100;			// average transaction ms to go fast
+	double connIntervalFastNotifyRate = 4.0;	// notifications per second to go fast
+	int connIntervalSlowAfter = 3;				// idle periods before going slow
+	bool connIntervalPinSubscribed = true;		// keep links with subscribers fast
+
 	/*
 	 * Controller settings
 	 */
@@ -89,6 +116,19 @@ public:
 	bool controllerControlEnabled = true;
 	int controllerControlPort = 3004;
 	int controllerControlMaxReconnect = 5;
+	int controllerCommandWorkers = 8;			// concurrent controller commands
+	int controllerMaxConnections = 4;			// concurrent api connections
+	int controllerPipelineDepth = 4;			// pipelined requests per connection
+	int controllerTimeout = 180;				// seconds to wait for a response
+	int controllerIdleTimeout = 30;				// seconds before closing idle connections
+	int controllerAccessTtl = 60;				// seconds to cache a permitted mapping
+	int controllerAccessDenyTtl = 10;			// seconds to cache a denied mapping
+	bool controllerAccessPrefetch = true;		// prefetch decisions when devices are added
+	int controllerAccessWorkers = 4;			// concurrent access control requests
+	int controllerAccessBatchSize = 32;			// pairs per prefetch request
+	int controllerReportDelay = 50;				// milliseconds to coalesce state reports
+	int controllerReportMaxBackoff = 60;		// max seconds between report retries
+	int controllerDiscoveryTtl = 30;			// seconds to cache discovery results
 
 	/*
 	 * Static topology
@@ -103,6 +143,7 @@ public:
 	std::string sslCert = "../certs/cert.pem";
 	std::string sslCaCert = "../certs/cert.pem";
 	bool sslVerifyPeers = true;
+	bool sslKtls = false;						// kernel tls where supported
 
 	/*
 	 * Debug settings
@@ -9,6 +9,7 @@
 #define BEETLETYPES_H_
 
 #include <functional>
+#include <string>
 
 /*
  * Forward declaration of Beetle.
@@ -30,4 +31,9 @@ typedef std::function<void(device_t d)> UpdateDeviceHandler;
 typedef std::function<void(device_t from, device_t to)> MapDevicesHandler;
 typedef std::function<void(device_t from, device_t to)> UnmapDevicesHandler;
 
+/*
+ * Called with the outcome of an asynchronous map.
+ */
+typedef std::function<void(bool success, std::string err)> MapResultHandler;
+
 #endif /* BEETLETYPES_H_ */
@@ -81,6 +81,9 @@ private:
 	void doListOffsets(const std::vector<std::string>& cmd);
 	void doSetMaxConnectionInterval(const std::vector<std::string>& cmd);
 	void doDumpData(const std::vector<std::string>& cmd);
+	void doStats(const std::vector<std::string>& cmd);
+	void doTrace(const std::vector<std::string>& cmd);
+	void doCapture(const std::vector<std::string>& cmd);
 	void doSetDebug(const std::vector<std::string>& cmd);
 
 	/*
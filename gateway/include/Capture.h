@@ -0,0 +1,90 @@
+/*
+ * Capture.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_CAPTURE_H_
+#define INCLUDE_CAPTURE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <set>
+#include <string>
+
+#include "BeetleTypes.h"
+
+class CaptureException : public std::exception {
+  public:
+	CaptureException(std::string msg) : msg(msg) {};
+	CaptureException(const char *msg) : msg(msg) {};
+    ~CaptureException() throw() {};
+    const char *what() const throw() { return this->msg.c_str(); };
+  private:
+    std::string msg;
+};
+
+/*
+ * Capture of ATT PDUs read from and written to devices, into a memory-mapped
+ * pcapng file that Wireshark opens. The file is a ring of fixed size blocks,
+ * preallocated when the capture starts, and the oldest packets are
+ * overwritten when it is full. Recording a packet is a copy into the mapping,
+ * without locks or system calls.
+ *
+ * Each PDU is wrapped in L2CAP and HCI ACL headers, with the direction in the
+ * pseudo header and the device in the ACL handle and the packet comment.
+ */
+
+// Set while capturing. Use capturing() to test it.
+extern std::atomic<bool> capture_enabled;
+
+inline bool capturing() {
+	return __builtin_expect(capture_enabled.load(std::memory_order_relaxed), false);
+}
+
+/*
+ * Record a PDU received from, or sent to, the device, if it passes the
+ * filters of the capture.
+ */
+void captureAtt(device_t device, bool received, const uint8_t *buf, int len);
+
+typedef struct {
+	std::string path;
+	size_t packets;					// packets kept in the ring
+	std::set<device_t> devices;		// all devices if empty
+	std::set<uint8_t> opCodes;		// all opcodes if empty
+} capture_params_t;
+
+/*
+ * Create the file and start capturing. Throws CaptureException, also if
+ * packets is 0 or more than CAPTURE_MAX_PACKETS.
+ */
+void captureStart(const capture_params_t &params);
+
+/*
+ * Stop capturing and close the file. Returns the number of packets recorded,
+ * including those overwritten, or -1 if not capturing.
+ */
+long captureStop();
+
+/*
+ * Description of the capture in progress, or empty.
+ */
+std::string captureStatus();
+
+/*
+ * Bytes of each PDU kept.
+ */
+const int CAPTURE_SNAP_LEN = 256;
+
+const size_t CAPTURE_DEFAULT_PACKETS = 65536;
+
+/*
+ * The whole ring is written when the capture starts, so it is kept to well
+ * under a gigabyte.
+ */
+const size_t CAPTURE_MAX_PACKETS = 1 << 21;
+
+#endif /* INCLUDE_CAPTURE_H_ */
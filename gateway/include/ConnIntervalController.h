@@ -0,0 +1,96 @@
+/*
+ * ConnIntervalController.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef CONNINTERVALCONTROLLER_H_
+#define CONNINTERVALCONTROLLER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "BeetleConfig.h"
+#include "BeetleTypes.h"
+
+/* Forward declarations */
+class LEDevice;
+
+/*
+ * Moves each LE link between a fast and a slow connection interval profile
+ * based on the traffic seen by the device.
+ */
+class ConnIntervalController {
+public:
+	ConnIntervalController(Beetle &beetle, const BeetleConfig &config);
+	virtual ~ConnIntervalController();
+
+	/*
+	 * Returns true if the link should be held at the fast profile regardless
+	 * of traffic. Called with the devices lock held.
+	 */
+	typedef std::function<bool(std::shared_ptr<LEDevice> device)> PinPolicy;
+
+	/*
+	 * Replace the policy used to pin links.
+	 */
+	void setPinPolicy(PinPolicy policy);
+
+	/*
+	 * Pins links that have at least one subscribed client.
+	 */
+	static PinPolicy getSubscribedPinPolicy();
+
+	/*
+	 * Return a daemon to sample traffic and adjust intervals. Must be
+	 * repeated every period seconds.
+	 */
+	std::function<void()> getDaemon();
+
+	/*
+	 * Forget the state of a removed device.
+	 */
+	RemoveDeviceHandler getRemoveDeviceHandler();
+
+	typedef struct {
+		uint16_t minInterval;
+		uint16_t maxInterval;
+		uint16_t latency;
+	} interval_profile_t;
+
+private:
+	Beetle &beetle;
+
+	int period;
+	interval_profile_t fastProfile;
+	interval_profile_t slowProfile;
+
+	int fastQueueDepth;
+	uint64_t fastLatency;
+	double fastNotifyRate;
+	int slowAfter;
+
+	PinPolicy pinPolicy;
+	std::mutex pinPolicyMutex;
+
+	enum Profile {
+		UNSET, FAST, SLOW,
+	};
+
+	typedef struct {
+		Profile profile;
+		int idlePeriods;
+	} link_state_t;
+
+	std::map<device_t, link_state_t> links;
+	std::mutex linksMutex;
+
+	void adjust(std::shared_ptr<LEDevice> le, link_state_t &state, bool pinned);
+	bool apply(std::shared_ptr<LEDevice> le, link_state_t &state, Profile profile);
+};
+
+#endif /* CONNINTERVALCONTROLLER_H_ */
@@ -17,8 +17,12 @@
 #include <mutex>
 #include <string>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 #include "BeetleTypes.h"
+#include "UUID.h"
+#include "UUIDTable.h"
 
 /* Forward declarations */
 class HandleAllocationTable;
@@ -81,6 +85,22 @@ public:
 	std::map<uint16_t, std::shared_ptr<Handle>> handles;
 	std::recursive_mutex handlesMutex;
 
+	/*
+	 * Rebuild the attribute type index. Must be called whenever handles is modified.
+	 */
+	void indexHandles();
+
+	/*
+	 * Changes whenever indexHandles() is called. Unique within the process.
+	 */
+	uint32_t getHandlesVersion();
+
+	/*
+	 * Returns the handles with the attribute type, in ascending order. Must be
+	 * called holding handlesMutex.
+	 */
+	const std::vector<uint16_t> &getHandlesByType(const UUID &type);
+
 	/*
 	 * Handle address offsets that this device is a client to.
 	 */
@@ -148,6 +168,16 @@ protected:
 private:
 	device_t id;
 
+	/*
+	 * Attribute type to handles, protected by handlesMutex. Types that are not
+	 * interned are in handlesByLongType.
+	 */
+	std::unordered_map<uuid_id_t, std::vector<uint16_t>> handlesByType;
+	std::unordered_map<UUID, std::vector<uint16_t>> handlesByLongType;
+	std::atomic<uint32_t> handlesVersion;
+
+	static std::atomic<uint32_t> handlesVersionCounter;
+
 	static std::atomic_int idCounter;
 	static const std::string deviceType2Str[];
 };
@@ -8,15 +8,23 @@
 #ifndef INCLUDE_HANDLE_H_
 #define INCLUDE_HANDLE_H_
 
+#include <boost/container/flat_set.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/shared_array.hpp>
 #include <cstdint>
 #include <ctime>
 #include <memory>
-#include <set>
 #include <string>
 
 #include "BeetleTypes.h"
 #include "UUID.h"
+#include "UUIDTable.h"
+
+/*
+ * Sorted set of devices, stored inline for the common case of few members.
+ */
+typedef boost::container::flat_set<device_t, std::less<device_t>,
+		boost::container::small_vector<device_t, 2>> subscriber_set_t;
 
 class CachedHandle {
 public:
@@ -28,7 +36,7 @@ public:
 
 	int len = 0;
 	time_t time = 0;
-	std::set<device_t> cachedSet;
+	subscriber_set_t cachedSet;
 };
 
 /*
@@ -36,6 +44,14 @@ public:
  */
 class Handle {
 public:
+	/*
+	 * Type tag, so that callers do not need RTTI to identify handles.
+	 */
+	enum Kind {
+		GENERIC, PRIMARY_SERVICE, CHARACTERISTIC, CHARACTERISTIC_VALUE, CLIENT_CHAR_CFG,
+	};
+	static constexpr Kind KIND = GENERIC;
+
 	/*
 	 * Static handle means that the value is guaranteed not change.
 	 * Cache infinite means that duplicate reads will still be
@@ -44,6 +60,8 @@ public:
 	Handle(bool staticHandle = false, bool cacheInfinite = false);
 	virtual ~Handle();
 
+	Kind getKind() const;
+
 	bool isCacheInfinite() const;
 	bool isStaticHandle() const;
 
@@ -66,14 +84,28 @@ public:
 	UUID getUuid() const;
 	void setUuid(UUID uuid);
 
+	/*
+	 * Interned id of the attribute type. Returns false if the type is not
+	 * interned.
+	 */
+	bool getUuidId(uuid_id_t &id) const;
+
+	/*
+	 * Same as getUuid().str().
+	 */
+	std::string getUuidStr() const;
+
 	virtual std::string str() const;
 
 	CachedHandle cache;
-	std::set<device_t> subscribersNotify;
-	std::set<device_t> subscribersIndicate;
+	subscriber_set_t subscribersNotify;
+	subscriber_set_t subscribersIndicate;
 protected:
+	Kind kind = GENERIC;
 	uint16_t handle = 0;
 	UUID uuid;
+	uuid_id_t uuidId;
+	bool uuidInterned;
 	uint16_t serviceHandle = 0;
 	uint16_t charHandle = 0;
 	uint16_t endGroupHandle = 0;
@@ -83,6 +115,7 @@ protected:
 
 class PrimaryService: public Handle {
 public:
+	static constexpr Kind KIND = PRIMARY_SERVICE;
 	PrimaryService();
 	UUID getServiceUuid() const;
 	std::string str() const;
@@ -90,6 +123,7 @@ public:
 
 class Characteristic: public Handle {
 public:
+	static constexpr Kind KIND = CHARACTERISTIC;
 	Characteristic();
 	uint16_t getAttrHandle() const;
 	UUID getCharUuid() const;
@@ -99,14 +133,27 @@ public:
 
 class CharacteristicValue: public Handle {
 public:
+	static constexpr Kind KIND = CHARACTERISTIC_VALUE;
 	CharacteristicValue(bool staticHandle = false, bool cacheInfinite = false);
 	std::string str() const;
 };
 
 class ClientCharCfg: public Handle {
 public:
+	static constexpr Kind KIND = CLIENT_CHAR_CFG;
 	ClientCharCfg();
 	std::string str() const;
 };
 
+/*
+ * Downcast a handle by its kind. Returns NULL if the handle is not a T.
+ */
+template<class T>
+inline std::shared_ptr<T> handle_cast(const std::shared_ptr<Handle> &h) {
+	if (h && h->getKind() == T::KIND) {
+		return std::static_pointer_cast<T>(h);
+	}
+	return NULL;
+}
+
 #endif /* INCLUDE_HANDLE_H_ */
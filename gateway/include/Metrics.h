@@ -0,0 +1,204 @@
+/*
+ * Metrics.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_METRICS_H_
+#define INCLUDE_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, std::string>> metric_labels_t;
+
+/*
+ * Index of the calling thread's counter shard.
+ */
+int metricsThreadShard();
+
+/*
+ * Monotonic counter. Threads add to their own shard, a cache line apart, and
+ * reads sum the shards, so that hot paths do not contend.
+ */
+class Counter {
+public:
+	Counter();
+
+	inline void add(uint64_t n = 1) {
+		shards[metricsThreadShard()].value.fetch_add(n, std::memory_order_relaxed);
+	};
+
+	uint64_t value();
+
+	static constexpr int NUM_SHARDS = 16;
+private:
+	struct shard_t {
+		std::atomic<uint64_t> value;
+		char pad[64 - sizeof(std::atomic<uint64_t>)];
+	};
+	shard_t shards[NUM_SHARDS];
+};
+
+/*
+ * Value that goes up and down, such as a queue depth.
+ */
+class Gauge {
+public:
+	Gauge();
+
+	inline void set(int64_t v) {
+		val.store(v, std::memory_order_relaxed);
+	};
+
+	inline void add(int64_t n) {
+		val.fetch_add(n, std::memory_order_relaxed);
+	};
+
+	int64_t value();
+private:
+	std::atomic<int64_t> val;
+};
+
+typedef struct {
+	std::vector<uint64_t> counts;
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+} histogram_snapshot_t;
+
+/*
+ * Log-linear histogram of microseconds, in the style of HdrHistogram. Each
+ * power of 2 is split into 8 buckets, so values are kept to within 12.5%.
+ * Recording is a few relaxed atomic adds.
+ */
+class Histogram {
+public:
+	Histogram();
+
+	void record(uint64_t micros);
+
+	histogram_snapshot_t snapshot();
+
+	/*
+	 * Highest value in the bucket at quantile q, from 0 to 1.
+	 */
+	static uint64_t percentile(const histogram_snapshot_t &snapshot, double q);
+
+	static int bucketOf(uint64_t micros);
+	static uint64_t bucketUpperBound(int bucket);
+
+	static constexpr int SUB_BUCKETS = 8;
+	static constexpr int MAX_EXPONENT = 36;		// about 19 hours
+	static constexpr int NUM_BUCKETS = (MAX_EXPONENT - 2) * SUB_BUCKETS;
+private:
+	std::atomic<uint64_t> counts[NUM_BUCKETS];
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+};
+
+/*
+ * Traffic on one kind of transport.
+ */
+typedef struct {
+	Counter *bytesIn;
+	Counter *bytesOut;
+	Counter *packetsIn;
+	Counter *packetsOut;
+} transport_metrics_t;
+
+/*
+ * Lookups in one cache.
+ */
+typedef struct {
+	Counter *hits;
+	Counter *misses;
+} cache_metrics_t;
+
+/*
+ * Named series with labels, exported in the Prometheus text format.
+ *
+ * Registration and export take a lock, but the returned counters and
+ * histograms are updated without one. Callers keep the pointers, which stay
+ * valid until the series are removed.
+ */
+class MetricsRegistry {
+public:
+	MetricsRegistry();
+	virtual ~MetricsRegistry();
+
+	/*
+	 * Get or create a series. Names should end in _total for counters and
+	 * _seconds for histograms, which are exported in seconds.
+	 */
+	Counter *counter(std::string name, std::string help, metric_labels_t labels = {});
+	Gauge *gauge(std::string name, std::string help, metric_labels_t labels = {});
+	Histogram *histogram(std::string name, std::string help, metric_labels_t labels = {});
+
+	/*
+	 * Gauge read at export. The function must not block on anything that
+	 * may be held while registering metrics.
+	 */
+	void gauge(std::string name, std::string help, metric_labels_t labels, std::function<double()> f);
+
+	/*
+	 * Counters for a transport, such as "l2cap" or "tcp".
+	 */
+	transport_metrics_t &transport(std::string name);
+
+	/*
+	 * Counters for a cache, exported with its hit ratio.
+	 */
+	cache_metrics_t &cache(std::string name);
+
+	/*
+	 * Remove every series with the label. Pointers to them become invalid.
+	 */
+	void remove(std::string label, std::string value);
+
+	/*
+	 * All series in the Prometheus text format, version 0.0.4.
+	 */
+	std::string prometheus();
+
+	/*
+	 * Human readable summary, with percentiles of histograms.
+	 */
+	std::string summary();
+private:
+	typedef struct {
+		metric_labels_t labels;
+		std::unique_ptr<Counter> counter;
+		std::unique_ptr<Gauge> gauge;
+		std::function<double()> gaugeFunction;
+		std::unique_ptr<Histogram> histogram;
+	} series_t;
+
+	enum MetricType {
+		COUNTER, GAUGE, HISTOGRAM,
+	};
+
+	typedef struct {
+		MetricType type;
+		std::string help;
+		std::map<std::string, std::unique_ptr<series_t>> series;
+	} family_t;
+
+	std::map<std::string, family_t> families;
+	std::map<std::string, transport_metrics_t> transports;
+	std::map<std::string, cache_metrics_t> caches;
+	std::mutex m;
+
+	series_t &getSeries(const std::string &name, const std::string &help, MetricType type,
+			const metric_labels_t &labels);
+};
+
+#endif /* INCLUDE_METRICS_H_ */
@@ -9,8 +9,11 @@
 #define INCLUDE_ROUTER_H_
 
 #include <cstdint>
+#include <utility>
+#include <vector>
 
 #include "BeetleTypes.h"
+#include "Metrics.h"
 
 class Router {
 public:
@@ -22,9 +25,20 @@ public:
 	 * caller, or -1 if an unhandled error occurred.
 	 */
 	int route(uint8_t *buf, int len, device_t src);
+
+	/*
+	 * Route packets from the same device in order, under one lock of the
+	 * devices. Returns -1 if any of them had an unhandled error.
+	 */
+	int route(std::vector<std::pair<uint8_t *, int>> &pdus, device_t src);
 private:
 	Beetle &beetle;
 
+	/*
+	 * The route methods are called holding a shared lock on devices.
+	 */
+	int routeLocked(uint8_t *buf, int len, device_t src);
+
 	int routeFindInfo(uint8_t *buf, int len, device_t src);
 	int routeFindByTypeValue(uint8_t *buf, int len, device_t src);
 	int routeReadByType(uint8_t *buf, int len, device_t src);
@@ -32,6 +46,21 @@ private:
 	int routeHandleNotifyOrIndicate(uint8_t *buf, int len, device_t src);
 	int routeReadWrite(uint8_t *buf, int len, device_t src);
 	int routeUnsupported(uint8_t *buf, int len, device_t src);
+
+	/*
+	 * Answer BEETLE_OP_READ_TABLE_REQ from a remote gateway.
+	 */
+	int routeReadTable(uint8_t *buf, int len, device_t src);
+
+	/*
+	 * Mixed into table versions, so that they differ across restarts.
+	 */
+	uint32_t tableVersionSalt;
+
+	/*
+	 * Reads served from handle caches, and reads forwarded to the device.
+	 */
+	cache_metrics_t *readCache;
 };
 
 #endif /* INCLUDE_ROUTER_H_ */
@@ -0,0 +1,81 @@
+/*
+ * ServiceIndex.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef SERVICEINDEX_H_
+#define SERVICEINDEX_H_
+
+#include <boost/thread/pthread/shared_mutex.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BeetleTypes.h"
+#include "UUID.h"
+
+typedef struct {
+	device_t id;
+	std::string name;
+	uint16_t startHandle;	// range of the service, or the service containing the characteristic
+	uint16_t endHandle;
+} indexed_service_t;
+
+/*
+ * Index of the services and characteristics offered by devices attached to
+ * this gateway. Kept up to date by the add, update and remove handlers.
+ */
+class ServiceIndex {
+public:
+	ServiceIndex(Beetle &beetle);
+	virtual ~ServiceIndex();
+
+	/*
+	 * Local instances of the primary service.
+	 */
+	std::vector<indexed_service_t> findService(const UUID &uuid);
+
+	/*
+	 * Local instances of the characteristic.
+	 */
+	std::vector<indexed_service_t> findCharacteristic(const UUID &uuid);
+
+	AddDeviceHandler getAddDeviceHandler();
+	UpdateDeviceHandler getUpdateDeviceHandler();
+	RemoveDeviceHandler getRemoveDeviceHandler();
+
+private:
+	Beetle &beetle;
+
+	/*
+	 * Keyed by UUID, since most service uuids are vendor specific and are not
+	 * interned.
+	 */
+	typedef std::unordered_map<UUID, std::vector<indexed_service_t>> index_t;
+
+	index_t services;
+	index_t characteristics;
+
+	/*
+	 * Uuids indexed for each device, so that they can be removed.
+	 */
+	std::map<device_t, std::vector<UUID>> deviceServices;
+	std::map<device_t, std::vector<UUID>> deviceCharacteristics;
+
+	boost::shared_mutex indexMutex;
+
+	void indexDevice(device_t d);
+
+	/*
+	 * Must hold indexMutex exclusively.
+	 */
+	void unindexDevice(device_t d);
+
+	std::vector<indexed_service_t> find(index_t &index, const UUID &uuid);
+};
+
+#endif /* SERVICEINDEX_H_ */
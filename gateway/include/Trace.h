@@ -0,0 +1,111 @@
+/*
+ * Trace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_TRACE_H_
+#define INCLUDE_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * Sampled tracing of PDUs through the gateway. A sampled PDU gets a trace id
+ * when it is read, which follows it through routing, the destination's
+ * transaction queue, the response, and the writers. Each stage is recorded
+ * as a span in a ring buffer of the thread that ran it.
+ *
+ * When tracing is off, each trace point costs one predictable branch.
+ */
+
+// Set while tracing. Use tracing() to test it.
+extern std::atomic<bool> trace_enabled;
+
+// Trace id of the PDU being handled by this thread, or 0.
+extern thread_local uint64_t trace_current;
+
+// When this thread's socket was found readable, in trace time.
+extern thread_local uint64_t trace_ready;
+
+inline bool tracing() {
+	return __builtin_expect(trace_enabled.load(std::memory_order_relaxed), false);
+}
+
+/*
+ * Monotonic nanoseconds.
+ */
+uint64_t traceNow();
+
+/*
+ * Trace id for a PDU just read, or 0 if it is not sampled.
+ */
+uint64_t traceSample();
+
+/*
+ * Record a span of trace id, from start to end. Stage must be a literal.
+ */
+void traceRecord(uint64_t id, const char *stage, uint64_t start, uint64_t end, int64_t device = -1);
+
+/*
+ * Clear the buffers and trace one in sampleRate PDUs.
+ */
+void traceStart(int sampleRate);
+void traceStop();
+
+/*
+ * Write recorded spans in the Chrome trace event format, which
+ * chrome://tracing and Perfetto open. Returns the number of spans.
+ */
+int traceDump(std::ostream &os);
+
+/*
+ * Spans kept per thread. Older spans are overwritten.
+ */
+const int TRACE_BUFFER_SPANS = 4096;
+
+/*
+ * Sets the trace id handled by this thread, for the scope.
+ */
+class TraceScope {
+public:
+	TraceScope(uint64_t id) {
+		prev = trace_current;
+		trace_current = id;
+	};
+	~TraceScope() {
+		trace_current = prev;
+	};
+private:
+	uint64_t prev;
+};
+
+/*
+ * Records a span of the current trace over the scope, if there is one.
+ */
+class TraceSpan {
+public:
+	TraceSpan(const char *stage_, int64_t device_ = -1) {
+		id = 0;
+		if (tracing() && trace_current != 0) {
+			id = trace_current;
+			stage = stage_;
+			device = device_;
+			start = traceNow();
+		}
+	};
+	~TraceSpan() {
+		if (id != 0) {
+			traceRecord(id, stage, start, traceNow(), device);
+		}
+	};
+private:
+	uint64_t id;
+	const char *stage;
+	int64_t device;
+	uint64_t start;
+};
+
+#endif /* INCLUDE_TRACE_H_ */
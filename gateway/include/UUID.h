@@ -10,8 +10,12 @@
 
 #include <stddef.h>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 const int UUID_LEN = 16;
 const int SHORT_UUID_LEN = 2;
@@ -59,9 +63,30 @@ public:
 	}
 
 	bool operator ==(const UUID &rhs) const {
+#ifdef __SSE2__
+		__m128i a = _mm_loadu_si128((const __m128i *) uuid.value);
+		__m128i b = _mm_loadu_si128((const __m128i *) rhs.uuid.value);
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF;
+#else
 	    return memcmp(uuid.value, rhs.uuid.value, UUID_LEN) == 0;
+#endif
 	}
 
+	bool operator !=(const UUID &rhs) const {
+		return !(*this == rhs);
+	}
+
+	/*
+	 * Hash of the full 128-bit value.
+	 */
+	size_t hash() const;
+
+	/*
+	 * Write the full 128-bit value to buf, which must hold UUID_LEN bytes.
+	 * Reversed is the byte order read by UUID(buf, UUID_LEN).
+	 */
+	void write(uint8_t *buf, bool reversed = true) const;
+
 	std::string str(bool forceLong = false) const;
 private:
 
@@ -72,4 +97,13 @@ private:
 	uuid_t uuid;
 };
 
+namespace std {
+template<>
+struct hash<UUID> {
+	size_t operator()(const UUID &uuid) const {
+		return uuid.hash();
+	}
+};
+}
+
 #endif /* INCLUDE_UUID_H_ */
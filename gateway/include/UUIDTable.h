@@ -0,0 +1,88 @@
+/*
+ * UUIDTable.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_UUIDTABLE_H_
+#define INCLUDE_UUIDTABLE_H_
+
+#include <boost/thread/pthread/shared_mutex.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "UUID.h"
+
+/*
+ * Id of an interned uuid. Ids are dense and never reused.
+ */
+typedef uint32_t uuid_id_t;
+
+/*
+ * Process wide table of interned uuids. Each uuid is stored once, with its
+ * short form flag, hash and canonical string precomputed.
+ *
+ * Only uuids in the short form, which include the GATT and Beetle types, are
+ * interned. Long uuids are chosen by peers and clients, and are kept as UUIDs,
+ * so the table holds at most 65536 entries and is never full.
+ *
+ * Lookups by id do not lock.
+ */
+class UUIDTable {
+public:
+	/*
+	 * Sets the id of the uuid, adding it to the table if needed. Returns false
+	 * if the uuid is not in the short form.
+	 */
+	static bool intern(const UUID &uuid, uuid_id_t &id);
+
+	/*
+	 * Looks up the id of the uuid without adding it. Returns whether found.
+	 */
+	static bool find(const UUID &uuid, uuid_id_t &id);
+
+	static const UUID &get(uuid_id_t id);
+	static bool isShort(uuid_id_t id);
+	static size_t hash(uuid_id_t id);
+
+	/*
+	 * Returns the same string as UUID::str().
+	 */
+	static const std::string &str(uuid_id_t id);
+
+	/*
+	 * Number of interned uuids.
+	 */
+	static size_t size();
+
+private:
+	typedef struct {
+		UUID uuid;
+		bool isShort;
+		size_t hash;
+		std::string str;
+	} entry_t;
+
+	static constexpr int CHUNK_BITS = 10;
+	static constexpr int CHUNK_SIZE = 1 << CHUNK_BITS;
+	static constexpr int MAX_CHUNKS = (1 << 16) >> CHUNK_BITS;
+
+	UUIDTable();
+	static UUIDTable &instance();
+	const entry_t &entry(uuid_id_t id) const;
+
+	/*
+	 * Entries are allocated in fixed chunks so that they never move.
+	 */
+	std::atomic<entry_t *> chunks[MAX_CHUNKS];
+	std::atomic<uint32_t> count;
+
+	std::unordered_map<UUID, uuid_id_t> ids;
+	boost::shared_mutex idsMutex;
+};
+
+#endif /* INCLUDE_UUIDTABLE_H_ */
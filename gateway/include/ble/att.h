@@ -67,6 +67,7 @@
 #define ATT_MAX_VALUE_LEN			512
 #define ATT_DEFAULT_L2CAP_MTU			48
 #define ATT_DEFAULT_LE_MTU			23
+#define ATT_MAX_LE_MTU				(ATT_MAX_VALUE_LEN + 5)
 
 #define ATT_CID					4
 #define ATT_PSM					31
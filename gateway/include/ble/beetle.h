@@ -26,4 +26,69 @@
 /* The name of the first hop gateway */
 #define BEETLE_CHARAC_CONNECTED_GATEWAY_UUID 0xBE05
 
+/*
+ * Request for the whole handle table that the sender sees through its
+ * handle allocation table, answered in one response instead of discovery.
+ * Only sent between gateways. Gateways that predate it reply with
+ * ATT_ECODE_REQ_NOT_SUPP.
+ *
+ * Request:
+ *   uint8_t	opcode
+ *   uint8_t	BEETLE_TABLE_FORMAT
+ *   uint32_t	version of the table the sender has, or 0
+ *
+ * Response:
+ *   uint8_t	opcode
+ *   uint8_t	BEETLE_TABLE_FORMAT
+ *   uint32_t	version of the table
+ *   uint8_t	flags
+ *   uint16_t	number of handles, 0 if BEETLE_TABLE_UNCHANGED
+ *   repeated:
+ *     uint16_t	handle
+ *     uint8_t	Handle::Kind
+ *     uint8_t	BEETLE_TABLE_HANDLE_* flags
+ *     uint16_t	service handle
+ *     uint16_t	characteristic handle
+ *     uint16_t	end group handle
+ *     uint8_t	uuid[16]
+ *     uint16_t	length of the cached value
+ *				cached value, for declarations and static handles
+ *
+ * Integers are little endian.
+ */
+#define BEETLE_OP_READ_TABLE_REQ 0x3C
+#define BEETLE_OP_READ_TABLE_RESP 0x3D
+
+#define BEETLE_TABLE_FORMAT 1
+
+#define BEETLE_TABLE_UNCHANGED 0x01
+
+#define BEETLE_TABLE_HANDLE_STATIC 0x01
+#define BEETLE_TABLE_HANDLE_CACHE_INFINITE 0x02
+
+/* Largest response sent */
+#define BEETLE_TABLE_MAX_LEN 60000
+
+/*
+ * Sent by a local application on its unix socket to move to the shared
+ * memory rings in ipc/ShmRing.h. Not forwarded.
+ *
+ * Request:
+ *   uint8_t	opcode
+ *   uint8_t	IPC_RING_VERSION
+ *
+ * Response, with four fds in SCM_RIGHTS: the rings, the slots (read only),
+ * the eventfd that the gateway signals and the eventfd that the application
+ * signals:
+ *   uint8_t	opcode
+ *   uint8_t	IPC_RING_VERSION
+ *   uint16_t	slot size
+ *   uint16_t	number of slots
+ *
+ * Every PDU after the response is sent on the rings. Gateways that do not
+ * offer rings reply with ATT_ECODE_REQ_NOT_SUPP.
+ */
+#define BEETLE_OP_IPC_RING_REQ 0x3E
+#define BEETLE_OP_IPC_RING_RESP 0x3F
+
 #endif /* BLE_BEETLE_H_ */
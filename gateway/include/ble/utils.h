@@ -14,6 +14,7 @@
 
 #include "UUID.h"
 #include "att.h"
+#include "beetle.h"
 
 const int ATT_ERROR_PDU_LEN = 5;
 inline void pack_error_pdu(uint8_t opCode, uint16_t handle, uint8_t errCode, uint8_t *buf) {
@@ -109,6 +110,7 @@ inline bool is_att_response(uint8_t opcode) {
 	case ATT_OP_WRITE_RESP:
 	case ATT_OP_PREP_WRITE_RESP:
 	case ATT_OP_EXEC_WRITE_RESP:
+	case BEETLE_OP_READ_TABLE_RESP:
 		return true;
 	default:
 		return false;
@@ -128,6 +130,7 @@ inline bool is_att_request(uint8_t opcode) {
 	case ATT_OP_WRITE_REQ:
 	case ATT_OP_PREP_WRITE_REQ:
 	case ATT_OP_EXEC_WRITE_REQ:
+	case BEETLE_OP_READ_TABLE_REQ:
 		return true;
 	default:
 		return false;
@@ -11,22 +11,31 @@
 #include <boost/thread/pthread/shared_mutex.hpp>
 #include <cstdint>
 #include <ctime>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <queue>
 #include <set>
+#include <sstream>
 #include <string>
 #include <mutex>
+#include <vector>
+#include <unordered_map>
 #include <utility>
 
 #include "ble/gatt.h"
 #include "BeetleTypes.h"
 #include "Debug.h"
+#include "Metrics.h"
 #include "UUID.h"
 #include "controller/access/Rule.h"
+#include "controller/ControllerResponse.h"
+#include "sync/ThreadPool.h"
 
 /* Forward declarations */
+class BeetleConfig;
 class ControllerClient;
 
 /*
@@ -44,19 +53,37 @@ typedef struct {
 	 * Mapping of service uuids to maps of char uuids to sets of relevant rules.
 	 * Uuids are stored in uppercase.
 	 */
-	std::map<UUID, std::map<UUID, rule_info_set>> service_char_rules;
+	std::unordered_map<UUID, std::unordered_map<UUID, rule_info_set>> service_char_rules;
 } cached_mapping_info_t;
 
+/*
+ * Cached result of a canMap query. Denials are cached too, for a shorter time.
+ */
+typedef struct {
+	bool allowed;
+	time_t expire;
+} map_decision_t;
+
+typedef std::function<void(bool allowed)> CanMapCallback;
+
 class AccessControl {
 public:
-	AccessControl(Beetle &beetle, std::shared_ptr<ControllerClient> client);
+	AccessControl(Beetle &beetle, std::shared_ptr<ControllerClient> client, const BeetleConfig &config);
 	virtual ~AccessControl();
 
 	/*
-	 * Caller should hold at least a read lock on devices.
+	 * Returns whether from may be mapped to to. Blocks on the controller if
+	 * the decision is not cached. Caller should not hold the devices lock.
 	 */
 	bool canMap(std::shared_ptr<Device> from, std::shared_ptr<Device> to);
 
+	/*
+	 * Same as canMap, but does not block on the controller. The callback runs
+	 * in the calling thread if the decision is cached, and otherwise in an
+	 * access control worker.
+	 */
+	void canMapAsync(std::shared_ptr<Device> from, std::shared_ptr<Device> to, CanMapCallback cb);
+
 	/*
 	 * Return: whether access is permitted, and the error code if not
 	 *
@@ -81,6 +108,13 @@ public:
 	bool canReadType(std::shared_ptr<Device> client, std::shared_ptr<Device> server,
 			UUID &attType);
 
+	/*
+	 * Get handler to drop stale decisions and prefetch decisions for pairs
+	 * involving the device. Should run after the controller has been told of
+	 * the device's services.
+	 */
+	UpdateDeviceHandler getUpdateDeviceHandler();
+
 	/*
 	 * Get handler to clear irrelevant cached rules.
 	 */
@@ -93,14 +127,62 @@ private:
 	std::map<std::pair<device_t, device_t>, cached_mapping_info_t> cache;
 	boost::shared_mutex cacheMutex;
 
+	/*
+	 * Controller identifiers of a pair.
+	 */
+	typedef struct {
+		std::shared_ptr<Device> from;
+		std::shared_ptr<Device> to;
+		std::string fromGateway;
+		device_t fromId;
+		std::string toGateway;
+		device_t toId;
+	} map_query_t;
+
+	/*
+	 * Returns whether the pair needs a controller decision. If not, result is set.
+	 */
+	bool resolveQuery(std::shared_ptr<Device> from, std::shared_ptr<Device> to, map_query_t &query,
+			bool &result);
+
+	/*
+	 * Decisions and in flight queries, keyed by (from, to).
+	 */
+	std::map<std::pair<device_t, device_t>, map_decision_t> decisions;
+	std::map<std::pair<device_t, device_t>, std::shared_future<bool>> pending;
+	std::mutex decisionsMutex;
+	cache_metrics_t *decisionCache;
+
+	int allowTtl;
+	int denyTtl;
+	bool prefetchEnabled;
+	int batchSize;
+
+	bool lookupDecision(std::pair<device_t, device_t> key, bool &allowed);
+	void storeDecision(std::pair<device_t, device_t> key, bool allowed, int ttl);
+	bool queryDecision(const map_query_t &query);
+	void prefetch(std::vector<map_query_t> queries);
+
+	/*
+	 * Returns whether the mapping is allowed and sets the time to cache the
+	 * decision, which is 0 if it should not be cached. When prefetching,
+	 * rules with side effects (leases, prompts) are not evaluated and
+	 * deferred is set instead.
+	 */
 	bool handleCanMapResponse(std::shared_ptr<Device> from, std::shared_ptr<Device> to,
-			std::stringstream &response);
+			const can_map_response_t &response, int &ttl, bool prefetching, bool &deferred);
 
 	std::map<device_t, std::map<exclusive_lease_t, time_t>> leases;
 	std::mutex leasesMutex;
 	bool acquireExclusiveLease(std::shared_ptr<Device> to, exclusive_lease_t id,
 			bool &newlyAcquired);
 	void releaseExclusiveLease(std::shared_ptr<Device> to, exclusive_lease_t id);
+
+	/*
+	 * Threads that block on the controller. Declared last, so that it is
+	 * joined before the state it uses is destroyed.
+	 */
+	ThreadPool fetchers;
 };
 
 #endif /* CONTROLLER_ACCESSCONTROL_H_ */
@@ -8,14 +8,17 @@
 #ifndef CONTROLLER_CONTROLLERCLIENT_H_
 #define CONTROLLER_CONTROLLERCLIENT_H_
 
-#define BOOST_NETWORK_ENABLE_HTTPS
-
-#include <boost/network/protocol/http/client.hpp>
 #include <exception>
+#include <functional>
+#include <map>
 #include <string>
 #include <memory>
 
 #include "BeetleTypes.h"
+#include "controller/HttpConnectionPool.h"
+
+/* Forward declarations */
+class BeetleConfig;
 
 class ControllerException : public std::exception {
   public:
@@ -29,11 +32,9 @@ class ControllerException : public std::exception {
 
 class ControllerClient {
 public:
-	ControllerClient(Beetle &beetle, std::string host, int apiPort, int ctrlPort,
-			bool verifyPeers, std::string clientCert, std::string clientKey, std::string caCert);
+	ControllerClient(Beetle &beetle, const BeetleConfig &config, bool verifyPeers);
 	virtual ~ControllerClient();
 	std::string getApiUrl(std::string resource);
-	std::shared_ptr<boost::network::http::client> getClient();
 	std::string getName();
 	std::string getHost();
 	int getApiPort();
@@ -41,6 +42,31 @@ public:
 	std::string getSessionToken();
 	void setSessionToken(std::string token);
 
+	/*
+	 * Requests to the controller's api, where resource is relative to the api
+	 * root. The session token is attached once it is set. These block until
+	 * the response and throw ControllerException if there is none.
+	 */
+	http_response_t get(std::string resource);
+	http_response_t post(std::string resource, std::string body = "", std::string contentType = "");
+	http_response_t put(std::string resource, std::string body = "", std::string contentType = "");
+	http_response_t del(std::string resource);
+
+	/*
+	 * Non-blocking request. The handler runs on the client's thread and must
+	 * not block.
+	 */
+	void request(std::string method, std::string resource, std::string body, std::string contentType,
+			HttpResponseHandler handler);
+
+	std::map<std::string, http_endpoint_stats_t> getEndpointStats();
+	http_pool_stats_t getPoolStats();
+
+	/*
+	 * Return a daemon that logs request statistics.
+	 */
+	std::function<void()> getDaemon();
+
 	static const std::string SESSION_HEADER;
 private:
 	Beetle &beetle;
@@ -48,7 +74,11 @@ private:
 	int apiPort;
 	int ctrlPort;
 	std::string sessionToken;
-	std::shared_ptr<boost::network::http::client> client;
+	std::unique_ptr<HttpConnectionPool> pool;
+
+	http_headers_t getHeaders(std::string contentType);
+	http_response_t blockingRequest(std::string method, std::string resource, std::string body,
+			std::string contentType);
 };
 
 #endif /* CONTROLLER_CONTROLLERCLIENT_H_ */
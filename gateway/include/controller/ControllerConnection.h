@@ -9,18 +9,30 @@
 #define CONTROLLER_CONTROLLERCONNECTION_H_
 
 #include <boost/asio/ip/tcp.hpp>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include "BeetleTypes.h"
+#include "sync/OrderedThreadPool.h"
 
 class ControllerClient;
 
+/*
+ * Reads commands from the controller's control port. Commands run
+ * concurrently on up to numWorkers threads, in the order received for
+ * each target device, and each is acknowledged with a line
+ *
+ *   ok <command>
+ *   error <command> : <reason>
+ */
 class ControllerConnection {
 public:
-	ControllerConnection(Beetle &beetle, std::shared_ptr<ControllerClient> client, int maxReconnectionAttempts);
+	ControllerConnection(Beetle &beetle, std::shared_ptr<ControllerClient> client, int maxReconnectionAttempts,
+			int numWorkers = 8);
 	virtual ~ControllerConnection();
 
 	/*
@@ -35,11 +47,33 @@ private:
 
 	int maxReconnectionAttempts;
 
+	/*
+	 * Read by the daemon only. Acknowledgements are written to the socket
+	 * under streamMutex.
+	 */
 	std::unique_ptr<boost::asio::ip::tcp::iostream> stream;
+	std::mutex streamMutex;
 
 	bool getCommand(std::vector<std::string> &ret);
 	bool reconnect();
+	void acknowledge(const std::vector<std::string> &cmd, bool success, std::string err);
 
+	/*
+	 * Serializes connecting to each remote device, so that concurrent
+	 * commands share one proxy. Entries exist while commands use them.
+	 */
+	std::map<std::string, std::shared_ptr<std::mutex>> remoteMutexes;
+	std::mutex remoteMutexesMutex;
+	device_t findRemoteProxy(std::string gateway, device_t remote);
+
+	/*
+	 * Commands by target device. Declared after what they use.
+	 */
+	OrderedThreadPool commands;
+
+	/*
+	 * Throw on failure.
+	 */
 	void doMapLocal(const std::vector<std::string>& cmd);
 	void doUnmapLocal(const std::vector<std::string>& cmd);
 	void doMapRemote(const std::vector<std::string>& cmd);
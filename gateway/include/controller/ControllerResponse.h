@@ -0,0 +1,85 @@
+/*
+ * ControllerResponse.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef CONTROLLER_CONTROLLERRESPONSE_H_
+#define CONTROLLER_CONTROLLERRESPONSE_H_
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BeetleTypes.h"
+#include "controller/access/Rule.h"
+#include "controller/JsonReader.h"
+#include "UUID.h"
+
+typedef struct {
+	std::string name;
+	device_t id;
+	std::string gateway;
+	std::string ip;
+	int port;
+	bool isLocal;
+} discovery_result_t;
+
+/*
+ * Additional auth of a rule, as sent by the controller.
+ */
+typedef struct {
+	std::string type;
+	int when;
+	std::string ip;			// network only
+	bool isPrivate;			// network only
+} dauth_spec_t;
+
+typedef struct {
+	rule_t id;
+	Rule rule;				// additionalAuth is left empty
+	std::vector<dauth_spec_t> dauth;
+} rule_spec_t;
+
+typedef struct {
+	UUID charUuid;
+	std::vector<rule_t> ruleIds;
+} char_rules_spec_t;
+
+/*
+ * Response to access/canMap.
+ */
+typedef struct {
+	bool result = false;
+	bool hasTtl = false;
+	int ttl = 0;
+	std::vector<rule_spec_t> rules;
+	std::vector<std::pair<UUID, std::vector<char_rules_spec_t>>> services;
+} can_map_response_t;
+
+/*
+ * Parse controller responses without building a json tree. Throw
+ * JsonReaderException if the response is malformed.
+ */
+void parseCanMapResponse(const std::string &body, can_map_response_t &ret);
+void parseCanMapResponse(JsonReader &reader, can_map_response_t &ret);
+
+/*
+ * Response to access/canMap/batch, in the order of the request.
+ */
+void parseCanMapBatchResponse(const std::string &body, std::vector<can_map_response_t> &ret);
+
+/*
+ * Response to network/discover. isLocal is set to false, for the caller to
+ * correct against the gateway name.
+ */
+void parseDiscoveryResponse(const std::string &body, std::list<discovery_result_t> &ret);
+
+/*
+ * Response to network/find/gateway.
+ */
+void parseGatewayResponse(const std::string &body, std::string &ip, int &port);
+
+#endif /* CONTROLLER_CONTROLLERRESPONSE_H_ */
@@ -0,0 +1,164 @@
+/*
+ * HttpConnectionPool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef CONTROLLER_HTTPCONNECTIONPOOL_H_
+#define CONTROLLER_HTTPCONNECTIONPOOL_H_
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/system/error_code.hpp>
+#include <openssl/ssl.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Forward declarations */
+class Counter;
+class Histogram;
+class MetricsRegistry;
+
+typedef std::vector<std::pair<std::string, std::string>> http_headers_t;
+
+typedef struct {
+	int status;
+	/*
+	 * Header names are lowercase.
+	 */
+	std::map<std::string, std::string> headers;
+	std::string body;
+} http_response_t;
+
+/*
+ * Runs on the pool's thread, so it must not block or make blocking requests.
+ */
+typedef std::function<void(const boost::system::error_code &ec, const http_response_t &response)> HttpResponseHandler;
+
+/*
+ * Latency includes time spent queued for a connection.
+ */
+typedef struct {
+	uint64_t requests;
+	uint64_t errors;
+	uint64_t totalMicros;
+	uint64_t maxMicros;
+} http_endpoint_stats_t;
+
+typedef struct {
+	uint64_t connections;	// connections opened
+	uint64_t resumed;		// handshakes that resumed a tls session
+	uint64_t reused;		// requests sent on a connection that was already used
+	uint64_t pipelined;		// requests sent behind another outstanding request
+	uint64_t retried;
+} http_pool_stats_t;
+
+/*
+ * Keep-alive HTTPS client for a single server. Requests are spread over at
+ * most maxConnections connections. Idempotent requests may be pipelined up
+ * to pipelineDepth deep once every connection is in use.
+ *
+ * All connection state is owned by a single thread running the io_service.
+ *
+ * Latencies are also recorded by endpoint in metrics, if given.
+ */
+class HttpConnectionPool {
+public:
+	HttpConnectionPool(std::string host, int port, bool verifyPeers, std::string clientCert,
+			std::string clientKey, std::string caCert, int maxConnections, int pipelineDepth,
+			int timeout, int idleTimeout, MetricsRegistry *metrics = NULL);
+	virtual ~HttpConnectionPool();
+
+	/*
+	 * Queue a request. Target is the path, starting with '/'.
+	 */
+	void asyncRequest(std::string method, std::string target, const http_headers_t &headers,
+			std::string body, HttpResponseHandler handler);
+
+	/*
+	 * Blocking variant of asyncRequest. Throws boost::system::system_error if
+	 * no response is received. Must not be called from a response handler.
+	 */
+	http_response_t request(std::string method, std::string target, const http_headers_t &headers,
+			std::string body);
+
+	std::map<std::string, http_endpoint_stats_t> getEndpointStats();
+	http_pool_stats_t getPoolStats();
+
+private:
+	class Connection;
+	friend class Connection;
+
+	typedef struct {
+		std::string method;
+		std::string endpoint;
+		std::shared_ptr<std::string> data;
+		HttpResponseHandler handler;
+		std::chrono::steady_clock::time_point queued;
+		int attempts;
+	} request_t;
+
+	std::string host;
+	int port;
+	int maxConnections;
+	int pipelineDepth;
+	int timeout;
+	int idleTimeout;
+
+	boost::asio::io_service io;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	boost::asio::ssl::context ctx;
+	boost::asio::ip::tcp::resolver resolver;
+
+	/*
+	 * Everything below is only touched on the io thread, except for stats.
+	 */
+	std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+	bool resolving;
+	bool stopping;
+	int connectFailures;
+	SSL_SESSION *session;
+	bool pipelining;
+
+	std::deque<std::shared_ptr<request_t>> queue;
+	std::list<std::shared_ptr<Connection>> connections;
+
+	void dispatch();
+	void resolve();
+	void retry(std::shared_ptr<request_t> r, const boost::system::error_code &ec, bool sent);
+
+	/*
+	 * Called when a connection fails to open. Returns true if the queued
+	 * requests should fail, once connections have failed MAX_CONNECT_FAILURES
+	 * times in a row with none open.
+	 */
+	bool connectFailed();
+	void complete(std::shared_ptr<request_t> r, const boost::system::error_code &ec,
+			const http_response_t &response);
+	void removeConnection(Connection *c);
+	void saveSession(SSL *ssl);
+	void shutdown();
+
+	std::map<std::string, http_endpoint_stats_t> endpointStats;
+	http_pool_stats_t poolStats;
+	std::mutex statsMutex;
+
+	MetricsRegistry *metrics;
+	std::map<std::string, std::pair<Histogram *, Counter *>> endpointMetrics;
+
+	std::thread thread;
+};
+
+#endif /* CONTROLLER_HTTPCONNECTIONPOOL_H_ */
@@ -0,0 +1,99 @@
+/*
+ * JsonReader.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef CONTROLLER_JSONREADER_H_
+#define CONTROLLER_JSONREADER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+
+class JsonReaderException : public std::exception {
+  public:
+	JsonReaderException(std::string msg) : msg(msg) {};
+	JsonReaderException(const char *msg) : msg(msg) {};
+    ~JsonReaderException() throw() {};
+    const char *what() const throw() { return this->msg.c_str(); };
+  private:
+    std::string msg;
+};
+
+/*
+ * Pull parser over a json document. Values are read in document order
+ * straight into the caller's structures, without building a tree.
+ *
+ * The document must outlive the reader. Throws JsonReaderException on
+ * malformed input or a value of the wrong type.
+ */
+class JsonReader {
+public:
+	JsonReader(const std::string &doc);
+	virtual ~JsonReader();
+
+	enum Type {
+		OBJECT, ARRAY, STRING, NUMBER, BOOLEAN, NUL,
+	};
+
+	/*
+	 * Type of the next value.
+	 */
+	Type peek();
+
+	/*
+	 * Iterate over an object:
+	 *   reader.beginObject();
+	 *   while (reader.nextKey(key)) { read or skip the value }
+	 */
+	void beginObject();
+	bool nextKey(std::string &key);
+
+	/*
+	 * Iterate over an array:
+	 *   reader.beginArray();
+	 *   while (reader.nextElement()) { read or skip the value }
+	 */
+	void beginArray();
+	bool nextElement();
+
+	void readString(std::string &s);
+	std::string readString();
+	int64_t readInt();
+	double readDouble();
+	bool readBool();
+	void readNull();
+
+	/*
+	 * Skip the next value, including everything nested in it.
+	 */
+	void skipValue();
+
+	/*
+	 * Check that nothing but whitespace remains.
+	 */
+	void end();
+
+private:
+	const char *first;
+	const char *pos;
+	const char *last;
+
+	/*
+	 * Whether a value was just completed in the enclosing container.
+	 */
+	bool needComma;
+
+	void skipWhitespace();
+	void expect(char c);
+	void expectLiteral(const char *literal);
+	void readNumber(const char *&start, bool &isInteger);
+	void appendCodePoint(std::string &s, uint32_t cp);
+	uint32_t readHex4();
+	[[noreturn]] void error(std::string msg);
+};
+
+#endif /* CONTROLLER_JSONREADER_H_ */
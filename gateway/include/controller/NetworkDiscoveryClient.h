@@ -10,27 +10,32 @@
 
 #include <string>
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <ctime>
 
 #include "BeetleTypes.h"
+#include "controller/ControllerResponse.h"
 #include "UUID.h"
 #include <Beetle.h>
 #include <functional>
 
 /* Forward declarations */
+class BeetleConfig;
 class ControllerClient;
 
-typedef struct {
-	std::string name;
-	device_t id;
-	std::string gateway;
-	std::string ip;
-	int port;
-} discovery_result_t;
+/*
+ * Called once with local results, and again with remote results from the
+ * controller. Success is false if the controller could not be queried.
+ */
+typedef std::function<void(const std::list<discovery_result_t> &results, bool remote, bool success)> NetworkDiscoveryHandler;
 
 class NetworkDiscoveryClient {
 public:
-	NetworkDiscoveryClient(Beetle &beetle, std::shared_ptr<ControllerClient> client);
+	NetworkDiscoveryClient(Beetle &beetle, std::shared_ptr<ControllerClient> client, const BeetleConfig &config);
 	virtual ~NetworkDiscoveryClient();
 
 	/*
@@ -38,6 +43,13 @@ public:
 	 */
 	bool discoverByUuid(UUID uuid, std::list<discovery_result_t> &ret, bool isService = true, device_t d = -1);
 
+	/*
+	 * Same as above, but answers with local devices right away. Local devices
+	 * are only answered from the index when d is -1; on behalf of a device,
+	 * the controller answers for them.
+	 */
+	void discoverByUuidAsync(UUID uuid, NetworkDiscoveryHandler handler, bool isService = true, device_t d = -1);
+
 	/*
 	 * Look for devices in the network.
 	 */
@@ -49,16 +61,51 @@ public:
 	bool findGatewayByName(std::string name, std::string &ip, int &port);
 
 	/*
-	 * Register interest in the uuid.
+	 * Register interest in the uuid. Does not block, and only the first
+	 * registration for each device and uuid is sent.
+	 */
+	void registerInterestInUuid(device_t id, UUID uuid, bool isService = true);
+
+	/*
+	 * Drop cached discovery results. Called when the controller reports that
+	 * the network has changed.
+	 */
+	void invalidateCache();
+
+	/*
+	 * Forgets the interests registered by the device.
 	 */
-	void registerInterestInUuid(device_t id, UUID uuid, bool isService = true, std::function<void()> cb = NULL);
+	RemoveDeviceHandler getRemoveDeviceHandler();
 
 private:
 	Beetle &beetle;
 
 	std::shared_ptr<ControllerClient> client;
 
+	int cacheTtl;
+
+	typedef struct {
+		time_t expire;
+		std::list<discovery_result_t> results;
+	} cached_result_t;
+
+	std::map<std::string, cached_result_t> cache;
+	std::mutex cacheMutex;
+
+	/*
+	 * (isService, uuid) registered or being registered, by device. The uuids
+	 * come from clients, so they are not interned.
+	 */
+	std::map<device_t, std::set<std::pair<bool, UUID>>> interests;
+	std::mutex interestsMutex;
+
 	bool queryHelper(std::string resource, std::list<discovery_result_t> &ret);
+	void queryHelperAsync(std::string resource, std::function<void(bool, const std::list<discovery_result_t> &)> cb);
+	bool lookupCache(std::string resource, std::list<discovery_result_t> &ret);
+	void parseResults(std::string body, std::string resource, std::list<discovery_result_t> &ret);
+
+	std::list<discovery_result_t> findLocal(UUID uuid, bool isService, device_t d);
+	std::string getRemoteResource(UUID uuid, bool isService, device_t d);
 };
 
 #endif /* CONTROLLER_NETWORKDISCOVERYCLIENT_H_ */
@@ -8,19 +8,30 @@
 #ifndef INCLUDE_CONTROLLER_NETWORKREPORTER_H_
 #define INCLUDE_CONTROLLER_NETWORKREPORTER_H_
 
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
 
 #include "BeetleTypes.h"
 
 /* Forward declarations */
+class BeetleConfig;
 class ControllerClient;
 
 /*
  * Reports devices connected and disconnected.
+ *
+ * Events are coalesced per device and per mapping, and sent to the controller
+ * in batches by a reporter thread, which retries with backoff on failure.
  */
 class NetworkStateClient {
 public:
-	NetworkStateClient(Beetle &beetle, std::shared_ptr<ControllerClient> client, int tcpPort);
+	NetworkStateClient(Beetle &beetle, std::shared_ptr<ControllerClient> client, const BeetleConfig &config);
 	virtual ~NetworkStateClient();
 
 	AddDeviceHandler getAddDeviceHandler();
@@ -30,17 +41,65 @@ public:
 	MapDevicesHandler getMapDevicesHandler();
 	UnmapDevicesHandler getUnmapDevicesHandler();
 
+	/*
+	 * Called on the reporter thread once the controller has acknowledged the
+	 * services of a device.
+	 */
+	void setDeviceReportedHandler(UpdateDeviceHandler handler);
+
 private:
+	typedef enum {
+		REPORT_UPSERT, REPORT_REMOVE,
+	} device_op_t;
+
+	/*
+	 * (fromGateway, fromId, toGateway, toId)
+	 */
+	typedef std::tuple<std::string, device_t, std::string, device_t> mapping_key_t;
+
+	typedef std::map<device_t, device_op_t> device_ops_t;
+	typedef std::map<mapping_key_t, bool> mapping_ops_t;	// true for map, false for unmap
+
 	Beetle &beetle;
 
 	std::shared_ptr<ControllerClient> client;
 
-	void addDeviceHelper(std::shared_ptr<Device> device);
-	void updateDeviceHelper(std::shared_ptr<Device> device);
-	void removeDeviceHelper(device_t d);
+	int reportDelay;
+	int reportMaxBackoff;
+
+	UpdateDeviceHandler reportedHandler;
+
+	/*
+	 * Everything below is protected by pendingMutex.
+	 */
+	device_ops_t pendingDevices;
+	mapping_ops_t pendingMappings;
+
+	/*
+	 * Services last acknowledged by the controller. Only written by the reporter thread.
+	 */
+	std::map<device_t, std::string> reported;
+
+	/*
+	 * Upserts in the batch currently being sent.
+	 */
+	std::set<device_t> inflight;
+
+	bool stopping;
+	std::mutex pendingMutex;
+	std::condition_variable pendingCond;
+
+	void queueDevice(device_t d, device_op_t op);
+	void queueMapping(const mapping_key_t &key, bool mapped);
+	void requeue(const device_ops_t &devices, const mapping_ops_t &mappings);
+
+	void reportDaemon();
+	bool sendReport(const device_ops_t &devices, const mapping_ops_t &mappings);
 
 	bool lookupNamesAndIds(device_t from, device_t to, std::string &fromGateway, device_t &fromId,
 			std::string &toGateway, device_t &toId);
+
+	std::thread reporter;
 };
 
 #endif /* INCLUDE_CONTROLLER_NETWORKREPORTER_H_ */
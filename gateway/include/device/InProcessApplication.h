@@ -0,0 +1,74 @@
+/*
+ * InProcessApplication.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_DEVICE_INPROCESSAPPLICATION_H_
+#define INCLUDE_DEVICE_INPROCESSAPPLICATION_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "BeetleTypes.h"
+#include "Metrics.h"
+#include "device/VirtualDevice.h"
+#include "sync/Countdown.h"
+
+/*
+ * An application linked with libbeetle, in the same process as the gateway.
+ * PDUs to it are passed to its handler, and PDUs from it to send(), without
+ * a socket.
+ *
+ * It reports itself as IPC_APPLICATION, so that access control and the
+ * controller treat it as an application on the ipc socket.
+ */
+class InProcessApplication: public VirtualDevice {
+public:
+	/*
+	 * Called with each PDU to the application, on the gateway's threads.
+	 * The buffer is only valid for the call.
+	 */
+	typedef std::function<void(uint8_t *buf, int len)> PduHandler;
+
+	InProcessApplication(Beetle &beetle, std::string name, PduHandler handler);
+	virtual ~InProcessApplication();
+
+	/*
+	 * Add the application to beetle and discover its handles, which the
+	 * handler must answer. Throws DeviceException on failure.
+	 */
+	static std::shared_ptr<InProcessApplication> connect(Beetle &beetle, std::string name,
+			PduHandler handler);
+
+	/*
+	 * Send a PDU from the application. PDUs sent from within the handler are
+	 * routed after it returns, in order, since the handler may be called with
+	 * locks held.
+	 */
+	void send(uint8_t *buf, int len);
+
+	/*
+	 * Remove the application from beetle. The handler is not called after
+	 * this returns.
+	 */
+	void stop();
+protected:
+	bool write(uint8_t *buf, int len);
+	void startInternal();
+private:
+	PduHandler handler;
+	std::atomic_bool stopped;
+	std::recursive_mutex handlerMutex;
+
+	transport_metrics_t *traffic;
+
+	Countdown pendingSends;
+};
+
+#endif /* INCLUDE_DEVICE_INPROCESSAPPLICATION_H_ */
@@ -10,10 +10,15 @@
 
 #include <boost/shared_array.hpp>
 #include <stddef.h>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <mutex>
 #include <queue>
+#include <string>
+#include <utility>
 #include <vector>
 #include <memory>
 
@@ -21,6 +26,10 @@
 #include "Device.h"
 #include "UUID.h"
 
+/* Forward declarations */
+class Gauge;
+class Histogram;
+
 /*
  * Base class that implements GATT and asynchronous transactions.
  */
@@ -49,6 +58,21 @@ public:
 	 */
 	std::vector<uint64_t> getTransactionLatencies();
 
+	/*
+	 * Traffic observed since the previous call to getTrafficStats().
+	 */
+	typedef struct {
+		int queueDepth;				// transactions outstanding or queued
+		int transactions;			// transactions completed
+		uint64_t totalLatency;		// sum of transaction latencies in ms
+		int notifications;			// notifications and indications received
+	} traffic_stats_t;
+
+	/*
+	 * Get and reset the traffic counters.
+	 */
+	traffic_stats_t getTrafficStats();
+
 protected:
 	/*
 	 * Cannot instantiate a VirtualDevice
@@ -60,6 +84,12 @@ protected:
 	 */
 	void readHandler(uint8_t *buf, int len);
 
+	/*
+	 * Called by derived class with packets received together. Packets that
+	 * are forwarded are routed in one pass, unless tracing.
+	 */
+	void readHandler(std::vector<std::pair<uint8_t *, int>> &pdus);
+
 	/*
 	 * Called by base class to write packet.
 	 */
@@ -70,6 +100,18 @@ protected:
 	 */
 	virtual void startInternal() = 0;
 
+	/*
+	 * Largest MTU that this side can receive, sent in response to MTU requests.
+	 */
+	virtual int getMaxMTU();
+
+	/*
+	 * Identifies the handle table of a remote gateway's view, if it can be
+	 * read with BEETLE_OP_READ_TABLE_REQ instead of discovered. Tables are
+	 * cached under the key, and refreshed by version. Empty if unsupported.
+	 */
+	virtual std::string getHandleTableKey();
+
 private:
 	bool isEndpoint;
 
@@ -96,17 +138,38 @@ private:
 		int len;
 		time_t time;
 		std::function<void(uint8_t*, int)> cb;
+		uint64_t traceId;			// 0 if not traced
+		uint64_t traceTime;			// when queued, then when sent
 	} transaction_t;
 
 	void handleTransactionResponse(uint8_t *buf, int len);
+	void traceTransactionSent(transaction_t &t);
 	std::shared_ptr<transaction_t> currentTransaction;
 	std::queue<std::shared_ptr<transaction_t>> pendingTransactions;
 	std::vector<uint64_t> transactionLatencies;
 	std::mutex transactionMutex;
 
+	/*
+	 * Transaction metrics, protected by transactionMutex. Latency histograms
+	 * are registered by request opcode on first use.
+	 */
+	std::chrono::steady_clock::time_point transactionStart;
+	std::map<uint8_t, Histogram *> latencyHistograms;
+	Gauge *queueDepthGauge;
+	void updateQueueDepth();
+
+	/*
+	 * Traffic counters. Transaction counters are protected by transactionMutex.
+	 */
+	int completedTransactions;
+	uint64_t completedTransactionsLatency;
+	std::atomic<int> receivedNotifications;
+
 	/*
 	 * Helper methods
 	 */
+	void handlePdu(uint8_t *buf, int len);
+	bool writePdu(uint8_t *buf, int len);
 	void discoverNetworkServices(UUID serviceUuid);
 	void setupBeetleService(int handleAlloc);
 
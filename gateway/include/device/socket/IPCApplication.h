@@ -10,25 +10,79 @@
 
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <atomic>
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <list>
+#include <utility>
+#include <vector>
 
 #include "sync/Countdown.h"
 #include "device/socket/SeqPacketConnection.h"
 #include "device/socket/shared.h"
 
+class ShmRing;
+class ShmSlotPool;
+
+/*
+ * A local application. Applications may move from the socket to shared
+ * memory rings with BEETLE_OP_IPC_RING_REQ, if ringCapacity is not 0.
+ */
 class IPCApplication: public SeqPacketConnection {
 public:
 	IPCApplication(Beetle &beetle, int sockfd, std::string name,
-			struct sockaddr_un sockaddr, struct ucred ucred_);
+			struct sockaddr_un sockaddr, struct ucred ucred_,
+			uint32_t ringCapacity = 0, uint16_t ringSlots = 0);
 	virtual ~IPCApplication();
 
 	struct sockaddr_un getSockaddr();
 	struct ucred getUcred();
+
+	/*
+	 * Whether the application moved to rings.
+	 */
+	bool isRingActive();
+protected:
+	bool write(uint8_t *buf, int len);
+	void socketReadHandler(std::vector<std::pair<uint8_t *, int>> &pdus);
 private:
 	struct sockaddr_un sockaddr;
 	struct ucred ucred;
+
+	uint32_t ringCapacity;
+	uint16_t ringSlots;
+
+	/*
+	 * Set once, with ringMutex held. The producer side of toApp, and
+	 * slotRefs, are protected by ringMutex. fromApp is only used by the
+	 * reader of fromAppEventFd.
+	 */
+	int ringFd;
+	std::shared_ptr<ShmSlotPool> slots;
+	void *ringRegion;
+	size_t ringRegionLen;
+	int toAppEventFd;
+	int fromAppEventFd;
+	std::unique_ptr<ShmRing> toApp;
+	std::unique_ptr<ShmRing> fromApp;
+	std::mutex ringMutex;
+	std::atomic_bool ringStopped;
+
+	/*
+	 * Slots referred to by toApp, with the position after each reference.
+	 */
+	std::deque<std::pair<uint32_t, int>> slotRefs;
+	void releaseSlots(bool all);
+
+	uint64_t droppedPdus;
+	transport_metrics_t *ringTraffic;
+
+	void setupRing(uint8_t *buf, int len);
+	bool writeRing(uint8_t *buf, int len);
+	void readRing();
 };
 
 #endif /* INCLUDE_DEVICE_SOCKET_IPCAPPLICATION_H_ */
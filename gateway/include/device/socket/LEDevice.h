@@ -32,6 +32,7 @@ public:
 	struct l2cap_conninfo getL2capConnInfo();
 
 	bool setConnectionInterval(uint16_t interval);
+	bool setConnectionInterval(uint16_t minInterval, uint16_t maxInterval, uint16_t latency);
 
 	static LEDevice *newPeripheral(Beetle &beetle, HCI &hci, bdaddr_t addr,
 			AddrType addrType);
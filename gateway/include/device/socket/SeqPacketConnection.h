@@ -8,34 +8,93 @@
 #ifndef DEVICE_SOCKET_SEQPACKETCONNECTION_H_
 #define DEVICE_SOCKET_SEQPACKETCONNECTION_H_
 
+#include <sys/socket.h>
 #include <atomic>
 #include <cstdint>
 #include <list>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "BeetleTypes.h"
 #include "device/socket/shared.h"
 #include "device/VirtualDevice.h"
 #include "device/socket/shared.h"
+#include "Metrics.h"
 #include "sync/Countdown.h"
 
 class SeqPacketConnection: public VirtualDevice {
 public:
 	virtual ~SeqPacketConnection();
 
+	/*
+	 * Packets read with one recvmmsg, and written with one sendmmsg.
+	 */
+	static constexpr int MAX_READ_BATCH = 16;
+	static constexpr int MAX_WRITE_BATCH = 64;
+
+	/*
+	 * Packets read before yielding the reader.
+	 */
+	static constexpr int MAX_READS_PER_WAKEUP = 64;
+
+	static constexpr int MAX_PACKET_LEN = 256;
 protected:
+	/*
+	 * Traffic is counted under the transport name.
+	 */
 	SeqPacketConnection(Beetle &beetle, int sockfd, bool isEndpoint,
-			std::list<delayed_packet_t> delayedPackets);
+			std::list<delayed_packet_t> delayedPackets, std::string transport);
 
 	bool write(uint8_t *buf, int len);
 	void startInternal();
+
+	/*
+	 * Called with the packets read from the socket in one wakeup.
+	 */
+	virtual void socketReadHandler(std::vector<std::pair<uint8_t *, int>> &pdus);
+
+	/*
+	 * Write a packet with copies of fds attached, in order with write().
+	 */
+	bool writeWithFds(uint8_t *buf, int len, std::vector<int> fds);
+
+	void stopInternal();
 private:
 	int sockfd;
 
 	std::atomic_bool stopped;
-	void stopInternal();
 
 	std::list<delayed_packet_t> delayedPackets;
 
+	transport_metrics_t *traffic;
+
+	/*
+	 * Only used by the reader.
+	 */
+	std::vector<uint8_t> readBuffers;
+	struct mmsghdr readMsgs[MAX_READ_BATCH];
+	struct iovec readIovs[MAX_READ_BATCH];
+	void readPackets();
+
+	/*
+	 * Packets waiting to be written. A single flush is scheduled at a time,
+	 * and writes everything queued. Written packets are kept for reuse.
+	 */
+	struct queued_packet {
+		std::vector<uint8_t> buf;
+		std::vector<int> fds;
+		uint64_t traceId;			// 0 if not traced
+		uint64_t traceTime;
+	};
+	std::vector<queued_packet> writeQueue;
+	std::vector<queued_packet> sparePackets;
+	bool flushScheduled;
+	std::mutex writeMutex;
+	bool enqueue(uint8_t *buf, int len, std::vector<int> &fds);
+	void flush();
+
 	Countdown pendingWrites;
 };
 
@@ -11,13 +11,20 @@
 
 #include <cstdint>
 #include <netinet/in.h>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <list>
+#include <memory>
+#include <vector>
 #include <openssl/ossl_typ.h>
 
+#include "Metrics.h"
 #include "sync/Countdown.h"
 #include "device/VirtualDevice.h"
+#include "tcp/TCPFraming.h"
+
+class GatewaySession;
 
 /*
  * Remote "device" connected using TCP.
@@ -28,6 +35,18 @@ public:
 
 	struct sockaddr_in getSockaddr();
 
+	/*
+	 * Framing negotiated with TCP_PARAM_FRAMING. Must be set before start().
+	 */
+	void setFramingVersion(int version);
+	int getFramingVersion();
+
+	/*
+	 * Returns the session carrying this connection, or NULL if it has its own
+	 * socket.
+	 */
+	std::shared_ptr<GatewaySession> getSession();
+
 protected:
 	/*
 	 * Cannot directly instantiate a TCPConnection
@@ -35,23 +54,57 @@ protected:
 	TCPConnection(Beetle &beetle, SSL *ssl, int sockfd, struct sockaddr_in sockaddr,
 			bool isEndpoint, HandleAllocationTable *hat = NULL);
 
+	/*
+	 * Connection over an open channel of a GatewaySession.
+	 */
+	TCPConnection(Beetle &beetle, std::shared_ptr<GatewaySession> session, uint32_t channel,
+			struct sockaddr_in sockaddr, bool isEndpoint, HandleAllocationTable *hat = NULL);
+
 	bool write(uint8_t *buf, int len);
 	void startInternal();
+	int getMaxMTU();
 private:
 	SSL *ssl;
 	int sockfd;
 
 	struct sockaddr_in sockaddr;
 
+	int framing;
+
+	std::shared_ptr<GatewaySession> session;
+	uint32_t channel;
+
 	std::atomic_bool stopped;
 	void stopInternal();
 
+	/*
+	 * Counted here only when the connection has its own socket.
+	 */
+	transport_metrics_t *traffic;
+
+	/*
+	 * Read what is available without blocking, and handle every complete
+	 * frame. Only called by the reader.
+	 */
+	void readAvailable();
+	TCPFrameDecoder decoder;
+
+	/*
+	 * PDUs waiting to be written. A single flush is scheduled at a time, and
+	 * writes everything queued in one SSL_write.
+	 */
+	std::vector<std::vector<uint8_t>> writeQueue;
+	std::vector<std::pair<uint64_t, uint64_t>> tracedWrites;	// trace id, time queued
+	bool flushScheduled;
+	std::mutex writeMutex;
+	void flush();
+
 	Countdown pendingWrites;
 
 	/*
-	 * Maximum number of seconds to wait for payload.
+	 * Most reads per wakeup, so that one busy peer does not hold a reader.
 	 */
-	static constexpr double TIMEOUT_PAYLOAD = 10;
+	static constexpr int MAX_READS_PER_WAKEUP = 16;
 };
 
 #endif /* TCPCONNECTION_H_ */
@@ -8,11 +8,13 @@
 #ifndef INCLUDE_DEVICE_SOCKET_TCP_TCPCLIENTPROXY_H_
 #define INCLUDE_DEVICE_SOCKET_TCP_TCPCLIENTPROXY_H_
 
+#include <memory>
 #include <string>
 #include <openssl/ossl_typ.h>
 
 #include "device/socket/TCPConnection.h"
 
+class GatewaySession;
 
 /*
  * Dummy device representing a client at a different Beetle gateway.
@@ -21,6 +23,8 @@ class TCPClientProxy: public TCPConnection {
 public:
 	TCPClientProxy(Beetle &beetle, SSL *ssl, int sockfd, std::string clientGateway,
 			struct sockaddr_in clientGatewaySockAddr, device_t localProxyFor);
+	TCPClientProxy(Beetle &beetle, std::shared_ptr<GatewaySession> session, uint32_t channel,
+			device_t localProxyFor);
 	virtual ~TCPClientProxy();
 
 	/*
@@ -36,6 +40,8 @@ public:
 private:
 	device_t localProxyFor;
 	std::string clientGateway;
+
+	void init(std::string clientGateway, device_t localProxyFor);
 };
 
 #endif /* INCLUDE_DEVICE_SOCKET_TCP_TCPCLIENTPROXY_H_ */
@@ -8,13 +8,19 @@
 #ifndef BLE_REMOTESERVERPROXY_H_
 #define BLE_REMOTESERVERPROXY_H_
 
+#include <condition_variable>
 #include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <openssl/ossl_typ.h>
 
 #include "BeetleTypes.h"
 #include "device/socket/TCPConnection.h"
 
+class GatewaySession;
 class SSLConfig;
 
 /*
@@ -24,6 +30,8 @@ class TCPServerProxy: public TCPConnection {
 public:
 	TCPServerProxy(Beetle &beetle, SSL *ssl, int sockfd, std::string serverGateway,
 			struct sockaddr_in serverGatewaySockAddr, device_t remoteProxyTo);
+	TCPServerProxy(Beetle &beetle, std::shared_ptr<GatewaySession> session, uint32_t channel,
+			device_t remoteProxyTo);
 	virtual ~TCPServerProxy();
 
 	/*
@@ -44,12 +52,27 @@ public:
 	/* Time to timeout proxy after unuse */
 	static constexpr int PROXY_UNUSED_TIMEOUT = 60;
 
+	/* Time to connect and handshake with a gateway */
+	static constexpr int TIMEOUT_CONNECT = 10;
+
 	/*
-	 * Static methods for connection establishment.
+	 * Static methods for connection establishment. Proxies to the same
+	 * gateway share a GatewaySession, unless the gateway does not support
+	 * them.
 	 */
 	static void initSSL(SSLConfig *sslConfig);
 	static TCPServerProxy *connectRemote(Beetle &beetle, std::string server,
 			int port, device_t remoteProxyTo);
+
+	/*
+	 * Name of the gateway last reached at server and port, or empty.
+	 */
+	static std::string getGatewayName(std::string server, int port);
+protected:
+	/*
+	 * Tables are too large for v1 frames.
+	 */
+	std::string getHandleTableKey();
 private:
 	device_t remoteProxyTo;
 	std::string serverGateway;
@@ -57,6 +80,25 @@ private:
 	time_t createdAt;
 
 	static SSLConfig *sslConfig;
+
+	/*
+	 * Connect and exchange parameters. Sets session if the server replied
+	 * with one, and otherwise returns a proxy around the connection.
+	 */
+	static TCPServerProxy *connectNew(Beetle &beetle, std::string host, int port, std::string peer,
+			bool offerSession, device_t remoteProxyTo, std::shared_ptr<GatewaySession> &session);
+
+	/*
+	 * Sessions by host and port, hosts that replied without one, and the
+	 * gateway names of hosts, to resume TLS sessions. Callers wait on
+	 * sessionsCv while a host is in connectingHosts, to share its session.
+	 */
+	static std::map<std::string, std::weak_ptr<GatewaySession>> sessions;
+	static std::set<std::string> noSessionHosts;
+	static std::set<std::string> connectingHosts;
+	static std::map<std::string, std::string> gatewayNames;
+	static std::mutex sessionsMutex;
+	static std::condition_variable sessionsCv;
 };
 
 
@@ -65,6 +65,18 @@ public:
 	 */
 	virtual handle_range_t reserve(device_t device, int size = 0) = 0;
 
+	/*
+	 * Resize the range owned by the device to at least size, moving
+	 * it if necessary. Returns the new range or [0,0] on failure.
+	 */
+	virtual handle_range_t resize(device_t device, int size) {
+		handle_range_t range = getDeviceRange(device);
+		if (range.isNull() || range.end - range.start + 1 < size) {
+			return handle_range_t { 0, 0 };
+		}
+		return range;
+	}
+
 	/*
 	 * Release any handle ranges owned by the device.
 	 */
@@ -0,0 +1,69 @@
+/*
+ * IntervalAllocator.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_HAT_INTERVALALLOCATOR_H_
+#define INCLUDE_HAT_INTERVALALLOCATOR_H_
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+#include "BeetleTypes.h"
+#include "HandleAllocationTable.h"
+
+/*
+ * Implementation of the HAT interface that allocates variable sized
+ * ranges, sized to the number of handles a device actually has. The
+ * first range is reserved for Beetle.
+ *
+ * Ranges are kept sorted by start handle for lookups by handle, and
+ * hashed by device for lookups by device.
+ */
+class IntervalAllocator: public HandleAllocationTable {
+public:
+	IntervalAllocator(int reservedSize = DEFAULT_RESERVED_SIZE);
+	virtual ~IntervalAllocator();
+	std::set<device_t> getDevices();
+	handle_range_t getDeviceRange(device_t d);
+	device_t getDeviceForHandle(uint16_t h);
+	handle_range_t getHandleRange(uint16_t h);
+	handle_range_t reserve(device_t d, int n = 0);
+	handle_range_t resize(device_t d, int n);
+	handle_range_t free(device_t d);
+
+	/* Size of the range reserved for Beetle's own handles. */
+	static constexpr int DEFAULT_RESERVED_SIZE = 256;
+
+	/* Size reserved when the caller does not know how many handles it needs. */
+	static constexpr int DEFAULT_RANGE_SIZE = 256;
+
+	/* Ranges are rounded up to a multiple of this, leaving room to grow in place. */
+	static constexpr int RANGE_ALIGNMENT = 16;
+private:
+	/*
+	 * Start handle to range
+	 */
+	std::map<uint16_t, std::pair<uint16_t, device_t>> ranges;
+
+	/*
+	 * Device to range
+	 */
+	std::unordered_map<device_t, handle_range_t> deviceRanges;
+
+	/*
+	 * Returns the range containing the handle, or ranges.end().
+	 */
+	std::map<uint16_t, std::pair<uint16_t, device_t>>::iterator find(uint16_t h);
+
+	/*
+	 * First fit search for a free range of size n.
+	 */
+	handle_range_t findFree(int n);
+};
+
+#endif /* INCLUDE_HAT_INTERVALALLOCATOR_H_ */
@@ -0,0 +1,154 @@
+/*
+ * ShmRing.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_IPC_SHMRING_H_
+#define INCLUDE_IPC_SHMRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * Transport shared with a local application, set up with
+ * BEETLE_OP_IPC_RING_REQ. The memfd holds an ipc_ring_header_t, then the ring
+ * from the gateway to the application, then the ring from the application to
+ * the gateway. Each ring is a shm_ring_header_t followed by capacity bytes.
+ *
+ * Head and tail are free running byte counts, written only by the producer
+ * and the consumer respectively. Records start on 8 byte boundaries and never
+ * wrap; RING_RECORD_PAD skips to the start of the buffer.
+ *
+ * The consumer advances the tail only after it is done with a record,
+ * including any slot it refers to. It may sleep on its eventfd once it has
+ * advanced the tail and seen head equal to it. The producer signals the
+ * eventfd when it publishes to a ring it saw empty.
+ */
+const uint32_t IPC_RING_MAGIC = 0x42525447;
+const uint16_t IPC_RING_VERSION = 1;
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	uint32_t capacity;			// bytes in each ring
+	uint32_t toAppOffset;		// of the ring to the application
+	uint32_t fromAppOffset;		// of the ring from the application
+} ipc_ring_header_t;
+
+typedef struct {
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+} shm_ring_header_t;
+
+enum RingRecordType : uint8_t {
+	RING_RECORD_PAD = 0,
+	RING_RECORD_PDU = 1,		// the PDU follows the record
+	RING_RECORD_SLOT = 2,		// the PDU is the bytes that follow, then the slot's
+};
+
+typedef struct {
+	uint16_t len;				// of the bytes after the record
+	uint8_t type;
+	uint8_t reserved;
+	uint16_t slot;				// RING_RECORD_SLOT only
+	uint16_t slotLen;
+} ring_record_t;
+
+/*
+ * One direction of the ring, over memory mapped by both sides.
+ */
+class ShmRing {
+public:
+	ShmRing(void *region, uint32_t capacity);
+
+	/*
+	 * Bytes used by a ring of capacity, which must be a power of two.
+	 */
+	static size_t regionSize(uint32_t capacity);
+
+	/*
+	 * Producer. Returns false if there is no room. wake is set if the
+	 * consumer should be signaled.
+	 */
+	bool push(const ring_record_t &record, const uint8_t *buf, bool &wake);
+
+	/*
+	 * Consumer. Returns false if the ring is empty. buf points into the ring
+	 * until pop(). Throws std::runtime_error if the producer corrupted it.
+	 */
+	bool peek(ring_record_t &record, uint8_t *&buf);
+	void pop();
+
+	/*
+	 * Position up to which the consumer is done, as written by it.
+	 */
+	uint32_t getTail();
+
+	/*
+	 * Producer. Position after the last record pushed, which does not trust
+	 * the shared header.
+	 */
+	uint32_t getHead();
+private:
+	shm_ring_header_t *header;
+	uint8_t *data;
+	uint32_t capacity;
+
+	/*
+	 * Position after the record last pushed.
+	 */
+	uint32_t produced;
+
+	/*
+	 * Position after the record last peeked.
+	 */
+	uint32_t next;
+};
+
+/*
+ * Fixed size slots in a memfd mapped read only by the applications of one
+ * user, so that notified values do not take up their rings, and a value sent
+ * to several of them is copied once. A slot is freed when every ring has been
+ * consumed past its references to it.
+ */
+class ShmSlotPool {
+public:
+	/*
+	 * Throws std::runtime_error if the memfd cannot be created.
+	 */
+	ShmSlotPool(uint16_t numSlots, uint16_t slotSize = DEFAULT_SLOT_SIZE);
+	virtual ~ShmSlotPool();
+
+	int getFd();
+	uint16_t getNumSlots();
+	uint16_t getSlotSize();
+
+	/*
+	 * Copy buf to a slot with a reference, or take another reference to the
+	 * last slot published if it holds the same bytes. Returns -1 if buf is
+	 * too long or no slot is free.
+	 */
+	int publish(const uint8_t *buf, int len);
+	void release(int slot);
+
+	static constexpr uint16_t DEFAULT_SLOT_SIZE = 512;
+private:
+	int fd;
+	uint8_t *region;
+	uint16_t numSlots;
+	uint16_t slotSize;
+
+	std::vector<int> refs;
+	std::vector<uint16_t> lens;
+	std::vector<uint16_t> freeSlots;
+	int lastSlot;
+	std::mutex m;
+};
+
+#endif /* INCLUDE_IPC_SHMRING_H_ */
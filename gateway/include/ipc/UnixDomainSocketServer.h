@@ -8,6 +8,8 @@
 #ifndef INCLUDE_IPC_UNIXDOMAINSOCKETSERVER_H_
 #define INCLUDE_IPC_UNIXDOMAINSOCKETSERVER_H_
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <thread>
 
@@ -15,12 +17,20 @@
 
 class UnixDomainSocketServer {
 public:
-	UnixDomainSocketServer(Beetle &beetle, std::string path);
+	/*
+	 * Applications may move to shared memory rings of ringCapacity bytes, if
+	 * it is not 0. The applications of each user share ringSlots slots for
+	 * notifications.
+	 */
+	UnixDomainSocketServer(Beetle &beetle, std::string path, uint32_t ringCapacity = 0, int ringSlots = 0);
 	virtual ~UnixDomainSocketServer();
 
 private:
 	Beetle &beetle;
 	int serverFd;
+
+	uint32_t ringCapacity;
+	uint16_t ringSlots;
 };
 
 #endif /* INCLUDE_IPC_UNIXDOMAINSOCKETSERVER_H_ */
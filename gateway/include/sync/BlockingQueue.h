@@ -77,6 +77,14 @@ public:
 	    cv.notify_all();
 	    return tmp;
 	};
+
+	/*
+	 * Number of elements waiting.
+	 */
+	size_t size() {
+	    std::lock_guard<std::mutex> lg(m);
+	    return (q == NULL) ? 0 : q->size();
+	};
 private:
 	std::mutex m;
 	std::condition_variable cv;
@@ -30,6 +30,12 @@ public:
 	 * Schedule a new task with id.
 	 */
 	void schedule(long id, std::function<void()> task);
+
+	/*
+	 * Number of tasks waiting for a worker, including those behind a task
+	 * with the same id.
+	 */
+	size_t size();
 private:
 	bool running;
 	std::vector<std::thread> workers;
@@ -26,6 +26,11 @@ public:
 	 * Schedule a new task.
 	 */
 	void schedule(std::function<void()> task);
+
+	/*
+	 * Number of tasks waiting for a worker.
+	 */
+	size_t size();
 private:
 	bool running;
 	std::vector<std::thread> workers;
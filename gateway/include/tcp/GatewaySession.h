@@ -0,0 +1,217 @@
+/*
+ * GatewaySession.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_TCP_GATEWAYSESSION_H_
+#define INCLUDE_TCP_GATEWAYSESSION_H_
+
+#include <netinet/in.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <openssl/ossl_typ.h>
+
+#include "BeetleTypes.h"
+#include "Metrics.h"
+#include "sync/OrderedThreadPool.h"
+
+class SessionException : public std::exception {
+  public:
+	SessionException(std::string msg) : msg(msg) {};
+	SessionException(const char *msg) : msg(msg) {};
+    ~SessionException() throw() {};
+    const char *what() const throw() { return this->msg.c_str(); };
+  private:
+    std::string msg;
+};
+
+/*
+ * Version of the session protocol, sent as the value of TCP_PARAM_SESSION.
+ */
+const int GATEWAY_SESSION_VERSION = 1;
+
+/*
+ * One TLS connection between two gateways, carrying a channel for each
+ * proxied device. Frames are
+ *
+ *   varint		length of the rest of the frame
+ *   varint		channel
+ *				payload
+ *
+ * Channel 0 carries control messages, and every other channel carries the
+ * PDUs of one device, one PDU per frame. Channels are opened by the client
+ * gateway. A sender may have at most INITIAL_CREDITS PDUs outstanding on a
+ * channel; the receiver returns credits once its handler has returned. PDUs
+ * written beyond that wait in order, up to MAX_BACKLOG.
+ *
+ * The reader only splits frames. Each channel's handlers are called in order
+ * on the session's delivery threads, so a slow device holds up its own
+ * channel and not the others on the link.
+ */
+class GatewaySession : public std::enable_shared_from_this<GatewaySession> {
+public:
+	/*
+	 * Takes over ssl and sockfd.
+	 */
+	GatewaySession(Beetle &beetle, SSL *ssl, int sockfd, std::string remoteGateway, struct sockaddr_in sockaddr);
+	virtual ~GatewaySession();
+
+	/*
+	 * Begin reading. Call once the session is owned by a shared_ptr.
+	 */
+	void start();
+
+	/*
+	 * Close every channel and stop reading.
+	 */
+	void stop();
+
+	bool isStopped();
+
+	std::string getRemoteGateway();
+	struct sockaddr_in getSockaddr();
+
+	/*
+	 * Called on the server when the client opens a channel. The handler must
+	 * eventually call acceptOpen() or rejectOpen().
+	 */
+	typedef std::function<void(uint32_t channel, device_t device)> OpenHandler;
+	void setOpenHandler(OpenHandler handler);
+
+	/*
+	 * Called once, after the session stops. Replacing the handler waits for
+	 * a call in progress, so it must not be done from within the handler.
+	 */
+	void setStopHandler(std::function<void()> handler);
+
+	/*
+	 * Open a channel to device at the server. Blocks until the server
+	 * responds, or throws SessionException.
+	 */
+	uint32_t open(device_t device, double timeout = TIMEOUT_OPEN);
+
+	void acceptOpen(uint32_t channel);
+	void rejectOpen(uint32_t channel, std::string reason);
+
+	/*
+	 * Deliver PDUs and close notifications for an open channel. PDUs received
+	 * before attaching are delivered in order afterwards. Throws
+	 * SessionException if the channel is no longer open.
+	 */
+	void attach(uint32_t channel, std::function<void(uint8_t *, int)> dataHandler,
+			std::function<void()> closeHandler);
+
+	/*
+	 * Close the channel. Waits for a handler in progress on another thread,
+	 * and no handlers are called after this returns.
+	 */
+	void detach(uint32_t channel);
+
+	/*
+	 * Queue a PDU on the channel. Returns false if the channel is closed or
+	 * its backlog is full.
+	 */
+	bool send(uint32_t channel, uint8_t *buf, int len);
+
+	static constexpr int INITIAL_CREDITS = 32;
+	static constexpr size_t MAX_BACKLOG = 256;
+	static constexpr size_t MAX_FRAME_LEN = 1 << 16;
+	static constexpr double TIMEOUT_OPEN = 10;
+	static constexpr int MAX_READS_PER_WAKEUP = 16;
+	static constexpr int NUM_DELIVERY_THREADS = 4;
+private:
+	Beetle &beetle;
+
+	SSL *ssl;
+	int sockfd;
+	std::string remoteGateway;
+	struct sockaddr_in sockaddr;
+
+	std::atomic_bool stopped;
+
+	transport_metrics_t *traffic;
+
+	OpenHandler openHandler;
+	std::function<void()> stopHandler;
+	std::mutex stopHandlerMutex;
+
+	/*
+	 * Receive side of the channels. PDUs wait in pending until a task on
+	 * deliverers, ordered by channel, hands them to the handler. The thread
+	 * calling a handler is recorded in deliverer, and detach() waits on
+	 * deliveredCv for it to finish.
+	 */
+	enum ChannelState {
+		OPENING, OPEN, FAILED, CLOSED,
+	};
+	struct channel {
+		ChannelState state;
+		std::string error;
+		std::function<void(uint8_t *, int)> dataHandler;
+		std::function<void()> closeHandler;
+		std::deque<std::vector<uint8_t>> pending;
+		bool draining;
+		std::thread::id deliverer;
+		int consumed;
+	};
+	uint32_t nextChannel;
+	std::map<uint32_t, channel> channels;
+	std::mutex channelsMutex;
+	std::condition_variable openCv;
+	std::condition_variable deliveredCv;
+	OrderedThreadPool deliverers;
+	std::map<uint32_t, channel>::iterator waitForHandlers(std::unique_lock<std::mutex> &lk, uint32_t channel);
+	void scheduleOnChannel(uint32_t channel, void (GatewaySession::*task)(uint32_t));
+
+	/*
+	 * Send side of the channels, and frames waiting to be written. A single
+	 * flush is scheduled at a time, and writes everything queued.
+	 */
+	struct send_state {
+		int credits;
+		std::deque<std::vector<uint8_t>> backlog;
+	};
+	std::map<uint32_t, send_state> sendStates;
+	std::vector<uint8_t> writeBuffer;
+	bool flushScheduled;
+	std::mutex writeMutex;
+	long writerId;
+	void appendFrame(uint32_t channel, const uint8_t *buf, size_t len);
+	void scheduleFlush();
+	void flush();
+
+	void sendControl(uint8_t type, uint32_t channel, uint32_t value, const std::string &reason = "");
+	void addChannel(uint32_t channel, ChannelState state);
+
+	/*
+	 * Only called by the reader.
+	 */
+	std::vector<uint8_t> readBuffer;
+	void readHandler();
+	void handleFrames();
+	void handleFrame(uint8_t *buf, size_t len);
+	void handleControl(uint8_t *buf, size_t len);
+	void deliver(uint32_t channel, uint8_t *buf, size_t len);
+	void closeChannel(uint32_t channel);
+
+	/*
+	 * Run on deliverers.
+	 */
+	void drainPending(uint32_t channel);
+	void finishClose(uint32_t channel);
+	void consumed(uint32_t channel);
+};
+
+#endif /* INCLUDE_TCP_GATEWAYSESSION_H_ */
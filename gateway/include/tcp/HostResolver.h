@@ -0,0 +1,49 @@
+/*
+ * HostResolver.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_TCP_HOSTRESOLVER_H_
+#define INCLUDE_TCP_HOSTRESOLVER_H_
+
+#include <netinet/in.h>
+#include <condition_variable>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+
+/*
+ * Caches IPv4 addresses of gateway hosts. Lookups of different hosts run
+ * concurrently on their callers' threads, and callers resolving a host that
+ * is already being looked up wait for that lookup instead of repeating it.
+ */
+class HostResolver {
+public:
+	/*
+	 * Returns false if the host could not be resolved.
+	 */
+	static bool resolve(std::string host, struct in_addr &addr);
+
+	/*
+	 * Forget the host, such as after failing to connect to it.
+	 */
+	static void invalidate(std::string host);
+
+	static constexpr time_t CACHE_TTL = 300;
+	static constexpr time_t NEGATIVE_TTL = 10;
+private:
+	struct entry {
+		bool resolving;
+		bool found;
+		struct in_addr addr;
+		time_t expires;
+	};
+	static std::map<std::string, entry> cache;
+	static std::mutex cacheMutex;
+	static std::condition_variable cacheCv;
+};
+
+#endif /* INCLUDE_TCP_HOSTRESOLVER_H_ */
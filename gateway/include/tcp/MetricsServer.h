@@ -0,0 +1,55 @@
+/*
+ * MetricsServer.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_TCP_METRICSSERVER_H_
+#define INCLUDE_TCP_METRICSSERVER_H_
+
+#include <string>
+
+#include "BeetleTypes.h"
+#include "sync/ThreadPool.h"
+
+/*
+ * Serve beetle.metrics in the Prometheus text format, over plain HTTP at
+ * /metrics. Only local clients can connect: the tcp port is bound to
+ * loopback, and the unix domain socket is protected by its permissions.
+ */
+class MetricsServer {
+public:
+	/*
+	 * Listen on the port if it is not 0, and at the path if it is not empty.
+	 * Throws ServerException on failure.
+	 */
+	MetricsServer(Beetle &beetle, int port, std::string path);
+	virtual ~MetricsServer();
+
+private:
+	Beetle &beetle;
+	int tcpFd;
+	int unixFd;
+	std::string path;
+
+	/*
+	 * Clients are served here rather than on beetle.workers, so that slow
+	 * scrapers cannot hold up device handlers.
+	 */
+	ThreadPool servers;
+
+	void startListening(int fd);
+	void stopListening(int fd);
+	void acceptClient(int fd);
+	void handleClient(int clifd);
+
+	/* Seconds to wait on a client */
+	static constexpr int CLIENT_TIMEOUT = 5;
+
+	static constexpr int NUM_SERVER_THREADS = 2;
+
+	static constexpr int MAX_REQUEST_LEN = 4096;
+};
+
+#endif /* INCLUDE_TCP_METRICSSERVER_H_ */
@@ -9,20 +9,114 @@
 #define TCP_SSLCONFIG_H_
 
 #include <openssl/ossl_typ.h>
+#include <openssl/ssl.h>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <set>
 #include <string>
 #include <mutex>
 
+typedef struct {
+	uint64_t handshakes;
+	uint64_t resumed;
+	uint64_t failed;
+	uint64_t ktls;
+	uint64_t totalMicros;
+	uint64_t maxMicros;
+} handshake_stats_t;
+
+struct TicketKeyCallback;
+
 class SSLConfig {
 public:
 	SSLConfig(bool verifyPeers, bool isServer = false, std::string cert = "", std::string key = "",
 			std::string caCert = "");
 	virtual ~SSLConfig();
 	SSL_CTX *getCtx();
+
+	/*
+	 * SSL_accept or SSL_connect, and record the handshake.
+	 */
+	int handshake(SSL *ssl);
+
+	/*
+	 * Record a handshake driven elsewhere, such as a nonblocking accept.
+	 */
+	void recordHandshake(SSL *ssl, bool success, uint64_t micros);
+
+	/*
+	 * Client only. Offer the last session saved for the peer, if any.
+	 */
+	void resumeSession(SSL *ssl, std::string peer);
+
+	/*
+	 * Client only. Save the session to resume the next connection to the
+	 * peer. TLS 1.3 tickets arrive after the handshake, so call after the
+	 * first read.
+	 */
+	void saveSession(SSL *ssl, std::string peer);
+
+	/*
+	 * Let openssl hand established connections to kernel TLS, where the
+	 * kernel and cipher support it. Returns false if openssl was built
+	 * without it.
+	 */
+	bool setKtls(bool enable);
+
+	/*
+	 * Whether the kernel encrypts what is written to the connection's socket.
+	 */
+	static bool isKtlsSend(SSL *ssl);
+
+	handshake_stats_t getHandshakeStats();
+
+	/*
+	 * Handshake stats of every SSLConfig, one per line.
+	 */
+	static std::string getAllHandshakeStats();
+
+	/*
+	 * Tickets are issued under a key for this long, and accepted for as long
+	 * again after the key is rotated.
+	 */
+	static constexpr time_t TICKET_KEY_LIFETIME = 3600;
+	static constexpr long SESSION_TIMEOUT = 2 * TICKET_KEY_LIFETIME;
+	static constexpr size_t MAX_CACHED_SESSIONS = 256;
 private:
 	SSL_CTX *ctx;
+	bool isServer;
+
+	std::map<std::string, SSL_SESSION *> sessions;
+	std::mutex sessionsMutex;
+
+	std::atomic<uint64_t> handshakes;
+	std::atomic<uint64_t> resumed;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> ktls;
+	std::atomic<uint64_t> totalMicros;
+	std::atomic<uint64_t> maxMicros;
+
+	friend struct TicketKeyCallback;
+	struct ticket_key {
+		uint8_t name[16];
+		uint8_t aesKey[32];
+		uint8_t hmacKey[32];
+		time_t created;
+	};
+	ticket_key currentTicketKey;
+	ticket_key previousTicketKey;
+	bool hasPreviousTicketKey;
+	std::mutex ticketKeyMutex;
+	void newTicketKey(ticket_key &key);
 
 	static bool initialized;
 	static std::mutex initMutex;
+	static int ctxIndex;
+
+	static std::set<SSLConfig *> instances;
+	static std::mutex instancesMutex;
 };
 
 #endif /* TCP_SSLCONFIG_H_ */
@@ -33,6 +33,19 @@ const std::string TCP_PARAM_CLIENT = "client";
  */
 const std::string TCP_PARAM_SERVER = "server";
 
+/*
+ * Highest framing version supported by the sender, see TCPFraming.h. The
+ * server replies with the version to use. Version 1 if absent.
+ */
+const std::string TCP_PARAM_FRAMING = "framing";
+
+/*
+ * Ask a gateway to carry all proxies over one GatewaySession. Value is the
+ * session version, see GatewaySession.h. The server replies with it if it
+ * agrees, and ignores TCP_PARAM_DEVICE.
+ */
+const std::string TCP_PARAM_SESSION = "session";
+
 /*
  * Read paramsLen bytes of plaintext parameters from fd into params. Socket
  * should be nonblocking, if timeout seconds passes, then failure is returned.
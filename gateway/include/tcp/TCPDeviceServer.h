@@ -8,7 +8,12 @@
 #ifndef INCLUDE_TCP_TCPDEVICESERVER_H_
 #define INCLUDE_TCP_TCPDEVICESERVER_H_
 
+#include <netinet/in.h>
+#include <chrono>
 #include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <openssl/ossl_typ.h>
 #include <string>
 #include <thread>
@@ -17,6 +22,8 @@
 #include "BeetleTypes.h"
 #include "tcp/SSLConfig.h"
 
+class GatewaySession;
+
 class ServerException : public std::exception {
   public:
 	ServerException(std::string msg) : msg(msg) {};
@@ -32,12 +39,53 @@ class ServerException : public std::exception {
  */
 class TCPDeviceServer {
 public:
-	TCPDeviceServer(Beetle &beetle, SSLConfig *sslConfig, int port);
+	/*
+	 * At most maxHandshakes clients are handshaking at once, each for up to
+	 * handshakeTimeout seconds. Further clients wait in the listen backlog.
+	 */
+	TCPDeviceServer(Beetle &beetle, SSLConfig *sslConfig, int port, int backlog = 128,
+			int maxHandshakes = 64, int handshakeTimeout = 10);
 	virtual ~TCPDeviceServer();
+
+	/*
+	 * Return a daemon to expire stalled handshakes.
+	 */
+	std::function<void()> getDaemon();
 private:
 	Beetle &beetle;
 	std::shared_ptr<SSLConfig> sslConfig;
 	int serverFd;
+
+	/*
+	 * TLS handshakes in progress. Each is advanced by the readers as the
+	 * client's data arrives, and never blocks them.
+	 */
+	struct pending_handshake {
+		SSL *ssl;
+		int fd;
+		struct sockaddr_in addr;
+		std::chrono::steady_clock::time_point started;
+		bool done;
+		std::mutex m;
+	};
+	size_t maxHandshakes;
+	int handshakeTimeout;
+	std::map<int, std::shared_ptr<pending_handshake>> handshakes;
+	bool acceptPaused;
+	std::mutex handshakesMutex;
+	static constexpr int TIMEOUT_HANDSHAKE_WRITE = 1000;	// milliseconds
+	void acceptClients();
+	void continueHandshake(int fd);
+	void endHandshake(std::shared_ptr<pending_handshake> hs, bool success);
+
+	void startDevice(SSL *ssl, int clifd, struct sockaddr_in cliaddr);
+
+	/*
+	 * Sessions with client gateways, until they stop.
+	 */
+	void startSession(SSL *ssl, int clifd, struct sockaddr_in cliaddr, std::string clientGateway);
+	std::map<GatewaySession *, std::shared_ptr<GatewaySession>> sessions;
+	std::mutex sessionsMutex;
 };
 
 #endif /* INCLUDE_TCP_TCPDEVICESERVER_H_ */
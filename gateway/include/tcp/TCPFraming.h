@@ -0,0 +1,118 @@
+/*
+ * TCPFraming.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#ifndef INCLUDE_TCP_TCPFRAMING_H_
+#define INCLUDE_TCP_TCPFRAMING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Version 1: each PDU is preceded by a uint8_t length.
+ */
+const int TCP_FRAMING_V1 = 1;
+
+/*
+ * Version 2: frames of one or more PDUs.
+ *
+ *   varint		length of the rest of the frame
+ *   uint8_t	flags
+ *   uint64_t	send time in microseconds since the epoch, big endian, if
+ *				TCP_FRAME_FLAG_TIMESTAMP is set
+ *   repeated:
+ *     varint	length of the PDU
+ *				PDU
+ *
+ * Varints are unsigned LEB128.
+ */
+const int TCP_FRAMING_V2 = 2;
+
+const int TCP_FRAMING_MAX_VERSION = TCP_FRAMING_V2;
+
+const uint8_t TCP_FRAME_FLAG_TIMESTAMP = 0x01;
+
+/*
+ * Largest v2 frame accepted or sent, excluding its length.
+ */
+const size_t TCP_FRAME_V2_MAX_LEN = 1 << 20;
+
+/*
+ * Largest PDU in a v1 frame.
+ */
+const int TCP_FRAME_V1_MAX_PDU = 255;
+
+const size_t VARINT_MAX_LEN = 5;
+
+/*
+ * Returns the number of bytes written to out.
+ */
+size_t encodeVarint(uint32_t value, uint8_t *out);
+
+/*
+ * Returns the number of bytes read, or 0 if buf does not hold a complete
+ * varint. Throws std::runtime_error if the varint is too long.
+ */
+size_t decodeVarint(const uint8_t *buf, size_t len, uint32_t &value);
+
+/*
+ * Version to use given the value of TCP_PARAM_FRAMING, or TCP_FRAMING_V1 if
+ * it is absent.
+ */
+int negotiateFraming(const std::map<std::string, std::string> &params);
+
+/*
+ * Append PDUs to out, as one v1 frame per PDU. Returns false if a PDU is
+ * too long.
+ */
+bool appendFramesV1(std::vector<uint8_t> &out, const std::vector<std::vector<uint8_t>> &pdus);
+
+/*
+ * Append PDUs to out, in as few v2 frames as fit. timestamp is 0 to omit it.
+ */
+void appendFramesV2(std::vector<uint8_t> &out, const std::vector<std::vector<uint8_t>> &pdus,
+		uint64_t timestamp);
+
+/*
+ * Split the body of a v2 frame (after its length) into PDUs. Throws
+ * std::runtime_error if the frame is malformed.
+ */
+void parseFrameV2(uint8_t *body, size_t len, uint64_t &timestamp, std::vector<std::pair<uint8_t *, int>> &pdus);
+
+/*
+ * Splits the bytes read from a connection into frames, keeping partial frames
+ * until the rest arrives.
+ */
+class TCPFrameDecoder {
+public:
+	TCPFrameDecoder(int version = TCP_FRAMING_V1);
+
+	void setVersion(int version);
+
+	void append(const uint8_t *buf, size_t len);
+
+	/*
+	 * Take the next complete frame. Returns false if there is none. The PDUs
+	 * point into the decoder, and are valid until it is next modified. Throws
+	 * std::runtime_error if the frame is malformed.
+	 */
+	bool next(uint64_t &timestamp, std::vector<std::pair<uint8_t *, int>> &pdus);
+
+	/*
+	 * Number of bytes of partial frames held.
+	 */
+	size_t buffered();
+private:
+	int version;
+	std::vector<uint8_t> buffer;
+	size_t offset;
+};
+
+#endif /* INCLUDE_TCP_TCPFRAMING_H_ */
@@ -8,9 +8,13 @@
 #ifndef UTIL_WRITE_H_
 #define UTIL_WRITE_H_
 
+#include <openssl/bio.h>
 #include <openssl/ossl_typ.h>
 #include <openssl/ssl.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstdint>
 
 inline int write_all(int fd, uint8_t *buf, int len) {
@@ -25,12 +29,61 @@ inline int write_all(int fd, uint8_t *buf, int len) {
 	return written;
 }
 
-inline int SSL_write_all(SSL *ssl, uint8_t *buf, int len) {
+/*
+ * Waits up to timeoutMs each time a nonblocking socket is not ready.
+ */
+inline int send_all(int fd, uint8_t *buf, int len, int timeoutMs = 10000) {
 	int written = 0;
 	while (written < len) {
-		int n = SSL_write(ssl, buf + written, len - written);
+		int n = send(fd, buf + written, len - written, MSG_NOSIGNAL);
 		if (n < 0) {
-			return -1;
+			if (errno == EINTR) {
+				continue;
+			} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				return -1;
+			}
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, timeoutMs) <= 0) {
+				return -1;
+			}
+			continue;
+		}
+		written += n;
+	}
+	return written;
+}
+
+/*
+ * Waits up to timeoutMs each time a nonblocking socket is not ready. Once
+ * the kernel encrypts the socket (SSLConfig::setKtls), writes go to it
+ * directly.
+ */
+inline int SSL_write_all(SSL *ssl, uint8_t *buf, int len, int timeoutMs = 10000) {
+#ifdef SSL_OP_ENABLE_KTLS
+	if (BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0) {
+		return send_all(SSL_get_fd(ssl), buf, len, timeoutMs);
+	}
+#endif
+
+	int written = 0;
+	while (written < len) {
+		int n = SSL_write(ssl, buf + written, len - written);
+		if (n <= 0) {
+			int err = SSL_get_error(ssl, n);
+			if (err != SSL_ERROR_WANT_WRITE && err != SSL_ERROR_WANT_READ) {
+				return -1;
+			}
+			struct pollfd pfd;
+			pfd.fd = SSL_get_fd(ssl);
+			pfd.events = (err == SSL_ERROR_WANT_WRITE) ? POLLOUT : POLLIN;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, timeoutMs) <= 0) {
+				return -1;
+			}
+			continue;
 		}
 		written += n;
 	}
@@ -1,17 +1,21 @@
 #include "Beetle.h"
 
 #include <boost/thread/lock_types.hpp>
+#include <algorithm>
 #include <cassert>
 #include <mutex>
+#include <set>
 #include <sstream>
 #include <utility>
 
 #include "controller/AccessControl.h"
+#include "controller/NetworkDiscoveryClient.h"
 #include "Debug.h"
 #include "device/BeetleInternal.h"
 #include "device/VirtualDevice.h"
 #include "hat/HandleAllocationTable.h"
 #include "Router.h"
+#include "ServiceIndex.h"
 
 Beetle::Beetle(std::string name_, std::string dev, int numWorkers, int numWriters, int numReaders) :
 		hci(dev), workers(numWorkers), writers(numWriters), readers(numReaders) {
@@ -19,6 +23,13 @@ Beetle::Beetle(std::string name_, std::string dev, int numWorkers, int numWriter
 	beetleDevice = std::make_shared<BeetleInternal>(*this, name_);
 	devices[BEETLE_RESERVED_DEVICE] = beetleDevice;
 	name = name_;
+
+	metrics.gauge("beetle_worker_queue_depth", "Tasks waiting for a worker.", {}, [this] {
+		return (double) workers.size();
+	});
+	metrics.gauge("beetle_writer_queue_depth", "Writes waiting for a writer.", {}, [this] {
+		return (double) writers.size();
+	});
 }
 
 Beetle::~Beetle() {
@@ -101,12 +112,62 @@ bool Beetle::removeDevice(device_t id, std::string &err) {
 }
 
 void Beetle::updateDevice(device_t id) {
+	/*
+	 * Spawn in a separate thread since caller might be holding the device lock.
+	 */
+	workers.schedule([this, id] {
+		resizeMappings(id);
+	});
 	for (auto &h : updateHandlers) {
 		workers.schedule([h,id] {h(id);});
 	}
 }
 
-bool Beetle::mapDevices(device_t from, device_t to, std::string &err) {
+void Beetle::resizeMappings(device_t id) {
+	boost::shared_lock<boost::shared_mutex> devicesLk(devicesMutex);
+	if (devices.find(id) == devices.end()) {
+		return;
+	}
+
+	std::shared_ptr<Device> d = devices[id];
+	int size = d->getHighestHandle() + 1;
+
+	d->mappedToMutex.lock();
+	std::set<device_t> mappedTo = d->mappedTo;
+	d->mappedToMutex.unlock();
+
+	for (device_t other : mappedTo) {
+		if (devices.find(other) == devices.end()) {
+			continue;
+		}
+		auto otherDevice = devices[other];
+		std::lock_guard<std::mutex> otherHatLg(otherDevice->hatMutex);
+		handle_range_t oldRange = otherDevice->hat->getDeviceRange(id);
+		if (oldRange.isNull()) {
+			continue;
+		}
+
+		handle_range_t newRange = otherDevice->hat->resize(id, size);
+		if (newRange.isNull()) {
+			pwarn("could not resize " + oldRange.str() + " at device " + std::to_string(other));
+			continue;
+		} else if (newRange.start == oldRange.start && newRange.end == oldRange.end) {
+			continue;
+		}
+
+		/* Inform of a range covering both the old and the new locations */
+		handle_range_t changed;
+		changed.start = std::min(oldRange.start, newRange.start);
+		changed.end = std::max(oldRange.end, newRange.end);
+		beetleDevice->informServicesChanged(changed, other);
+		if (debug) {
+			pdebug("resized " + oldRange.str() + " to " + newRange.str() + " at device " + std::to_string(other));
+		}
+	}
+}
+
+bool Beetle::getMappingDevices(device_t from, device_t to, std::shared_ptr<Device> &fromD,
+		std::shared_ptr<Device> &toD, std::string &err) {
 	if (from == BEETLE_RESERVED_DEVICE || to == BEETLE_RESERVED_DEVICE) {
 		err = "not allowed to map Beetle";
 		return false;
@@ -127,13 +188,24 @@ bool Beetle::mapDevices(device_t from, device_t to, std::string &err) {
 		return false;
 	}
 
-	std::shared_ptr<Device> fromD = devices[from];
-	std::shared_ptr<Device> toD = devices[to];
-	if (accessControl && accessControl->canMap(fromD, toD) == false) {
-		err = "permission denied";
+	fromD = devices[from];
+	toD = devices[to];
+	return true;
+}
+
+bool Beetle::reserveMapping(device_t from, device_t to, std::string &err) {
+	boost::shared_lock<boost::shared_mutex> devicesLk(devicesMutex);
+	if (devices.find(from) == devices.end()) {
+		err = std::to_string(from) + " was removed";
+		return false;
+	} else if (devices.find(to) == devices.end()) {
+		err = std::to_string(to) + " was removed";
 		return false;
 	}
 
+	std::shared_ptr<Device> fromD = devices[from];
+	std::shared_ptr<Device> toD = devices[to];
+
 	std::lock_guard<std::mutex> hatLg(toD->hatMutex);
 	std::lock_guard<std::mutex> mappedToLg(fromD->mappedToMutex);
 	if (fromD->mappedTo.find(to) != fromD->mappedTo.end()) {
@@ -142,7 +214,13 @@ bool Beetle::mapDevices(device_t from, device_t to, std::string &err) {
 		err = ss.str();
 		return false;
 	} else {
-		handle_range_t range = toD->hat->reserve(from);
+		handle_range_t range = toD->hat->reserve(from, fromD->getHighestHandle() + 1);
+		if (range.isNull()) {
+			std::stringstream ss;
+			ss << "no handle space for " << from << " in " << to << "'s space";
+			err = ss.str();
+			return false;
+		}
 		fromD->mappedTo.insert(to);
 		beetleDevice->informServicesChanged(range, to);
 		if (debug) {
@@ -157,6 +235,55 @@ bool Beetle::mapDevices(device_t from, device_t to, std::string &err) {
 	return true;
 }
 
+bool Beetle::mapDevices(device_t from, device_t to, std::string &err) {
+	std::shared_ptr<Device> fromD;
+	std::shared_ptr<Device> toD;
+	if (!getMappingDevices(from, to, fromD, toD, err)) {
+		return false;
+	}
+
+	/*
+	 * Not holding the devices lock, since this may block on the controller.
+	 */
+	if (accessControl && accessControl->canMap(fromD, toD) == false) {
+		err = "permission denied";
+		return false;
+	}
+
+	return reserveMapping(from, to, err);
+}
+
+void Beetle::mapDevicesAsync(device_t from, device_t to, MapResultHandler h) {
+	std::string err;
+	std::shared_ptr<Device> fromD;
+	std::shared_ptr<Device> toD;
+	if (!getMappingDevices(from, to, fromD, toD, err)) {
+		if (h) {
+			h(false, err);
+		}
+		return;
+	}
+
+	auto finish = [this, from, to, h](bool allowed) {
+		std::string err;
+		bool success = false;
+		if (allowed) {
+			success = reserveMapping(from, to, err);
+		} else {
+			err = "permission denied";
+		}
+		if (h) {
+			h(success, err);
+		}
+	};
+
+	if (accessControl) {
+		accessControl->canMapAsync(fromD, toD, finish);
+	} else {
+		finish(true);
+	}
+}
+
 bool Beetle::unmapDevices(device_t from, device_t to, std::string &err) {
 	if (from == BEETLE_RESERVED_DEVICE || to == BEETLE_RESERVED_DEVICE) {
 		err = "not allowed to unmap Beetle";
@@ -252,5 +379,14 @@ void Beetle::setAccessControl(std::shared_ptr<AccessControl> ac) {
 void Beetle::setDiscoveryClient(std::shared_ptr<NetworkDiscoveryClient> nd) {
 	assert(discoveryClient == NULL && nd != NULL);
 	discoveryClient = nd;
+	registerRemoveDeviceHandler(nd->getRemoveDeviceHandler());
+}
+
+void Beetle::setServiceIndex(std::shared_ptr<ServiceIndex> si) {
+	assert(serviceIndex == NULL && si != NULL);
+	serviceIndex = si;
+	registerAddDeviceHandler(si->getAddDeviceHandler());
+	registerUpdateDeviceHandler(si->getUpdateDeviceHandler());
+	registerRemoveDeviceHandler(si->getRemoveDeviceHandler());
 }
 
@@ -108,10 +108,19 @@ BeetleConfig::BeetleConfig(std::string filename) {
 				tcpEnabled = it.value();
 			} else if (it.key() == "port") {
 				tcpPort = it.value();
+			} else if (it.key() == "backlog") {
+				tcpBacklog = it.value();
+			} else if (it.key() == "maxHandshakes") {
+				tcpMaxHandshakes = it.value();
+			} else if (it.key() == "handshakeTimeout") {
+				tcpHandshakeTimeout = it.value();
 			} else {
 				throw ConfigException("unknown tcp param: " + it.key());
 			}
 		}
+		if (tcpBacklog <= 0 || tcpMaxHandshakes <= 0 || tcpHandshakeTimeout <= 0) {
+			throw ConfigException("tcp backlog, handshakes and handshake timeout must be positive");
+		}
 	}
 
 	if (config.count("ipc")) {
@@ -121,10 +130,37 @@ BeetleConfig::BeetleConfig(std::string filename) {
 				ipcEnabled = it.value();
 			} else if (it.key() == "path") {
 				ipcPath = it.value();
+			} else if (it.key() == "ringSize") {
+				ipcRingSize = it.value();
+			} else if (it.key() == "ringSlots") {
+				ipcRingSlots = it.value();
 			} else {
 				throw ConfigException("unknown ipc param: " + it.key());
 			}
 		}
+		if (ipcRingSize != 0 && (ipcRingSize < 4096 || ipcRingSize > (1 << 30)
+				|| (ipcRingSize & (ipcRingSize - 1)) != 0)) {
+			throw ConfigException("ipc ringSize must be 0 or a power of 2 from 4096");
+		}
+		if (ipcRingSlots <= 0 || ipcRingSlots > 65535) {
+			throw ConfigException("ipc ringSlots must be in range 1 to 65535");
+		}
+	}
+
+	if (config.count("metrics")) {
+		json metricsConfig = config["metrics"];
+		for (json::iterator it = metricsConfig.begin(); it != metricsConfig.end(); ++it) {
+			if (it.key() == "port") {
+				metricsPort = it.value();
+			} else if (it.key() == "path") {
+				metricsPath = it.value();
+			} else {
+				throw ConfigException("unknown metrics param: " + it.key());
+			}
+		}
+		if (metricsPort < 0 || metricsPort > 65535) {
+			throw ConfigException("metrics port must be in range 0 to 65535");
+		}
 	}
 
 	if (config.count("advertise")) {
@@ -140,6 +176,59 @@ BeetleConfig::BeetleConfig(std::string filename) {
 		}
 	}
 
+	if (config.count("connInterval")) {
+		json connIntervalConfig = config["connInterval"];
+		for (json::iterator it = connIntervalConfig.begin(); it != connIntervalConfig.end(); ++it) {
+			if (it.key() == "enable") {
+				connIntervalEnabled = it.value();
+			} else if (it.key() == "period") {
+				connIntervalPeriod = it.value();
+			} else if (it.key() == "fastMin") {
+				connIntervalFastMin = it.value();
+			} else if (it.key() == "fastMax") {
+				connIntervalFastMax = it.value();
+			} else if (it.key() == "slowMin") {
+				connIntervalSlowMin = it.value();
+			} else if (it.key() == "slowMax") {
+				connIntervalSlowMax = it.value();
+			} else if (it.key() == "slowLatency") {
+				connIntervalSlowLatency = it.value();
+			} else if (it.key() == "fastQueueDepth") {
+				connIntervalFastQueueDepth = it.value();
+			} else if (it.key() == "fastLatency") {
+				connIntervalFastLatency = it.value();
+			} else if (it.key() == "fastNotifyRate") {
+				connIntervalFastNotifyRate = it.value();
+			} else if (it.key() == "slowAfter") {
+				connIntervalSlowAfter = it.value();
+			} else if (it.key() == "pinSubscribed") {
+				connIntervalPinSubscribed = it.value();
+			} else {
+				throw ConfigException("unknown connInterval param: " + it.key());
+			}
+		}
+		if (connIntervalPeriod < 1) {
+			throw ConfigException("connInterval period must be positive");
+		}
+		if (connIntervalFastMin < 0x0006 || connIntervalFastMax > 0x0C80 || connIntervalFastMin > connIntervalFastMax
+				|| connIntervalSlowMin < 0x0006 || connIntervalSlowMax > 0x0C80
+				|| connIntervalSlowMin > connIntervalSlowMax) {
+			throw ConfigException("connInterval intervals must be in range 6 to 3200");
+		}
+		if (connIntervalSlowLatency < 0 || connIntervalSlowLatency > 0x01F3) {
+			throw ConfigException("connInterval slowLatency must be in range 0 to 499");
+		}
+
+		/*
+		 * Links are updated with a supervision timeout of 32 s, which must be
+		 * longer than (1 + latency) * maxInterval * 2, in units of 1.25 ms.
+		 */
+		if ((1 + connIntervalSlowLatency) * connIntervalSlowMax * 5 >= 32000 * 2
+				|| connIntervalFastMax * 5 >= 32000 * 2) {
+			throw ConfigException("connInterval (1 + latency) * maxInterval * 2.5 ms must be under 32 s");
+		}
+	}
+
 	if (config.count("controller")) {
 		json controllerConfig = config["controller"];
 		for (json::iterator it = controllerConfig.begin(); it != controllerConfig.end(); ++it) {
@@ -155,10 +244,57 @@ BeetleConfig::BeetleConfig(std::string filename) {
 				controllerControlPort = it.value();
 			} else if (it.key() == "controlMaxReconnect") {
 				controllerControlMaxReconnect = it.value();
-			}else {
+			} else if (it.key() == "commandWorkers") {
+				controllerCommandWorkers = it.value();
+			} else if (it.key() == "maxConnections") {
+				controllerMaxConnections = it.value();
+			} else if (it.key() == "pipelineDepth") {
+				controllerPipelineDepth = it.value();
+			} else if (it.key() == "timeout") {
+				controllerTimeout = it.value();
+			} else if (it.key() == "idleTimeout") {
+				controllerIdleTimeout = it.value();
+			} else if (it.key() == "accessTtl") {
+				controllerAccessTtl = it.value();
+			} else if (it.key() == "accessDenyTtl") {
+				controllerAccessDenyTtl = it.value();
+			} else if (it.key() == "accessPrefetch") {
+				controllerAccessPrefetch = it.value();
+			} else if (it.key() == "accessWorkers") {
+				controllerAccessWorkers = it.value();
+			} else if (it.key() == "accessBatchSize") {
+				controllerAccessBatchSize = it.value();
+			} else if (it.key() == "reportDelay") {
+				controllerReportDelay = it.value();
+			} else if (it.key() == "reportMaxBackoff") {
+				controllerReportMaxBackoff = it.value();
+			} else if (it.key() == "discoveryTtl") {
+				controllerDiscoveryTtl = it.value();
+			} else {
 				throw ConfigException("unknown controller param: " + it.key());
 			}
 		}
+		if (controllerCommandWorkers <= 0) {
+			throw ConfigException("controller command workers must be positive");
+		}
+		if (controllerMaxConnections <= 0 || controllerPipelineDepth <= 0) {
+			throw ConfigException("controller connections and pipeline depth must be positive");
+		}
+		if (controllerTimeout <= 0 || controllerIdleTimeout <= 0) {
+			throw ConfigException("controller timeouts must be positive");
+		}
+		if (controllerAccessTtl < 0 || controllerAccessDenyTtl < 0) {
+			throw ConfigException("access ttls must be non-negative");
+		}
+		if (controllerAccessWorkers <= 0 || controllerAccessBatchSize <= 0) {
+			throw ConfigException("access workers and batch size must be positive");
+		}
+		if (controllerReportDelay < 0 || controllerReportMaxBackoff <= 0) {
+			throw ConfigException("invalid controller report delay or backoff");
+		}
+		if (controllerDiscoveryTtl < 0) {
+			throw ConfigException("discovery ttl must be non-negative");
+		}
 	}
 
 	if (config.count("ssl")) {
@@ -181,6 +317,8 @@ BeetleConfig::BeetleConfig(std::string filename) {
 				if (sslCaCert != "" && !file_exists(sslCaCert)) {
 					throw ConfigException("file does not exist: " + sslCaCert);
 				}
+			} else if (it.key() == "ktls") {
+				sslKtls = it.value();
 			} else {
 				throw ConfigException("unknown ssl param: " + it.key());
 			}
@@ -251,6 +389,9 @@ std::string BeetleConfig::str(unsigned int indent) const {
 		json tcp;
 		tcp["enable"] = tcpEnabled;
 		tcp["port"] = tcpPort;
+		tcp["backlog"] = tcpBacklog;
+		tcp["maxHandshakes"] = tcpMaxHandshakes;
+		tcp["handshakeTimeout"] = tcpHandshakeTimeout;
 		config["tcp"] = tcp;
 	}
 
@@ -258,9 +399,18 @@ std::string BeetleConfig::str(unsigned int indent) const {
 		json ipc;
 		ipc["enable"] = ipcEnabled;
 		ipc["path"] = ipcPath;
+		ipc["ringSize"] = ipcRingSize;
+		ipc["ringSlots"] = ipcRingSlots;
 		config["ipc"] = ipc;
 	}
 
+	{
+		json metrics;
+		metrics["port"] = metricsPort;
+		metrics["path"] = metricsPath;
+		config["metrics"] = metrics;
+	}
+
 	{
 		json advertise;
 		advertise["enable"] = advertiseEnabled;
@@ -268,6 +418,23 @@ std::string BeetleConfig::str(unsigned int indent) const {
 		config["advertise"] = advertise;
 	}
 
+	{
+		json connInterval;
+		connInterval["enable"] = connIntervalEnabled;
+		connInterval["period"] = connIntervalPeriod;
+		connInterval["fastMin"] = connIntervalFastMin;
+		connInterval["fastMax"] = connIntervalFastMax;
+		connInterval["slowMin"] = connIntervalSlowMin;
+		connInterval["slowMax"] = connIntervalSlowMax;
+		connInterval["slowLatency"] = connIntervalSlowLatency;
+		connInterval["fastQueueDepth"] = connIntervalFastQueueDepth;
+		connInterval["fastLatency"] = connIntervalFastLatency;
+		connInterval["fastNotifyRate"] = connIntervalFastNotifyRate;
+		connInterval["slowAfter"] = connIntervalSlowAfter;
+		connInterval["pinSubscribed"] = connIntervalPinSubscribed;
+		config["connInterval"] = connInterval;
+	}
+
 	{
 		json controller;
 		controller["enable"] = controllerEnabled;
@@ -276,6 +443,19 @@ std::string BeetleConfig::str(unsigned int indent) const {
 		controller["controlEnable"] = controllerControlEnabled;
 		controller["controlPort"] = controllerControlPort;
 		controller["controlMaxReconnect"] = controllerControlMaxReconnect;
+		controller["commandWorkers"] = controllerCommandWorkers;
+		controller["maxConnections"] = controllerMaxConnections;
+		controller["pipelineDepth"] = controllerPipelineDepth;
+		controller["timeout"] = controllerTimeout;
+		controller["idleTimeout"] = controllerIdleTimeout;
+		controller["accessTtl"] = controllerAccessTtl;
+		controller["accessDenyTtl"] = controllerAccessDenyTtl;
+		controller["accessPrefetch"] = controllerAccessPrefetch;
+		controller["accessWorkers"] = controllerAccessWorkers;
+		controller["accessBatchSize"] = controllerAccessBatchSize;
+		controller["reportDelay"] = controllerReportDelay;
+		controller["reportMaxBackoff"] = controllerReportMaxBackoff;
+		controller["discoveryTtl"] = controllerDiscoveryTtl;
 		config["controller"] = controller;
 	}
 
@@ -285,6 +465,7 @@ std::string BeetleConfig::str(unsigned int indent) const {
 		ssl["cert"] = sslCert;
 		ssl["key"] = sslKey;
 		ssl["caCert"] = sslCaCert;
+		ssl["ktls"] = sslKtls;
 		config["ssl"] = ssl;
 	}
 
@@ -22,14 +22,19 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <iterator>
+#include <list>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <utility>
 
 #include "ble/utils.h"
 #include "Beetle.h"
+#include "Capture.h"
 #include "controller/NetworkDiscoveryClient.h"
 #include "Debug.h"
 #include "Device.h"
@@ -39,6 +44,9 @@
 #include "Handle.h"
 #include "hat/HandleAllocationTable.h"
 #include "Router.h"
+#include "ServiceIndex.h"
+#include "tcp/SSLConfig.h"
+#include "Trace.h"
 
 #define O_STREAM ((iostream) ? *iostream : std::cout)
 #define I_STREAM ((iostream) ? *iostream : std::cin)
@@ -172,6 +180,12 @@ void CLI::cmdLineDaemon() {
 			doSetDebug(cmd);
 		} else if (c1 == "dump") {
 			doDumpData(cmd);
+		} else if (c1 == "stats") {
+			doStats(cmd);
+		} else if (c1 == "trace") {
+			doTrace(cmd);
+		} else if (c1 == "capture") {
+			doCapture(cmd);
 		} else if (c1 == "name") {
 			printMessage(beetle.name);
 		} else if (c1 == "port") {
@@ -233,6 +247,9 @@ void CLI::doHelp(const std::vector<std::string>& cmd) {
 	printMessage("");
 	printMessage("  interval\t\tSet max-connection interval for all devices.");
 	printMessage("  dump\t\tDump data into console.");
+	printMessage("  stats\t\tPrint metrics, or in prometheus format.");
+	printMessage("  trace\t\tTrace sampled packets, and dump the spans.");
+	printMessage("  capture\t\tCapture ATT packets to a pcapng file.");
 	printMessage("");
 	printMessage("  debug\t\tSet debugging level.");
 	printMessage("  quit,q");
@@ -407,12 +424,20 @@ void CLI::doRemote(const std::vector<std::string>& cmd) {
 	}
 }
 
-void CLI::doNetworkDiscover(const std::vector<std::string>& cmd) {
-	if (!networkDiscovery) {
-		printUsageError("Beetle controller not enabled. Network discovery unavailable.");
-		return;
+static void printDiscovered(const std::list<discovery_result_t> &discovered,
+		std::function<void(std::string)> print) {
+	for (auto &d : discovered) {
+		print("device : " + d.name);
+		print("  gateway : " + d.gateway + (d.isLocal ? " (local)" : ""));
+		print("  remote id : " + std::to_string(d.id));
+		if (!d.isLocal) {
+			print("  ip : " + d.ip);
+			print("  port : " + std::to_string(d.port));
+		}
 	}
+}
 
+void CLI::doNetworkDiscover(const std::vector<std::string>& cmd) {
 	if (cmd.size() != 2 && cmd.size() != 3) {
 		printUsage("network d");
 		printUsage("network s uuid");
@@ -420,46 +445,65 @@ void CLI::doNetworkDiscover(const std::vector<std::string>& cmd) {
 		return;
 	}
 
-	bool success = false;
-	std::list<discovery_result_t> discovered;
+	auto print = [this](std::string msg) {
+		printMessage(msg);
+	};
+
 	if (cmd[1] == "d") {
-		success = networkDiscovery->discoverDevices(discovered);
-	} else if (cmd[1] == "s") {
-		if (cmd.size() != 3) {
-			printUsageError("no uuid specified");
+		if (!networkDiscovery) {
+			printUsageError("Beetle controller not enabled. Network discovery unavailable.");
 			return;
 		}
-		try {
-			success = networkDiscovery->discoverByUuid(UUID(cmd[2]), discovered, true);
-		} catch (std::invalid_argument &e) {
-			printUsageError("could not parse uuid");
-			return;
+		std::list<discovery_result_t> discovered;
+		if (networkDiscovery->discoverDevices(discovered)) {
+			printDiscovered(discovered, print);
+		} else {
+			printMessage("network discovery failed");
 		}
-	} else if (cmd[1] == "c") {
+	} else if (cmd[1] == "s" || cmd[1] == "c") {
 		if (cmd.size() != 3) {
 			printUsageError("no uuid specified");
 			return;
 		}
+		UUID uuid;
 		try {
-			success = networkDiscovery->discoverByUuid(UUID(cmd[2]), discovered, false);
+			uuid = UUID(cmd[2]);
 		} catch (std::invalid_argument &e) {
 			printUsageError("could not parse uuid");
 			return;
 		}
-	} else {
-		printUsageError("invalid argument: " + cmd[1]);
-	}
+		bool isService = (cmd[1] == "s");
+
+		if (!networkDiscovery) {
+			/* Only local devices can be found */
+			std::vector<indexed_service_t> matches = isService ?
+					beetle.serviceIndex->findService(uuid) : beetle.serviceIndex->findCharacteristic(uuid);
+			for (auto &m : matches) {
+				std::stringstream ss;
+				ss << "device : " << m.name << " (" << m.id << ") handles " << m.startHandle << "-" << m.endHandle;
+				printMessage(ss.str());
+			}
+			return;
+		}
 
-	if (success) {
-		for (auto &d : discovered) {
-			printMessage("device : " + d.name);
-			printMessage("  gateway : " + d.gateway);
-			printMessage("  remote id : " + std::to_string(d.id));
-			printMessage("  ip : " + d.ip);
-			printMessage("  port : " + std::to_string(d.port));
+		/*
+		 * Local results are printed right away. Wait for the controller for the rest.
+		 */
+		std::promise<bool> remoteDone;
+		std::mutex printMutex;
+		networkDiscovery->discoverByUuidAsync(uuid,
+				[&](const std::list<discovery_result_t> &discovered, bool remote, bool success) {
+			std::lock_guard<std::mutex> lg(printMutex);
+			printDiscovered(discovered, print);
+			if (remote) {
+				remoteDone.set_value(success);
+			}
+		}, isService);
+		if (!remoteDone.get_future().get()) {
+			printMessage("network discovery failed");
 		}
 	} else {
-		printMessage("network discovery failed");
+		printUsageError("invalid argument: " + cmd[1]);
 	}
 }
 
@@ -654,7 +698,7 @@ void CLI::doSetMaxConnectionInterval(const std::vector<std::string>& cmd) {
 
 void CLI::doDumpData(const std::vector<std::string>& cmd) {
 	if (cmd.size() != 2) {
-		printUsage("dump latency|config");
+		printUsage("dump latency|config|tls");
 		return;
 	}
 
@@ -679,11 +723,122 @@ void CLI::doDumpData(const std::vector<std::string>& cmd) {
 		}
 	} else if (cmd[1] == "config") {
 		O_STREAM << beetleConfig.str() << std::endl;
+	} else if (cmd[1] == "tls") {
+		O_STREAM << SSLConfig::getAllHandshakeStats();
 	} else {
 		printUsageError(cmd[1] + " not recognized");
 	}
 }
 
+void CLI::doStats(const std::vector<std::string>& cmd) {
+	if (cmd.size() == 1) {
+		O_STREAM << beetle.metrics.summary();
+	} else if (cmd.size() == 2 && cmd[1] == "prometheus") {
+		O_STREAM << beetle.metrics.prometheus();
+	} else {
+		printUsage("stats [prometheus]");
+	}
+}
+
+void CLI::doTrace(const std::vector<std::string>& cmd) {
+	if (cmd.size() >= 2 && cmd.size() <= 3 && cmd[1] == "on") {
+		int rate = 1;
+		if (cmd.size() == 3) {
+			try {
+				rate = std::stoi(cmd[2]);
+			} catch (std::exception &e) {
+				rate = 0;
+			}
+			if (rate <= 0) {
+				printUsageError("invalid sample rate");
+				return;
+			}
+		}
+		traceStart(rate);
+		printMessage("tracing 1 in " + std::to_string(rate) + " packets");
+	} else if (cmd.size() == 2 && cmd[1] == "off") {
+		traceStop();
+	} else if (cmd.size() == 3 && cmd[1] == "dump") {
+		std::ofstream ofs(cmd[2]);
+		if (!ofs) {
+			printUsageError("could not open " + cmd[2]);
+			return;
+		}
+		int spans = traceDump(ofs);
+		printMessage("wrote " + std::to_string(spans) + " spans to " + cmd[2]);
+	} else {
+		printUsage("trace on [sample rate]");
+		printUsage("trace off");
+		printUsage("trace dump file");
+	}
+}
+
+void CLI::doCapture(const std::vector<std::string>& cmd) {
+	if (cmd.size() == 1) {
+		std::string status = captureStatus();
+		printMessage((status == "") ? "not capturing" : status);
+	} else if (cmd.size() >= 3 && cmd.size() % 2 == 1 && cmd[1] == "start") {
+		capture_params_t params;
+		params.path = cmd[2];
+		params.packets = CAPTURE_DEFAULT_PACKETS;
+
+		boost::shared_lock<boost::shared_mutex> deviceslk(beetle.devicesMutex);
+		for (size_t i = 3; i < cmd.size(); i += 2) {
+			const std::string &filter = cmd[i];
+			const std::string &value = cmd[i + 1];
+			if (filter == "device") {
+				std::shared_ptr<Device> device = matchDevice(value);
+				if (!device) {
+					printUsageError("could not match device: " + value);
+					return;
+				}
+				params.devices.insert(device->getId());
+			} else if (filter == "opcode" || filter == "packets") {
+				long n;
+				try {
+					n = std::stol(value, NULL, 0);
+				} catch (std::exception &e) {
+					n = -1;
+				}
+				if (filter == "opcode" && n >= 0 && n <= 0xFF) {
+					params.opCodes.insert(n);
+				} else if (filter == "packets" && n > 0 && (size_t) n <= CAPTURE_MAX_PACKETS) {
+					params.packets = n;
+				} else if (filter == "packets") {
+					printUsageError("packets must be in range 1 to " + std::to_string(CAPTURE_MAX_PACKETS));
+					return;
+				} else {
+					printUsageError("invalid " + filter + ": " + value);
+					return;
+				}
+			} else {
+				printUsageError("unknown filter: " + filter);
+				return;
+			}
+		}
+		deviceslk.unlock();
+
+		try {
+			captureStart(params);
+		} catch (CaptureException &e) {
+			printUsageError(e.what());
+			return;
+		}
+		printMessage(captureStatus());
+	} else if (cmd.size() == 2 && cmd[1] == "stop") {
+		long packets = captureStop();
+		if (packets < 0) {
+			printUsageError("not capturing");
+		} else {
+			printMessage("captured " + std::to_string(packets) + " packets");
+		}
+	} else {
+		printUsage("capture");
+		printUsage("capture start file [packets n] [device name|id|addr]... [opcode op]...");
+		printUsage("capture stop");
+	}
+}
+
 void CLI::doSetDebug(const std::vector<std::string>& cmd) {
 	if (cmd.size() != 2 && cmd.size() != 3) {
 		printUsage("debug on|off");
@@ -0,0 +1,271 @@
+/*
+ * Capture.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "Capture.h"
+
+#include <arpa/inet.h>
+#include <bluetooth/bluetooth.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+std::atomic<bool> capture_enabled(false);
+
+/*
+ * pcapng block types and options.
+ */
+static const uint32_t PCAPNG_SHB = 0x0A0D0D0A;
+static const uint32_t PCAPNG_IDB = 0x00000001;
+static const uint32_t PCAPNG_ISB = 0x00000005;
+static const uint32_t PCAPNG_EPB = 0x00000006;
+static const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+static const uint16_t PCAPNG_OPT_ENDOFOPT = 0;
+static const uint16_t PCAPNG_OPT_COMMENT = 1;
+static const uint16_t PCAPNG_OPT_EPB_FLAGS = 2;
+static const uint16_t PCAPNG_OPT_IF_TSRESOL = 9;
+static const uint32_t PCAPNG_EPB_INBOUND = 1;
+static const uint32_t PCAPNG_EPB_OUTBOUND = 2;
+
+/*
+ * LINKTYPE_BLUETOOTH_HCI_H4_WITH_PHDR: a 4 byte direction, then the H4
+ * packet type.
+ */
+static const uint16_t LINKTYPE_H4_WITH_PHDR = 201;
+static const uint8_t H4_ACL = 0x02;
+static const uint16_t ACL_START_FLUSHABLE = 0x2000;
+static const uint16_t L2CAP_CID_ATT = 0x0004;
+static const int PDU_HEADER_LEN = 4 + 1 + 4 + 4;
+
+static inline size_t pad4(size_t len) {
+	return (len + 3) & ~(size_t) 3;
+}
+
+/*
+ * Every slot in the ring is a block of the same length. Packets are enhanced
+ * packet blocks, and unused slots are empty interface statistics blocks. Both
+ * are padded out with the comment option. The file is well formed, except
+ * for blocks being written.
+ */
+static const size_t SHB_LEN = 28;
+static const size_t IDB_LEN = 32;
+static const size_t FILE_HEADER_LEN = SHB_LEN + IDB_LEN;
+static const size_t MAX_COMMENT_LEN = 32;
+static const size_t SLOT_LEN = 28 + pad4(PDU_HEADER_LEN + CAPTURE_SNAP_LEN) + 8 + 4 + MAX_COMMENT_LEN + 4 + 4;
+
+typedef struct {
+	std::string path;
+	int fd;
+	uint8_t *map;
+	size_t mapLen;
+	size_t slots;
+	std::set<device_t> devices;
+	bool opCodes[256];
+	uint64_t realtimeOffset;	// added to monotonic time
+	std::atomic<uint64_t> next;
+} capture_t;
+
+/*
+ * Writers announce themselves before loading the capture, so that stopping
+ * can wait for them to finish with it.
+ */
+static std::atomic<capture_t *> current(NULL);
+static std::atomic<int> activeWriters(0);
+static std::mutex captureMutex;
+
+static uint64_t clockNanos(clockid_t clock) {
+	struct timespec spec;
+	clock_gettime(clock, &spec);
+	return (uint64_t) spec.tv_sec * 1000000000 + spec.tv_nsec;
+}
+
+static uint8_t *putOption(uint8_t *p, uint16_t code, uint16_t len) {
+	*(uint16_t *) p = code;
+	*(uint16_t *) (p + 2) = len;
+	return p + 4;
+}
+
+/*
+ * Comment option filling the rest of the block, followed by the end of
+ * options and the block trailer.
+ */
+static void putCommentAndTrailer(uint8_t *slot, uint8_t *p, const char *comment, size_t commentLen) {
+	size_t len = SLOT_LEN - (p - slot) - 4 - 4 - 4;
+	p = putOption(p, PCAPNG_OPT_COMMENT, len);
+	memset(p, ' ', len);
+	memcpy(p, comment, std::min(commentLen, len));
+	p += len;
+	p = putOption(p, PCAPNG_OPT_ENDOFOPT, 0);
+	*(uint32_t *) p = SLOT_LEN;
+}
+
+static void writeEmptySlot(uint8_t *slot) {
+	*(uint32_t *) slot = PCAPNG_ISB;
+	*(uint32_t *) (slot + 4) = SLOT_LEN;
+	*(uint32_t *) (slot + 8) = 0;		// interface
+	*(uint32_t *) (slot + 12) = 0;		// timestamp
+	*(uint32_t *) (slot + 16) = 0;
+	putCommentAndTrailer(slot, slot + 20, "", 0);
+}
+
+static void writeFileHeader(uint8_t *p) {
+	*(uint32_t *) p = PCAPNG_SHB;
+	*(uint32_t *) (p + 4) = SHB_LEN;
+	*(uint32_t *) (p + 8) = PCAPNG_BYTE_ORDER_MAGIC;
+	*(uint16_t *) (p + 12) = 1;			// major version
+	*(uint16_t *) (p + 14) = 0;			// minor version
+	*(int64_t *) (p + 16) = -1;			// section length, unspecified
+	*(uint32_t *) (p + 24) = SHB_LEN;
+	p += SHB_LEN;
+
+	*(uint32_t *) p = PCAPNG_IDB;
+	*(uint32_t *) (p + 4) = IDB_LEN;
+	*(uint16_t *) (p + 8) = LINKTYPE_H4_WITH_PHDR;
+	*(uint16_t *) (p + 10) = 0;
+	*(uint32_t *) (p + 12) = PDU_HEADER_LEN + CAPTURE_SNAP_LEN;
+	uint8_t *opt = putOption(p + 16, PCAPNG_OPT_IF_TSRESOL, 1);
+	*(uint32_t *) opt = 0;
+	opt[0] = 9;							// nanoseconds
+	opt = putOption(opt + 4, PCAPNG_OPT_ENDOFOPT, 0);
+	*(uint32_t *) opt = IDB_LEN;
+}
+
+static void writePacket(capture_t *c, device_t device, bool received, const uint8_t *buf, int len) {
+	uint64_t index = c->next.fetch_add(1, std::memory_order_relaxed);
+	uint8_t *slot = c->map + FILE_HEADER_LEN + (index % c->slots) * SLOT_LEN;
+
+	uint64_t ts = clockNanos(CLOCK_MONOTONIC) + c->realtimeOffset;
+	int capLen = std::min(len, CAPTURE_SNAP_LEN);
+
+	*(uint32_t *) slot = PCAPNG_EPB;
+	*(uint32_t *) (slot + 4) = SLOT_LEN;
+	*(uint32_t *) (slot + 8) = 0;		// interface
+	*(uint32_t *) (slot + 12) = ts >> 32;
+	*(uint32_t *) (slot + 16) = ts & 0xFFFFFFFF;
+	*(uint32_t *) (slot + 20) = PDU_HEADER_LEN + capLen;
+	*(uint32_t *) (slot + 24) = PDU_HEADER_LEN + len;
+
+	uint8_t *p = slot + 28;
+	*(uint32_t *) p = htonl(received ? 1 : 0);
+	p[4] = H4_ACL;
+	*(uint16_t *) (p + 5) = htobs(ACL_START_FLUSHABLE | (device & 0x0FFF));
+	*(uint16_t *) (p + 7) = htobs(len + 4);
+	*(uint16_t *) (p + 9) = htobs(len);
+	*(uint16_t *) (p + 11) = htobs(L2CAP_CID_ATT);
+	memcpy(p + PDU_HEADER_LEN, buf, capLen);
+	memset(p + PDU_HEADER_LEN + capLen, 0, pad4(PDU_HEADER_LEN + capLen) - PDU_HEADER_LEN - capLen);
+	p += pad4(PDU_HEADER_LEN + capLen);
+
+	p = putOption(p, PCAPNG_OPT_EPB_FLAGS, 4);
+	*(uint32_t *) p = received ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+	char comment[MAX_COMMENT_LEN + 1];
+	int commentLen = snprintf(comment, sizeof(comment), "device %ld", device);
+	putCommentAndTrailer(slot, p + 4, comment, commentLen);
+}
+
+void captureAtt(device_t device, bool received, const uint8_t *buf, int len) {
+	activeWriters.fetch_add(1);
+	capture_t *c = current.load();
+	if (c != NULL && len > 0 && c->opCodes[buf[0]] && (c->devices.empty() || c->devices.count(device))) {
+		writePacket(c, device, received, buf, len);
+	}
+	activeWriters.fetch_sub(1);
+}
+
+void captureStart(const capture_params_t &params) {
+	std::lock_guard<std::mutex> lg(captureMutex);
+	if (current.load() != NULL) {
+		throw CaptureException("already capturing to " + current.load()->path);
+	}
+	if (params.packets == 0) {
+		throw CaptureException("capture must keep at least one packet");
+	}
+	if (params.packets > CAPTURE_MAX_PACKETS || params.packets > (SIZE_MAX - FILE_HEADER_LEN) / SLOT_LEN) {
+		throw CaptureException("capture can keep at most " + std::to_string(CAPTURE_MAX_PACKETS) + " packets");
+	}
+
+	std::unique_ptr<capture_t> c(new capture_t());
+	c->path = params.path;
+	c->slots = params.packets;
+	c->mapLen = FILE_HEADER_LEN + c->slots * SLOT_LEN;
+	c->devices = params.devices;
+	for (int i = 0; i < 256; i++) {
+		c->opCodes[i] = params.opCodes.empty() || params.opCodes.count(i);
+	}
+	c->realtimeOffset = clockNanos(CLOCK_REALTIME) - clockNanos(CLOCK_MONOTONIC);
+	c->next = 0;
+
+	c->fd = open(c->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (c->fd < 0) {
+		throw CaptureException("could not open " + c->path + ": " + strerror(errno));
+	}
+	if (ftruncate(c->fd, c->mapLen) < 0) {
+		std::string err = strerror(errno);
+		close(c->fd);
+		throw CaptureException("could not size " + c->path + ": " + err);
+	}
+	void *map = mmap(NULL, c->mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+	if (map == MAP_FAILED) {
+		std::string err = strerror(errno);
+		close(c->fd);
+		throw CaptureException("could not map " + c->path + ": " + err);
+	}
+	c->map = (uint8_t *) map;
+
+	/*
+	 * Writing every slot now also faults in the pages, so that writers do not.
+	 */
+	writeFileHeader(c->map);
+	for (size_t i = 0; i < c->slots; i++) {
+		writeEmptySlot(c->map + FILE_HEADER_LEN + i * SLOT_LEN);
+	}
+
+	current = c.release();
+	capture_enabled = true;
+}
+
+long captureStop() {
+	std::lock_guard<std::mutex> lg(captureMutex);
+	capture_t *c = current.exchange(NULL);
+	if (c == NULL) {
+		return -1;
+	}
+	capture_enabled = false;
+	while (activeWriters.load() != 0) {
+		std::this_thread::yield();
+	}
+
+	long packets = c->next.load();
+	munmap(c->map, c->mapLen);
+	close(c->fd);
+	delete c;
+	return packets;
+}
+
+std::string captureStatus() {
+	std::lock_guard<std::mutex> lg(captureMutex);
+	capture_t *c = current.load();
+	if (c == NULL) {
+		return "";
+	}
+
+	uint64_t packets = c->next.load();
+	std::stringstream ss;
+	ss << "capturing to " << c->path << ": " << packets << " packets";
+	if (packets > c->slots) {
+		ss << ", " << (packets - c->slots) << " overwritten";
+	}
+	return ss.str();
+}
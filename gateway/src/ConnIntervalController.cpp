@@ -0,0 +1,180 @@
+/*
+ * ConnIntervalController.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "ConnIntervalController.h"
+
+#include <boost/thread/lock_types.hpp>
+#include <boost/thread/pthread/shared_mutex.hpp>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "Beetle.h"
+#include "Debug.h"
+#include "Device.h"
+#include "device/socket/LEDevice.h"
+#include "device/VirtualDevice.h"
+#include "Handle.h"
+
+ConnIntervalController::ConnIntervalController(Beetle &beetle, const BeetleConfig &config) :
+		beetle(beetle) {
+	period = config.connIntervalPeriod;
+
+	fastProfile.minInterval = config.connIntervalFastMin;
+	fastProfile.maxInterval = config.connIntervalFastMax;
+	fastProfile.latency = 0;
+
+	slowProfile.minInterval = config.connIntervalSlowMin;
+	slowProfile.maxInterval = config.connIntervalSlowMax;
+	slowProfile.latency = config.connIntervalSlowLatency;
+
+	fastQueueDepth = config.connIntervalFastQueueDepth;
+	fastLatency = config.connIntervalFastLatency;
+	fastNotifyRate = config.connIntervalFastNotifyRate;
+	slowAfter = config.connIntervalSlowAfter;
+
+	if (config.connIntervalPinSubscribed) {
+		pinPolicy = getSubscribedPinPolicy();
+	}
+}
+
+ConnIntervalController::~ConnIntervalController() {
+
+}
+
+void ConnIntervalController::setPinPolicy(PinPolicy policy) {
+	std::lock_guard<std::mutex> lg(pinPolicyMutex);
+	pinPolicy = policy;
+}
+
+ConnIntervalController::PinPolicy ConnIntervalController::getSubscribedPinPolicy() {
+	return [](std::shared_ptr<LEDevice> device) {
+		std::lock_guard<std::recursive_mutex> handlesLg(device->handlesMutex);
+		for (auto &kv : device->handles) {
+			if (!kv.second->subscribersNotify.empty() || !kv.second->subscribersIndicate.empty()) {
+				return true;
+			}
+		}
+		return false;
+	};
+}
+
+std::function<void()> ConnIntervalController::getDaemon() {
+	return [this] {
+		PinPolicy policy;
+		pinPolicyMutex.lock();
+		policy = pinPolicy;
+		pinPolicyMutex.unlock();
+
+		/*
+		 * Links are added while holding the devices lock, so that the remove
+		 * handler, which runs after the device is gone, erases them.
+		 */
+		std::vector<std::pair<std::shared_ptr<LEDevice>, bool>> les;
+		{
+			boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+			std::lock_guard<std::mutex> linksLg(linksMutex);
+			for (auto &kv : beetle.devices) {
+				auto le = std::dynamic_pointer_cast<LEDevice>(kv.second);
+				if (!le) {
+					continue;
+				}
+
+				if (links.find(kv.first) == links.end()) {
+					link_state_t state;
+					state.profile = UNSET;
+					state.idlePeriods = 0;
+					links.insert(std::make_pair(kv.first, state));
+				}
+				les.push_back(std::make_pair(le, policy && policy(le)));
+			}
+		}
+
+		/*
+		 * Updates block until the controller answers, so no locks are held
+		 * while adjusting. Only this daemon changes the state of a link.
+		 */
+		for (auto &kv : les) {
+			link_state_t state;
+			{
+				std::lock_guard<std::mutex> linksLg(linksMutex);
+				auto it = links.find(kv.first->getId());
+				if (it == links.end()) {
+					continue;
+				}
+				state = it->second;
+			}
+
+			adjust(kv.first, state, kv.second);
+
+			std::lock_guard<std::mutex> linksLg(linksMutex);
+			auto it = links.find(kv.first->getId());
+			if (it != links.end()) {
+				it->second = state;
+			}
+		}
+	};
+}
+
+RemoveDeviceHandler ConnIntervalController::getRemoveDeviceHandler() {
+	return [this](device_t d) {
+		std::lock_guard<std::mutex> lg(linksMutex);
+		links.erase(d);
+	};
+}
+
+/*
+ * Going fast happens as soon as any entry threshold is crossed. Going slow
+ * requires traffic to stay below half of every threshold for slowAfter
+ * consecutive periods, so bursty links do not flap between profiles.
+ */
+void ConnIntervalController::adjust(std::shared_ptr<LEDevice> le, link_state_t &state, bool pinned) {
+	VirtualDevice::traffic_stats_t stats = le->getTrafficStats();
+
+	uint64_t avgLatency = (stats.transactions > 0) ? stats.totalLatency / stats.transactions : 0;
+	double notifyRate = (double) stats.notifications / period;
+
+	bool busy = pinned
+			|| stats.queueDepth >= fastQueueDepth
+			|| avgLatency >= fastLatency
+			|| notifyRate >= fastNotifyRate;
+	bool idle = !pinned
+			&& 2 * stats.queueDepth < fastQueueDepth
+			&& 2 * avgLatency < fastLatency
+			&& 2 * notifyRate < fastNotifyRate;
+
+	if (busy) {
+		state.idlePeriods = 0;
+		if (state.profile != FAST) {
+			apply(le, state, FAST);
+		}
+	} else if (idle) {
+		state.idlePeriods++;
+		if (state.profile != SLOW && state.idlePeriods >= slowAfter) {
+			apply(le, state, SLOW);
+		}
+	} else {
+		state.idlePeriods = 0;
+	}
+}
+
+bool ConnIntervalController::apply(std::shared_ptr<LEDevice> le, link_state_t &state, Profile profile) {
+	interval_profile_t &p = (profile == FAST) ? fastProfile : slowProfile;
+	if (!le->setConnectionInterval(p.minInterval, p.maxInterval, p.latency)) {
+		/* Leave the state unchanged so that the update is retried */
+		return false;
+	}
+
+	state.profile = profile;
+	if (debug_socket) {
+		std::stringstream ss;
+		ss << "connection interval for " << le->getId() << " set to " << ((profile == FAST) ? "fast" : "slow")
+				<< " (" << p.minInterval << "-" << p.maxInterval << ", latency " << p.latency << ")";
+		pdebug(ss.str());
+	}
+	return true;
+}
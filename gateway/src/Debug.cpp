@@ -0,0 +1,19 @@
+/*
+ * Debug.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "Debug.h"
+
+/* Global debug variables */
+bool debug;
+bool debug_scan;
+bool debug_topology;
+bool debug_discovery;
+bool debug_router;
+bool debug_socket;
+bool debug_controller;
+bool debug_performance;
+bool debug_advertise;
@@ -15,10 +15,11 @@
 #include "Beetle.h"
 #include "ble/att.h"
 #include "Handle.h"
-#include "hat/BlockAllocator.h"
+#include "hat/IntervalAllocator.h"
 #include "UUID.h"
 
 std::atomic_int Device::idCounter(1);
+std::atomic<uint32_t> Device::handlesVersionCounter(0);
 
 const std::string Device::deviceType2Str[] = {
 		"BeetleInternal", 	// 0
@@ -37,8 +38,9 @@ Device::Device(Beetle &beetle_, HandleAllocationTable *hat_) :
 Device::Device(Beetle &beetle_, device_t id_, HandleAllocationTable *hat_) :
 		hat(hat_), beetle(beetle_) {
 	id = id_;
+	handlesVersion = 0;
 	if (!hat) {
-		hat = std::make_unique<BlockAllocator>(256);
+		hat = std::make_unique<IntervalAllocator>();
 	}
 	type = UNKNOWN;
 }
@@ -72,11 +74,47 @@ int Device::getHighestHandle() {
 	}
 }
 
+void Device::indexHandles() {
+	std::lock_guard<std::recursive_mutex> lg(handlesMutex);
+	handlesByType.clear();
+	handlesByLongType.clear();
+	for (auto &kv : handles) {
+		uuid_id_t id;
+		if (kv.second->getUuidId(id)) {
+			handlesByType[id].push_back(kv.first);
+		} else {
+			handlesByLongType[kv.second->getUuid()].push_back(kv.first);
+		}
+	}
+	handlesVersion = ++handlesVersionCounter;
+}
+
+uint32_t Device::getHandlesVersion() {
+	return handlesVersion;
+}
+
+const std::vector<uint16_t> &Device::getHandlesByType(const UUID &type) {
+	static const std::vector<uint16_t> none;
+	uuid_id_t id;
+	if (!type.isShort()) {
+		auto it = handlesByLongType.find(type);
+		return (it == handlesByLongType.end()) ? none : it->second;
+	}
+	if (!UUIDTable::find(type, id)) {
+		return none;
+	}
+	auto it = handlesByType.find(id);
+	if (it == handlesByType.end()) {
+		return none;
+	}
+	return it->second;
+}
+
 void Device::unsubscribeAll(device_t d) {
 	std::lock_guard<std::recursive_mutex> lg(handlesMutex);
 	std::map<uint16_t,uint8_t> charCccdsToWrite;
 	for (auto &kv : handles) {
-		auto cvH = std::dynamic_pointer_cast<CharacteristicValue>(kv.second);
+		auto cvH = handle_cast<CharacteristicValue>(kv.second);
 		if (cvH) {
 			uint8_t initialState = 0;
 			initialState += (cvH->subscribersNotify.empty()) ? 0 : 1;
@@ -96,7 +134,7 @@ void Device::unsubscribeAll(device_t d) {
 		/*
 		 * Makes assumption that cccd follows attribute value
 		 */
-		auto cccdH = std::dynamic_pointer_cast<ClientCharCfg>(kv.second);
+		auto cccdH = handle_cast<ClientCharCfg>(kv.second);
 		if (cccdH && type != BEETLE_INTERNAL && charCccdsToWrite.find(cccdH->getCharHandle()) != charCccdsToWrite.end()) {
 			int reqLen = 5;
 			uint8_t req[reqLen];
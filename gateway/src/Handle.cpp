@@ -9,6 +9,7 @@
 
 #include <bluetooth/bluetooth.h>
 #include <boost/smart_ptr/shared_array.hpp>
+#include <set>
 #include <sstream>
 
 #include "ble/gatt.h"
@@ -30,6 +31,7 @@ void CachedHandle::clear() {
 }
 
 Handle::Handle(bool staticHandle_, bool cacheInfinite_) {
+	uuidInterned = UUIDTable::intern(uuid, uuidId);
 	staticHandle = staticHandle_;
 	cacheInfinite = cacheInfinite_;
 }
@@ -38,6 +40,10 @@ Handle::~Handle() {
 
 }
 
+Handle::Kind Handle::getKind() const {
+	return kind;
+}
+
 bool Handle::isStaticHandle() const {
 	return staticHandle;
 }
@@ -84,11 +90,21 @@ UUID Handle::getUuid() const {
 
 void Handle::setUuid(UUID uuid_) {
 	uuid = uuid_;
+	uuidInterned = UUIDTable::intern(uuid, uuidId);
+}
+
+bool Handle::getUuidId(uuid_id_t &id) const {
+	id = uuidId;
+	return uuidInterned;
+}
+
+std::string Handle::getUuidStr() const {
+	return uuidInterned ? UUIDTable::str(uuidId) : uuid.str();
 }
 
 std::string Handle::str() const {
 	std::stringstream ss;
-	ss << handle << "\t" << uuid.str() << "\tsH=" << serviceHandle << "\tcH=" << charHandle;
+	ss << handle << "\t" << getUuidStr() << "\tsH=" << serviceHandle << "\tcH=" << charHandle;
 	if (cache.value != NULL) {
 		ss << "\tcache: [";
 		std::string sep = "";
@@ -103,7 +119,7 @@ std::string Handle::str() const {
 
 CharacteristicValue::CharacteristicValue(bool staticHandle, bool cacheInfinite)
 	: Handle(staticHandle, cacheInfinite) {
-
+	kind = CHARACTERISTIC_VALUE;
 }
 
 std::string CharacteristicValue::str() const {
@@ -112,7 +128,7 @@ std::string CharacteristicValue::str() const {
 	subscribers.insert(subscribersIndicate.cbegin(), subscribersIndicate.cend());
 
 	std::stringstream ss;
-	ss << handle << "\t" << uuid.str() << "\tsH=" << serviceHandle << "\tcH=" << charHandle << "\tnSub="
+	ss << handle << "\t" << getUuidStr() << "\tsH=" << serviceHandle << "\tcH=" << charHandle << "\tnSub="
 			<< subscribers.size();
 	if (!subscribers.empty()) {
 		ss << "\tsub=[";
@@ -136,7 +152,8 @@ std::string CharacteristicValue::str() const {
 }
 
 PrimaryService::PrimaryService() : Handle(true, true) {
-	uuid = UUID(GATT_PRIM_SVC_UUID);
+	kind = PRIMARY_SERVICE;
+	setUuid(UUID(GATT_PRIM_SVC_UUID));
 }
 
 UUID PrimaryService::getServiceUuid() const {
@@ -151,7 +168,8 @@ std::string PrimaryService::str() const {
 }
 
 Characteristic::Characteristic() : Handle(true, true) {
-	uuid = UUID(GATT_CHARAC_UUID);
+	kind = CHARACTERISTIC;
+	setUuid(UUID(GATT_CHARAC_UUID));
 }
 
 uint16_t Characteristic::getAttrHandle() const {
@@ -194,7 +212,8 @@ std::string Characteristic::str() const {
 }
 
 ClientCharCfg::ClientCharCfg() : Handle(false, false) {
-	uuid = UUID(GATT_CLIENT_CHARAC_CFG_UUID);
+	kind = CLIENT_CHAR_CFG;
+	setUuid(UUID(GATT_CLIENT_CHARAC_CFG_UUID));
 }
 
 std::string ClientCharCfg::str() const {
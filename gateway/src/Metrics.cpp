@@ -0,0 +1,361 @@
+/*
+ * Metrics.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+static std::atomic<int> nextShard(0);
+
+int metricsThreadShard() {
+	static thread_local int shard = nextShard.fetch_add(1) % Counter::NUM_SHARDS;
+	return shard;
+}
+
+Counter::Counter() {
+	for (int i = 0; i < NUM_SHARDS; i++) {
+		shards[i].value = 0;
+	}
+}
+
+uint64_t Counter::value() {
+	uint64_t total = 0;
+	for (int i = 0; i < NUM_SHARDS; i++) {
+		total += shards[i].value.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+Gauge::Gauge() {
+	val = 0;
+}
+
+int64_t Gauge::value() {
+	return val.load(std::memory_order_relaxed);
+}
+
+Histogram::Histogram() {
+	for (int i = 0; i < NUM_BUCKETS; i++) {
+		counts[i] = 0;
+	}
+	sum = 0;
+	max = 0;
+}
+
+int Histogram::bucketOf(uint64_t micros) {
+	if (micros < SUB_BUCKETS) {
+		return micros;
+	}
+	int exponent = 63 - __builtin_clzll(micros);
+	if (exponent >= MAX_EXPONENT) {
+		return NUM_BUCKETS - 1;
+	}
+	int sub = (micros >> (exponent - 3)) & (SUB_BUCKETS - 1);
+	return (exponent - 2) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucketUpperBound(int bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	int exponent = bucket / SUB_BUCKETS + 2;
+	int sub = bucket % SUB_BUCKETS;
+	return ((uint64_t) (SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+}
+
+void Histogram::record(uint64_t micros) {
+	counts[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(micros, std::memory_order_relaxed);
+	uint64_t prev = max.load(std::memory_order_relaxed);
+	while (micros > prev && !max.compare_exchange_weak(prev, micros, std::memory_order_relaxed)) {
+		// retry
+	}
+}
+
+histogram_snapshot_t Histogram::snapshot() {
+	histogram_snapshot_t ret;
+	ret.counts.resize(NUM_BUCKETS);
+	ret.count = 0;
+	for (int i = 0; i < NUM_BUCKETS; i++) {
+		ret.counts[i] = counts[i].load(std::memory_order_relaxed);
+		ret.count += ret.counts[i];
+	}
+	ret.sum = sum.load(std::memory_order_relaxed);
+	ret.max = max.load(std::memory_order_relaxed);
+	return ret;
+}
+
+uint64_t Histogram::percentile(const histogram_snapshot_t &snapshot, double q) {
+	if (snapshot.count == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t) (q * snapshot.count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (int i = 0; i < (int) snapshot.counts.size(); i++) {
+		seen += snapshot.counts[i];
+		if (seen >= rank) {
+			return std::min(bucketUpperBound(i), snapshot.max);
+		}
+	}
+	return snapshot.max;
+}
+
+/*
+ * Bucket bounds in seconds for export. Counts are rounded down to the
+ * resolution of the histogram.
+ */
+static const double EXPORT_BUCKETS[] = { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+		0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60 };
+
+static std::string escapeLabel(const std::string &s) {
+	std::string ret;
+	for (char c : s) {
+		if (c == '\\' || c == '"') {
+			ret += '\\';
+			ret += c;
+		} else if (c == '\n') {
+			ret += "\\n";
+		} else {
+			ret += c;
+		}
+	}
+	return ret;
+}
+
+static std::string formatLabels(const metric_labels_t &labels, std::string extra = "") {
+	if (labels.empty() && extra.empty()) {
+		return "";
+	}
+	std::stringstream ss;
+	ss << "{";
+	std::string delim = "";
+	for (auto &kv : labels) {
+		ss << delim << kv.first << "=\"" << escapeLabel(kv.second) << "\"";
+		delim = ",";
+	}
+	if (!extra.empty()) {
+		ss << delim << extra;
+	}
+	ss << "}";
+	return ss.str();
+}
+
+static std::string formatDouble(double v) {
+	std::stringstream ss;
+	ss << std::setprecision(9) << v;
+	return ss.str();
+}
+
+MetricsRegistry::MetricsRegistry() {
+
+}
+
+MetricsRegistry::~MetricsRegistry() {
+
+}
+
+MetricsRegistry::series_t &MetricsRegistry::getSeries(const std::string &name, const std::string &help,
+		MetricType type, const metric_labels_t &labels) {
+	family_t &family = families[name];
+	if (family.series.empty()) {
+		family.type = type;
+		family.help = help;
+	} else if (family.type != type) {
+		throw std::invalid_argument(name + " registered with another type");
+	}
+
+	std::string key = formatLabels(labels);
+	std::unique_ptr<series_t> &series = family.series[key];
+	if (!series) {
+		series.reset(new series_t());
+		series->labels = labels;
+	}
+	return *series;
+}
+
+Counter *MetricsRegistry::counter(std::string name, std::string help, metric_labels_t labels) {
+	std::lock_guard<std::mutex> lg(m);
+	series_t &series = getSeries(name, help, COUNTER, labels);
+	if (!series.counter) {
+		series.counter.reset(new Counter());
+	}
+	return series.counter.get();
+}
+
+Gauge *MetricsRegistry::gauge(std::string name, std::string help, metric_labels_t labels) {
+	std::lock_guard<std::mutex> lg(m);
+	series_t &series = getSeries(name, help, GAUGE, labels);
+	if (!series.gauge) {
+		series.gauge.reset(new Gauge());
+	}
+	return series.gauge.get();
+}
+
+void MetricsRegistry::gauge(std::string name, std::string help, metric_labels_t labels,
+		std::function<double()> f) {
+	std::lock_guard<std::mutex> lg(m);
+	series_t &series = getSeries(name, help, GAUGE, labels);
+	series.gauge.reset();
+	series.gaugeFunction = f;
+}
+
+Histogram *MetricsRegistry::histogram(std::string name, std::string help, metric_labels_t labels) {
+	std::lock_guard<std::mutex> lg(m);
+	series_t &series = getSeries(name, help, HISTOGRAM, labels);
+	if (!series.histogram) {
+		series.histogram.reset(new Histogram());
+	}
+	return series.histogram.get();
+}
+
+transport_metrics_t &MetricsRegistry::transport(std::string name) {
+	{
+		std::lock_guard<std::mutex> lg(m);
+		auto it = transports.find(name);
+		if (it != transports.end()) {
+			return it->second;
+		}
+	}
+
+	transport_metrics_t t;
+	metric_labels_t in = { { "transport", name }, { "direction", "in" } };
+	metric_labels_t out = { { "transport", name }, { "direction", "out" } };
+	t.bytesIn = counter("beetle_transport_bytes_total", "Bytes read and written by transport.", in);
+	t.bytesOut = counter("beetle_transport_bytes_total", "Bytes read and written by transport.", out);
+	t.packetsIn = counter("beetle_transport_packets_total", "Packets read and written by transport.", in);
+	t.packetsOut = counter("beetle_transport_packets_total", "Packets read and written by transport.", out);
+
+	std::lock_guard<std::mutex> lg(m);
+	return transports.insert(std::make_pair(name, t)).first->second;
+}
+
+cache_metrics_t &MetricsRegistry::cache(std::string name) {
+	{
+		std::lock_guard<std::mutex> lg(m);
+		auto it = caches.find(name);
+		if (it != caches.end()) {
+			return it->second;
+		}
+	}
+
+	cache_metrics_t c;
+	c.hits = counter("beetle_cache_hits_total", "Lookups answered from a cache.", { { "cache", name } });
+	c.misses = counter("beetle_cache_misses_total", "Lookups not answered from a cache.", { { "cache", name } });
+
+	Counter *hits = c.hits;
+	Counter *misses = c.misses;
+	gauge("beetle_cache_hit_ratio", "Hits over lookups, since start.", { { "cache", name } }, [hits, misses] {
+		double total = hits->value() + misses->value();
+		return (total > 0) ? hits->value() / total : 0;
+	});
+
+	std::lock_guard<std::mutex> lg(m);
+	return caches.insert(std::make_pair(name, c)).first->second;
+}
+
+void MetricsRegistry::remove(std::string label, std::string value) {
+	std::lock_guard<std::mutex> lg(m);
+	for (auto fit = families.begin(); fit != families.end();) {
+		auto &series = fit->second.series;
+		for (auto it = series.begin(); it != series.end();) {
+			bool matches = false;
+			for (auto &kv : it->second->labels) {
+				if (kv.first == label && kv.second == value) {
+					matches = true;
+					break;
+				}
+			}
+			if (matches) {
+				it = series.erase(it);
+			} else {
+				it++;
+			}
+		}
+		if (series.empty()) {
+			fit = families.erase(fit);
+		} else {
+			fit++;
+		}
+	}
+}
+
+std::string MetricsRegistry::prometheus() {
+	std::stringstream ss;
+	std::lock_guard<std::mutex> lg(m);
+	for (auto &fkv : families) {
+		const std::string &name = fkv.first;
+		family_t &family = fkv.second;
+		ss << "# HELP " << name << " " << family.help << "\n";
+		ss << "# TYPE " << name << " "
+				<< ((family.type == COUNTER) ? "counter" : (family.type == GAUGE) ? "gauge" : "histogram") << "\n";
+
+		for (auto &skv : family.series) {
+			series_t &series = *skv.second;
+			if (series.counter) {
+				ss << name << skv.first << " " << series.counter->value() << "\n";
+			} else if (series.gauge) {
+				ss << name << skv.first << " " << series.gauge->value() << "\n";
+			} else if (series.gaugeFunction) {
+				ss << name << skv.first << " " << formatDouble(series.gaugeFunction()) << "\n";
+			} else if (series.histogram) {
+				histogram_snapshot_t snapshot = series.histogram->snapshot();
+				uint64_t cumulative = 0;
+				int bucket = 0;
+				for (double le : EXPORT_BUCKETS) {
+					uint64_t micros = (uint64_t) (le * 1000000);
+					while (bucket < Histogram::NUM_BUCKETS && Histogram::bucketUpperBound(bucket) <= micros) {
+						cumulative += snapshot.counts[bucket++];
+					}
+					ss << name << "_bucket" << formatLabels(series.labels, "le=\"" + formatDouble(le) + "\"")
+							<< " " << cumulative << "\n";
+				}
+				ss << name << "_bucket" << formatLabels(series.labels, "le=\"+Inf\"") << " "
+						<< snapshot.count << "\n";
+				ss << name << "_sum" << skv.first << " " << formatDouble(snapshot.sum / 1e6) << "\n";
+				ss << name << "_count" << skv.first << " " << snapshot.count << "\n";
+			}
+		}
+	}
+	return ss.str();
+}
+
+std::string MetricsRegistry::summary() {
+	std::stringstream ss;
+	std::lock_guard<std::mutex> lg(m);
+	for (auto &fkv : families) {
+		const std::string &name = fkv.first;
+		for (auto &skv : fkv.second.series) {
+			series_t &series = *skv.second;
+			ss << name << skv.first << "\t";
+			if (series.counter) {
+				ss << series.counter->value();
+			} else if (series.gauge) {
+				ss << series.gauge->value();
+			} else if (series.gaugeFunction) {
+				ss << formatDouble(series.gaugeFunction());
+			} else if (series.histogram) {
+				histogram_snapshot_t snapshot = series.histogram->snapshot();
+				ss << "count=" << snapshot.count;
+				if (snapshot.count > 0) {
+					ss << " mean=" << (snapshot.sum / snapshot.count) << "us"
+							<< " p50=" << Histogram::percentile(snapshot, 0.5) << "us"
+							<< " p90=" << Histogram::percentile(snapshot, 0.9) << "us"
+							<< " p99=" << Histogram::percentile(snapshot, 0.99) << "us"
+							<< " max=" << snapshot.max << "us";
+				}
+			}
+			ss << std::endl;
+		}
+	}
+	return ss.str();
+}
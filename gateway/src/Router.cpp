@@ -10,15 +10,18 @@
 #include <bluetooth/bluetooth.h>
 #include <boost/thread/lock_types.hpp>
 #include <boost/thread/pthread/shared_mutex.hpp>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <random>
 #include <set>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "Beetle.h"
 #include "ble/att.h"
@@ -31,11 +34,14 @@
 #include "device/VirtualDevice.h"
 #include "hat/HandleAllocationTable.h"
 #include "Handle.h"
+#include "Trace.h"
 #include "UUID.h"
 
 Router::Router(Beetle &beetle_) :
 		beetle(beetle_) {
-
+	std::random_device rd;
+	tableVersionSalt = rd();
+	readCache = &beetle.metrics.cache("att_read");
 }
 
 Router::~Router() {
@@ -43,8 +49,25 @@ Router::~Router() {
 }
 
 int Router::route(uint8_t *buf, int len, device_t src) {
+	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+	return routeLocked(buf, len, src);
+}
+
+int Router::route(std::vector<std::pair<uint8_t *, int>> &pdus, device_t src) {
+	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+	int result = 0;
+	for (auto &pdu : pdus) {
+		if (routeLocked(pdu.first, pdu.second, src) < 0) {
+			result = -1;
+		}
+	}
+	return result;
+}
+
+int Router::routeLocked(uint8_t *buf, int len, device_t src) {
 	assert(len > 0);
 	int result;
+	TraceSpan span("route", src);
 
 	switch (buf[0]) {
 	case ATT_OP_FIND_INFO_REQ:
@@ -70,6 +93,9 @@ int Router::route(uint8_t *buf, int len, device_t src) {
 	case ATT_OP_SIGNED_WRITE_CMD:
 		result = routeReadWrite(buf, len, src);
 		break;
+	case BEETLE_OP_READ_TABLE_REQ:
+		result = routeReadTable(buf, len, src);
+		break;
 	default:
 		result = routeUnsupported(buf, len, src);
 		break;
@@ -82,7 +108,6 @@ int Router::routeUnsupported(uint8_t *buf, int len, device_t src) {
 		pwarn("unimplemented command " + std::to_string(buf[0]));
 	}
 
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -94,12 +119,139 @@ int Router::routeUnsupported(uint8_t *buf, int len, device_t src) {
 	}
 }
 
-int Router::routeFindInfo(uint8_t *buf, int len, device_t src) {
+static inline void fnv1a(uint32_t &h, uint32_t v) {
+	for (int i = 0; i < 4; i++) {
+		h ^= (v >> (8 * i)) & 0xFF;
+		h *= 16777619;
+	}
+}
+
+int Router::routeReadTable(uint8_t *buf, int len, device_t src) {
+	if (beetle.devices.find(src) == beetle.devices.end()) {
+		pwarn(std::to_string(src) + " does not id a device");
+		return -1;
+	}
+
+	std::shared_ptr<Device> sourceDevice = beetle.devices[src];
+
 	/*
-	 * Lock devices
+	 * Only remote gateways ask, and only they can receive the response.
 	 */
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+	if (sourceDevice->getType() != Device::TCP_CLIENT_PROXY) {
+		return routeUnsupported(buf, len, src);
+	}
+
+	const uint8_t opCode = buf[0];
+	if (len != 6 || buf[1] != BEETLE_TABLE_FORMAT) {
+		uint8_t err[ATT_ERROR_PDU_LEN];
+		pack_error_pdu(opCode, 0, ATT_ECODE_INVALID_PDU, err);
+		sourceDevice->writeResponse(err, ATT_ERROR_PDU_LEN);
+		return 0;
+	}
+	uint32_t knownVersion = btohl(*(uint32_t *) (buf + 2));
+
+	std::lock_guard<std::mutex> hatLg(sourceDevice->hatMutex);
+
+	/*
+	 * The version covers the devices in view, where they are, and their
+	 * handles.
+	 */
+	std::vector<std::pair<std::shared_ptr<Device>, handle_range_t>> servers;
+	uint32_t version = 2166136261u;
+	fnv1a(version, tableVersionSalt);
+	for (device_t dst : sourceDevice->hat->getDevices()) {
+		if (dst == src || beetle.devices.find(dst) == beetle.devices.end()) {
+			continue;
+		}
+		auto destinationDevice = beetle.devices[dst];
+		handle_range_t handleRange = sourceDevice->hat->getDeviceRange(dst);
+		servers.push_back(std::make_pair(destinationDevice, handleRange));
+		fnv1a(version, dst);
+		fnv1a(version, handleRange.start);
+		fnv1a(version, destinationDevice->getHandlesVersion());
+	}
+	if (version == 0) {
+		version = 1;
+	}
+
+	std::vector<uint8_t> resp(9);
+	resp[0] = BEETLE_OP_READ_TABLE_RESP;
+	resp[1] = BEETLE_TABLE_FORMAT;
+	*(uint32_t *) (resp.data() + 2) = htobl(version);
+	resp[6] = 0;
+
+	uint16_t count = 0;
+	if (version == knownVersion) {
+		resp[6] |= BEETLE_TABLE_UNCHANGED;
+	} else {
+		for (auto &server : servers) {
+			handle_range_t handleRange = server.second;
+			std::lock_guard<std::recursive_mutex> handlesLg(server.first->handlesMutex);
+			for (auto &mapping : server.first->handles) {
+				if (mapping.first + handleRange.start > handleRange.end) {
+					break;
+				}
+				auto handle = mapping.second;
+
+				/*
+				 * Values of declarations and static handles do not change.
+				 */
+				int valueLen = 0;
+				if (handle->getKind() == Handle::PRIMARY_SERVICE || handle->getKind() == Handle::CHARACTERISTIC
+						|| handle->isStaticHandle()) {
+					valueLen = handle->cache.len;
+				}
+
+				size_t offset = resp.size();
+				resp.resize(offset + 28 + valueLen);
+				if (resp.size() > BEETLE_TABLE_MAX_LEN) {
+					uint8_t err[ATT_ERROR_PDU_LEN];
+					pack_error_pdu(opCode, 0, ATT_ECODE_INSUFF_RESOURCES, err);
+					sourceDevice->writeResponse(err, ATT_ERROR_PDU_LEN);
+					return 0;
+				}
 
+				uint8_t *p = resp.data() + offset;
+				*(uint16_t *) p = htobs(mapping.first + handleRange.start);
+				p[2] = handle->getKind();
+				p[3] = (handle->isStaticHandle() ? BEETLE_TABLE_HANDLE_STATIC : 0)
+						| (handle->isCacheInfinite() ? BEETLE_TABLE_HANDLE_CACHE_INFINITE : 0);
+				*(uint16_t *) (p + 4) = htobs(handle->getServiceHandle() + handleRange.start);
+				*(uint16_t *) (p + 6) = htobs(handle->getCharHandle() + handleRange.start);
+				*(uint16_t *) (p + 8) = htobs(handle->getEndGroupHandle() + handleRange.start);
+				handle->getUuid().write(p + 10);
+				*(uint16_t *) (p + 26) = htobs(valueLen);
+				if (valueLen > 0) {
+					memcpy(p + 28, handle->cache.value.get(), valueLen);
+
+					/*
+					 * Handles in values are translated, as when read.
+					 */
+					UUID attType = handle->getUuid();
+					if (attType.isShort() && attType.getShort() == GATT_CHARAC_UUID && valueLen >= 3) {
+						uint16_t valueHandle = btohs(*(uint16_t *) (p + 29)) + handleRange.start;
+						*(uint16_t *) (p + 29) = htobs(valueHandle);
+					} else if (attType.isShort() && attType.getShort() == BEETLE_CHARAC_HANDLE_RANGE_UUID
+							&& valueLen >= 4) {
+						*(uint16_t *) (p + 28) = htobs(handleRange.start);
+						*(uint16_t *) (p + 30) = htobs(handleRange.end);
+					}
+				}
+				count++;
+			}
+		}
+	}
+	*(uint16_t *) (resp.data() + 7) = htobs(count);
+
+	if (debug_router) {
+		pdebug("ReadTable sent " + std::to_string(count) + " handles in " + std::to_string(resp.size()) + " bytes");
+	}
+
+	sourceDevice->writeResponse(resp.data(), resp.size());
+	return 0;
+}
+
+int Router::routeFindInfo(uint8_t *buf, int len, device_t src) {
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -228,11 +380,6 @@ int Router::routeFindInfo(uint8_t *buf, int len, device_t src) {
 
 // TODO this works for discovery purposes, but not if things are not cached
 int Router::routeFindByTypeValue(uint8_t *buf, int len, device_t src) {
-	/*
-	 * Lock devices
-	 */
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
-
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -313,38 +460,37 @@ int Router::routeFindByTypeValue(uint8_t *buf, int len, device_t src) {
 			 */
 			std::lock_guard<std::recursive_mutex> handlesLg(destinationDevice->handlesMutex);
 
-			for (auto &mapping : destinationDevice->handles) {
-				uint16_t offset = mapping.first + handleRange.start;
-				if (offset < currHandle) {
-					continue;
-				} else if (offset > endHandle) {
+			const std::vector<uint16_t> &matches = destinationDevice->getHandlesByType(attUUID);
+			for (auto it = std::lower_bound(matches.begin(), matches.end(), currHandle - handleRange.start);
+					it != matches.end(); ++it) {
+				uint16_t offset = *it + handleRange.start;
+				if (offset > endHandle) {
 					done = true;
 					break;
 				}
 
-				auto handle = mapping.second;
-				if (handle->getUuid().getShort() == attType) {
-					/*
-					 * Check whether access is permitted.
-					 */
-					uint8_t unused;
-					if (dst != BEETLE_RESERVED_DEVICE && beetle.accessControl
-							&& beetle.accessControl->canAccessHandle(sourceDevice, destinationDevice, handle, opCode,
-									unused) == false) {
-						continue;
-					}
+				auto handle = destinationDevice->handles[*it];
+
+				/*
+				 * Check whether access is permitted.
+				 */
+				uint8_t unused;
+				if (dst != BEETLE_RESERVED_DEVICE && beetle.accessControl
+						&& beetle.accessControl->canAccessHandle(sourceDevice, destinationDevice, handle, opCode,
+								unused) == false) {
+					continue;
+				}
 
-					int cmpLen = (attValLen < handle->cache.len) ? attValLen : handle->cache.len;
-					if (memcmp(handle->cache.value.get(), attValue, cmpLen) == 0) {
-						*(uint16_t *) (resp + respLen) = htobs(offset);
-						*(uint16_t *) (resp + respLen + 2) = htobs(handle->getEndGroupHandle());
-						respLen += 4;
-						respHandleCount++;
+				int cmpLen = (attValLen < handle->cache.len) ? attValLen : handle->cache.len;
+				if (memcmp(handle->cache.value.get(), attValue, cmpLen) == 0) {
+					*(uint16_t *) (resp + respLen) = htobs(offset);
+					*(uint16_t *) (resp + respLen + 2) = htobs(handle->getEndGroupHandle());
+					respLen += 4;
+					respHandleCount++;
 
-						if (respLen + 4 > srcMTU) {
-							done = true;
-							break;
-						}
+					if (respLen + 4 > srcMTU) {
+						done = true;
+						break;
 					}
 				}
 			}
@@ -376,11 +522,6 @@ int Router::routeFindByTypeValue(uint8_t *buf, int len, device_t src) {
 }
 
 int Router::routeReadByType(uint8_t *buf, int len, device_t src) {
-	/*
-	 * Lock devices
-	 */
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
-
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -441,21 +582,14 @@ int Router::routeReadByType(uint8_t *buf, int len, device_t src) {
 			uint8_t resp[destinationDevice->getMTU()];
 			resp[0] = ATT_OP_READ_BY_TYPE_RESP;
 			int respLen = 2;
-			for (auto &kv : destinationDevice->handles) {
-				if (kv.first < startHandle) {
-					continue;
-				} else if (kv.first > endHandle) {
-					break;
-				}
-
-				auto handle = kv.second;
-				if (handle->getUuid() == attType) {
-					*(uint16_t*) (resp + 2) = htobs(handle->getHandle());
-					memcpy(resp + 4, handle->cache.value.get(), handle->cache.len);
-					respLen += 2 + handle->cache.len;
-					resp[1] = 2 + handle->cache.len;
-					break;
-				}
+			const std::vector<uint16_t> &matches = destinationDevice->getHandlesByType(attType);
+			auto it = std::lower_bound(matches.begin(), matches.end(), startHandle);
+			if (it != matches.end() && *it <= endHandle) {
+				auto handle = destinationDevice->handles[*it];
+				*(uint16_t*) (resp + 2) = htobs(handle->getHandle());
+				memcpy(resp + 4, handle->cache.value.get(), handle->cache.len);
+				respLen += 2 + handle->cache.len;
+				resp[1] = 2 + handle->cache.len;
 			}
 
 			if (respLen > 2) {
@@ -507,31 +641,29 @@ int Router::routeReadByType(uint8_t *buf, int len, device_t src) {
 			 */
 			bool serveMetadataHandle = false;
 
+			const std::vector<uint16_t> &matches = destinationDevice->getHandlesByType(attType);
 			int firstHandleMatch = -1;
-			for (auto &kv : destinationDevice->handles) {
-				if (kv.first + currHandleRange.start < startHandle) {
+			for (uint16_t h : matches) {
+				if (h + currHandleRange.start < startHandle) {
 					continue;
-				} else if (kv.first + currHandleRange.start > endHandle) {
+				} else if (h + currHandleRange.start > endHandle) {
 					break;
 				}
 
-				auto handle = kv.second;
-				if (handle->getUuid() == attType) {
-
-					if (kv.first > destinationVirtualDevice->getHighestForwardedHandle()) {
-						/*
-						 * Ensure access to at least one handle is allowed.
-						 */
-						uint8_t unused;
-						if (beetle.accessControl && beetle.accessControl->canAccessHandle(sourceDevice,
-								destinationDevice, handle, ATT_OP_READ_REQ, unused) == false) {
-							continue;
-						}
+				auto handle = destinationDevice->handles[h];
+				if (h > destinationVirtualDevice->getHighestForwardedHandle()) {
+					/*
+					 * Ensure access to at least one handle is allowed.
+					 */
+					uint8_t unused;
+					if (beetle.accessControl && beetle.accessControl->canAccessHandle(sourceDevice,
+							destinationDevice, handle, ATT_OP_READ_REQ, unused) == false) {
+						continue;
 					}
-
-					firstHandleMatch = handle->getHandle();
-					break;
 				}
+
+				firstHandleMatch = handle->getHandle();
+				break;
 			}
 
 			if (firstHandleMatch >= 0) {
@@ -551,33 +683,31 @@ int Router::routeReadByType(uint8_t *buf, int len, device_t src) {
 				uint8_t resp[destinationDevice->getMTU()];
 				resp[0] = ATT_OP_READ_BY_TYPE_RESP;
 				int respLen = 2;
-				for (auto &kv : destinationVirtualDevice->handles) {
-					if (kv.first < destinationVirtualDevice->getHighestForwardedHandle()) {
+				for (uint16_t h : matches) {
+					if (h < destinationVirtualDevice->getHighestForwardedHandle()) {
 						continue;
-					} else if (kv.first + currHandleRange.start < startHandle) {
+					} else if (h + currHandleRange.start < startHandle) {
 						continue;
-					} else if (kv.first + currHandleRange.start > endHandle) {
+					} else if (h + currHandleRange.start > endHandle) {
 						break;
 					}
 
-					auto handle = kv.second;
-					if (handle->getUuid() == attType) {
-						*(uint16_t*) (resp + 2) = htobs(handle->getHandle() + currHandleRange.start);
-						memcpy(resp + 4, handle->cache.value.get(), handle->cache.len);
-						respLen += 2 + handle->cache.len;
-						resp[1] = 2 + handle->cache.len;
-						if (attType.isShort()) {
-							if (attType.getShort() == GATT_CHARAC_UUID) {
-								uint16_t valueHandle = btohs(*(uint16_t *)(resp + 5));
-								valueHandle += currHandleRange.start;
-								*(uint16_t *)(resp + 5) = htobs(valueHandle);
-							} else if (attType.getShort() == BEETLE_CHARAC_HANDLE_RANGE_UUID) {
-								*(uint16_t *)(resp + 4) = htobs(currHandleRange.start);
-								*(uint16_t *)(resp + 6) = htobs(currHandleRange.end);
-							}
+					auto handle = destinationVirtualDevice->handles[h];
+					*(uint16_t*) (resp + 2) = htobs(handle->getHandle() + currHandleRange.start);
+					memcpy(resp + 4, handle->cache.value.get(), handle->cache.len);
+					respLen += 2 + handle->cache.len;
+					resp[1] = 2 + handle->cache.len;
+					if (attType.isShort()) {
+						if (attType.getShort() == GATT_CHARAC_UUID) {
+							uint16_t valueHandle = btohs(*(uint16_t *)(resp + 5));
+							valueHandle += currHandleRange.start;
+							*(uint16_t *)(resp + 5) = htobs(valueHandle);
+						} else if (attType.getShort() == BEETLE_CHARAC_HANDLE_RANGE_UUID) {
+							*(uint16_t *)(resp + 4) = htobs(currHandleRange.start);
+							*(uint16_t *)(resp + 6) = htobs(currHandleRange.end);
 						}
-						break;
 					}
+					break;
 				}
 
 				if (respLen > 2) {
@@ -704,11 +834,6 @@ int Router::routeReadByType(uint8_t *buf, int len, device_t src) {
 
 // TODO this works for discovery purposes, but not if things are not cached
 int Router::routeReadByGroupType(uint8_t *buf, int len, device_t src) {
-	/*
-	 * Lock devices
-	 */
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
-
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -840,11 +965,6 @@ int Router::routeReadByGroupType(uint8_t *buf, int len, device_t src) {
 }
 
 int Router::routeHandleNotifyOrIndicate(uint8_t *buf, int len, device_t src) {
-	/*
-	 * Lock devices
-	 */
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
-
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -870,7 +990,7 @@ int Router::routeHandleNotifyOrIndicate(uint8_t *buf, int len, device_t src) {
 	}
 	auto h = sourceDevice->handles[handle];
 
-	std::set<device_t> &list = (opCode == ATT_OP_HANDLE_NOTIFY) ? h->subscribersNotify : h->subscribersIndicate;
+	subscriber_set_t &list = (opCode == ATT_OP_HANDLE_NOTIFY) ? h->subscribersNotify : h->subscribersIndicate;
 
 	for (device_t dst : list) {
 		if (beetle.devices.find(dst) == beetle.devices.end()) {
@@ -918,11 +1038,6 @@ int Router::routeHandleNotifyOrIndicate(uint8_t *buf, int len, device_t src) {
 }
 
 int Router::routeReadWrite(uint8_t *buf, int len, device_t src) {
-	/*
-	 * Lock devices
-	 */
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
-
 	if (beetle.devices.find(src) == beetle.devices.end()) {
 		pwarn(std::to_string(src) + " does not id a device");
 		return -1;
@@ -986,7 +1101,7 @@ int Router::routeReadWrite(uint8_t *buf, int len, device_t src) {
 	}
 
 	if ((opCode == ATT_OP_WRITE_REQ || opCode == ATT_OP_WRITE_CMD) &&
-			std::dynamic_pointer_cast<ClientCharCfg>(proxyH) != NULL) {
+			handle_cast<ClientCharCfg>(proxyH) != NULL) {
 		/*
 		 * Length of subscription command needs to be correct.
 		 */
@@ -1002,8 +1117,8 @@ int Router::routeReadWrite(uint8_t *buf, int len, device_t src) {
 		/*
 		 * Update to subscription
 		 */
-		auto charH = std::dynamic_pointer_cast<Characteristic>(destinationDevice->handles[proxyH->getCharHandle()]);
-		auto charAttrH = std::dynamic_pointer_cast<CharacteristicValue>(
+		auto charH = handle_cast<Characteristic>(destinationDevice->handles[proxyH->getCharHandle()]);
+		auto charAttrH = handle_cast<CharacteristicValue>(
 				destinationDevice->handles[charH->getAttrHandle()]);
 
 		uint8_t initialState = 0;
@@ -1079,13 +1194,14 @@ int Router::routeReadWrite(uint8_t *buf, int len, device_t src) {
 		/*
 		 * Serve read from cache
 		 */
+		readCache->hits->add();
 		proxyH->cache.cachedSet.insert(src);
 		int respLen = 1 + proxyH->cache.len;
 		uint8_t resp[respLen];
 		resp[0] = ATT_OP_READ_RESP;
 		memcpy(resp + 1, proxyH->cache.value.get(), proxyH->cache.len);
 
-		auto ch = std::dynamic_pointer_cast<Characteristic>(proxyH);
+		auto ch = handle_cast<Characteristic>(proxyH);
 		if (ch) {
 			/*
 			 * This works because characteristics are cached infinitely.
@@ -1122,6 +1238,9 @@ int Router::routeReadWrite(uint8_t *buf, int len, device_t src) {
 		if (opCode == ATT_OP_WRITE_CMD || opCode == ATT_OP_SIGNED_WRITE_CMD) {
 			destinationDevice->writeCommand(buf, len);
 		} else {
+			if (opCode == ATT_OP_READ_REQ) {
+				readCache->misses->add();
+			}
 			destinationDevice->writeTransaction(buf, len,
 				[this, opCode, src, dst, handle, remoteHandle](uint8_t *resp, int respLen) {
 				/*
@@ -0,0 +1,147 @@
+/*
+ * ServiceIndex.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "ServiceIndex.h"
+
+#include <boost/thread/lock_types.hpp>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "Beetle.h"
+#include "Device.h"
+#include "Handle.h"
+
+ServiceIndex::ServiceIndex(Beetle &beetle) :
+		beetle(beetle) {
+
+}
+
+ServiceIndex::~ServiceIndex() {
+
+}
+
+std::vector<indexed_service_t> ServiceIndex::findService(const UUID &uuid) {
+	return find(services, uuid);
+}
+
+std::vector<indexed_service_t> ServiceIndex::findCharacteristic(const UUID &uuid) {
+	return find(characteristics, uuid);
+}
+
+std::vector<indexed_service_t> ServiceIndex::find(index_t &index, const UUID &uuid) {
+	boost::shared_lock<boost::shared_mutex> lk(indexMutex);
+	auto it = index.find(uuid);
+	if (it == index.end()) {
+		return std::vector<indexed_service_t>();
+	}
+	return it->second;
+}
+
+AddDeviceHandler ServiceIndex::getAddDeviceHandler() {
+	return [this](device_t d) {
+		indexDevice(d);
+	};
+}
+
+UpdateDeviceHandler ServiceIndex::getUpdateDeviceHandler() {
+	return [this](device_t d) {
+		indexDevice(d);
+	};
+}
+
+RemoveDeviceHandler ServiceIndex::getRemoveDeviceHandler() {
+	return [this](device_t d) {
+		std::lock_guard<boost::shared_mutex> lg(indexMutex);
+		unindexDevice(d);
+	};
+}
+
+void ServiceIndex::indexDevice(device_t d) {
+	/*
+	 * Hold the devices lock throughout, so that a concurrent removal cannot
+	 * be overtaken by a stale update.
+	 */
+	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+	auto dit = beetle.devices.find(d);
+	if (dit == beetle.devices.end()) {
+		return;
+	}
+	std::shared_ptr<Device> device = dit->second;
+
+	switch (device->getType()) {
+	case Device::IPC_APPLICATION:
+	case Device::LE_PERIPHERAL:
+	case Device::LE_CENTRAL:
+	case Device::TCP_CLIENT:
+		break;
+	default:
+		/* Not attached to this gateway */
+		return;
+	}
+
+	std::vector<std::pair<UUID, indexed_service_t>> newServices;
+	std::vector<std::pair<UUID, indexed_service_t>> newCharacteristics;
+	{
+		std::lock_guard<std::recursive_mutex> handlesLg(device->handlesMutex);
+		indexed_service_t current;
+		current.id = d;
+		current.name = device->getName();
+		current.startHandle = 0;
+		current.endHandle = 0;
+		for (auto &kv : device->handles) {
+			auto service = handle_cast<PrimaryService>(kv.second);
+			if (service) {
+				current.startHandle = service->getHandle();
+				current.endHandle = service->getEndGroupHandle();
+				newServices.push_back(std::make_pair(service->getServiceUuid(), current));
+				continue;
+			}
+			auto characteristic = handle_cast<Characteristic>(kv.second);
+			if (characteristic) {
+				newCharacteristics.push_back(std::make_pair(characteristic->getCharUuid(), current));
+			}
+		}
+	}
+
+	std::lock_guard<boost::shared_mutex> lg(indexMutex);
+	unindexDevice(d);
+	for (auto &kv : newServices) {
+		services[kv.first].push_back(kv.second);
+		deviceServices[d].push_back(kv.first);
+	}
+	for (auto &kv : newCharacteristics) {
+		characteristics[kv.first].push_back(kv.second);
+		deviceCharacteristics[d].push_back(kv.first);
+	}
+}
+
+void ServiceIndex::unindexDevice(device_t d) {
+	auto unindex = [d](index_t &index, std::map<device_t, std::vector<UUID>> &byDevice) {
+		auto it = byDevice.find(d);
+		if (it == byDevice.end()) {
+			return;
+		}
+		for (const UUID &uuid : it->second) {
+			auto iit = index.find(uuid);
+			if (iit == index.end()) {
+				continue;
+			}
+			auto &entries = iit->second;
+			entries.erase(std::remove_if(entries.begin(), entries.end(), [d](const indexed_service_t &e) {
+				return e.id == d;
+			}), entries.end());
+			if (entries.empty()) {
+				index.erase(iit);
+			}
+		}
+		byDevice.erase(it);
+	};
+	unindex(services, deviceServices);
+	unindex(characteristics, deviceCharacteristics);
+}
@@ -133,12 +133,21 @@ UpdateDeviceHandler StaticTopo::getUpdateDeviceHandler() {
 		}
 		devicesLk.unlock();
 
+		/*
+		 * Map concurrently, rather than waiting on access control for each pair.
+		 */
+		auto logResult = [](bool success, std::string err) {
+			if (!success && debug_topology) {
+				pdebug(err);
+			}
+		};
+
 		for (device_t to : mapToIds) {
-			beetle.mapDevices(id, to);
+			beetle.mapDevicesAsync(id, to, logResult);
 		}
 
 		for (device_t from : mapFromIds) {
-			beetle.mapDevices(from, id);
+			beetle.mapDevicesAsync(from, id, logResult);
 		}
 	};
 }
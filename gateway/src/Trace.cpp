@@ -0,0 +1,172 @@
+/*
+ * Trace.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "Trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> trace_enabled(false);
+thread_local uint64_t trace_current = 0;
+thread_local uint64_t trace_ready = 0;
+
+static std::atomic<uint64_t> nextTraceId(1);
+static std::atomic<int> sampleRate(1);
+
+/*
+ * Spans that started before this are from an earlier run.
+ */
+static std::atomic<uint64_t> traceEpoch(0);
+
+/*
+ * Written only by its thread. Each slot is a seqlock, so that dumps can read
+ * it while the thread writes without either side blocking: seq is 0 while
+ * the slot is being written, and the span's index + 1 after.
+ */
+typedef struct {
+	std::atomic<uint64_t> seq;
+	std::atomic<uint64_t> id;
+	std::atomic<const char *> stage;
+	std::atomic<uint64_t> start;
+	std::atomic<uint64_t> end;
+	std::atomic<int64_t> device;
+} trace_slot_t;
+
+typedef struct {
+	long tid;
+	uint64_t head;
+	trace_slot_t slots[TRACE_BUFFER_SPANS];
+} trace_buffer_t;
+
+/*
+ * Buffers outlive their threads, so that their spans can still be dumped.
+ * When a thread exits, its buffer goes on the free list, and is cleared for
+ * the next thread to start tracing. There are at most as many buffers as
+ * threads that were tracing at once.
+ */
+static std::mutex buffersMutex;
+static std::vector<std::unique_ptr<trace_buffer_t>> buffers;
+static std::vector<trace_buffer_t *> freeBuffers;
+
+class LocalBuffer {
+public:
+	trace_buffer_t *buffer = NULL;
+	~LocalBuffer() {
+		if (buffer != NULL) {
+			std::lock_guard<std::mutex> lg(buffersMutex);
+			freeBuffers.push_back(buffer);
+		}
+	};
+};
+static thread_local LocalBuffer localBuffer;
+
+static trace_buffer_t *getLocalBuffer() {
+	if (localBuffer.buffer == NULL) {
+		std::lock_guard<std::mutex> lg(buffersMutex);
+		trace_buffer_t *buffer;
+		if (freeBuffers.empty()) {
+			buffer = new trace_buffer_t();
+			buffers.push_back(std::unique_ptr<trace_buffer_t>(buffer));
+		} else {
+			buffer = freeBuffers.back();
+			freeBuffers.pop_back();
+		}
+		buffer->tid = syscall(SYS_gettid);
+		buffer->head = 0;
+		for (trace_slot_t &slot : buffer->slots) {
+			slot.seq = 0;
+		}
+		localBuffer.buffer = buffer;
+	}
+	return localBuffer.buffer;
+}
+
+uint64_t traceNow() {
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return (uint64_t) spec.tv_sec * 1000000000 + spec.tv_nsec;
+}
+
+uint64_t traceSample() {
+	static thread_local unsigned int count = 0;
+	if (++count % sampleRate.load(std::memory_order_relaxed) != 0) {
+		return 0;
+	}
+	return nextTraceId.fetch_add(1, std::memory_order_relaxed);
+}
+
+void traceRecord(uint64_t id, const char *stage, uint64_t start, uint64_t end, int64_t device) {
+	trace_buffer_t *buffer = getLocalBuffer();
+	uint64_t index = buffer->head++;
+	trace_slot_t &slot = buffer->slots[index % TRACE_BUFFER_SPANS];
+
+	slot.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.id.store(id, std::memory_order_relaxed);
+	slot.stage.store(stage, std::memory_order_relaxed);
+	slot.start.store(start, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+	slot.device.store(device, std::memory_order_relaxed);
+	slot.seq.store(index + 1, std::memory_order_release);
+}
+
+void traceStart(int rate) {
+	sampleRate = (rate > 0) ? rate : 1;
+	traceEpoch = traceNow();
+	trace_enabled = true;
+}
+
+void traceStop() {
+	trace_enabled = false;
+}
+
+int traceDump(std::ostream &os) {
+	uint64_t epoch = traceEpoch.load();
+	int spans = 0;
+	std::string delim = "";
+
+	os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	std::lock_guard<std::mutex> lg(buffersMutex);
+	for (auto &buffer : buffers) {
+		os << delim << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+				<< buffer->tid << ",\"args\":{\"name\":\"" << buffer->tid << "\"}}";
+		delim = ",";
+		for (trace_slot_t &slot : buffer->slots) {
+			uint64_t seq = slot.seq.load(std::memory_order_acquire);
+			if (seq == 0) {
+				continue;
+			}
+			uint64_t id = slot.id.load(std::memory_order_relaxed);
+			const char *stage = slot.stage.load(std::memory_order_relaxed);
+			uint64_t start = slot.start.load(std::memory_order_relaxed);
+			uint64_t end = slot.end.load(std::memory_order_relaxed);
+			int64_t device = slot.device.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.seq.load(std::memory_order_relaxed) != seq || start < epoch || end < start) {
+				continue;
+			}
+
+			os << ",\n{\"name\":\"" << stage << "\",\"cat\":\"beetle\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+					<< buffer->tid << std::fixed << std::setprecision(3)
+					<< ",\"ts\":" << (start - epoch) / 1000.0 << ",\"dur\":" << (end - start) / 1000.0
+					<< ",\"args\":{\"trace\":" << id;
+			if (device >= 0) {
+				os << ",\"device\":" << device;
+			}
+			os << "}}";
+			spans++;
+		}
+	}
+	os << "\n]}" << std::endl;
+	return spans;
+}
@@ -9,7 +9,6 @@
 
 #include <algorithm>
 #include <assert.h>
-#include <boost/format.hpp>
 #include <cstring>
 #include <iostream>
 #include <iterator>
@@ -18,7 +17,7 @@
 
 #include "ble/gatt.h"
 
-static inline void backward_memcpy(uint8_t *dst, uint8_t *src, int len) {
+static inline void backward_memcpy(uint8_t *dst, const uint8_t *src, int len) {
 	for (int i = 0; i < len; i++) {
 		dst[i] = src[len - 1 - i];
 	}
@@ -81,22 +80,66 @@ uint16_t UUID::getShort() const {
 	return (uuid.value[2] << 8) + uuid.value[3];
 }
 
+size_t UUID::hash() const {
+	uint64_t lo;
+	uint64_t hi;
+	memcpy(&lo, uuid.value, sizeof(lo));
+	memcpy(&hi, uuid.value + sizeof(lo), sizeof(hi));
+	uint64_t h = lo ^ (hi * 0x9E3779B97F4A7C15ULL);
+	h ^= h >> 32;
+	h *= 0xD6E8FEB86659FD93ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+void UUID::write(uint8_t *buf, bool reversed) const {
+	if (reversed) {
+		backward_memcpy(buf, uuid.value, UUID_LEN);
+	} else {
+		memcpy(buf, uuid.value, UUID_LEN);
+	}
+}
+
+#ifdef __SSE2__
+/* Bluetooth base uuid, with the 16-bit short value zeroed */
+static const __m128i BASE_UUID_MASKED = _mm_setr_epi8(0, 0, 0, 0, BLUETOOTH_BASE_UUID[0], BLUETOOTH_BASE_UUID[1],
+		BLUETOOTH_BASE_UUID[2], BLUETOOTH_BASE_UUID[3], BLUETOOTH_BASE_UUID[4], BLUETOOTH_BASE_UUID[5],
+		BLUETOOTH_BASE_UUID[6], BLUETOOTH_BASE_UUID[7], BLUETOOTH_BASE_UUID[8], BLUETOOTH_BASE_UUID[9],
+		BLUETOOTH_BASE_UUID[10], BLUETOOTH_BASE_UUID[11]);
+#endif
+
 bool UUID::isShort() const {
+#ifdef __SSE2__
+	/* Compare all bytes except the 16-bit short value */
+	__m128i v = _mm_loadu_si128((const __m128i *) uuid.value);
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(v, BASE_UUID_MASKED)) | 0x000C) == 0xFFFF;
+#else
 	return uuid.value[0] == 0 && uuid.value[1] == 0 && memcmp(uuid.value + 4, BLUETOOTH_BASE_UUID, 12) == 0;
+#endif
+}
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static inline char *hex_byte(char *dst, uint8_t b) {
+	dst[0] = HEX_DIGITS[b >> 4];
+	dst[1] = HEX_DIGITS[b & 0x0F];
+	return dst + 2;
 }
 
 std::string UUID::str(bool forceLong) const {
-	std::stringstream ss;
 	if (!forceLong && isShort()) {
-		ss << boost::format("%02X") % static_cast<int>(uuid.value[2]);
-		ss << boost::format("%02X") % static_cast<int>(uuid.value[3]);
+		char buf[SHORT_UUID_LEN * 2];
+		hex_byte(hex_byte(buf, uuid.value[2]), uuid.value[3]);
+		return std::string(buf, sizeof(buf));
 	} else {
+		char buf[UUID_LEN * 2 + 4];
+		char *p = buf;
 		for (int i = 0; i < UUID_LEN; i++) {
 			if (i == 4 || i == 6 || i == 8 || i == 10) {
-				ss << '-';
+				*p++ = '-';
 			}
-			ss << boost::format("%02X") % static_cast<int>(uuid.value[i]);
+			p = hex_byte(p, uuid.value[i]);
 		}
+		return std::string(buf, p - buf);
 	}
-	return ss.str();
 }
@@ -0,0 +1,102 @@
+/*
+ * UUIDTable.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "UUIDTable.h"
+
+#include <boost/thread/lock_types.hpp>
+#include <cassert>
+#include <mutex>
+
+UUIDTable::UUIDTable() : count(0) {
+	for (int i = 0; i < MAX_CHUNKS; i++) {
+		chunks[i] = NULL;
+	}
+}
+
+UUIDTable &UUIDTable::instance() {
+	/* Never destroyed, since ids may be used by static destructors */
+	static UUIDTable *table = new UUIDTable();
+	return *table;
+}
+
+const UUIDTable::entry_t &UUIDTable::entry(uuid_id_t id) const {
+	assert(id < count.load(std::memory_order_acquire));
+	return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)];
+}
+
+bool UUIDTable::intern(const UUID &uuid, uuid_id_t &id) {
+	if (!uuid.isShort()) {
+		return false;
+	}
+
+	UUIDTable &t = instance();
+
+	{
+		boost::shared_lock<boost::shared_mutex> lk(t.idsMutex);
+		auto it = t.ids.find(uuid);
+		if (it != t.ids.end()) {
+			id = it->second;
+			return true;
+		}
+	}
+
+	std::lock_guard<boost::shared_mutex> lg(t.idsMutex);
+	auto it = t.ids.find(uuid);
+	if (it != t.ids.end()) {
+		id = it->second;
+		return true;
+	}
+
+	/* There are only as many short uuids as entries */
+	id = t.count.load(std::memory_order_relaxed);
+	int chunk = id >> CHUNK_BITS;
+	assert(chunk < MAX_CHUNKS);
+	if (t.chunks[chunk].load(std::memory_order_relaxed) == NULL) {
+		t.chunks[chunk].store(new entry_t[CHUNK_SIZE], std::memory_order_release);
+	}
+
+	entry_t &e = t.chunks[chunk].load(std::memory_order_relaxed)[id & (CHUNK_SIZE - 1)];
+	e.uuid = uuid;
+	e.isShort = uuid.isShort();
+	e.hash = uuid.hash();
+	e.str = uuid.str();
+
+	t.ids[uuid] = id;
+	t.count.store(id + 1, std::memory_order_release);
+	return true;
+}
+
+bool UUIDTable::find(const UUID &uuid, uuid_id_t &id) {
+	UUIDTable &t = instance();
+	boost::shared_lock<boost::shared_mutex> lk(t.idsMutex);
+	auto it = t.ids.find(uuid);
+	if (it == t.ids.end()) {
+		return false;
+	}
+	id = it->second;
+	return true;
+}
+
+const UUID &UUIDTable::get(uuid_id_t id) {
+	return instance().entry(id).uuid;
+}
+
+bool UUIDTable::isShort(uuid_id_t id) {
+	return instance().entry(id).isShort;
+}
+
+size_t UUIDTable::hash(uuid_id_t id) {
+	return instance().entry(id).hash;
+}
+
+const std::string &UUIDTable::str(uuid_id_t id) {
+	return instance().entry(id).str;
+}
+
+size_t UUIDTable::size() {
+	return instance().count.load(std::memory_order_acquire);
+}
@@ -7,18 +7,17 @@
 
 #include "controller/AccessControl.h"
 
-#define BOOST_NETWORK_ENABLE_HTTPS
-
-#include <boost/network/protocol/http/client.hpp>
-#include <boost/network/protocol/http/request.hpp>
 #include <boost/thread/lock_types.hpp>
+#include <algorithm>
 #include <cassert>
 #include <exception>
 #include <json/json.hpp>
 #include <list>
 #include <sstream>
+#include <stdexcept>
 
 #include "Beetle.h"
+#include "BeetleConfig.h"
 #include "ble/att.h"
 #include "ble/beetle.h"
 #include "controller/ControllerClient.h"
@@ -27,90 +26,209 @@
 #include "device/socket/tcp/TCPClientProxy.h"
 #include "device/socket/tcp/TCPServerProxy.h"
 #include "Handle.h"
+#include "Trace.h"
 
 using json = nlohmann::json;
 
-AccessControl::AccessControl(Beetle &beetle, std::shared_ptr<ControllerClient> client_) :
-		beetle(beetle) {
+AccessControl::AccessControl(Beetle &beetle, std::shared_ptr<ControllerClient> client_, const BeetleConfig &config) :
+		beetle(beetle), fetchers(config.controllerAccessWorkers) {
 	client = client_;
+	allowTtl = config.controllerAccessTtl;
+	denyTtl = config.controllerAccessDenyTtl;
+	prefetchEnabled = config.controllerAccessPrefetch;
+	batchSize = config.controllerAccessBatchSize;
+	decisionCache = &beetle.metrics.cache("access");
 }
 
 AccessControl::~AccessControl() {
 
 }
 
-bool AccessControl::canMap(std::shared_ptr<Device> from, std::shared_ptr<Device> to) {
-	std::string fromGateway;
-	device_t fromId;
+bool AccessControl::resolveQuery(std::shared_ptr<Device> from, std::shared_ptr<Device> to, map_query_t &query,
+		bool &result) {
+	query.from = from;
+	query.to = to;
+
 	switch (from->getType()) {
 	case Device::BEETLE_INTERNAL:
-		return true;
+		result = true;
+		return false;
 	case Device::IPC_APPLICATION:
 	case Device::LE_PERIPHERAL:
 	case Device::LE_CENTRAL:
 	case Device::TCP_CLIENT: {
-		fromGateway = beetle.name;
-		fromId = from->getId();
+		query.fromGateway = beetle.name;
+		query.fromId = from->getId();
 		break;
 	}
 	case Device::TCP_CLIENT_PROXY:
+		result = false;
 		return false;
 	case Device::TCP_SERVER_PROXY: {
 		auto fromCast = std::dynamic_pointer_cast<TCPServerProxy>(from);
-		fromGateway = fromCast->getServerGateway();
-		fromId = fromCast->getRemoteDeviceId();
+		query.fromGateway = fromCast->getServerGateway();
+		query.fromId = fromCast->getRemoteDeviceId();
 		break;
 	}
 	case Device::UNKNOWN:
 	default:
+		result = false;
 		return false;
 	}
 
-	std::string toGateway;
-	device_t toId;
 	switch (to->getType()) {
-	case Device::BEETLE_INTERNAL:
-		return false;
 	case Device::IPC_APPLICATION:
 	case Device::LE_PERIPHERAL:
 	case Device::LE_CENTRAL:
 	case Device::TCP_CLIENT: {
-		toGateway = beetle.name;
-		toId = to->getId();
+		query.toGateway = beetle.name;
+		query.toId = to->getId();
 		break;
 	}
+	case Device::BEETLE_INTERNAL:
 	case Device::TCP_CLIENT_PROXY:
 	case Device::TCP_SERVER_PROXY:
 	case Device::UNKNOWN:
 	default:
+		result = false;
 		return false;
 	}
+	return true;
+}
+
+bool AccessControl::lookupDecision(std::pair<device_t, device_t> key, bool &allowed) {
+	auto it = decisions.find(key);
+	if (it == decisions.end()) {
+		return false;
+	} else if (it->second.expire <= time(NULL)) {
+		decisions.erase(it);
+		return false;
+	}
+	allowed = it->second.allowed;
+	return true;
+}
+
+void AccessControl::storeDecision(std::pair<device_t, device_t> key, bool allowed, int ttl) {
+	if (ttl <= 0) {
+		return;
+	}
+	std::unique_lock<std::mutex> decisionsLk(decisionsMutex);
+	decisions[key] = map_decision_t { allowed, time(NULL) + ttl };
+	decisionsLk.unlock();
+
+	/*
+	 * The remove handler may have run while the query was in flight.
+	 */
+	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+	bool exists = beetle.devices.find(key.first) != beetle.devices.end()
+			&& beetle.devices.find(key.second) != beetle.devices.end();
+	devicesLk.unlock();
+	if (!exists) {
+		decisionsLk.lock();
+		decisions.erase(key);
+		decisionsLk.unlock();
+
+		boost::unique_lock<boost::shared_mutex> cacheLk(cacheMutex);
+		cache.erase(key);
+	}
+}
+
+bool AccessControl::canMap(std::shared_ptr<Device> from, std::shared_ptr<Device> to) {
+	TraceSpan span("access");
+	map_query_t query;
+	bool result;
+	if (!resolveQuery(from, to, query, result)) {
+		return result;
+	}
+
+	auto key = std::make_pair(from->getId(), to->getId());
+	std::unique_lock<std::mutex> decisionsLk(decisionsMutex);
+	if (lookupDecision(key, result)) {
+		decisionCache->hits->add();
+		if (debug_controller) {
+			pdebug("cached canMap decision: " + std::string(result ? "allowed" : "denied"));
+		}
+		return result;
+	}
+
+	decisionCache->misses->add();
+
+	/*
+	 * Wait on a query for the same pair if there is one.
+	 */
+	auto it = pending.find(key);
+	if (it != pending.end()) {
+		std::shared_future<bool> f = it->second;
+		decisionsLk.unlock();
+		return f.get();
+	}
+
+	std::promise<bool> promise;
+	pending[key] = promise.get_future().share();
+	decisionsLk.unlock();
+
+	result = queryDecision(query);
+
+	decisionsLk.lock();
+	pending.erase(key);
+	decisionsLk.unlock();
+	promise.set_value(result);
+	return result;
+}
+
+void AccessControl::canMapAsync(std::shared_ptr<Device> from, std::shared_ptr<Device> to, CanMapCallback cb) {
+	map_query_t query;
+	bool result;
+	if (!resolveQuery(from, to, query, result)) {
+		cb(result);
+		return;
+	}
 
+	std::unique_lock<std::mutex> decisionsLk(decisionsMutex);
+	if (lookupDecision(std::make_pair(from->getId(), to->getId()), result)) {
+		decisionsLk.unlock();
+		decisionCache->hits->add();
+		cb(result);
+		return;
+	}
+	decisionsLk.unlock();
+
+	fetchers.schedule([this, from, to, cb] {
+		cb(canMap(from, to));
+	});
+}
+
+bool AccessControl::queryDecision(const map_query_t &query) {
 	std::stringstream resource;
-	resource << "access/canMap/" << fromGateway << "/" << std::fixed << fromId << "/" << toGateway << "/" << std::fixed
-			<< toId;
+	resource << "access/canMap/" << query.fromGateway << "/" << std::fixed << query.fromId << "/"
+			<< query.toGateway << "/" << std::fixed << query.toId;
 
 	std::string url = client->getApiUrl(resource.str());
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
 
 	if (debug_controller) {
 		pdebug("get: " + url);
 	}
 
+	auto key = std::make_pair(query.from->getId(), query.to->getId());
 	try {
-		auto response = client->getClient()->get(request);
+		auto response = client->get(resource.str());
 
-		switch (response.status()) {
+		switch (response.status) {
 		case 200: {
 			if (debug_controller) {
 				pdebug("controller request ok");
 			}
 			try {
-				std::stringstream ss;
-				ss << body(response);
-				return handleCanMapResponse(from, to, ss);
+				if (debug_controller) {
+					pdebug(json::parse(response.body).dump());
+				}
+				can_map_response_t parsed;
+				parseCanMapResponse(response.body, parsed);
+				int ttl;
+				bool deferred;
+				bool result = handleCanMapResponse(query.from, query.to, parsed, ttl, false, deferred);
+				storeDecision(key, result, ttl);
+				return result;
 			} catch (std::exception &e) {
 				if (debug_controller) {
 					std::stringstream ss;
@@ -128,7 +246,7 @@ bool AccessControl::canMap(std::shared_ptr<Device> from, std::shared_ptr<Device>
 		default:
 			if (debug_controller) {
 				std::stringstream ss;
-				ss << "controller request failed " << response.status();
+				ss << "controller request failed " << response.status;
 				pdebug(ss.str());
 			}
 			return false;
@@ -139,8 +257,137 @@ bool AccessControl::canMap(std::shared_ptr<Device> from, std::shared_ptr<Device>
 	}
 }
 
+/*
+ * Queries the controller for a batch of pairs in one request.
+ */
+void AccessControl::prefetch(std::vector<map_query_t> queries) {
+	json pairs = json::array();
+	for (map_query_t &query : queries) {
+		pairs.push_back( { query.fromGateway, query.fromId, query.toGateway, query.toId });
+	}
+	json j;
+	j["pairs"] = pairs;
+	std::string postBody = j.dump();
+
+	std::string url = client->getApiUrl("access/canMap/batch");
+
+	if (debug_controller) {
+		pdebug("post: " + url + " (" + std::to_string(queries.size()) + " pairs)");
+	}
+
+	try {
+		auto response = client->post("access/canMap/batch", postBody, "application/json");
+		if (response.status != 200) {
+			if (debug_controller) {
+				std::stringstream ss;
+				ss << "canMap prefetch failed " << response.status;
+				pdebug(ss.str());
+			}
+			return;
+		}
+
+		if (debug_controller) {
+			pdebug(json::parse(response.body).dump());
+		}
+		std::vector<can_map_response_t> results;
+		parseCanMapBatchResponse(response.body, results);
+		if (results.size() != queries.size()) {
+			throw std::runtime_error("canMap batch response does not match request");
+		}
+
+		for (size_t i = 0; i < queries.size(); i++) {
+			int ttl;
+			bool deferred;
+			bool result = handleCanMapResponse(queries[i].from, queries[i].to, results[i], ttl, true, deferred);
+			if (!deferred) {
+				storeDecision(std::make_pair(queries[i].from->getId(), queries[i].to->getId()), result, ttl);
+			}
+		}
+	} catch (std::exception &e) {
+		if (debug_controller) {
+			pexcept(e);
+		}
+	}
+}
+
+UpdateDeviceHandler AccessControl::getUpdateDeviceHandler() {
+	return [this](device_t d) {
+		/*
+		 * The services of the device may have changed.
+		 */
+		std::unique_lock<std::mutex> decisionsLk(decisionsMutex);
+		for (auto it = decisions.cbegin(); it != decisions.cend();) {
+			if (it->first.first == d) {
+				decisions.erase(it++);
+			} else {
+				++it;
+			}
+		}
+		decisionsLk.unlock();
+
+		if (!prefetchEnabled) {
+			return;
+		}
+
+		boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+		auto it = beetle.devices.find(d);
+		if (it == beetle.devices.end()) {
+			return;
+		}
+		std::shared_ptr<Device> device = it->second;
+
+		/*
+		 * Plausible pairs are the ones that would need a controller decision.
+		 */
+		std::vector<map_query_t> queries;
+		for (auto &kv : beetle.devices) {
+			if (kv.first == d) {
+				continue;
+			}
+			map_query_t query;
+			bool unused;
+			if (resolveQuery(device, kv.second, query, unused)) {
+				queries.push_back(query);
+			}
+			if (resolveQuery(kv.second, device, query, unused)) {
+				queries.push_back(query);
+			}
+		}
+		devicesLk.unlock();
+
+		decisionsLk.lock();
+		std::vector<map_query_t> batch;
+		for (map_query_t &query : queries) {
+			auto key = std::make_pair(query.from->getId(), query.to->getId());
+			bool unused;
+			if (lookupDecision(key, unused) || pending.find(key) != pending.end()) {
+				continue;
+			}
+			batch.push_back(query);
+			if ((int) batch.size() == batchSize) {
+				fetchers.schedule([this, batch] {prefetch(batch);});
+				batch.clear();
+			}
+		}
+		decisionsLk.unlock();
+		if (!batch.empty()) {
+			fetchers.schedule([this, batch] {prefetch(batch);});
+		}
+	};
+}
+
 RemoveDeviceHandler AccessControl::getRemoveDeviceHandler() {
 	return [this](device_t d) {
+		std::unique_lock<std::mutex> decisionsLk(decisionsMutex);
+		for (auto it = decisions.cbegin(); it != decisions.cend();) {
+			if (it->first.first == d || it->first.second == d) {
+				decisions.erase(it++);
+			} else {
+				++it;
+			}
+		}
+		decisionsLk.unlock();
+
 		boost::unique_lock<boost::shared_mutex> cacheLk(cacheMutex);
 		for (auto it = cache.cbegin(); it != cache.cend();) {
 			/*
@@ -169,19 +416,16 @@ bool AccessControl::acquireExclusiveLease(std::shared_ptr<Device> to, exclusive_
 			<< to->getId();
 
 	std::string url = client->getApiUrl(resource.str());
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
 
 	if (debug_controller) {
 		pdebug("post: " + url);
 	}
 
 	try {
-		auto response = client->getClient()->post(request);
-		if (response.status() == 202) {
+		auto response = client->post(resource.str());
+		if (response.status == 202) {
 			std::stringstream ss;
-			ss << body(response);
+			ss << response.body;
 			time_t expire = static_cast<time_t>(std::stod(ss.str()));
 
 			leasesLk.lock();
@@ -193,7 +437,7 @@ bool AccessControl::acquireExclusiveLease(std::shared_ptr<Device> to, exclusive_
 		} else {
 			if (debug_controller) {
 				std::stringstream ss;
-				ss << "exclusive lease denied: " << body(response);
+				ss << "exclusive lease denied: " << response.body;
 				pdebug(ss.str());
 			}
 			newlyAcquired = false;
@@ -218,19 +462,16 @@ void AccessControl::releaseExclusiveLease(std::shared_ptr<Device> to, exclusive_
 			<< to->getId();
 
 	std::string url = client->getApiUrl(resource.str());
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
 
 	if (debug_controller) {
 		pdebug("delete: " + url);
 	}
 
 	try {
-		auto response = client->getClient()->delete_(request);
-		if (response.status() != 200) {
+		auto response = client->del(resource.str());
+		if (response.status != 200) {
 			std::stringstream ss;
-			ss << "failed to release lease : " << body(response);
+			ss << "failed to release lease : " << response.body;
 			if (debug_controller) {
 				pdebug(ss.str());
 			}
@@ -240,105 +481,107 @@ void AccessControl::releaseExclusiveLease(std::shared_ptr<Device> to, exclusive_
 	}
 }
 
+/*
+ * Whether evaluating the rule on map has side effects beyond this gateway.
+ */
+static bool hasMapSideEffects(const rule_spec_t &spec) {
+	if (spec.rule.exclusiveId > 0) {
+		return true;
+	}
+	for (const dauth_spec_t &dAuth : spec.dauth) {
+		if (dAuth.when == DynamicAuth::ON_MAP && dAuth.type != "network") {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
  * Unpacks the controller response and returns whether the mapping is allowed.
  */
 bool AccessControl::handleCanMapResponse(std::shared_ptr<Device> from, std::shared_ptr<Device> to,
-		std::stringstream &response) {
-	json j;
-	j << response;
+		const can_map_response_t &response, int &ttl, bool prefetching, bool &deferred) {
+	bool result = response.result;
 
-	if (debug_controller) {
-		pdebug(json(j).dump());
-	}
-
-	bool result = j["result"];
+	ttl = denyTtl;
+	deferred = false;
 
-	json access = j["access"];
-	json rules = access["rules"];
-	json services = access["services"];
+	/*
+	 * Leases and prompts are only acquired for mappings that are requested.
+	 * Decisions that would need them are not cached, so that each mapping
+	 * evaluates them again.
+	 */
+	bool sideEffects = false;
+	for (const rule_spec_t &spec : response.rules) {
+		sideEffects |= hasMapSideEffects(spec);
+	}
+	if (sideEffects && prefetching) {
+		deferred = true;
+		ttl = 0;
+		return false;
+	}
 
 	// Is at least one rule satisfiable
 	bool mappingSatisfiable = false;
 
 	cached_mapping_info_t cacheEntry;
-	for (json::iterator it = rules.begin(); it != rules.end(); ++it) {
+	for (const rule_spec_t &spec : response.rules) {
 		// Is this rule satisfiable
 		bool ruleSatisfiable = true;
 
-		std::string ruleIdStr = it.key();
-		json ruleValue = it.value();
-
-		rule_t ruleId = std::stoi(ruleIdStr);
-
-		Rule rule;
-		rule.setProperties(ruleValue["prop"]);
-		rule.encryption = ruleValue["enc"];
-		rule.integrity = ruleValue["int"];
-		rule.exclusiveId = ruleValue["excl"];
-		std::string tStr = ruleValue["lease"];
-		rule.lease = static_cast<time_t>(std::stod(tStr));
-		rule.priority = 0;
-		json dAuthValues = ruleValue["dauth"];
+		rule_t ruleId = spec.id;
+		Rule rule = spec.rule;
 
 		bool acquiredNewLease = false;
 		if (rule.exclusiveId > 0 && !acquireExclusiveLease(to, rule.exclusiveId, acquiredNewLease)) {
 			continue; // cannot use this rule
 		}
 
-		if (dAuthValues.size() > 0) {
-			for (json::iterator it2 = dAuthValues.begin(); it2 != dAuthValues.end(); ++it2) {
-				json dAuthValue = *it2;
-				std::string type = dAuthValue["type"];
-
-				DynamicAuth *auth = NULL;
-				if (type == "network") {
-					std::string ip = dAuthValue["ip"];
-					bool isPrivate = dAuthValue["priv"];
-					auth = new NetworkAuth(ruleId, ip, isPrivate);
-					rule.priority += 0;
-				} else if (type == "passcode") {
-					auth = new PasscodeAuth(ruleId);
-					rule.priority += 1 << 1;
-				} else if (type == "user") {
-					auth = new UserAuth(ruleId);
-					rule.priority += 1 << 2;
-				} else if (type == "admin") {
-					auth = new AdminAuth(ruleId);
-					rule.priority += 1 << 3;
-				}
+		for (const dauth_spec_t &dAuth : spec.dauth) {
+			DynamicAuth *auth = NULL;
+			if (dAuth.type == "network") {
+				auth = new NetworkAuth(ruleId, dAuth.ip, dAuth.isPrivate);
+				rule.priority += 0;
+			} else if (dAuth.type == "passcode") {
+				auth = new PasscodeAuth(ruleId);
+				rule.priority += 1 << 1;
+			} else if (dAuth.type == "user") {
+				auth = new UserAuth(ruleId);
+				rule.priority += 1 << 2;
+			} else if (dAuth.type == "admin") {
+				auth = new AdminAuth(ruleId);
+				rule.priority += 1 << 3;
+			}
 
-				/*
-				 * Populate generic fields
-				 */
-				if (auth != NULL) {
-					int when = dAuthValue["when"];
-					auth->when = static_cast<DynamicAuth::When>(when);
-				} else {
-					if (debug_controller) {
-						pwarn("unsupported auth type");
-					}
+			/*
+			 * Populate generic fields
+			 */
+			if (auth != NULL) {
+				auth->when = static_cast<DynamicAuth::When>(dAuth.when);
+			} else {
+				if (debug_controller) {
+					pwarn("unsupported auth type");
 				}
+			}
 
-				/*
-				 * Evaluate if ON_MAP
-				 */
-				if (auth != NULL) {
-					if (auth->when == DynamicAuth::ON_MAP) {
-						auth->evaluate(client, from, to);
-						if (auth->state != DynamicAuth::SATISFIED) {
-							ruleSatisfiable = false;
-						}
+			/*
+			 * Evaluate if ON_MAP
+			 */
+			if (auth != NULL) {
+				if (auth->when == DynamicAuth::ON_MAP) {
+					auth->evaluate(client, from, to);
+					if (auth->state != DynamicAuth::SATISFIED) {
+						ruleSatisfiable = false;
 					}
-					rule.additionalAuth.push_back(std::shared_ptr<DynamicAuth>(auth));
 				}
+				rule.additionalAuth.push_back(std::shared_ptr<DynamicAuth>(auth));
+			}
 
-				/*
-				 * Stop evaluating
-				 */
-				if (!ruleSatisfiable) {
-					break;
-				}
+			/*
+			 * Stop evaluating
+			 */
+			if (!ruleSatisfiable) {
+				break;
 			}
 		}
 
@@ -362,43 +605,51 @@ bool AccessControl::handleCanMapResponse(std::shared_ptr<Device> from, std::shar
 		if (debug_controller) {
 			pdebug("no rules are satisfiable");
 		}
+		if (response.hasTtl) {
+			ttl = std::min(ttl, response.ttl);
+		}
 		return false;
 	}
 
-	for (json::iterator it = services.begin(); it != services.end(); ++it) {
-		std::string tmp = it.key();
-		UUID serviceUuid = UUID(tmp);
-		json chars = it.value();
+	for (auto &service : response.services) {
+		const UUID &serviceUuid = service.first;
 		if (debug_controller) {
 			pdebug("service: " + serviceUuid.str());
 		}
 
 		assert(cacheEntry.service_char_rules.find(serviceUuid) == cacheEntry.service_char_rules.end());
-		for (json::iterator it2 = chars.begin(); it2 != chars.end(); ++it2) {
-			tmp = it2.key();
-			UUID charUuid = UUID(tmp);
-			json ruleIds = it2.value();
+		for (const char_rules_spec_t &chars : service.second) {
 			if (debug_controller) {
-				pdebug("char: " + charUuid.str());
+				pdebug("char: " + chars.charUuid.str());
 			}
 
 			rule_info_set charRulesSet;
-			for (json::iterator it3 = ruleIds.begin(); it3 != ruleIds.end(); ++it3) {
-				rule_t ruleId = *it3;
-				if (cacheEntry.rules.find(ruleId) != cacheEntry.rules.end()) {
-					rule_info_t ruleInfo = ((uint64_t) cacheEntry.rules[ruleId].priority) << 32;
+			for (rule_t ruleId : chars.ruleIds) {
+				auto rit = cacheEntry.rules.find(ruleId);
+				if (rit != cacheEntry.rules.end()) {
+					rule_info_t ruleInfo = ((uint64_t) rit->second.priority) << 32;
 					ruleInfo |= ruleId;
 					charRulesSet.insert(ruleInfo);
 				}
 			}
 
-			cacheEntry.service_char_rules[serviceUuid][charUuid] = charRulesSet;
+			cacheEntry.service_char_rules[serviceUuid][chars.charUuid] = charRulesSet;
 		}
 	}
 
 	boost::unique_lock<boost::shared_mutex> lk(cacheMutex);
 	cache[std::make_pair(from->getId(), to->getId())] = cacheEntry;
 
+	if (!result) {
+		ttl = denyTtl;
+	} else if (sideEffects) {
+		ttl = 0;
+	} else {
+		ttl = allowTtl;
+	}
+	if (response.hasTtl) {
+		ttl = std::min(ttl, response.ttl);
+	}
 	return result;
 }
 
@@ -414,6 +665,7 @@ static inline bool isWriteReq(uint8_t op) {
 
 bool AccessControl::canAccessHandle(std::shared_ptr<Device> client, std::shared_ptr<Device> server,
 		std::shared_ptr<Handle> handle, uint8_t op, uint8_t &attErr) {
+	TraceSpan span("access");
 	if (client->getType() == Device::TCP_CLIENT_PROXY) {
 		return true;
 	} else if (client->getType() == Device::TCP_SERVER_PROXY) {
@@ -438,7 +690,7 @@ bool AccessControl::canAccessHandle(std::shared_ptr<Device> client, std::shared_
 	/*
 	 * Case 1: This handle is a service.
 	 */
-	std::shared_ptr<PrimaryService> ps = std::dynamic_pointer_cast<PrimaryService>(handle);
+	std::shared_ptr<PrimaryService> ps = handle_cast<PrimaryService>(handle);
 	if (ps) {
 		if (ruleMapping.service_char_rules.find(ps->getServiceUuid()) == ruleMapping.service_char_rules.end()) {
 			return false;
@@ -450,9 +702,9 @@ bool AccessControl::canAccessHandle(std::shared_ptr<Device> client, std::shared_
 	/*
 	 * Case 2: This handle is a characteristic.
 	 */
-	auto ch = std::dynamic_pointer_cast<Characteristic>(handle);
+	auto ch = handle_cast<Characteristic>(handle);
 	if (ch) {
-		ps = std::dynamic_pointer_cast<PrimaryService>(server->handles[ch->getServiceHandle()]);
+		ps = handle_cast<PrimaryService>(server->handles[ch->getServiceHandle()]);
 		if (!ps) {
 			return false;
 		}
@@ -472,8 +724,8 @@ bool AccessControl::canAccessHandle(std::shared_ptr<Device> client, std::shared_
 	/*
 	 * Case 3: This is a handle that is part of a service.
 	 */
-	ps = std::dynamic_pointer_cast<PrimaryService>(server->handles[handle->getServiceHandle()]);
-	ch = std::dynamic_pointer_cast<Characteristic>(server->handles[handle->getCharHandle()]);
+	ps = handle_cast<PrimaryService>(server->handles[handle->getServiceHandle()]);
+	ch = handle_cast<Characteristic>(server->handles[handle->getCharHandle()]);
 	if (!ps || !ch) {
 		return false;
 	}
@@ -489,7 +741,7 @@ bool AccessControl::canAccessHandle(std::shared_ptr<Device> client, std::shared_
 	/*
 	 * SubCase: char config
 	 */
-	auto ccc = std::dynamic_pointer_cast<ClientCharCfg>(handle);
+	auto ccc = handle_cast<ClientCharCfg>(handle);
 	if (ccc) {
 		if (!isWriteReq(op)) {
 			return true;
@@ -554,6 +806,7 @@ bool AccessControl::canAccessHandle(std::shared_ptr<Device> client, std::shared_
 
 bool AccessControl::getCharAccessProperties(std::shared_ptr<Device> client, std::shared_ptr<Device> server,
 		std::shared_ptr<Handle> handle, uint8_t &properties) {
+	TraceSpan span("access");
 	boost::shared_lock<boost::shared_mutex> lk(cacheMutex);
 	if (client->getType() == Device::TCP_CLIENT_PROXY) {
 		properties = 0xFF;
@@ -572,9 +825,9 @@ bool AccessControl::getCharAccessProperties(std::shared_ptr<Device> client, std:
 	cached_mapping_info_t &ruleMapping = cache[key];
 	properties = 0;
 
-	auto ch = std::dynamic_pointer_cast<Characteristic>(handle);
+	auto ch = handle_cast<Characteristic>(handle);
 	if (ch) {
-		auto ps = std::dynamic_pointer_cast<PrimaryService>(server->handles[ch->getServiceHandle()]);
+		auto ps = handle_cast<PrimaryService>(server->handles[ch->getServiceHandle()]);
 		if (!ps) {
 			return false;
 		}
@@ -602,6 +855,7 @@ bool AccessControl::getCharAccessProperties(std::shared_ptr<Device> client, std:
 }
 
 bool AccessControl::canReadType(std::shared_ptr<Device> client, std::shared_ptr<Device> server, UUID &attType) {
+	TraceSpan span("access");
 	if (std::dynamic_pointer_cast<TCPClientProxy>(client)) {
 		return true;
 	} else if (std::dynamic_pointer_cast<TCPServerProxy>(client)) {
@@ -7,39 +7,31 @@
 
 #include "controller/ControllerClient.h"
 
-#define BOOST_NETWORK_ENABLE_HTTPS
-
-#include <boost/network/protocol/http/client/options.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/system/system_error.hpp>
 #include <cassert>
+#include <iomanip>
 #include <sstream>
 #include <memory>
 
 #include "Beetle.h"
+#include "BeetleConfig.h"
+#include "Debug.h"
 #include "util/file.h"
 
-static const int CLIENT_TIMEOUT = 180;
-
 /* Custom header to identify gateway */
 const std::string ControllerClient::SESSION_HEADER = "Beetle-Gateway-Session";
 
-ControllerClient::ControllerClient(Beetle &beetle, std::string host, int apiPort, int ctrlPort,
-		bool verifyPeers, std::string clientCert, std::string clientKey, std::string caCert) :
-		beetle(beetle), host(host), apiPort(apiPort), ctrlPort(ctrlPort) {
-	assert(file_exists(clientCert));
-	assert(file_exists(clientKey));
-	assert(file_exists(caCert));
-
-	using namespace boost::network;
-	http::client::options options;
-	options.follow_redirects(false)
-		.cache_resolved(true)
-		.always_verify_peer(verifyPeers)
-		.timeout(CLIENT_TIMEOUT)
-		.openssl_certificate(caCert)
-		.openssl_certificate_file(clientCert)
-		.openssl_private_key_file(clientKey);
-	client.reset(new http::client(options));
+ControllerClient::ControllerClient(Beetle &beetle, const BeetleConfig &config, bool verifyPeers) :
+		beetle(beetle), host(config.controllerHost), apiPort(config.controllerApiPort),
+		ctrlPort(config.controllerControlPort) {
+	assert(file_exists(config.sslCert));
+	assert(file_exists(config.sslKey));
+	assert(file_exists(config.sslCaCert));
+
+	pool = std::make_unique<HttpConnectionPool>(host, apiPort, verifyPeers, config.sslCert, config.sslKey,
+			config.sslCaCert, config.controllerMaxConnections, config.controllerPipelineDepth,
+			config.controllerTimeout, config.controllerIdleTimeout, &beetle.metrics);
 }
 
 ControllerClient::~ControllerClient() {
@@ -54,10 +46,6 @@ std::string ControllerClient::getApiUrl(std::string resource) {
 	return ss.str();
 }
 
-std::shared_ptr<boost::network::http::client> ControllerClient::getClient() {
-	return client;
-}
-
 std::string ControllerClient::getName() {
 	return beetle.name;
 }
@@ -81,3 +69,78 @@ void ControllerClient::setSessionToken(std::string token) {
 std::string ControllerClient::getSessionToken() {
 	return sessionToken;
 }
+
+http_headers_t ControllerClient::getHeaders(std::string contentType) {
+	http_headers_t headers;
+	headers.push_back(std::make_pair("User-Agent", "linux"));
+	if (sessionToken != "") {
+		headers.push_back(std::make_pair(SESSION_HEADER, sessionToken));
+	}
+	if (contentType != "") {
+		headers.push_back(std::make_pair("Content-Type", contentType));
+	}
+	return headers;
+}
+
+void ControllerClient::request(std::string method, std::string resource, std::string body, std::string contentType,
+		HttpResponseHandler handler) {
+	// TODO more robust escaping
+	boost::replace_all(resource, " ", "%20");
+	pool->asyncRequest(method, "/" + resource, getHeaders(contentType), body, handler);
+}
+
+http_response_t ControllerClient::blockingRequest(std::string method, std::string resource, std::string body,
+		std::string contentType) {
+	// TODO more robust escaping
+	boost::replace_all(resource, " ", "%20");
+	try {
+		return pool->request(method, "/" + resource, getHeaders(contentType), body);
+	} catch (boost::system::system_error &e) {
+		throw ControllerException(method + " " + resource + ": " + e.what());
+	}
+}
+
+http_response_t ControllerClient::get(std::string resource) {
+	return blockingRequest("GET", resource, "", "");
+}
+
+http_response_t ControllerClient::post(std::string resource, std::string body, std::string contentType) {
+	return blockingRequest("POST", resource, body, contentType);
+}
+
+http_response_t ControllerClient::put(std::string resource, std::string body, std::string contentType) {
+	return blockingRequest("PUT", resource, body, contentType);
+}
+
+http_response_t ControllerClient::del(std::string resource) {
+	return blockingRequest("DELETE", resource, "", "");
+}
+
+std::map<std::string, http_endpoint_stats_t> ControllerClient::getEndpointStats() {
+	return pool->getEndpointStats();
+}
+
+http_pool_stats_t ControllerClient::getPoolStats() {
+	return pool->getPoolStats();
+}
+
+std::function<void()> ControllerClient::getDaemon() {
+	return [this] {
+		if (!debug_controller) {
+			return;
+		}
+
+		http_pool_stats_t poolStats = pool->getPoolStats();
+		std::stringstream ss;
+		ss << "controller connections: " << poolStats.connections << " opened, " << poolStats.resumed
+				<< " resumed, " << poolStats.reused << " reused, " << poolStats.pipelined << " pipelined, "
+				<< poolStats.retried << " retried";
+		for (auto &kv : pool->getEndpointStats()) {
+			double avgMillis = kv.second.totalMicros / 1000.0 / kv.second.requests;
+			ss << std::endl << "  " << kv.first << ": " << kv.second.requests << " requests, " << kv.second.errors
+					<< " errors, " << std::fixed << std::setprecision(1) << avgMillis << " ms avg, "
+					<< kv.second.maxMicros / 1000.0 << " ms max";
+		}
+		pdebug(ss.str());
+	};
+}
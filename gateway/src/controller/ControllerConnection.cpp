@@ -9,6 +9,7 @@
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/basic_socket_iostream.hpp>
+#include <boost/version.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/thread/lock_types.hpp>
 #include <boost/thread/pthread/shared_mutex.hpp>
@@ -17,16 +18,21 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <stdexcept>
 #include <utility>
 
 #include "Beetle.h"
 #include "controller/ControllerClient.h"
+#include "controller/NetworkDiscoveryClient.h"
 #include "device/socket/tcp/TCPServerProxy.h"
 #include "Debug.h"
 #include "Device.h"
+#include "util/write.h"
 
 using namespace boost::asio;
 
@@ -62,8 +68,8 @@ static ip::tcp::iostream *connect_controller(ControllerClient *client) {
 }
 
 ControllerConnection::ControllerConnection(Beetle &beetle, std::shared_ptr<ControllerClient> client_,
-		int maxReconnectionAttempts_) :
-	beetle(beetle), daemonThread() {
+		int maxReconnectionAttempts_, int numWorkers) :
+	beetle(beetle), commands(numWorkers), daemonThread() {
 	client = client_;
 
 	maxReconnectionAttempts = maxReconnectionAttempts_;
@@ -78,10 +84,12 @@ ControllerConnection::ControllerConnection(Beetle &beetle, std::shared_ptr<Contr
 }
 
 ControllerConnection::~ControllerConnection() {
+	streamMutex.lock();
 	if (stream) {
 		stream->close();
 		stream.reset();
 	}
+	streamMutex.unlock();
 	daemonRunning = false;
 	if (daemonThread.joinable()) {
 		daemonThread.join();
@@ -102,8 +110,11 @@ bool ControllerConnection::reconnect() {
 		if (debug) {
 			pdebug("reconnecting to controller: " + std::to_string(i));
 		}
+		streamMutex.lock();
 		stream.reset(connect_controller(client.get()));
-		if (stream) {
+		bool connected = (bool) stream;
+		streamMutex.unlock();
+		if (connected) {
 			if (debug) {
 				pdebug("reconnected to controller");
 			}
@@ -125,8 +136,10 @@ void ControllerConnection::socketDaemon() {
 	while (daemonRunning) {
 		std::vector<std::string> cmd;
 		if (!getCommand(cmd)) {
+			streamMutex.lock();
 			stream->close();
 			stream.reset();
+			streamMutex.unlock();
 			if (!reconnect()) {
 				throw ControllerException("max controller reconnection attempts exceeded");
 			}
@@ -136,18 +149,91 @@ void ControllerConnection::socketDaemon() {
 		}
 
 		std::string c1 = cmd[0];
+		std::function<void(const std::vector<std::string>&)> f;
+		size_t nArgs = 0;
 		if (c1 == "map-local") {
-			doMapLocal(cmd);
+			f = [this](const std::vector<std::string>& cmd) { doMapLocal(cmd); };
+			nArgs = 2;
 		} else if (c1 == "unmap-local") {
-			doUnmapLocal(cmd);
+			f = [this](const std::vector<std::string>& cmd) { doUnmapLocal(cmd); };
+			nArgs = 2;
 		} else if (c1 == "map-remote") {
-			doMapRemote(cmd);
+			f = [this](const std::vector<std::string>& cmd) { doMapRemote(cmd); };
+			nArgs = (cmd.size() == 5) ? 4 : 5;
 		} else if (c1 == "unmap-remote") {
-			doUnmapRemote(cmd);
+			f = [this](const std::vector<std::string>& cmd) { doUnmapRemote(cmd); };
+			nArgs = 3;
+		} else if (c1 == "invalidate-discovery") {
+			if (beetle.discoveryClient) {
+				beetle.discoveryClient->invalidateCache();
+			}
+			acknowledge(cmd, true, "");
+			continue;
 		} else {
 			if (debug_controller) {
 				pdebug("unrecognized command : " + c1);
 			}
+			acknowledge(cmd, false, "unrecognized command");
+			continue;
+		}
+
+		/*
+		 * Commands to the same device run in order. The target is always
+		 * the last argument.
+		 */
+		device_t to;
+		try {
+			if (cmd.size() != nArgs + 1) {
+				throw std::invalid_argument("expected " + std::to_string(nArgs) + " arguments");
+			}
+			to = std::stol(cmd.back());
+			if (to < 0) {
+				throw std::invalid_argument("invalid device");
+			}
+		} catch (std::exception &e) {
+			acknowledge(cmd, false, e.what());
+			continue;
+		}
+
+		commands.schedule(to, [this, cmd, f] {
+			try {
+				f(cmd);
+				acknowledge(cmd, true, "");
+			} catch (std::exception &e) {
+				if (debug) {
+					pdebug("failed to complete controller command: " + std::string(e.what()));
+				}
+				acknowledge(cmd, false, e.what());
+			}
+		});
+	}
+}
+
+void ControllerConnection::acknowledge(const std::vector<std::string> &cmd, bool success, std::string err) {
+	std::stringstream ss;
+	ss << (success ? "ok" : "error");
+	for (auto &t : cmd) {
+		ss << " " << t;
+	}
+	if (!success) {
+		ss << " : " << err;
+	}
+	ss << "\n";
+	std::string line = ss.str();
+
+	/*
+	 * Written to the socket, since the daemon may be blocked reading the
+	 * stream.
+	 */
+	std::lock_guard<std::mutex> lg(streamMutex);
+	if (stream) {
+#if BOOST_VERSION >= 106600
+		int fd = stream->rdbuf()->socket().native_handle();
+#else
+		int fd = stream->rdbuf()->native_handle();
+#endif
+		if (send_all(fd, (uint8_t *) line.c_str(), line.length()) < 0 && debug_controller) {
+			pdebug("could not acknowledge controller command");
 		}
 	}
 }
@@ -177,12 +263,9 @@ bool ControllerConnection::getCommand(std::vector<std::string> &ret) {
 void ControllerConnection::doMapLocal(const std::vector<std::string>& cmd) {
 	device_t from = std::stol(cmd[1]);
 	device_t to = std::stol(cmd[2]);
-
 	std::string err;
 	if (!beetle.mapDevices(from, to, err)) {
-		if (debug) {
-			pdebug(err);
-		}
+		throw ControllerException(err);
 	}
 }
 
@@ -191,59 +274,99 @@ void ControllerConnection::doUnmapLocal(const std::vector<std::string>& cmd) {
 	device_t to = std::stol(cmd[2]);
 	std::string err;
 	if (!beetle.unmapDevices(from, to, err)) {
-		if (debug) {
-			pdebug(err);
-		}
+		throw ControllerException(err);
 	}
 }
 
-void ControllerConnection::doMapRemote(const std::vector<std::string>& cmd) {
-	std::string gateway = cmd[1];
-	std::string addr = cmd[2];
-	int port = std::stoi(cmd[3]);
-	device_t remote = std::stol(cmd[4]);
-	device_t to = std::stol(cmd[5]);
-
-	device_t from = NULL_RESERVED_DEVICE;
-	beetle.devicesMutex.lock_shared();
+device_t ControllerConnection::findRemoteProxy(std::string gateway, device_t remote) {
+	if (gateway == "") {
+		return NULL_RESERVED_DEVICE;
+	}
+	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
 	for (auto &kv : beetle.devices) {
 		if (kv.second->getType() == Device::TCP_SERVER_PROXY) {
 			auto proxy = std::dynamic_pointer_cast<TCPServerProxy>(kv.second);
 			if (proxy->getServerGateway() == gateway && proxy->getRemoteDeviceId() == remote) {
-				from = proxy->getId();
+				return proxy->getId();
 			}
 		}
 	}
-	beetle.devicesMutex.unlock_shared();
-
-	if (from == NULL_RESERVED_DEVICE) {
-		std::shared_ptr<VirtualDevice> device = NULL;
-		try {
-			device.reset(TCPServerProxy::connectRemote(beetle, addr, port, remote));
-
-			boost::shared_lock<boost::shared_mutex> devicesLk;
-			beetle.addDevice(device, devicesLk);
-
-			device->start();
+	return NULL_RESERVED_DEVICE;
+}
 
-			if (debug) {
-				pdebug("connected to remote " + std::to_string(device->getId()) + " : " + device->getName());
-			}
+/*
+ * The controller may leave out the gateway name, in which case it is the
+ * name last seen at the address.
+ */
+void ControllerConnection::doMapRemote(const std::vector<std::string>& cmd) {
+	size_t i = (cmd.size() == 5) ? 1 : 2;
+	std::string addr = cmd[i];
+	int port = std::stoi(cmd[i + 1]);
+	device_t remote = std::stol(cmd[i + 2]);
+	device_t to = std::stol(cmd[i + 3]);
+
+	std::string key = addr + ":" + std::to_string(port) + "/" + std::to_string(remote);
+	std::shared_ptr<std::mutex> remoteMutex;
+	{
+		std::lock_guard<std::mutex> lg(remoteMutexesMutex);
+		auto &m = remoteMutexes[key];
+		if (!m) {
+			m = std::make_shared<std::mutex>();
+		}
+		remoteMutex = m;
+	}
 
-			from = device->getId();
-		} catch (DeviceException& e) {
-			pexcept(e);
-			if (debug) {
-				pdebug("failed to complete controller command");
-			}
-			if (device) {
-				beetle.removeDevice(device->getId());
+	/*
+	 * The last command using an entry erases it, so that there is one per
+	 * connection in progress.
+	 */
+	auto releaseRemoteMutex = [this, &key, &remoteMutex] {
+		std::lock_guard<std::mutex> lg(remoteMutexesMutex);
+		if (remoteMutex.use_count() == 2) {
+			remoteMutexes.erase(key);
+		}
+		remoteMutex.reset();
+	};
+
+	std::unique_lock<std::mutex> remoteLk(*remoteMutex);
+	device_t from;
+	try {
+		std::string gateway = (i == 2) ? cmd[1] : TCPServerProxy::getGatewayName(addr, port);
+		from = findRemoteProxy(gateway, remote);
+		if (from == NULL_RESERVED_DEVICE) {
+			std::shared_ptr<VirtualDevice> device = NULL;
+			try {
+				device.reset(TCPServerProxy::connectRemote(beetle, addr, port, remote));
+
+				boost::shared_lock<boost::shared_mutex> devicesLk;
+				beetle.addDevice(device, devicesLk);
+
+				device->start();
+
+				if (debug) {
+					pdebug("connected to remote " + std::to_string(device->getId()) + " : " + device->getName());
+				}
+
+				from = device->getId();
+			} catch (DeviceException& e) {
+				pexcept(e);
+				if (device) {
+					beetle.removeDevice(device->getId());
+				}
+				throw;
 			}
 		}
+	} catch (...) {
+		remoteLk.unlock();
+		releaseRemoteMutex();
+		throw;
 	}
+	remoteLk.unlock();
+	releaseRemoteMutex();
 
-	if (from != NULL_RESERVED_DEVICE) {
-		beetle.unmapDevices(from, to);
+	std::string err;
+	if (!beetle.mapDevices(from, to, err)) {
+		throw ControllerException(err);
 	}
 }
 
@@ -252,22 +375,13 @@ void ControllerConnection::doUnmapRemote(const std::vector<std::string>& cmd) {
 	device_t remote = std::stol(cmd[2]);
 	device_t to = std::stol(cmd[3]);
 
-	device_t from = NULL_RESERVED_DEVICE;
-	boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
-	for (auto &kv : beetle.devices) {
-		if (kv.second->getType() == Device::TCP_SERVER_PROXY) {
-			auto proxy = std::dynamic_pointer_cast<TCPServerProxy>(kv.second);
-			if (proxy->getServerGateway() == gateway && proxy->getRemoteDeviceId() == remote) {
-				from = proxy->getId();
-			}
-		}
+	device_t from = findRemoteProxy(gateway, remote);
+	if (from == NULL_RESERVED_DEVICE) {
+		throw ControllerException("no proxy to " + std::to_string(remote) + " at " + gateway);
 	}
-	devicesLk.unlock();
 
-	if (from != NULL_RESERVED_DEVICE) {
-		beetle.unmapDevices(from, to);
+	std::string err;
+	if (!beetle.unmapDevices(from, to, err)) {
+		throw ControllerException(err);
 	}
 }
-
-
-
@@ -0,0 +1,214 @@
+/*
+ * ControllerResponse.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "controller/ControllerResponse.h"
+
+static void parseDynamicAuth(JsonReader &reader, dauth_spec_t &ret) {
+	ret.when = 0;
+	ret.isPrivate = false;
+
+	std::string key;
+	reader.beginObject();
+	while (reader.nextKey(key)) {
+		if (key == "type") {
+			reader.readString(ret.type);
+		} else if (key == "when") {
+			ret.when = reader.readInt();
+		} else if (key == "ip") {
+			reader.readString(ret.ip);
+		} else if (key == "priv") {
+			ret.isPrivate = reader.readBool();
+		} else {
+			reader.skipValue();
+		}
+	}
+}
+
+static void parseRule(JsonReader &reader, rule_spec_t &ret) {
+	Rule &rule = ret.rule;
+	rule.properties = 0;
+	rule.integrity = false;
+	rule.encryption = false;
+	rule.exclusiveId = 0;
+	rule.lease = 0;
+	rule.priority = 0;
+
+	std::string key;
+	std::string value;
+	reader.beginObject();
+	while (reader.nextKey(key)) {
+		if (key == "prop") {
+			reader.readString(value);
+			rule.setProperties(value);
+		} else if (key == "int") {
+			rule.integrity = reader.readBool();
+		} else if (key == "enc") {
+			rule.encryption = reader.readBool();
+		} else if (key == "excl") {
+			rule.exclusiveId = reader.readInt();
+		} else if (key == "lease") {
+			/* Sent as a string of epoch seconds */
+			if (reader.peek() == JsonReader::STRING) {
+				reader.readString(value);
+				rule.lease = static_cast<time_t>(std::stod(value));
+			} else {
+				rule.lease = static_cast<time_t>(reader.readDouble());
+			}
+		} else if (key == "dauth") {
+			reader.beginArray();
+			while (reader.nextElement()) {
+				ret.dauth.emplace_back();
+				parseDynamicAuth(reader, ret.dauth.back());
+			}
+		} else {
+			reader.skipValue();
+		}
+	}
+}
+
+static void parseAccess(JsonReader &reader, can_map_response_t &ret) {
+	std::string key;
+	std::string uuid;
+	reader.beginObject();
+	while (reader.nextKey(key)) {
+		if (key == "rules") {
+			reader.beginObject();
+			while (reader.nextKey(key)) {
+				ret.rules.emplace_back();
+				ret.rules.back().id = std::stoul(key);
+				parseRule(reader, ret.rules.back());
+			}
+		} else if (key == "services") {
+			reader.beginObject();
+			while (reader.nextKey(uuid)) {
+				ret.services.emplace_back(UUID(uuid), std::vector<char_rules_spec_t>());
+				auto &chars = ret.services.back().second;
+				reader.beginObject();
+				while (reader.nextKey(uuid)) {
+					chars.push_back( { UUID(uuid), std::vector<rule_t>() });
+					auto &ruleIds = chars.back().ruleIds;
+					reader.beginArray();
+					while (reader.nextElement()) {
+						ruleIds.push_back(reader.readInt());
+					}
+				}
+			}
+		} else {
+			reader.skipValue();
+		}
+	}
+}
+
+void parseCanMapResponse(JsonReader &reader, can_map_response_t &ret) {
+	std::string key;
+	reader.beginObject();
+	while (reader.nextKey(key)) {
+		if (key == "result") {
+			ret.result = reader.readBool();
+		} else if (key == "ttl") {
+			ret.hasTtl = true;
+			ret.ttl = reader.readInt();
+		} else if (key == "access" && reader.peek() == JsonReader::OBJECT) {
+			parseAccess(reader, ret);
+		} else {
+			reader.skipValue();
+		}
+	}
+}
+
+void parseCanMapResponse(const std::string &body, can_map_response_t &ret) {
+	JsonReader reader(body);
+	parseCanMapResponse(reader, ret);
+	reader.end();
+}
+
+void parseCanMapBatchResponse(const std::string &body, std::vector<can_map_response_t> &ret) {
+	JsonReader reader(body);
+	std::string key;
+	reader.beginObject();
+	while (reader.nextKey(key)) {
+		if (key == "results") {
+			reader.beginArray();
+			while (reader.nextElement()) {
+				ret.emplace_back();
+				parseCanMapResponse(reader, ret.back());
+			}
+		} else {
+			reader.skipValue();
+		}
+	}
+	reader.end();
+}
+
+void parseDiscoveryResponse(const std::string &body, std::list<discovery_result_t> &ret) {
+	JsonReader reader(body);
+	std::string key;
+	std::string inner;
+	reader.beginArray();
+	while (reader.nextElement()) {
+		discovery_result_t result;
+		result.id = -1;
+		result.port = 0;
+		result.isLocal = false;
+
+		reader.beginObject();
+		while (reader.nextKey(key)) {
+			if (key == "device") {
+				reader.beginObject();
+				while (reader.nextKey(inner)) {
+					if (inner == "name") {
+						reader.readString(result.name);
+					} else if (inner == "id") {
+						result.id = reader.readInt();
+					} else {
+						reader.skipValue();
+					}
+				}
+			} else if (key == "gateway") {
+				reader.beginObject();
+				while (reader.nextKey(inner)) {
+					if (inner == "name") {
+						reader.readString(result.gateway);
+					} else if (inner == "ip") {
+						reader.readString(result.ip);
+					} else if (inner == "port") {
+						result.port = reader.readInt();
+					} else {
+						reader.skipValue();
+					}
+				}
+			} else {
+				reader.skipValue();
+			}
+		}
+		ret.push_back(result);
+	}
+	reader.end();
+}
+
+void parseGatewayResponse(const std::string &body, std::string &ip, int &port) {
+	JsonReader reader(body);
+	std::string key;
+	bool hasIp = false;
+	bool hasPort = false;
+	reader.beginObject();
+	while (reader.nextKey(key)) {
+		if (key == "ip") {
+			reader.readString(ip);
+			hasIp = true;
+		} else if (key == "port") {
+			port = reader.readInt();
+			hasPort = true;
+		} else {
+			reader.skipValue();
+		}
+	}
+	reader.end();
+	if (!hasIp || !hasPort) {
+		throw JsonReaderException("json: gateway response is missing ip or port");
+	}
+}
@@ -0,0 +1,758 @@
+/*
+ * HttpConnectionPool.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "controller/HttpConnectionPool.h"
+
+#include <boost/asio/buffers_iterator.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/asio/ssl/stream.hpp>
+#include <boost/asio/ssl/verify_mode.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 107300
+#include <boost/asio/ssl/host_name_verification.hpp>
+#else
+#include <boost/asio/ssl/rfc2818_verification.hpp>
+#endif
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <sstream>
+
+#include "Debug.h"
+#include "Metrics.h"
+
+using namespace boost::asio;
+typedef boost::system::error_code error_code;
+
+/*
+ * Attempts per request, when a connection fails before it is answered.
+ */
+static const int MAX_ATTEMPTS = 2;
+
+/*
+ * Connections in a row that may fail to open before the queue is failed.
+ */
+static const int MAX_CONNECT_FAILURES = 2;
+
+static bool isIdempotent(const std::string &method) {
+	return method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE";
+}
+
+static bool isPipelinable(const std::string &method) {
+	return method == "GET" || method == "HEAD";
+}
+
+/*
+ * Method and the first two path segments, such as "GET access/canMap".
+ */
+static std::string endpointName(const std::string &method, const std::string &target) {
+	std::string name = method + " ";
+	size_t start = 1;
+	for (int segments = 0; segments < 2 && start < target.size(); segments++) {
+		size_t end = target.find_first_of("/?", start);
+		if (end == std::string::npos) {
+			end = target.size();
+		}
+		if (segments > 0) {
+			name += "/";
+		}
+		name += target.substr(start, end - start);
+		if (end == target.size() || target[end] == '?') {
+			break;
+		}
+		start = end + 1;
+	}
+	return name;
+}
+
+static std::string toLower(std::string s) {
+	std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+	return s;
+}
+
+class HttpConnectionPool::Connection: public std::enable_shared_from_this<Connection> {
+public:
+	enum State {
+		CONNECTING, OPEN, CLOSED,
+	};
+
+	State state;
+
+	/*
+	 * Requests written or being written, in order.
+	 */
+	std::deque<std::shared_ptr<request_t>> inflight;
+
+	Connection(HttpConnectionPool &pool) :
+			pool(pool), stream(pool.io, pool.ctx), timer(pool.io) {
+		state = CONNECTING;
+		writing = false;
+		responses = 0;
+		closeAfter = false;
+	}
+
+	bool isIdle() {
+		return state == OPEN && inflight.empty();
+	}
+
+	bool canPipeline(const std::shared_ptr<request_t> &r) {
+		if (state != OPEN || inflight.empty() || (int) inflight.size() >= pool.pipelineDepth
+				|| !isPipelinable(r->method)) {
+			return false;
+		}
+		for (auto &other : inflight) {
+			if (!isPipelinable(other->method)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void connect() {
+		auto self = shared_from_this();
+		endpoints = pool.endpoints;
+		armTimer(pool.timeout);
+		async_connect(stream.lowest_layer(), endpoints.begin(), endpoints.end(),
+				[this, self](const error_code &ec, std::vector<ip::tcp::endpoint>::iterator) {
+					if (state == CLOSED) {
+						return;
+					} else if (ec) {
+						pool.endpoints.clear();
+						fail(ec);
+						return;
+					}
+					error_code ignored;
+					stream.lowest_layer().set_option(ip::tcp::no_delay(true), ignored);
+					handshake();
+				});
+	}
+
+	void send(std::shared_ptr<request_t> r) {
+		{
+			std::lock_guard<std::mutex> lg(pool.statsMutex);
+			if (responses > 0 || !inflight.empty()) {
+				pool.poolStats.reused++;
+			}
+			if (!inflight.empty()) {
+				pool.poolStats.pipelined++;
+			}
+		}
+
+		if (inflight.empty()) {
+			armTimer(pool.timeout);
+		}
+		inflight.push_back(r);
+		writes.push_back(r->data);
+		if (!writing) {
+			write();
+		}
+	}
+
+	/*
+	 * Close, failing or retrying the outstanding requests.
+	 */
+	void fail(const error_code &ec) {
+		if (state == CLOSED) {
+			return;
+		}
+		bool connected = state == OPEN;
+		std::deque<std::shared_ptr<request_t>> pending;
+		pending.swap(inflight);
+		close();
+
+		for (auto &r : pending) {
+			pool.retry(r, ec, true);
+		}
+		if (!connected && pool.connectFailed()) {
+			/*
+			 * Nothing was sent, but do not retry forever if the server is down.
+			 */
+			std::deque<std::shared_ptr<request_t>> queued;
+			queued.swap(pool.queue);
+			for (auto &r : queued) {
+				pool.complete(r, ec, http_response_t());
+			}
+		}
+		pool.dispatch();
+	}
+
+	/*
+	 * Close and fail the outstanding requests without retrying.
+	 */
+	void abort() {
+		std::deque<std::shared_ptr<request_t>> pending;
+		pending.swap(inflight);
+		close();
+		for (auto &r : pending) {
+			pool.complete(r, error::operation_aborted, http_response_t());
+		}
+	}
+
+private:
+	HttpConnectionPool &pool;
+	ssl::stream<ip::tcp::socket> stream;
+	steady_timer timer;
+	std::vector<ip::tcp::endpoint> endpoints;
+
+	std::deque<std::shared_ptr<std::string>> writes;
+	bool writing;
+
+	/*
+	 * Response being read.
+	 */
+	streambuf rbuf;
+	http_response_t response;
+	bool closeAfter;
+	int responses;
+
+	void close() {
+		/*
+		 * Skip the tls close notify, but keep openssl from invalidating the
+		 * saved session as it would for an unclean shutdown.
+		 */
+		if (state == OPEN) {
+			SSL_set_shutdown(stream.native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		}
+		state = CLOSED;
+		timer.cancel();
+		error_code ignored;
+		stream.lowest_layer().close(ignored);
+		pool.removeConnection(this);
+	}
+
+	void armTimer(int seconds) {
+		auto self = shared_from_this();
+		timer.expires_after(std::chrono::seconds(seconds));
+		timer.async_wait([this, self](const error_code &ec) {
+			if (ec == error::operation_aborted || state == CLOSED) {
+				return;
+			}
+			if (debug_controller && !inflight.empty()) {
+				pwarn("controller request timed out");
+			}
+			fail(error::timed_out);
+		});
+	}
+
+	void handshake() {
+		auto self = shared_from_this();
+		SSL *ssl = stream.native_handle();
+		SSL_set_tlsext_host_name(ssl, pool.host.c_str());
+		if (pool.session) {
+			SSL_set_session(ssl, pool.session);
+		}
+		stream.async_handshake(ssl::stream_base::client, [this, self](const error_code &ec) {
+			if (state == CLOSED) {
+				return;
+			} else if (ec) {
+				fail(ec);
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lg(pool.statsMutex);
+				pool.poolStats.connections++;
+				if (SSL_session_reused(stream.native_handle())) {
+					pool.poolStats.resumed++;
+				}
+			}
+
+			state = OPEN;
+			pool.connectFailures = 0;
+			armTimer(pool.idleTimeout);
+
+			/*
+			 * Always keep a read outstanding, so that a server closing an idle
+			 * connection is noticed before a request is sent on it.
+			 */
+			readHeader();
+			pool.dispatch();
+		});
+	}
+
+	void write() {
+		auto self = shared_from_this();
+		auto data = writes.front();
+		writing = true;
+		async_write(stream, buffer(*data), [this, self, data](const error_code &ec, size_t) {
+			writing = false;
+			if (state == CLOSED) {
+				return;
+			} else if (ec) {
+				fail(ec);
+				return;
+			}
+			writes.pop_front();
+			if (!writes.empty()) {
+				write();
+			}
+		});
+	}
+
+	std::string take(size_t n) {
+		auto begin = buffers_begin(rbuf.data());
+		std::string s(begin, begin + n);
+		rbuf.consume(n);
+		return s;
+	}
+
+	/*
+	 * Calls next once at least n bytes are buffered.
+	 */
+	void ensure(size_t n, std::function<void()> next) {
+		if (rbuf.size() >= n) {
+			next();
+			return;
+		}
+		auto self = shared_from_this();
+		async_read(stream, rbuf, transfer_exactly(n - rbuf.size()), [this, self, next](const error_code &ec, size_t) {
+			if (state == CLOSED) {
+				return;
+			} else if (ec) {
+				fail(ec);
+				return;
+			}
+			next();
+		});
+	}
+
+	void readHeader() {
+		auto self = shared_from_this();
+		async_read_until(stream, rbuf, "\r\n\r\n", [this, self](const error_code &ec, size_t n) {
+			if (state == CLOSED) {
+				return;
+			} else if (ec) {
+				fail(ec);
+				return;
+			} else if (inflight.empty() || !parseHeader(take(n))) {
+				fail(error::invalid_argument);
+				return;
+			}
+
+			if (response.status >= 100 && response.status < 200) {
+				response = http_response_t();
+				readHeader();
+				return;
+			}
+
+			auto te = response.headers.find("transfer-encoding");
+			auto cl = response.headers.find("content-length");
+			if (inflight.front()->method == "HEAD" || response.status == 204 || response.status == 304) {
+				finish();
+			} else if (te != response.headers.end() && toLower(te->second).find("chunked") != std::string::npos) {
+				readChunk();
+			} else if (cl != response.headers.end()) {
+				size_t length = std::strtoul(cl->second.c_str(), NULL, 10);
+				ensure(length, [this, length] {
+					response.body = take(length);
+					finish();
+				});
+			} else {
+				closeAfter = true;
+				readToEof();
+			}
+		});
+	}
+
+	bool parseHeader(const std::string &header) {
+		std::istringstream ss(header);
+		std::string line;
+		std::getline(ss, line);
+		if (line.size() < 12 || line.compare(0, 5, "HTTP/") != 0) {
+			return false;
+		}
+		bool http10 = line.compare(0, 8, "HTTP/1.0") == 0;
+		response.status = std::atoi(line.c_str() + 9);
+
+		while (std::getline(ss, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (line.empty()) {
+				break;
+			}
+			size_t colon = line.find(':');
+			if (colon == std::string::npos) {
+				continue;
+			}
+			size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+			std::string value = (valueStart == std::string::npos) ? "" : line.substr(valueStart);
+			response.headers[toLower(line.substr(0, colon))] = value;
+		}
+
+		auto conn = response.headers.find("connection");
+		std::string connValue = (conn == response.headers.end()) ? "" : toLower(conn->second);
+		if (http10) {
+			closeAfter = connValue.find("keep-alive") == std::string::npos;
+		} else {
+			closeAfter = connValue.find("close") != std::string::npos;
+		}
+		return true;
+	}
+
+	void readChunk() {
+		auto self = shared_from_this();
+		async_read_until(stream, rbuf, "\r\n", [this, self](const error_code &ec, size_t n) {
+			if (state == CLOSED) {
+				return;
+			} else if (ec) {
+				fail(ec);
+				return;
+			}
+			size_t size = std::strtoul(take(n).c_str(), NULL, 16);
+			if (size == 0) {
+				readTrailer();
+				return;
+			}
+			ensure(size + 2, [this, size] {
+				response.body += take(size);
+				take(2);
+				readChunk();
+			});
+		});
+	}
+
+	void readTrailer() {
+		auto self = shared_from_this();
+		async_read_until(stream, rbuf, "\r\n", [this, self](const error_code &ec, size_t n) {
+			if (state == CLOSED) {
+				return;
+			} else if (ec) {
+				fail(ec);
+				return;
+			}
+			if (take(n) == "\r\n") {
+				finish();
+			} else {
+				readTrailer();
+			}
+		});
+	}
+
+	void readToEof() {
+		auto self = shared_from_this();
+		async_read(stream, rbuf, transfer_all(), [this, self](const error_code &ec, size_t) {
+			if (state == CLOSED) {
+				return;
+			} else if (ec != error::eof && ec != ssl::error::stream_truncated) {
+				fail(ec);
+				return;
+			}
+			response.body = take(rbuf.size());
+			finish();
+		});
+	}
+
+	void finish() {
+		auto r = inflight.front();
+		inflight.pop_front();
+		http_response_t done;
+		std::swap(done, response);
+		response = http_response_t();
+
+		/*
+		 * Tls 1.3 tickets arrive after the handshake, so save the session
+		 * once something has been read.
+		 */
+		if (responses++ == 0) {
+			pool.saveSession(stream.native_handle());
+		}
+
+		if (closeAfter) {
+			/*
+			 * The server did not process anything pipelined behind this.
+			 */
+			pool.pipelining = false;
+			std::deque<std::shared_ptr<request_t>> unanswered;
+			unanswered.swap(inflight);
+			close();
+			for (auto it = unanswered.rbegin(); it != unanswered.rend(); ++it) {
+				pool.queue.push_front(*it);
+			}
+			pool.complete(r, error_code(), done);
+			pool.dispatch();
+			return;
+		}
+
+		armTimer(inflight.empty() ? pool.idleTimeout : pool.timeout);
+		readHeader();
+		pool.complete(r, error_code(), done);
+		pool.dispatch();
+	}
+};
+
+HttpConnectionPool::HttpConnectionPool(std::string host, int port, bool verifyPeers, std::string clientCert,
+		std::string clientKey, std::string caCert, int maxConnections, int pipelineDepth, int timeout,
+		int idleTimeout, MetricsRegistry *metrics) :
+		host(host), port(port), maxConnections(maxConnections), pipelineDepth(pipelineDepth), timeout(timeout),
+		idleTimeout(idleTimeout), work(new io_service::work(io)), ctx(ssl::context::sslv23_client),
+		resolver(io), metrics(metrics) {
+	resolving = false;
+	stopping = false;
+	connectFailures = 0;
+	session = NULL;
+	pipelining = pipelineDepth > 1;
+	poolStats = http_pool_stats_t { };
+
+	ctx.set_options(ssl::context::default_workarounds | ssl::context::no_sslv2 | ssl::context::no_sslv3);
+	ctx.load_verify_file(caCert);
+	ctx.use_certificate_file(clientCert, ssl::context::pem);
+	ctx.use_private_key_file(clientKey, ssl::context::pem);
+	if (verifyPeers) {
+		ctx.set_verify_mode(ssl::verify_peer);
+#if BOOST_VERSION >= 107300
+		ctx.set_verify_callback(ssl::host_name_verification(host));
+#else
+		ctx.set_verify_callback(ssl::rfc2818_verification(host));
+#endif
+	}
+
+	thread = std::thread([this] {
+		io.run();
+	});
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+	io.post([this] {
+		shutdown();
+	});
+	work.reset();
+	thread.join();
+	if (session) {
+		SSL_SESSION_free(session);
+	}
+}
+
+void HttpConnectionPool::shutdown() {
+	stopping = true;
+	resolver.cancel();
+	auto toClose = connections;
+	for (auto &c : toClose) {
+		c->abort();
+	}
+	std::deque<std::shared_ptr<request_t>> queued;
+	queued.swap(queue);
+	for (auto &r : queued) {
+		complete(r, error::operation_aborted, http_response_t());
+	}
+}
+
+void HttpConnectionPool::asyncRequest(std::string method, std::string target, const http_headers_t &headers,
+		std::string body, HttpResponseHandler handler) {
+	auto r = std::make_shared<request_t>();
+	r->method = method;
+	r->endpoint = endpointName(method, target);
+	r->handler = handler;
+	r->queued = std::chrono::steady_clock::now();
+	r->attempts = 0;
+
+	std::stringstream ss;
+	ss << method << " " << target << " HTTP/1.1\r\n";
+	ss << "Host: " << host << ":" << port << "\r\n";
+	for (auto &h : headers) {
+		ss << h.first << ": " << h.second << "\r\n";
+	}
+	if (!body.empty() || method == "POST" || method == "PUT") {
+		ss << "Content-Length: " << body.length() << "\r\n";
+	}
+	ss << "\r\n" << body;
+	r->data = std::make_shared<std::string>(ss.str());
+
+	io.post([this, r] {
+		if (stopping) {
+			complete(r, error::operation_aborted, http_response_t());
+			return;
+		}
+		queue.push_back(r);
+		dispatch();
+	});
+}
+
+http_response_t HttpConnectionPool::request(std::string method, std::string target, const http_headers_t &headers,
+		std::string body) {
+	assert(std::this_thread::get_id() != thread.get_id());
+
+	auto promise = std::make_shared<std::promise<http_response_t>>();
+	asyncRequest(method, target, headers, body, [promise](const error_code &ec, const http_response_t &response) {
+		if (ec) {
+			promise->set_exception(std::make_exception_ptr(boost::system::system_error(ec)));
+		} else {
+			promise->set_value(response);
+		}
+	});
+	return promise->get_future().get();
+}
+
+void HttpConnectionPool::dispatch() {
+	if (stopping) {
+		return;
+	} else if (endpoints.empty()) {
+		if (!queue.empty()) {
+			resolve();
+		}
+		return;
+	}
+
+	while (!queue.empty()) {
+		auto r = queue.front();
+		std::shared_ptr<Connection> target;
+		for (auto &c : connections) {
+			if (c->isIdle()) {
+				target = c;
+				break;
+			}
+		}
+
+		/*
+		 * Only pipeline once no more connections can be opened.
+		 */
+		if (!target && (int) connections.size() >= maxConnections && pipelining) {
+			for (auto &c : connections) {
+				if (c->canPipeline(r) && (!target || c->inflight.size() < target->inflight.size())) {
+					target = c;
+				}
+			}
+		}
+
+		if (!target) {
+			break;
+		}
+		queue.pop_front();
+		target->send(r);
+	}
+
+	int connecting = std::count_if(connections.begin(), connections.end(),
+			[](const std::shared_ptr<Connection> &c) {return c->state == Connection::CONNECTING;});
+	while ((int) queue.size() > connecting && (int) connections.size() < maxConnections) {
+		auto c = std::make_shared<Connection>(*this);
+		connections.push_back(c);
+		c->connect();
+		connecting++;
+	}
+}
+
+void HttpConnectionPool::resolve() {
+	if (resolving) {
+		return;
+	}
+	resolving = true;
+	resolver.async_resolve(host, std::to_string(port),
+			[this](const error_code &ec, ip::tcp::resolver::results_type results) {
+				resolving = false;
+				if (!ec) {
+					for (auto &entry : results) {
+						endpoints.push_back(entry.endpoint());
+					}
+				}
+				if (ec || endpoints.empty()) {
+					std::deque<std::shared_ptr<request_t>> queued;
+					queued.swap(queue);
+					for (auto &r : queued) {
+						complete(r, ec ? ec : error::host_not_found, http_response_t());
+					}
+					return;
+				}
+				dispatch();
+			});
+}
+
+bool HttpConnectionPool::connectFailed() {
+	for (auto &c : connections) {
+		if (c->state == Connection::OPEN) {
+			return false;
+		}
+	}
+	if (++connectFailures < MAX_CONNECT_FAILURES) {
+		return false;
+	}
+	connectFailures = 0;
+	return true;
+}
+
+void HttpConnectionPool::retry(std::shared_ptr<request_t> r, const error_code &ec, bool sent) {
+	r->attempts++;
+	if (!stopping && r->attempts < MAX_ATTEMPTS && (!sent || isIdempotent(r->method))) {
+		std::lock_guard<std::mutex> lg(statsMutex);
+		poolStats.retried++;
+		queue.push_back(r);
+	} else {
+		complete(r, ec, http_response_t());
+	}
+}
+
+void HttpConnectionPool::complete(std::shared_ptr<request_t> r, const error_code &ec,
+		const http_response_t &response) {
+	uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - r->queued).count();
+	{
+		std::lock_guard<std::mutex> lg(statsMutex);
+		http_endpoint_stats_t &stats = endpointStats[r->endpoint];
+		stats.requests++;
+		if (ec) {
+			stats.errors++;
+		}
+		stats.totalMicros += micros;
+		stats.maxMicros = std::max(stats.maxMicros, micros);
+
+		if (metrics) {
+			auto &m = endpointMetrics[r->endpoint];
+			if (m.first == NULL) {
+				metric_labels_t labels = { { "endpoint", r->endpoint } };
+				m.first = metrics->histogram("beetle_controller_request_seconds",
+						"Controller requests from queueing to response, by endpoint.", labels);
+				m.second = metrics->counter("beetle_controller_request_errors_total",
+						"Controller requests that failed, by endpoint.", labels);
+			}
+			m.first->record(micros);
+			if (ec) {
+				m.second->add();
+			}
+		}
+	}
+
+	try {
+		r->handler(ec, response);
+	} catch (std::exception &e) {
+		pexcept(e);
+	}
+}
+
+void HttpConnectionPool::removeConnection(Connection *c) {
+	connections.remove_if([c](const std::shared_ptr<Connection> &other) {return other.get() == c;});
+}
+
+void HttpConnectionPool::saveSession(SSL *ssl) {
+	SSL_SESSION *s = SSL_get1_session(ssl);
+	if (s == NULL) {
+		return;
+	}
+	if (session) {
+		SSL_SESSION_free(session);
+	}
+	session = s;
+}
+
+std::map<std::string, http_endpoint_stats_t> HttpConnectionPool::getEndpointStats() {
+	std::lock_guard<std::mutex> lg(statsMutex);
+	return endpointStats;
+}
+
+http_pool_stats_t HttpConnectionPool::getPoolStats() {
+	std::lock_guard<std::mutex> lg(statsMutex);
+	return poolStats;
+}
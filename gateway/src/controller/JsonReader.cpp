@@ -0,0 +1,380 @@
+/*
+ * JsonReader.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "controller/JsonReader.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+JsonReader::JsonReader(const std::string &doc) {
+	/* c_str() is terminated, so strtod cannot run past the end */
+	first = doc.c_str();
+	pos = first;
+	last = pos + doc.length();
+	needComma = false;
+}
+
+JsonReader::~JsonReader() {
+
+}
+
+void JsonReader::error(std::string msg) {
+	throw JsonReaderException("json: " + msg + " at offset " + std::to_string(pos - first));
+}
+
+void JsonReader::skipWhitespace() {
+	while (pos < last && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+		pos++;
+	}
+}
+
+void JsonReader::expect(char c) {
+	skipWhitespace();
+	if (pos >= last || *pos != c) {
+		error(std::string("expected '") + c + "'");
+	}
+	pos++;
+}
+
+void JsonReader::expectLiteral(const char *literal) {
+	size_t len = strlen(literal);
+	if ((size_t) (last - pos) < len || memcmp(pos, literal, len) != 0) {
+		error(std::string("expected ") + literal);
+	}
+	pos += len;
+	needComma = true;
+}
+
+JsonReader::Type JsonReader::peek() {
+	skipWhitespace();
+	if (pos >= last) {
+		error("unexpected end");
+	}
+	switch (*pos) {
+	case '{':
+		return OBJECT;
+	case '[':
+		return ARRAY;
+	case '"':
+		return STRING;
+	case 't':
+	case 'f':
+		return BOOLEAN;
+	case 'n':
+		return NUL;
+	default:
+		if (*pos == '-' || (*pos >= '0' && *pos <= '9')) {
+			return NUMBER;
+		}
+		error("unexpected character");
+	}
+}
+
+void JsonReader::beginObject() {
+	expect('{');
+	needComma = false;
+}
+
+bool JsonReader::nextKey(std::string &key) {
+	skipWhitespace();
+	if (pos < last && *pos == '}') {
+		pos++;
+		needComma = true;
+		return false;
+	}
+	if (needComma) {
+		expect(',');
+	}
+	if (peek() != STRING) {
+		error("expected key");
+	}
+	readString(key);
+	expect(':');
+	needComma = false;
+	return true;
+}
+
+void JsonReader::beginArray() {
+	expect('[');
+	needComma = false;
+}
+
+bool JsonReader::nextElement() {
+	skipWhitespace();
+	if (pos < last && *pos == ']') {
+		pos++;
+		needComma = true;
+		return false;
+	}
+	if (needComma) {
+		expect(',');
+		skipWhitespace();
+		if (pos < last && *pos == ']') {
+			error("trailing comma");
+		}
+	}
+	return true;
+}
+
+uint32_t JsonReader::readHex4() {
+	if (last - pos < 4) {
+		error("short escape");
+	}
+	uint32_t v = 0;
+	for (int i = 0; i < 4; i++) {
+		char c = *pos++;
+		v <<= 4;
+		if (c >= '0' && c <= '9') {
+			v |= c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			v |= c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			v |= c - 'A' + 10;
+		} else {
+			error("bad escape");
+		}
+	}
+	return v;
+}
+
+void JsonReader::appendCodePoint(std::string &s, uint32_t cp) {
+	if (cp < 0x80) {
+		s += (char) cp;
+	} else if (cp < 0x800) {
+		s += (char) (0xC0 | (cp >> 6));
+		s += (char) (0x80 | (cp & 0x3F));
+	} else if (cp < 0x10000) {
+		s += (char) (0xE0 | (cp >> 12));
+		s += (char) (0x80 | ((cp >> 6) & 0x3F));
+		s += (char) (0x80 | (cp & 0x3F));
+	} else {
+		s += (char) (0xF0 | (cp >> 18));
+		s += (char) (0x80 | ((cp >> 12) & 0x3F));
+		s += (char) (0x80 | ((cp >> 6) & 0x3F));
+		s += (char) (0x80 | (cp & 0x3F));
+	}
+}
+
+void JsonReader::readString(std::string &s) {
+	expect('"');
+	s.clear();
+	while (true) {
+		/* Copy unescaped runs in one go */
+		const char *start = pos;
+		while (pos < last && *pos != '"' && *pos != '\\') {
+			pos++;
+		}
+		s.append(start, pos - start);
+		if (pos >= last) {
+			error("unterminated string");
+		}
+		if (*pos++ == '"') {
+			break;
+		}
+
+		if (pos >= last) {
+			error("unterminated string");
+		}
+		char c = *pos++;
+		switch (c) {
+		case '"':
+		case '\\':
+		case '/':
+			s += c;
+			break;
+		case 'b':
+			s += '\b';
+			break;
+		case 'f':
+			s += '\f';
+			break;
+		case 'n':
+			s += '\n';
+			break;
+		case 'r':
+			s += '\r';
+			break;
+		case 't':
+			s += '\t';
+			break;
+		case 'u': {
+			uint32_t cp = readHex4();
+			if (cp >= 0xD800 && cp <= 0xDBFF && last - pos >= 6 && pos[0] == '\\' && pos[1] == 'u') {
+				pos += 2;
+				uint32_t low = readHex4();
+				if (low < 0xDC00 || low > 0xDFFF) {
+					error("bad surrogate pair");
+				}
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+			}
+			appendCodePoint(s, cp);
+			break;
+		}
+		default:
+			error("bad escape");
+		}
+	}
+	needComma = true;
+}
+
+std::string JsonReader::readString() {
+	std::string s;
+	readString(s);
+	return s;
+}
+
+void JsonReader::readNumber(const char *&start, bool &isInteger) {
+	if (peek() != NUMBER) {
+		error("expected number");
+	}
+	start = pos;
+	isInteger = true;
+
+	/*
+	 * -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+	 */
+	auto digits = [this] {
+		const char *begin = pos;
+		while (pos < last && *pos >= '0' && *pos <= '9') {
+			pos++;
+		}
+		if (pos == begin) {
+			error("bad number");
+		}
+		return pos - begin;
+	};
+	if (*pos == '-') {
+		pos++;
+	}
+	const char *intStart = pos;
+	if (digits() > 1 && *intStart == '0') {
+		error("bad number");
+	}
+	if (pos < last && *pos == '.') {
+		isInteger = false;
+		pos++;
+		digits();
+	}
+	if (pos < last && (*pos == 'e' || *pos == 'E')) {
+		isInteger = false;
+		pos++;
+		if (pos < last && (*pos == '+' || *pos == '-')) {
+			pos++;
+		}
+		digits();
+	}
+	needComma = true;
+}
+
+int64_t JsonReader::readInt() {
+	const char *start;
+	bool isInteger;
+	readNumber(start, isInteger);
+	if (!isInteger) {
+		char *end;
+		double v = strtod(start, &end);
+		if (end != pos) {
+			error("bad number");
+		} else if (!(v >= (double) INT64_MIN && v < (double) INT64_MAX)) {
+			error("integer overflow");
+		}
+		return (int64_t) v;
+	}
+
+	/*
+	 * Accumulated as negative, which also holds INT64_MIN.
+	 */
+	bool negative = (*start == '-');
+	int64_t v = 0;
+	for (const char *p = start + (negative ? 1 : 0); p < pos; p++) {
+		int d = *p - '0';
+		if (v < (INT64_MIN + d) / 10) {
+			error("integer overflow");
+		}
+		v = v * 10 - d;
+	}
+	if (!negative) {
+		if (v == INT64_MIN) {
+			error("integer overflow");
+		}
+		v = -v;
+	}
+	return v;
+}
+
+double JsonReader::readDouble() {
+	const char *start;
+	bool isInteger;
+	readNumber(start, isInteger);
+	char *end;
+	double v = strtod(start, &end);
+	if (end != pos) {
+		error("bad number");
+	}
+	return v;
+}
+
+bool JsonReader::readBool() {
+	if (peek() != BOOLEAN) {
+		error("expected boolean");
+	}
+	if (*pos == 't') {
+		expectLiteral("true");
+		return true;
+	} else {
+		expectLiteral("false");
+		return false;
+	}
+}
+
+void JsonReader::readNull() {
+	if (peek() != NUL) {
+		error("expected null");
+	}
+	expectLiteral("null");
+}
+
+void JsonReader::skipValue() {
+	std::string key;
+	switch (peek()) {
+	case OBJECT:
+		beginObject();
+		while (nextKey(key)) {
+			skipValue();
+		}
+		break;
+	case ARRAY:
+		beginArray();
+		while (nextElement()) {
+			skipValue();
+		}
+		break;
+	case STRING:
+		readString(key);
+		break;
+	case NUMBER: {
+		const char *start;
+		bool isInteger;
+		readNumber(start, isInteger);
+		break;
+	}
+	case BOOLEAN:
+		readBool();
+		break;
+	case NUL:
+		readNull();
+		break;
+	}
+}
+
+void JsonReader::end() {
+	skipWhitespace();
+	if (pos != last) {
+		error("trailing characters");
+	}
+}
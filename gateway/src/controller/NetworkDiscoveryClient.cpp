@@ -7,24 +7,25 @@
 
 #include "controller/NetworkDiscoveryClient.h"
 
-#define BOOST_NETWORK_ENABLE_HTTPS
-
-#include <boost/network/protocol/http/client.hpp>
-#include <boost/network/protocol/http/request.hpp>
 #include <exception>
 #include <iostream>
 #include <json/json.hpp>
 #include <sstream>
 
 #include "Beetle.h"
+#include "BeetleConfig.h"
 #include "Debug.h"
 #include "controller/ControllerClient.h"
+#include "controller/ControllerResponse.h"
+#include "ServiceIndex.h"
 
 using json = nlohmann::json;
 
-NetworkDiscoveryClient::NetworkDiscoveryClient(Beetle &beetle, std::shared_ptr<ControllerClient> client_) :
+NetworkDiscoveryClient::NetworkDiscoveryClient(Beetle &beetle, std::shared_ptr<ControllerClient> client_,
+		const BeetleConfig &config) :
 		beetle(beetle) {
 	client = client_;
+	cacheTtl = config.controllerDiscoveryTtl;
 }
 
 NetworkDiscoveryClient::~NetworkDiscoveryClient() {
@@ -38,35 +39,73 @@ bool NetworkDiscoveryClient::discoverDevices(std::list<discovery_result_t> &ret)
 }
 
 bool NetworkDiscoveryClient::discoverByUuid(UUID uuid, std::list<discovery_result_t> &ret, bool isService, device_t d) {
+	std::list<discovery_result_t> local = findLocal(uuid, isService, d);
+	ret.insert(ret.end(), local.begin(), local.end());
+	return queryHelper(getRemoteResource(uuid, isService, d), ret);
+}
+
+void NetworkDiscoveryClient::discoverByUuidAsync(UUID uuid, NetworkDiscoveryHandler handler, bool isService,
+		device_t d) {
+	handler(findLocal(uuid, isService, d), false, true);
+	queryHelperAsync(getRemoteResource(uuid, isService, d),
+			[handler](bool success, const std::list<discovery_result_t> &results) {
+		handler(results, true, success);
+	});
+}
+
+std::string NetworkDiscoveryClient::getRemoteResource(UUID uuid, bool isService, device_t d) {
 	std::stringstream resource;
 	resource << "network/discover/" << ((isService) ? "service" : "char") << "/" << uuid.str();
-	if (d != -1) {
-		resource << "?gateway=" << beetle.name << "&" << "remote_id" << std::fixed << d;
+
+	if (d == -1) {
+		/* Local devices are answered from the service index */
+		resource << "?exclude_gateway=" << beetle.name;
+	} else {
+		resource << "?gateway=" << beetle.name << "&" << "remote_id=" << std::fixed << d;
 	}
-	return queryHelper(resource.str(), ret);
+	return resource.str();
 }
 
-bool NetworkDiscoveryClient::findGatewayByName(std::string name, std::string &ip, int &port) {
-	std::string url = client->getApiUrl("network/find/gateway/" + name);
+std::list<discovery_result_t> NetworkDiscoveryClient::findLocal(UUID uuid, bool isService, device_t d) {
+	std::list<discovery_result_t> ret;
 
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
+	/*
+	 * Which local devices another device may discover is up to the
+	 * controller, so queries on its behalf are not answered here.
+	 */
+	if (!beetle.serviceIndex || d != -1) {
+		return ret;
+	}
+
+	std::vector<indexed_service_t> matches = isService ?
+			beetle.serviceIndex->findService(uuid) : beetle.serviceIndex->findCharacteristic(uuid);
+	std::set<device_t> seen;
+	for (auto &m : matches) {
+		if (!seen.insert(m.id).second) {
+			continue;
+		}
+		discovery_result_t result;
+		result.name = m.name;
+		result.id = m.id;
+		result.gateway = beetle.name;
+		result.ip = "";
+		result.port = 0;
+		result.isLocal = true;
+		ret.push_back(result);
+	}
+	return ret;
+}
 
+bool NetworkDiscoveryClient::findGatewayByName(std::string name, std::string &ip, int &port) {
 	try {
-		auto response = client->getClient()->get(request);
-		if (response.status() == 200) {
-			std::stringstream ss;
-			ss << body(response);
-			json j;
-			j << ss;
-			ip = j["ip"];
-			port = j["port"];
+		auto response = client->get("network/find/gateway/" + name);
+		if (response.status == 200) {
+			parseGatewayResponse(response.body, ip, port);
 			return true;
 		} else {
 			if (debug_controller) {
 				std::stringstream ss;
-				ss << "error : " << body(response);
+				ss << "error : " << response.body;
 				pwarn(ss.str());
 			}
 			return false;
@@ -77,34 +116,52 @@ bool NetworkDiscoveryClient::findGatewayByName(std::string name, std::string &ip
 	}
 }
 
-bool NetworkDiscoveryClient::queryHelper(std::string resource, std::list<discovery_result_t> &ret) {
-	std::string url = client->getApiUrl(resource);
+bool NetworkDiscoveryClient::lookupCache(std::string resource, std::list<discovery_result_t> &ret) {
+	std::lock_guard<std::mutex> lg(cacheMutex);
+	auto it = cache.find(resource);
+	if (it == cache.end()) {
+		return false;
+	}
+	if (it->second.expire <= time(NULL)) {
+		cache.erase(it);
+		return false;
+	}
+	ret.insert(ret.end(), it->second.results.begin(), it->second.results.end());
+	return true;
+}
 
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
+void NetworkDiscoveryClient::parseResults(std::string body, std::string resource,
+		std::list<discovery_result_t> &ret) {
+	if (debug_controller) {
+		pdebug(json::parse(body).dump());
+	}
+	std::list<discovery_result_t> results;
+	parseDiscoveryResponse(body, results);
+	for (auto &result : results) {
+		result.isLocal = (result.gateway == beetle.name);
+	}
+	ret.insert(ret.end(), results.begin(), results.end());
+
+	if (cacheTtl > 0) {
+		std::lock_guard<std::mutex> lg(cacheMutex);
+		cache[resource] = { time(NULL) + cacheTtl, results };
+	}
+}
+
+bool NetworkDiscoveryClient::queryHelper(std::string resource, std::list<discovery_result_t> &ret) {
+	if (lookupCache(resource, ret)) {
+		return true;
+	}
 
 	try {
-		auto response = client->getClient()->get(request);
-		if (response.status() == 200) {
-			std::stringstream ss;
-			ss << body(response);
-			json j;
-			j << ss;
-			for (auto &it : j) {
-				discovery_result_t result;
-				result.name = it["device"]["name"];
-				result.id = it["device"]["id"];
-				result.gateway = it["gateway"]["name"];
-				result.ip = it["gateway"]["ip"];
-				result.port = it["gateway"]["port"];
-				ret.push_back(result);
-			}
+		auto response = client->get(resource);
+		if (response.status == 200) {
+			parseResults(response.body, resource, ret);
 			return true;
 		} else {
 			if (debug_controller) {
 				std::stringstream ss;
-				ss << "network discovery failed : " << body(response);
+				ss << "network discovery failed : " << response.body;
 				pwarn(ss.str());
 			}
 			return false;
@@ -115,33 +172,79 @@ bool NetworkDiscoveryClient::queryHelper(std::string resource, std::list<discove
 	}
 }
 
-void NetworkDiscoveryClient::registerInterestInUuid(device_t id, UUID uuid, bool isService, std::function<void()> cb) {
+void NetworkDiscoveryClient::queryHelperAsync(std::string resource,
+		std::function<void(bool, const std::list<discovery_result_t> &)> cb) {
+	std::list<discovery_result_t> ret;
+	if (lookupCache(resource, ret)) {
+		cb(true, ret);
+		return;
+	}
+
+	client->request("GET", resource, "", "",
+			[this, resource, cb](const boost::system::error_code &ec, const http_response_t &response) {
+		std::list<discovery_result_t> ret;
+		if (ec || response.status != 200) {
+			if (debug_controller) {
+				pwarn("network discovery failed : " + (ec ? ec.message() : response.body));
+			}
+			cb(false, ret);
+			return;
+		}
+		try {
+			parseResults(response.body, resource, ret);
+		} catch (std::exception &e) {
+			pexcept(e);
+			cb(false, ret);
+			return;
+		}
+		cb(true, ret);
+	});
+}
+
+void NetworkDiscoveryClient::registerInterestInUuid(device_t id, UUID uuid, bool isService) {
+	auto key = std::make_pair(isService, uuid);
+	{
+		std::lock_guard<std::mutex> lg(interestsMutex);
+		if (!interests[id].insert(key).second) {
+			return;
+		}
+	}
+
 	std::stringstream resource;
 	resource << "network/registerInterest/" << ((isService) ? "service" : "char") << "/" << std::fixed << id
 			<< "/" << uuid.str();
 
-	std::string url = client->getApiUrl(resource.str());
-
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
-	request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
+	client->request("POST", resource.str(), "", "",
+			[this, id, key](const boost::system::error_code &ec, const http_response_t &response) {
+		if (!ec && response.status == 200) {
+			return;
+		}
+		if (debug_controller) {
+			std::stringstream ss;
+			ss << "error registering interest: " << (ec ? ec.message() : response.body);
+			pdebug(ss.str());
+		}
 
-	try {
-		auto response = client->getClient()->post(request);
-		if (response.status() != 200) {
-			if (debug_controller) {
-				std::stringstream ss;
-				ss << "error registering interest: " << body(response);
-				pdebug(ss.str());
+		/* Try again on the next discovery */
+		std::lock_guard<std::mutex> lg(interestsMutex);
+		auto it = interests.find(id);
+		if (it != interests.end()) {
+			it->second.erase(key);
+			if (it->second.empty()) {
+				interests.erase(it);
 			}
 		}
-	} catch (std::exception &e) {
-		pexcept(e);
-	}
+	});
+}
 
-	/*
-	 * TODO: might want to wait
-	 */
-	cb();
+void NetworkDiscoveryClient::invalidateCache() {
+	std::lock_guard<std::mutex> lg(cacheMutex);
+	cache.clear();
+}
+
+RemoveDeviceHandler NetworkDiscoveryClient::getRemoveDeviceHandler() {
+	return [this](device_t d) {
+		std::lock_guard<std::mutex> lg(interestsMutex);
+		interests.erase(d);
+	};
 }
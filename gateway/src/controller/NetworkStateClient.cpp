@@ -7,12 +7,9 @@
 
 #include <controller/NetworkStateClient.h>
 
-#define BOOST_NETWORK_ENABLE_HTTPS
-
-#include <boost/network/protocol/http/client.hpp>
-#include <boost/network/protocol/http/request.hpp>
 #include <boost/thread/lock_types.hpp>
 #include <boost/thread/pthread/shared_mutex.hpp>
+#include <algorithm>
 #include <iostream>
 #include <json/json.hpp>
 #include <list>
@@ -26,6 +23,7 @@
 #include <thread>
 
 #include "Beetle.h"
+#include "BeetleConfig.h"
 #include "controller/ControllerClient.h"
 #include "device/socket/tcp/TCPServerProxy.h"
 #include "Debug.h"
@@ -35,52 +33,54 @@
 
 using json = nlohmann::json;
 
-NetworkStateClient::NetworkStateClient(Beetle &beetle, std::shared_ptr<ControllerClient> client_, int tcpPort) :
+NetworkStateClient::NetworkStateClient(Beetle &beetle, std::shared_ptr<ControllerClient> client_,
+		const BeetleConfig &config) :
 		beetle(beetle) {
 	client = client_;
+	reportDelay = config.controllerReportDelay;
+	reportMaxBackoff = config.controllerReportMaxBackoff;
+	stopping = false;
 
-	std::string postParams = "port=" + std::to_string(tcpPort);
-
-	using namespace boost::network;
-	http::client::request request(client->getApiUrl("network/connectGateway/" + beetle.name));
-	request << header("User-Agent", "linux");
-	request << header("Content-Type", "application/x-www-form-urlencoded");
-	request << header("Content-Length", std::to_string(postParams.length()));
-	request << body(postParams);
+	std::string postParams = "port=" + std::to_string(config.tcpPort);
 
-	http::client::response response = client->getClient()->post(request);
-	if (response.status() != 200) {
+	http_response_t response = client->post("network/connectGateway/" + beetle.name, postParams,
+			"application/x-www-form-urlencoded");
+	if (response.status != 200) {
 		std::stringstream ss;
-		ss << "error connecting to beetle controller (" << response.status() << "): " << body(response);
+		ss << "error connecting to beetle controller (" << response.status << "): " << response.body;
 		throw ControllerException(ss.str());
 	} else {
 		if (debug_controller) {
 			pdebug("beetle controller: connected");
 		}
 		std::stringstream ss;
-		ss << body(response);
+		ss << response.body;
 		client->setSessionToken(ss.str());
 	}
+
+	reporter = std::thread(&NetworkStateClient::reportDaemon, this);
 }
 
 NetworkStateClient::~NetworkStateClient() {
-	using namespace boost::network;
-	http::client::request request(client->getApiUrl("network/connectGateway/"));
-	request << header("User-Agent", "linux");
-	request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
+	{
+		std::lock_guard<std::mutex> lg(pendingMutex);
+		stopping = true;
+	}
+	pendingCond.notify_all();
+	reporter.join();
 
 	try {
-		auto response = client->getClient()->delete_(request);
-		if (response.status() != 200) {
+		auto response = client->del("network/connectGateway/");
+		if (response.status != 200) {
 			if (debug_controller) {
 				std::stringstream ss;
-				ss << "error disconnecting from controller (" << response.status() << "): " << body(response);
+				ss << "error disconnecting from controller (" << response.status << "): " << response.body;
 				pwarn(ss.str());
 			}
 		} else {
 			if (debug_controller) {
 				std::stringstream ss;
-				ss << "beetle controller: " << body(response);
+				ss << "beetle controller: " << response.body;
 				pdebug(ss.str());
 			}
 		}
@@ -99,25 +99,18 @@ AddDeviceHandler NetworkStateClient::getAddDeviceHandler() {
 			return;
 		}
 		std::shared_ptr<Device> device = beetle.devices[d];
+		devicesLk.unlock();
+
 		switch (device->getType()) {
 			case Device::IPC_APPLICATION:
 			case Device::LE_PERIPHERAL:
 			case Device::LE_CENTRAL:
 			case Device::TCP_CLIENT: {
-				if (debug_controller) {
-					pdebug("informing controller of new connection");
-				}
-
 				if (device->getName() == "") {
-					pwarn("informing controller of unnamed device");
+					pwarn("not reporting unnamed device");
 					return;
 				}
-
-				try {
-					addDeviceHelper(device);
-				} catch (std::exception &e) {
-					pexcept(e);
-				}
+				queueDevice(d, REPORT_UPSERT);
 				break;
 			}
 			default:
@@ -134,41 +127,40 @@ UpdateDeviceHandler NetworkStateClient::getUpdateDeviceHandler() {
 		boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
 		if (beetle.devices.find(d) == beetle.devices.end()) {
 			if (debug_controller) {
-				pwarn("tried to add device that does not exist" + std::to_string(d));
+				pwarn("tried to update device that does not exist" + std::to_string(d));
 			}
 			return;
 		}
 		std::shared_ptr<Device> device = beetle.devices[d];
+		devicesLk.unlock();
+
 		switch (device->getType()) {
 			case Device::IPC_APPLICATION:
 			case Device::LE_PERIPHERAL:
 			case Device::LE_CENTRAL:
 			case Device::TCP_CLIENT:
-			if (debug_controller) {
-				pdebug("informing controller of new connection");
-			}
-			try {
-				updateDeviceHelper(device);
-			} catch (std::exception &e) {
-				pexcept(e);
+			if (device->getName() == "") {
+				return;
 			}
+			queueDevice(d, REPORT_UPSERT);
 			break;
-			default:
-			if (debug_controller) {
-				pdebug("not reporting " + device->getTypeStr());
+			default: {
+				/* Nothing to wait for */
+				std::unique_lock<std::mutex> lk(pendingMutex);
+				UpdateDeviceHandler handler = reportedHandler;
+				lk.unlock();
+				if (handler) {
+					handler(d);
+				}
+				return;
 			}
-			return;
 		}
 	};
 }
 
 RemoveDeviceHandler NetworkStateClient::getRemoveDeviceHandler() {
 	return [this](device_t d) {
-		try {
-			removeDeviceHelper(d);
-		} catch (std::exception &e) {
-			pexcept(e);
-		}
+		queueDevice(d, REPORT_REMOVE);
 	};
 }
 
@@ -231,77 +223,141 @@ bool NetworkStateClient::lookupNamesAndIds(device_t from, device_t to, std::stri
 
 MapDevicesHandler NetworkStateClient::getMapDevicesHandler() {
 	return [this](device_t from, device_t to) {
-		device_t fromId;
-		device_t toId;
-		std::string fromGateway;
-		std::string toGateway;
-		if (!lookupNamesAndIds(from, to, fromGateway, fromId, toGateway, toId)) {
-			return;
-		}
-
-		std::stringstream resource;
-		resource << "network/map/" << fromGateway << "/" << std::fixed << fromId << "/" << toGateway << "/"
-				<< std::fixed << toId;
-
-		std::string url = client->getApiUrl(resource.str());
-
-		using namespace boost::network;
-		http::client::request request(url);
-		request << header("User-Agent", "linux");
-		request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
-
-		try {
-			auto response = client->getClient()->post(request);
-			if (response.status() != 200) {
-				if (debug_controller) {
-					std::stringstream ss;
-					ss << "error informing controller of map: " << body(response);
-					pdebug(ss.str());
-				}
-			}
-		} catch (std::exception &e) {
-			pexcept(e);
+		mapping_key_t key;
+		if (lookupNamesAndIds(from, to, std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key))) {
+			queueMapping(key, true);
 		}
 	};
 }
 
 MapDevicesHandler NetworkStateClient::getUnmapDevicesHandler() {
 	return [this](device_t from, device_t to) {
-		device_t fromId;
-		device_t toId;
-		std::string fromGateway;
-		std::string toGateway;
-		if (!lookupNamesAndIds(from, to, fromGateway, fromId, toGateway, toId)) {
+		mapping_key_t key;
+		if (lookupNamesAndIds(from, to, std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key))) {
+			queueMapping(key, false);
+		}
+	};
+}
+
+void NetworkStateClient::setDeviceReportedHandler(UpdateDeviceHandler handler) {
+	std::lock_guard<std::mutex> lg(pendingMutex);
+	reportedHandler = handler;
+}
+
+void NetworkStateClient::queueDevice(device_t d, device_op_t op) {
+	std::unique_lock<std::mutex> lk(pendingMutex);
+	bool known = reported.find(d) != reported.end() || inflight.find(d) != inflight.end();
+	auto it = pendingDevices.find(d);
+	if (op == REPORT_REMOVE && !known) {
+		/*
+		 * The controller never heard of the device, so drop the pending upsert
+		 * and any mappings involving it.
+		 */
+		if (it == pendingDevices.end()) {
 			return;
 		}
+		pendingDevices.erase(it);
+		for (auto mit = pendingMappings.begin(); mit != pendingMappings.end();) {
+			const mapping_key_t &key = mit->first;
+			if ((std::get<0>(key) == beetle.name && std::get<1>(key) == d)
+					|| (std::get<2>(key) == beetle.name && std::get<3>(key) == d)) {
+				pendingMappings.erase(mit++);
+			} else {
+				++mit;
+			}
+		}
+		return;
+	}
+	pendingDevices[d] = op;
+	lk.unlock();
+	pendingCond.notify_all();
+}
+
+void NetworkStateClient::queueMapping(const mapping_key_t &key, bool mapped) {
+	std::unique_lock<std::mutex> lk(pendingMutex);
+	auto it = pendingMappings.find(key);
+	if (it != pendingMappings.end() && it->second != mapped) {
+		/* Map then unmap, or the reverse, cancel out */
+		pendingMappings.erase(it);
+		return;
+	}
+	pendingMappings[key] = mapped;
+	lk.unlock();
+	pendingCond.notify_all();
+}
 
-		std::stringstream resource;
-		resource << "network/map/" << fromGateway << "/" << std::fixed << fromId << "/" << toGateway << "/"
-				<< std::fixed << toId;
+void NetworkStateClient::requeue(const device_ops_t &devices, const mapping_ops_t &mappings) {
+	std::unique_lock<std::mutex> lk(pendingMutex);
+	device_ops_t newerDevices;
+	mapping_ops_t newerMappings;
+	newerDevices.swap(pendingDevices);
+	newerMappings.swap(pendingMappings);
+	lk.unlock();
+
+	/*
+	 * Replay the failed batch before anything queued while it was being sent.
+	 */
+	for (auto &kv : devices) {
+		queueDevice(kv.first, kv.second);
+	}
+	for (auto &kv : mappings) {
+		queueMapping(kv.first, kv.second);
+	}
+	for (auto &kv : newerDevices) {
+		queueDevice(kv.first, kv.second);
+	}
+	for (auto &kv : newerMappings) {
+		queueMapping(kv.first, kv.second);
+	}
+}
 
-		std::string url = client->getApiUrl(resource.str());
+void NetworkStateClient::reportDaemon() {
+	int backoff = 0;
+	std::unique_lock<std::mutex> lk(pendingMutex);
+	while (!stopping) {
+		if (pendingDevices.empty() && pendingMappings.empty()) {
+			pendingCond.wait(lk);
+			continue;
+		}
 
-		using namespace boost::network;
-		http::client::request request(url);
-		request << header("User-Agent", "linux");
-		request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
+		/* Let more events coalesce */
+		if (pendingCond.wait_for(lk, std::chrono::milliseconds(reportDelay), [this] {return stopping;})) {
+			break;
+		}
 
-		try {
-			auto response = client->getClient()->delete_(request);
-			if (response.status() != 200) {
-				if (debug_controller) {
-					std::stringstream ss;
-					ss << "error informing controller of unmap: " << body(response);
-					pdebug(ss.str());
-				}
+		device_ops_t devices;
+		mapping_ops_t mappings;
+		devices.swap(pendingDevices);
+		mappings.swap(pendingMappings);
+		for (auto &kv : devices) {
+			if (kv.second == REPORT_UPSERT) {
+				inflight.insert(kv.first);
 			}
-		} catch (std::exception &e) {
-			pexcept(e);
 		}
-	};
+		lk.unlock();
+
+		bool sent = sendReport(devices, mappings);
+
+		lk.lock();
+		inflight.clear();
+		if (sent) {
+			backoff = 0;
+			continue;
+		}
+		lk.unlock();
+
+		requeue(devices, mappings);
+		backoff = (backoff == 0) ? 1 : std::min(backoff * 2, reportMaxBackoff);
+		if (debug_controller) {
+			pwarn("retrying controller report in " + std::to_string(backoff) + "s");
+		}
+
+		lk.lock();
+		pendingCond.wait_for(lk, std::chrono::seconds(backoff), [this] {return stopping;});
+	}
 }
 
-static std::string serializeHandles(std::shared_ptr<Device> d) {
+static json serializeHandles(std::shared_ptr<Device> d) {
 	std::lock_guard<std::recursive_mutex> lg(d->handlesMutex);
 
 	std::list<json> arr;
@@ -309,7 +365,7 @@ static std::string serializeHandles(std::shared_ptr<Device> d) {
 	std::string currServiceUuid;
 	std::set<std::string> currCharUuids;
 	for (auto &h : d->handles) {
-		auto pSvc = std::dynamic_pointer_cast<PrimaryService>(h.second);
+		auto pSvc = handle_cast<PrimaryService>(h.second);
 		if (pSvc) {
 			if (currServiceUuid != "") {
 				json j;
@@ -320,9 +376,9 @@ static std::string serializeHandles(std::shared_ptr<Device> d) {
 			currCharUuids.clear();
 			currServiceUuid = pSvc->getServiceUuid().str();
 		}
-		auto chr = std::dynamic_pointer_cast<Characteristic>(h.second);
+		auto chr = handle_cast<Characteristic>(h.second);
 		if (chr) {
-			currCharUuids.insert(d->handles[chr->getAttrHandle()]->getUuid().str());
+			currCharUuids.insert(d->handles[chr->getAttrHandle()]->getUuidStr());
 		}
 	}
 
@@ -333,98 +389,120 @@ static std::string serializeHandles(std::shared_ptr<Device> d) {
 		arr.push_back(j);
 	}
 
-	if (debug_controller) {
-		pdebug(json(arr).dump());
-	}
-	return json(arr).dump();
+	return json(arr);
 }
 
-void NetworkStateClient::addDeviceHelper(std::shared_ptr<Device> d) {
-	std::string url = client->getApiUrl(
-			"network/connectDevice/" + d->getName() + "/" + std::to_string(d->getId()));
-	if (debug_controller) {
-		pdebug("post: " + url);
-	}
+bool NetworkStateClient::sendReport(const device_ops_t &devices, const mapping_ops_t &mappings) {
+	json upserts = json::array();
+	json removed = json::array();
+	std::map<device_t, std::string> services;
+	for (auto &kv : devices) {
+		if (kv.second == REPORT_REMOVE) {
+			removed.push_back(kv.first);
+			continue;
+		}
 
-	std::string requestBody = serializeHandles(d);
+		std::shared_ptr<Device> device;
+		{
+			boost::shared_lock<boost::shared_mutex> devicesLk(beetle.devicesMutex);
+			auto it = beetle.devices.find(kv.first);
+			if (it == beetle.devices.end()) {
+				/* Removal is already queued */
+				continue;
+			}
+			device = it->second;
+		}
 
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
-	request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
-	request << header("Content-Length", std::to_string(requestBody.length()));
-	request << body(requestBody);
+		json j;
+		j["id"] = kv.first;
+		j["name"] = device->getName();
+		j["services"] = serializeHandles(device);
+
+		/* Only the reporter thread writes reported */
+		std::string dump = j["services"].dump();
+		auto rit = reported.find(kv.first);
+		if (rit != reported.end() && rit->second == dump) {
+			continue;
+		}
+		services[kv.first] = dump;
+		upserts.push_back(j);
+	}
 
-	try {
-		auto response = client->getClient()->post(request);
-		if (response.status() != 200) {
-			throw ControllerException("error informing server of connection " + std::to_string(d->getId()));
+	json mapped = json::array();
+	json unmapped = json::array();
+	for (auto &kv : mappings) {
+		json key = { std::get<0>(kv.first), std::get<1>(kv.first), std::get<2>(kv.first), std::get<3>(kv.first) };
+		if (kv.second) {
+			mapped.push_back(key);
 		} else {
-			if (debug_controller) {
-				std::stringstream ss;
-				ss << "controller responded for " << std::to_string(d->getId()) << ": " << body(response);
-				pdebug(ss.str());
-			}
+			unmapped.push_back(key);
 		}
-	} catch (std::exception &e) {
-		pexcept(e);
 	}
-}
 
-void NetworkStateClient::updateDeviceHelper(std::shared_ptr<Device> d) {
-	std::string url = client->getApiUrl("network/updateDevice/" + std::to_string(d->getId()));
-	if (debug_controller) {
-		pdebug("put: " + url);
+	if (upserts.empty() && removed.empty() && mapped.empty() && unmapped.empty()) {
+		return true;
 	}
 
-	std::string requestBody = serializeHandles(d);
+	json j;
+	j["devices"] = upserts;
+	j["removed"] = removed;
+	j["mapped"] = mapped;
+	j["unmapped"] = unmapped;
+	std::string requestBody = j.dump();
 
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
-	request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
-	request << header("Content-Length", std::to_string(requestBody.length()));
-	request << body(requestBody);
+	if (debug_controller) {
+		std::stringstream ss;
+		ss << "post: " << client->getApiUrl("network/batch") << " (" << upserts.size() << " upserts, "
+				<< removed.size() << " removes, " << mapped.size() + unmapped.size() << " mappings)";
+		pdebug(ss.str());
+	}
 
+	http_response_t response;
 	try {
-		auto response = client->getClient()->put(request);
-		if (response.status() != 200) {
-			throw ControllerException("error informing server of update " + std::to_string(d->getId()));
-		} else {
-			if (debug_controller) {
-				std::stringstream ss;
-				ss << "controller responded for " << std::to_string(d->getId()) << ": " << body(response);
-				pdebug(ss.str());
-			}
-		}
+		response = client->post("network/batch", requestBody, "application/json");
 	} catch (std::exception &e) {
 		pexcept(e);
+		return false;
+	}
+
+	if (response.status >= 500) {
+		if (debug_controller) {
+			pwarn("controller report failed (" + std::to_string(response.status) + ")");
+		}
+		return false;
+	} else if (response.status != 200) {
+		/* Retrying will not help */
+		std::stringstream ss;
+		ss << "controller rejected report (" << response.status << "): " << response.body;
+		pwarn(ss.str());
+		return true;
 	}
-}
 
-void NetworkStateClient::removeDeviceHelper(device_t d) {
-	std::string url = client->getApiUrl("network/updateDevice/" + std::to_string(d));
 	if (debug_controller) {
-		pdebug("delete: " + url);
+		try {
+			json errors = json::parse(response.body)["errors"];
+			for (auto &e : errors) {
+				pwarn("controller report: " + e.get<std::string>());
+			}
+		} catch (std::exception &e) {
+			pexcept(e);
+		}
 	}
 
-	using namespace boost::network;
-	http::client::request request(url);
-	request << header("User-Agent", "linux");
-	request << header(ControllerClient::SESSION_HEADER, client->getSessionToken());
+	std::unique_lock<std::mutex> lk(pendingMutex);
+	for (auto &kv : services) {
+		reported[kv.first] = kv.second;
+	}
+	for (auto &d : removed) {
+		reported.erase(d.get<device_t>());
+	}
+	UpdateDeviceHandler handler = reportedHandler;
+	lk.unlock();
 
-	try {
-		auto response = client->getClient()->delete_(request);
-		if (response.status() != 200) {
-			throw ControllerException("error informing server of disconnection " + std::to_string(d));
-		} else {
-			if (debug_controller) {
-				std::stringstream ss;
-				ss << "controller responded for " << std::to_string(d) << ": " << body(response);
-				pdebug(ss.str());
-			}
+	if (handler) {
+		for (auto &kv : services) {
+			handler(kv.first);
 		}
-	} catch (std::exception &e) {
-		pexcept(e);
 	}
+	return true;
 }
@@ -7,10 +7,6 @@
 
 #include <controller/access/DynamicAuth.h>
 
-#define BOOST_NETWORK_ENABLE_HTTPS
-
-#include <boost/network/protocol/http/client.hpp>
-#include <boost/network/protocol/http/request.hpp>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <cstdint>
@@ -96,17 +92,12 @@ void PasscodeAuth::evaluate(std::shared_ptr<ControllerClient> cc, std::shared_pt
 		std::stringstream resource;
 		resource << "state/passcode/isLive/" << std::fixed << ruleId << "/" << cc->getName() << "/" << std::fixed
 				<< to->getId();
-		std::string url = cc->getApiUrl(resource.str());
-
-		using namespace boost::network;
-		http::client::request request(url);
-		request << header("User-Agent", "linux");
 
 		try {
-			auto response = cc->getClient()->get(request);
-			if (response.status() == 200) {
+			auto response = cc->get(resource.str());
+			if (response.status == 200) {
 				std::stringstream ss;
-				ss << body(response);
+				ss << response.body;
 				expire = static_cast<time_t>(std::stod(ss.str()));
 				state = SATISFIED;
 			} else {
@@ -148,17 +139,12 @@ void AdminAuth::evaluate(std::shared_ptr<ControllerClient> cc, std::shared_ptr<D
 			std::stringstream resource;
 			resource << "state/admin/request/" << std::fixed << ruleId << "/" << cc->getName() << "/" << std::fixed
 					<< to->getId();
-			std::string url = cc->getApiUrl(resource.str());
-
-			using namespace boost::network;
-			http::client::request request(url);
-			request << header("User-Agent", "linux");
 
 			try {
-				auto response = cc->getClient()->post(request);
-				if (response.status() == 202) {
+				auto response = cc->post(resource.str());
+				if (response.status == 202) {
 					std::stringstream ss;
-					ss << body(response);
+					ss << response.body;
 					expire = static_cast<time_t>(std::stod(ss.str()));
 					state = SATISFIED;
 				} else {
@@ -201,17 +187,12 @@ void UserAuth::evaluate(std::shared_ptr<ControllerClient> cc, std::shared_ptr<De
 			std::stringstream resource;
 			resource << "state/user/request/" << std::fixed << ruleId << "/" << cc->getName() << "/" << std::fixed
 					<< to->getId();
-			std::string url = cc->getApiUrl(resource.str());
-
-			using namespace boost::network;
-			http::client::request request(url);
-			request << header("User-Agent", "linux");
 
 			try {
-				auto response = cc->getClient()->post(request);
-				if (response.status() == 202) {
+				auto response = cc->post(resource.str());
+				if (response.status == 202) {
 					std::stringstream ss;
-					ss << body(response);
+					ss << response.body;
 					expire = static_cast<time_t>(std::stod(ss.str()));
 					state = SATISFIED;
 				} else {
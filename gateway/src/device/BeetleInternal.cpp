@@ -190,5 +190,7 @@ void BeetleInternal::init() {
 
 	// save the service changed attr handle
 	serviceChangedAttr = gattServiceChangedAttrHandle;
+
+	indexHandles();
 }
 
@@ -0,0 +1,109 @@
+/*
+ * InProcessApplication.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "device/InProcessApplication.h"
+
+#include <boost/shared_array.hpp>
+#include <cstring>
+
+#include "Beetle.h"
+#include "Debug.h"
+
+/*
+ * Depth of handler calls on this thread.
+ */
+static thread_local int inHandler = 0;
+
+InProcessApplication::InProcessApplication(Beetle &beetle, std::string name_, PduHandler handler_) :
+		VirtualDevice(beetle, true) {
+	type = IPC_APPLICATION;
+	name = name_;
+	handler = handler_;
+	stopped = false;
+	traffic = &beetle.metrics.transport("inprocess");
+}
+
+InProcessApplication::~InProcessApplication() {
+	stopped = true;
+	pendingSends.wait();
+	std::lock_guard<std::recursive_mutex> lg(handlerMutex);
+}
+
+std::shared_ptr<InProcessApplication> InProcessApplication::connect(Beetle &beetle, std::string name,
+		PduHandler handler) {
+	auto device = std::make_shared<InProcessApplication>(beetle, name, handler);
+	try {
+		beetle.addDevice(device);
+		device->start();
+	} catch (std::exception &e) {
+		beetle.removeDevice(device->getId());
+		throw DeviceException("could not connect " + name + ": " + e.what());
+	}
+
+	pdebug("connected to " + device->getName());
+	if (debug) {
+		pdebug(device->getName() + " has handle range [0,"
+				+ std::to_string(device->getHighestHandle()) + "]");
+	}
+	return device;
+}
+
+void InProcessApplication::send(uint8_t *buf, int len) {
+	if (stopped || len <= 0) {
+		return;
+	}
+	traffic->bytesIn->add(len);
+	traffic->packetsIn->add();
+
+	if (inHandler > 0) {
+		boost::shared_array<uint8_t> bufCpy(new uint8_t[len]);
+		memcpy(bufCpy.get(), buf, len);
+		pendingSends.increment();
+		beetle.writers.schedule(getId(), [this, bufCpy, len] {
+			if (!stopped) {
+				readHandler(bufCpy.get(), len);
+			}
+			pendingSends.decrement();
+		});
+	} else {
+		readHandler(buf, len);
+	}
+}
+
+void InProcessApplication::stop() {
+	if (!stopped.exchange(true)) {
+		{
+			std::lock_guard<std::recursive_mutex> lg(handlerMutex);
+		}
+		beetle.removeDevice(getId());
+	}
+}
+
+bool InProcessApplication::write(uint8_t *buf, int len) {
+	if (stopped) {
+		return false;
+	}
+
+	std::lock_guard<std::recursive_mutex> lg(handlerMutex);
+	if (stopped) {
+		return false;
+	}
+	traffic->bytesOut->add(len);
+	traffic->packetsOut->add();
+	inHandler++;
+	try {
+		handler(buf, len);
+	} catch (std::exception &e) {
+		pexcept(e);
+	}
+	inHandler--;
+	return true;
+}
+
+void InProcessApplication::startInternal() {
+	// nothing to do
+}
@@ -11,13 +11,16 @@
 #include <ble/utils.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
+#include <cstdio>
 #include <cstring>
 #include <map>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <time.h>
 
 #include "Beetle.h"
+#include "Capture.h"
 #include "ble/att.h"
 #include "ble/beetle.h"
 #include "ble/gatt.h"
@@ -26,8 +29,10 @@
 #include "device/socket/tcp/TCPServerProxy.h"
 #include "device/socket/LEDevice.h"
 #include "Handle.h"
+#include "Metrics.h"
 #include "Router.h"
 #include "sync/Semaphore.h"
+#include "Trace.h"
 #include "UUID.h"
 
 static uint64_t getCurrentTimeMillis(void) {
@@ -43,8 +48,14 @@ VirtualDevice::VirtualDevice(Beetle &beetle, bool isEndpoint_, HandleAllocationT
 	mtu = ATT_DEFAULT_LE_MTU;
 	unfinishedClientTransactions = 0;
 	lastTransactionMillis = 0;
+	completedTransactions = 0;
+	completedTransactionsLatency = 0;
+	receivedNotifications = 0;
 	highestForwardedHandle = -1;
 	connectedTime = time(NULL);
+
+	queueDepthGauge = beetle.metrics.gauge("beetle_transaction_queue_depth",
+			"Transactions outstanding or queued, by device.", { { "device", std::to_string(getId()) } });
 }
 
 VirtualDevice::~VirtualDevice() {
@@ -64,9 +75,12 @@ VirtualDevice::~VirtualDevice() {
 		t->cb(err, ATT_ERROR_PDU_LEN);
 	}
 	transactionMutex.unlock();
+
+	beetle.metrics.remove("device", std::to_string(getId()));
 }
 
 static std::map<uint16_t, std::shared_ptr<Handle>> discoverAllHandles(VirtualDevice *d);
+static bool readHandleTable(VirtualDevice *d, std::string key, std::map<uint16_t, std::shared_ptr<Handle>> &handles);
 
 void VirtualDevice::start(bool discoverHandles) {
 	if (debug) {
@@ -74,8 +88,12 @@ void VirtualDevice::start(bool discoverHandles) {
 	}
 	startInternal();
 	if (discoverHandles) {
-		/* May throw device exception */
-		std::map<uint16_t, std::shared_ptr<Handle>> handlesTmp = discoverAllHandles(this);
+		std::map<uint16_t, std::shared_ptr<Handle>> handlesTmp;
+		std::string tableKey = getHandleTableKey();
+		if (tableKey == "" || !readHandleTable(this, tableKey, handlesTmp)) {
+			/* May throw device exception */
+			handlesTmp = discoverAllHandles(this);
+		}
 
 		handlesMutex.lock();
 		handles = handlesTmp;
@@ -88,6 +106,8 @@ void VirtualDevice::start(bool discoverHandles) {
 		setupBeetleService(highestForwardedHandle + 1);
 	}
 
+	indexHandles();
+
 	beetle.updateDevice(getId());
 }
 
@@ -98,13 +118,25 @@ std::vector<uint64_t> VirtualDevice::getTransactionLatencies() {
 	return ret;
 }
 
+VirtualDevice::traffic_stats_t VirtualDevice::getTrafficStats() {
+	traffic_stats_t stats;
+	std::lock_guard<std::mutex> lg(transactionMutex);
+	stats.queueDepth = pendingTransactions.size() + (currentTransaction ? 1 : 0);
+	stats.transactions = completedTransactions;
+	stats.totalLatency = completedTransactionsLatency;
+	stats.notifications = receivedNotifications.exchange(0);
+	completedTransactions = 0;
+	completedTransactionsLatency = 0;
+	return stats;
+}
+
 void VirtualDevice::writeCommand(uint8_t *buf, int len) {
 	assert(buf);
 	assert(len > 0);
 	assert(!is_att_response(buf[0]) && !is_att_request(buf[0]) && buf[0] != ATT_OP_HANDLE_IND
 			&& buf[0] != ATT_OP_HANDLE_CNF);
 
-	write(buf, len);
+	writePdu(buf, len);
 }
 
 void VirtualDevice::writeResponse(uint8_t *buf, int len) {
@@ -112,7 +144,7 @@ void VirtualDevice::writeResponse(uint8_t *buf, int len) {
 	assert(len > 0);
 	assert(is_att_response(buf[0]) || buf[0] == ATT_OP_HANDLE_CNF || buf[0] == ATT_OP_ERROR);
 
-	write(buf, len);
+	writePdu(buf, len);
 }
 
 void VirtualDevice::writeTransaction(uint8_t *buf, int len, std::function<void(uint8_t*, int)> cb) {
@@ -126,17 +158,27 @@ void VirtualDevice::writeTransaction(uint8_t *buf, int len, std::function<void(u
 	t->len = len;
 	t->cb = cb;
 	t->time = time(NULL);
+	t->traceId = 0;
+	if (tracing() && trace_current != 0) {
+		t->traceId = trace_current;
+		t->traceTime = traceNow();
+	}
 
 	std::lock_guard<std::mutex> lg(transactionMutex);
 	if (currentTransaction == NULL) {
 		currentTransaction = t;
 		lastTransactionMillis = getCurrentTimeMillis();
-		if (!write(t->buf.get(), t->len)) {
+		transactionStart = std::chrono::steady_clock::now();
+		if (t->traceId != 0) {
+			traceTransactionSent(*t);
+		}
+		if (!writePdu(t->buf.get(), t->len)) {
 			cb(NULL, -1);
 		}
 	} else {
 		pendingTransactions.push(t);
 	}
+	updateQueueDepth();
 }
 
 int VirtualDevice::writeTransactionBlocking(uint8_t *buf, int len, uint8_t *&resp) {
@@ -175,6 +217,14 @@ int VirtualDevice::getMTU() {
 	return mtu;
 }
 
+int VirtualDevice::getMaxMTU() {
+	return ATT_DEFAULT_LE_MTU;
+}
+
+std::string VirtualDevice::getHandleTableKey() {
+	return "";
+}
+
 int VirtualDevice::getHighestForwardedHandle() {
 	return highestForwardedHandle;
 }
@@ -195,9 +245,9 @@ bool VirtualDevice::isLive() {
 void VirtualDevice::handleTransactionResponse(uint8_t *buf, int len) {
 	std::unique_lock<std::mutex> lk(transactionMutex);
 
+	uint64_t currentTimeMillis = getCurrentTimeMillis();
+	uint64_t elapsed = currentTimeMillis - lastTransactionMillis;
 	if (debug_performance) {
-		uint64_t currentTimeMillis = getCurrentTimeMillis();
-		uint64_t elapsed = currentTimeMillis - lastTransactionMillis;
 		std::stringstream ss;
 		ss << "Transaction" << std::endl;
 		ss << " start:\t" << std::fixed << lastTransactionMillis << std::endl;
@@ -238,13 +288,46 @@ void VirtualDevice::handleTransactionResponse(uint8_t *buf, int len) {
 		return;
 	}
 
+	completedTransactions++;
+	completedTransactionsLatency += elapsed;
+
+	Histogram *&latency = latencyHistograms[reqOpcode];
+	if (latency == NULL) {
+		char opcode[8];
+		snprintf(opcode, sizeof(opcode), "0x%02x", reqOpcode);
+		latency = beetle.metrics.histogram("beetle_transaction_latency_seconds",
+				"Time from sending a request to its response, by device and request opcode.",
+				{ { "device", std::to_string(getId()) }, { "opcode", opcode } });
+	}
+	latency->record(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - transactionStart).count());
+
+	/*
+	 * The transaction ends when the response was ready to read. Reading it
+	 * is a select span of the same trace.
+	 */
+	if (currentTransaction->traceId != 0) {
+		uint64_t now = traceNow();
+		uint64_t sent = currentTransaction->traceTime;
+		uint64_t ready = (trace_ready >= sent && trace_ready <= now) ? trace_ready : now;
+		traceRecord(currentTransaction->traceId, "transaction", sent, ready, getId());
+		if (ready < now) {
+			traceRecord(currentTransaction->traceId, "select", ready, now, getId());
+		}
+	}
+
 	auto t = currentTransaction;
 	if (pendingTransactions.size() > 0) {
 		while (pendingTransactions.size() > 0) {
 			currentTransaction = pendingTransactions.front();
 			currentTransaction->time = time(NULL);
 			pendingTransactions.pop();
-			if(!write(currentTransaction->buf.get(), currentTransaction->len)) {
+			lastTransactionMillis = getCurrentTimeMillis();
+			transactionStart = std::chrono::steady_clock::now();
+			if (currentTransaction->traceId != 0) {
+				traceTransactionSent(*currentTransaction);
+			}
+			if(!writePdu(currentTransaction->buf.get(), currentTransaction->len)) {
 				currentTransaction->cb(NULL, -1);
 				currentTransaction.reset();
 			} else {
@@ -254,22 +337,72 @@ void VirtualDevice::handleTransactionResponse(uint8_t *buf, int len) {
 	} else {
 		currentTransaction.reset();
 	}
+	updateQueueDepth();
 	lk.unlock();
 
-	t->cb(buf, len);
+	if (t->traceId != 0) {
+		TraceScope scope(t->traceId);
+		t->cb(buf, len);
+	} else {
+		t->cb(buf, len);
+	}
+}
+
+void VirtualDevice::traceTransactionSent(transaction_t &t) {
+	uint64_t now = traceNow();
+	traceRecord(t.traceId, "queue", t.traceTime, now, getId());
+	t.traceTime = now;
+}
+
+void VirtualDevice::updateQueueDepth() {
+	queueDepthGauge->set(pendingTransactions.size() + (currentTransaction ? 1 : 0));
 }
 
 void VirtualDevice::readHandler(uint8_t *buf, int len) {
+	/*
+	 * Responses are traced as part of their request.
+	 */
+	if (tracing() && !is_att_response(buf[0]) && buf[0] != ATT_OP_HANDLE_CNF && buf[0] != ATT_OP_ERROR) {
+		uint64_t id = traceSample();
+		if (id != 0) {
+			uint64_t start = traceNow();
+			if (trace_ready != 0 && trace_ready <= start) {
+				traceRecord(id, "select", trace_ready, start, getId());
+			}
+			TraceScope scope(id);
+			handlePdu(buf, len);
+			traceRecord(id, "ingress", start, traceNow(), getId());
+			return;
+		}
+	}
+	handlePdu(buf, len);
+}
+
+bool VirtualDevice::writePdu(uint8_t *buf, int len) {
+	if (capturing()) {
+		captureAtt(getId(), false, buf, len);
+	}
+	return write(buf, len);
+}
+
+void VirtualDevice::handlePdu(uint8_t *buf, int len) {
+	if (capturing()) {
+		captureAtt(getId(), true, buf, len);
+	}
+
 	uint8_t opCode = buf[0];
 	if (opCode == ATT_OP_MTU_REQ) {
 		mtu = btohs(*(uint16_t * )(buf + 1));
 		uint8_t resp[3];
 		resp[0] = ATT_OP_MTU_RESP;
-		*(uint16_t *) (resp + 1) = htobs(ATT_DEFAULT_LE_MTU);
-		write(resp, sizeof(resp));
+		*(uint16_t *) (resp + 1) = htobs(getMaxMTU());
+		writePdu(resp, sizeof(resp));
 	} else if (is_att_response(opCode) || opCode == ATT_OP_HANDLE_CNF || opCode == ATT_OP_ERROR) {
 		handleTransactionResponse(buf, len);
 	} else {
+		if (opCode == ATT_OP_HANDLE_NOTIFY || opCode == ATT_OP_HANDLE_IND) {
+			receivedNotifications++;
+		}
 
 		/*
 		 * Discover services in the network
@@ -283,25 +416,55 @@ void VirtualDevice::readHandler(uint8_t *buf, int len) {
 			if (!parse_find_by_type_value_request(buf, len, startHandle, endHandle, attType, attValue, attValLen)) {
 				uint8_t err[ATT_ERROR_PDU_LEN];
 				pack_error_pdu(opCode, 0, ATT_ECODE_INVALID_PDU, err);
-				write(err, sizeof(err));
+				writePdu(err, sizeof(err));
 				return;
 			}
 
 			if (attType == GATT_PRIM_SVC_UUID) {
 				UUID serviceUuid(attValue, attValLen);
-				boost::shared_array<uint8_t> bufCpy(new uint8_t[len]);
-				memcpy(bufCpy.get(), buf, len);
-
-				beetle.discoveryClient->registerInterestInUuid(getId(), serviceUuid, true, [this, bufCpy, len] {
-					beetle.router->route(bufCpy.get(), len, getId());
-				});
+				beetle.discoveryClient->registerInterestInUuid(getId(), serviceUuid, true);
 			}
+			beetle.router->route(buf, len, getId());
 		} else {
 			beetle.router->route(buf, len, getId());
 		}
 	}
 }
 
+void VirtualDevice::readHandler(std::vector<std::pair<uint8_t *, int>> &pdus) {
+	if (tracing()) {
+		for (auto &pdu : pdus) {
+			readHandler(pdu.first, pdu.second);
+		}
+		return;
+	}
+
+	std::vector<std::pair<uint8_t *, int>> routed;
+	for (auto &pdu : pdus) {
+		uint8_t opCode = pdu.first[0];
+		if (opCode == ATT_OP_MTU_REQ || is_att_response(opCode) || opCode == ATT_OP_HANDLE_CNF
+				|| opCode == ATT_OP_ERROR
+				|| (opCode == ATT_OP_FIND_BY_TYPE_REQ && isEndpoint && beetle.discoveryClient)) {
+			if (!routed.empty()) {
+				beetle.router->route(routed, getId());
+				routed.clear();
+			}
+			readHandler(pdu.first, pdu.second);
+		} else {
+			if (capturing()) {
+				captureAtt(getId(), true, pdu.first, pdu.second);
+			}
+			if (opCode == ATT_OP_HANDLE_NOTIFY || opCode == ATT_OP_HANDLE_IND) {
+				receivedNotifications++;
+			}
+			routed.push_back(pdu);
+		}
+	}
+	if (!routed.empty()) {
+		beetle.router->route(routed, getId());
+	}
+}
+
 void VirtualDevice::setupBeetleService(int handleAlloc) {
 	handleAlloc++;
 
@@ -719,7 +882,7 @@ static std::map<uint16_t, std::shared_ptr<Handle>> discoverAllHandles(VirtualDev
 				handle_value_t characteristic = characteristics[i];
 				uint16_t startGroup = characteristic.handle + 1;
 				uint16_t endGroup = characteristics[i + 1].handle - 1;
-				auto charHandle = std::dynamic_pointer_cast<Characteristic>(handles[characteristic.handle]);
+				auto charHandle = handle_cast<Characteristic>(handles[characteristic.handle]);
 				charHandle->setEndGroupHandle(endGroup);
 
 				std::vector<handle_info_t> handleInfos = discoverHandles(d, startGroup, endGroup);
@@ -746,7 +909,7 @@ static std::map<uint16_t, std::shared_ptr<Handle>> discoverAllHandles(VirtualDev
 			handle_value_t characteristic = characteristics[characteristics.size() - 1];
 			uint16_t startGroup = characteristic.handle + 1;
 			uint16_t endGroup = serviceHandle->getEndGroupHandle();
-			auto charHandle = std::dynamic_pointer_cast<Characteristic>(handles[characteristic.handle]);
+			auto charHandle = handle_cast<Characteristic>(handles[characteristic.handle]);
 			charHandle->setEndGroupHandle(endGroup);
 
 			std::vector<handle_info_t> handleInfos = discoverHandles(d, startGroup, endGroup);
@@ -787,3 +950,148 @@ static std::map<uint16_t, std::shared_ptr<Handle>> discoverAllHandles(VirtualDev
 	return handles;
 }
 
+
+/*
+ * Tables last read, by key. The raw response is kept, since handles carry
+ * per-device state and cannot be shared.
+ */
+typedef struct {
+	uint32_t version;
+	std::vector<uint8_t> table;
+} cached_table_t;
+static std::map<std::string, cached_table_t> cachedTables;
+static std::mutex cachedTablesMutex;
+static constexpr size_t MAX_CACHED_TABLES = 256;
+
+static bool decodeHandleTable(std::vector<uint8_t> &table, std::map<uint16_t, std::shared_ptr<Handle>> &handles) {
+	uint8_t *buf = table.data();
+	size_t len = table.size();
+	if (len < 9) {
+		return false;
+	}
+	uint16_t count = btohs(*(uint16_t *) (buf + 7));
+	size_t i = 9;
+	for (int n = 0; n < count; n++) {
+		if (i + 28 > len) {
+			return false;
+		}
+		uint16_t handleNum = btohs(*(uint16_t *) (buf + i));
+		uint8_t kind = buf[i + 2];
+		bool staticHandle = buf[i + 3] & BEETLE_TABLE_HANDLE_STATIC;
+		bool cacheInfinite = buf[i + 3] & BEETLE_TABLE_HANDLE_CACHE_INFINITE;
+		UUID uuid(buf + i + 10, 16);
+		int valueLen = btohs(*(uint16_t *) (buf + i + 26));
+		if (i + 28 + valueLen > len || handles.find(handleNum) != handles.end()) {
+			return false;
+		}
+
+		std::shared_ptr<Handle> handle;
+		switch (kind) {
+		case Handle::PRIMARY_SERVICE:
+			handle = std::make_shared<PrimaryService>();
+			break;
+		case Handle::CHARACTERISTIC:
+			if (valueLen < 5) {
+				return false;
+			}
+			handle = std::make_shared<Characteristic>();
+			break;
+		case Handle::CHARACTERISTIC_VALUE:
+			handle = std::make_shared<CharacteristicValue>(staticHandle, cacheInfinite);
+			handle->setUuid(uuid);
+			break;
+		case Handle::CLIENT_CHAR_CFG:
+			handle = std::make_shared<ClientCharCfg>();
+			break;
+		case Handle::GENERIC:
+			handle = std::make_shared<Handle>(staticHandle, cacheInfinite);
+			handle->setUuid(uuid);
+			break;
+		default:
+			return false;
+		}
+		handle->setHandle(handleNum);
+		handle->setServiceHandle(btohs(*(uint16_t *) (buf + i + 4)));
+		handle->setCharHandle(btohs(*(uint16_t *) (buf + i + 6)));
+		handle->setEndGroupHandle(btohs(*(uint16_t *) (buf + i + 8)));
+		if (valueLen > 0) {
+			boost::shared_array<uint8_t> value(new uint8_t[valueLen]);
+			memcpy(value.get(), buf + i + 28, valueLen);
+			handle->cache.set(value, valueLen);
+		}
+		handles[handleNum] = handle;
+		i += 28 + valueLen;
+	}
+	return i == len;
+}
+
+/*
+ * Read the handles in one transaction. Returns false if the remote does not
+ * support it, or the response is malformed.
+ */
+static bool readHandleTable(VirtualDevice *d, std::string key, std::map<uint16_t, std::shared_ptr<Handle>> &handles) {
+	uint32_t knownVersion = 0;
+	std::vector<uint8_t> knownTable;
+	{
+		std::lock_guard<std::mutex> lg(cachedTablesMutex);
+		auto it = cachedTables.find(key);
+		if (it != cachedTables.end()) {
+			knownVersion = it->second.version;
+			knownTable = it->second.table;
+		}
+	}
+
+	uint8_t req[6];
+	req[0] = BEETLE_OP_READ_TABLE_REQ;
+	req[1] = BEETLE_TABLE_FORMAT;
+	*(uint32_t *) (req + 2) = htobl(knownVersion);
+
+	uint8_t *resp;
+	int respLen = d->writeTransactionBlocking(req, sizeof(req), resp);
+	boost::shared_array<uint8_t> respOwner(resp);
+
+	if (resp == NULL || respLen < 9 || resp[0] != BEETLE_OP_READ_TABLE_RESP || resp[1] != BEETLE_TABLE_FORMAT) {
+		if (debug_discovery) {
+			pdebug("handle table not supported by " + d->getName());
+		}
+		return false;
+	}
+
+	uint32_t version = btohl(*(uint32_t *) (resp + 2));
+	bool unchanged = resp[6] & BEETLE_TABLE_UNCHANGED;
+	if (unchanged && (knownVersion == 0 || version != knownVersion)) {
+		pwarn("unexpected unchanged handle table from " + d->getName());
+		return false;
+	}
+
+	std::vector<uint8_t> table;
+	if (unchanged) {
+		table.swap(knownTable);
+	} else {
+		table.assign(resp, resp + respLen);
+	}
+
+	if (!decodeHandleTable(table, handles)) {
+		pwarn("malformed handle table from " + d->getName());
+		handles.clear();
+		std::lock_guard<std::mutex> lg(cachedTablesMutex);
+		cachedTables.erase(key);
+		return false;
+	}
+
+	if (debug_discovery) {
+		pdebug("read " + std::to_string(handles.size()) + " handles for " + d->getName()
+				+ (unchanged ? " from cache" : ""));
+	}
+
+	if (!unchanged) {
+		std::lock_guard<std::mutex> lg(cachedTablesMutex);
+		if (cachedTables.size() >= MAX_CACHED_TABLES && cachedTables.find(key) == cachedTables.end()) {
+			cachedTables.erase(cachedTables.begin());
+		}
+		cached_table_t &cached = cachedTables[key];
+		cached.version = version;
+		cached.table.swap(table);
+	}
+	return true;
+}
@@ -8,31 +8,95 @@
 #include "device/socket/IPCApplication.h"
 
 #include <boost/shared_array.hpp>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <cstring>
 #include <errno.h>
 #include <iostream>
+#include <map>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 #include <unistd.h>
 #include <memory>
 
 #include "Beetle.h"
+#include "ble/beetle.h"
 #include "Debug.h"
 #include "device/socket/shared.h"
+#include "ipc/ShmRing.h"
 #include "sync/OrderedThreadPool.h"
+#include "sync/SocketSelect.h"
 #include "util/write.h"
 
+/*
+ * Slot pools by user. Applications of one user share a pool, since each can
+ * already open the memfds of the others through /proc/<pid>/fd. Pools are
+ * never shared between users.
+ */
+static std::map<uid_t, std::weak_ptr<ShmSlotPool>> slotPools;
+static std::mutex slotPoolsMutex;
+
+static std::shared_ptr<ShmSlotPool> getSlotPool(uid_t uid, uint16_t numSlots) {
+	std::lock_guard<std::mutex> lg(slotPoolsMutex);
+	for (auto it = slotPools.begin(); it != slotPools.end();) {
+		if (it->second.expired()) {
+			it = slotPools.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	std::shared_ptr<ShmSlotPool> pool = slotPools[uid].lock();
+	if (!pool) {
+		pool = std::make_shared<ShmSlotPool>(numSlots);
+		slotPools[uid] = pool;
+	}
+	return pool;
+}
+
 IPCApplication::IPCApplication(Beetle &beetle, int sockfd, std::string name_, struct sockaddr_un sockaddr_,
-		struct ucred ucred_) :
-		SeqPacketConnection(beetle, sockfd, true, std::list<delayed_packet_t>()) {
+		struct ucred ucred_, uint32_t ringCapacity_, uint16_t ringSlots_) :
+		SeqPacketConnection(beetle, sockfd, true, std::list<delayed_packet_t>(), "ipc") {
 	type = IPC_APPLICATION;
 	name = name_;
 	sockaddr = sockaddr_;
 	ucred = ucred_;
+	ringCapacity = ringCapacity_;
+	ringSlots = ringSlots_;
+	ringFd = -1;
+	ringRegion = NULL;
+	ringRegionLen = 0;
+	toAppEventFd = -1;
+	fromAppEventFd = -1;
+	ringStopped = false;
+	droppedPdus = 0;
+	ringTraffic = &beetle.metrics.transport("ipc_ring");
 }
 
 IPCApplication::~IPCApplication() {
-	// nothing to do
+	ringStopped = true;
+	if (fromAppEventFd >= 0) {
+		beetle.readers.remove(fromAppEventFd);
+	}
+
+	std::lock_guard<std::mutex> lg(ringMutex);
+	releaseSlots(true);
+	toApp.reset();
+	fromApp.reset();
+	slots.reset();
+	if (ringRegion) {
+		munmap(ringRegion, ringRegionLen);
+	}
+	for (int fd : { ringFd, toAppEventFd, fromAppEventFd }) {
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+	if (droppedPdus > 0) {
+		pwarn(getName() + " dropped " + std::to_string(droppedPdus) + " pdus on a full ring");
+	}
 }
 
 struct ucred IPCApplication::getUcred() {
@@ -42,3 +106,221 @@ struct ucred IPCApplication::getUcred() {
 struct sockaddr_un IPCApplication::getSockaddr() {
 	return sockaddr;
 }
+
+bool IPCApplication::isRingActive() {
+	std::lock_guard<std::mutex> lg(ringMutex);
+	return toApp != NULL;
+}
+
+bool IPCApplication::write(uint8_t *buf, int len) {
+	/*
+	 * Held while queuing on the socket, so that nothing queued there follows
+	 * the ring response.
+	 */
+	std::lock_guard<std::mutex> lg(ringMutex);
+	if (toApp) {
+		return writeRing(buf, len);
+	} else {
+		return SeqPacketConnection::write(buf, len);
+	}
+}
+
+void IPCApplication::socketReadHandler(std::vector<std::pair<uint8_t *, int>> &pdus) {
+	std::vector<std::pair<uint8_t *, int>> routed;
+	for (auto &pdu : pdus) {
+		if (pdu.first[0] == BEETLE_OP_IPC_RING_REQ) {
+			readHandler(routed);
+			routed.clear();
+			setupRing(pdu.first, pdu.second);
+		} else {
+			routed.push_back(pdu);
+		}
+	}
+	readHandler(routed);
+}
+
+void IPCApplication::setupRing(uint8_t *buf, int len) {
+	std::unique_lock<std::mutex> lk(ringMutex);
+	if (ringCapacity == 0 || ringSlots == 0 || len != 2 || buf[1] != IPC_RING_VERSION || toApp) {
+		lk.unlock();
+		uint8_t err[ATT_ERROR_PDU_LEN];
+		pack_error_pdu(buf[0], 0, ATT_ECODE_REQ_NOT_SUPP, err);
+		write(err, sizeof(err));
+		return;
+	}
+
+	size_t headerLen = (sizeof(ipc_ring_header_t) + 63) & ~(size_t) 63;
+	size_t regionLen = ShmRing::regionSize(ringCapacity);
+	ringRegionLen = headerLen + 2 * regionLen;
+
+	try {
+		slots = getSlotPool(ucred.uid, ringSlots);
+
+		ringFd = memfd_create("beetle-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (ringFd < 0 || ftruncate(ringFd, ringRegionLen) < 0) {
+			throw std::runtime_error("could not create memfd");
+		}
+		fcntl(ringFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+		ringRegion = mmap(NULL, ringRegionLen, PROT_READ | PROT_WRITE, MAP_SHARED, ringFd, 0);
+		if (ringRegion == MAP_FAILED) {
+			ringRegion = NULL;
+			throw std::runtime_error("could not map memfd");
+		}
+
+		toAppEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		fromAppEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (toAppEventFd < 0 || fromAppEventFd < 0) {
+			throw std::runtime_error("could not create eventfd");
+		}
+	} catch (std::runtime_error &e) {
+		pwarn(e.what() + std::string(": ") + strerror(errno));
+		stopInternal();
+		return;
+	}
+
+	ipc_ring_header_t *header = (ipc_ring_header_t *) ringRegion;
+	header->magic = IPC_RING_MAGIC;
+	header->version = IPC_RING_VERSION;
+	header->capacity = ringCapacity;
+	header->toAppOffset = headerLen;
+	header->fromAppOffset = headerLen + regionLen;
+
+	/*
+	 * Positions are read before the application can write them.
+	 */
+	std::unique_ptr<ShmRing> toAppRing(new ShmRing((uint8_t *) ringRegion + header->toAppOffset, ringCapacity));
+	std::unique_ptr<ShmRing> fromAppRing(new ShmRing((uint8_t *) ringRegion + header->fromAppOffset, ringCapacity));
+
+	uint8_t resp[6];
+	resp[0] = BEETLE_OP_IPC_RING_RESP;
+	resp[1] = IPC_RING_VERSION;
+	*(uint16_t *) (resp + 2) = htobs(slots->getSlotSize());
+	*(uint16_t *) (resp + 4) = htobs(slots->getNumSlots());
+	if (!writeWithFds(resp, sizeof(resp), { ringFd, slots->getFd(), toAppEventFd, fromAppEventFd })) {
+		return;
+	}
+
+	toApp = std::move(toAppRing);
+	fromApp = std::move(fromAppRing);
+	beetle.readers.add(fromAppEventFd, [this] {
+		readRing();
+	});
+
+	if (debug_socket) {
+		pdebug(getName() + " moved to rings of " + std::to_string(ringCapacity) + " bytes");
+	}
+}
+
+bool IPCApplication::writeRing(uint8_t *buf, int len) {
+	if (ringStopped || len > UINT16_MAX) {
+		return false;
+	}
+
+	releaseSlots(false);
+
+	ring_record_t record = { 0 };
+	bool wake;
+	bool written;
+
+	/*
+	 * Notified values go in a slot, which repeats of the value share.
+	 */
+	int slot = -1;
+	if ((buf[0] == ATT_OP_HANDLE_NOTIFY || buf[0] == ATT_OP_HANDLE_IND) && len > 3) {
+		slot = slots->publish(buf + 3, len - 3);
+	}
+	if (slot >= 0) {
+		record.type = RING_RECORD_SLOT;
+		record.len = 3;
+		record.slot = slot;
+		record.slotLen = len - 3;
+		written = toApp->push(record, buf, wake);
+		if (written) {
+			slotRefs.push_back(std::make_pair(toApp->getHead(), slot));
+		} else {
+			slots->release(slot);
+		}
+	} else {
+		record.type = RING_RECORD_PDU;
+		record.len = len;
+		written = toApp->push(record, buf, wake);
+	}
+
+	if (!written) {
+		if (droppedPdus++ == 0 || debug_socket) {
+			pwarn("ring to " + getName() + " is full");
+		}
+		return false;
+	}
+
+	ringTraffic->bytesOut->add(len);
+	ringTraffic->packetsOut->add();
+
+	if (wake) {
+		uint64_t one = 1;
+		if (::write(toAppEventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+			pwarn("could not signal " + getName());
+		}
+	}
+	return true;
+}
+
+void IPCApplication::releaseSlots(bool all) {
+	/*
+	 * The application writes the tail. It cannot be past what was pushed.
+	 */
+	uint32_t tail = 0;
+	if (toApp) {
+		tail = toApp->getTail();
+		if ((int32_t) (tail - toApp->getHead()) > 0) {
+			tail = toApp->getHead();
+		}
+	}
+	while (!slotRefs.empty() && (all || (int32_t) (tail - slotRefs.front().first) >= 0)) {
+		slots->release(slotRefs.front().second);
+		slotRefs.pop_front();
+	}
+}
+
+void IPCApplication::readRing() {
+	if (ringStopped) {
+		return;
+	}
+
+	uint64_t count;
+	if (read(fromAppEventFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		pwarn("could not read eventfd of " + getName());
+	}
+
+	/*
+	 * PDUs are copied out, since the application can change the ring while
+	 * they are being routed.
+	 */
+	try {
+		ring_record_t record;
+		uint8_t *pdu;
+		while (fromApp->peek(record, pdu)) {
+			if (record.type != RING_RECORD_PDU || record.len == 0) {
+				throw std::runtime_error("unexpected ring record");
+			} else if (record.len > MAX_PACKET_LEN) {
+				throw std::runtime_error("ring record too long");
+			}
+			uint8_t buf[MAX_PACKET_LEN];
+			memcpy(buf, pdu, record.len);
+			fromApp->pop();
+			ringTraffic->bytesIn->add(record.len);
+			ringTraffic->packetsIn->add();
+
+			if (debug_socket) {
+				pdebug("read " + std::to_string(record.len) + " bytes from ring of " + getName());
+				phex(buf, record.len);
+			}
+			readHandler(buf, record.len);
+		}
+	} catch (std::runtime_error &e) {
+		pwarn(getName() + ": " + e.what());
+		ringStopped = true;
+		stopInternal();
+	}
+}
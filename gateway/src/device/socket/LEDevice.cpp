@@ -114,7 +114,7 @@ LEDevice::LEDevice(
 		std::string name_,
 		std::list<delayed_packet_t> delayedPackets,
 		std::function<void()> onDisconnect_) :
-		SeqPacketConnection(beetle, sockfd, true, delayedPackets), hci(hci) {
+		SeqPacketConnection(beetle, sockfd, true, delayedPackets, "l2cap"), hci(hci) {
 	type = type_;
 
 	name = name_;
@@ -149,4 +149,8 @@ bool LEDevice::setConnectionInterval(uint16_t interval) {
 	return hci.setConnectionInterval(connInfo.hci_handle, interval, interval, 0, 0x0C80, 0);
 }
 
+bool LEDevice::setConnectionInterval(uint16_t minInterval, uint16_t maxInterval, uint16_t latency) {
+	return hci.setConnectionInterval(connInfo.hci_handle, minInterval, maxInterval, latency, 0x0C80, 0);
+}
+
 
@@ -14,12 +14,25 @@
 #include "device/socket/SeqPacketConnection.h"
 #include "Debug.h"
 #include "sync/SocketSelect.h"
+#include "Trace.h"
+
+/* Written packets kept for reuse, per connection */
+static const size_t MAX_SPARE_PACKETS = 64;
 
 SeqPacketConnection::SeqPacketConnection(Beetle &beetle, int sockfd_, bool isEndpoint,
-		std::list<delayed_packet_t> delayedPackets_) :
+		std::list<delayed_packet_t> delayedPackets_, std::string transport) :
 	VirtualDevice(beetle, isEndpoint) {
 	sockfd = sockfd_;
 	delayedPackets = delayedPackets_;
+	traffic = &beetle.metrics.transport(transport);
+	stopped = false;
+	flushScheduled = false;
+
+	readBuffers.resize(MAX_READ_BATCH * MAX_PACKET_LEN);
+	for (int i = 0; i < MAX_READ_BATCH; i++) {
+		readIovs[i].iov_base = readBuffers.data() + i * MAX_PACKET_LEN;
+		readIovs[i].iov_len = MAX_PACKET_LEN;
+	}
 }
 
 SeqPacketConnection::~SeqPacketConnection() {
@@ -38,7 +51,9 @@ SeqPacketConnection::~SeqPacketConnection() {
 
 void SeqPacketConnection::startInternal() {
 	for (delayed_packet_t &packet : delayedPackets) {
-		readHandler(packet.buf.get(), packet.len);
+		std::vector<std::pair<uint8_t *, int>> pdus;
+		pdus.push_back(std::make_pair(packet.buf.get(), packet.len));
+		socketReadHandler(pdus);
 	}
 	delayedPackets.clear();
 
@@ -46,53 +61,220 @@ void SeqPacketConnection::startInternal() {
 		if (stopped) {
 			return;
 		}
+		readPackets();
+	});
+}
+
+void SeqPacketConnection::readPackets() {
+	std::vector<std::pair<uint8_t *, int>> pdus;
+	int total = 0;
+	while (total < MAX_READS_PER_WAKEUP) {
+		memset(readMsgs, 0, sizeof(readMsgs));
+		for (int i = 0; i < MAX_READ_BATCH; i++) {
+			readMsgs[i].msg_hdr.msg_iov = &readIovs[i];
+			readMsgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int n = recvmmsg(sockfd, readMsgs, MAX_READ_BATCH, MSG_DONTWAIT, NULL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+
+		/*
+		 * Packets after the end of the stream have length 0.
+		 */
+		bool eof = (n <= 0);
+		pdus.clear();
+		for (int i = 0; i < n; i++) {
+			if (readMsgs[i].msg_len == 0) {
+				eof = true;
+				break;
+			}
+			pdus.push_back(std::make_pair((uint8_t *) readIovs[i].iov_base, (int) readMsgs[i].msg_len));
+			traffic->bytesIn->add(readMsgs[i].msg_len);
+		}
+		traffic->packetsIn->add(pdus.size());
 
-		uint8_t buf[256];
-		int n = read(sockfd, buf, sizeof(buf));
 		if (debug_socket) {
-			pdebug("read " + std::to_string(n) + " bytes from " + getName());
+			pdebug("read " + std::to_string(pdus.size()) + " packets from " + getName());
+			for (auto &pdu : pdus) {
+				phex(pdu.first, pdu.second);
+			}
+		}
+		if (!pdus.empty()) {
+			socketReadHandler(pdus);
 		}
-		if (n <= 0) {
+
+		if (eof) {
 			if (debug_socket) {
 				std::stringstream ss;
-				ss << "socket errno: " << strerror(errno);
+				ss << "socket errno: " << ((n < 0) ? strerror(errno) : "end of stream");
 				pdebug(ss.str());
 			}
 			stopInternal();
-		} else {
-			if (debug_socket) {
-				phex(buf, n);
-			}
-			readHandler(buf, n);
+			return;
 		}
-	});
+
+		total += n;
+		if (n < MAX_READ_BATCH) {
+			break;
+		}
+	}
+}
+
+void SeqPacketConnection::socketReadHandler(std::vector<std::pair<uint8_t *, int>> &pdus) {
+	readHandler(pdus);
 }
 
 bool SeqPacketConnection::write(uint8_t *buf, int len) {
+	std::vector<int> noFds;
+	return enqueue(buf, len, noFds);
+}
+
+bool SeqPacketConnection::writeWithFds(uint8_t *buf, int len, std::vector<int> fds) {
+	std::vector<int> fdsCpy;
+	for (int fd : fds) {
+		int fdCpy = dup(fd);
+		if (fdCpy < 0) {
+			for (int fd : fdsCpy) {
+				close(fd);
+			}
+			return false;
+		}
+		fdsCpy.push_back(fdCpy);
+	}
+
+	if (!enqueue(buf, len, fdsCpy)) {
+		for (int fd : fdsCpy) {
+			close(fd);
+		}
+		return false;
+	}
+	return true;
+}
+
+bool SeqPacketConnection::enqueue(uint8_t *buf, int len, std::vector<int> &fds) {
+	std::lock_guard<std::mutex> lg(writeMutex);
 	if (stopped) {
 		return false;
 	}
 
-	boost::shared_array<uint8_t> bufCpy(new uint8_t[len]);
-	memcpy(bufCpy.get(), buf, len);
-	pendingWrites.increment();
-	beetle.writers.schedule(getId(), [this, bufCpy, len] {
-		if (write_all(sockfd, bufCpy.get(), len) != len) {
-			if (debug_socket) {
-				std::stringstream ss;
-				ss << "socket write failed : " << strerror(errno);
-				pdebug(ss.str());
+	if (sparePackets.empty()) {
+		writeQueue.emplace_back();
+	} else {
+		writeQueue.push_back(std::move(sparePackets.back()));
+		sparePackets.pop_back();
+	}
+	queued_packet &packet = writeQueue.back();
+	packet.buf.assign(buf, buf + len);
+	packet.fds.swap(fds);
+	packet.traceId = 0;
+	if (tracing() && trace_current != 0) {
+		packet.traceId = trace_current;
+		packet.traceTime = traceNow();
+	}
+
+	if (!flushScheduled) {
+		flushScheduled = true;
+		pendingWrites.increment();
+		beetle.writers.schedule(getId(), [this] {
+			flush();
+			pendingWrites.decrement();
+		});
+	}
+	return true;
+}
+
+void SeqPacketConnection::flush() {
+	std::vector<queued_packet> batch;
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		batch.swap(writeQueue);
+		flushScheduled = false;
+	}
+
+	struct mmsghdr msgs[MAX_WRITE_BATCH];
+	struct iovec iovs[MAX_WRITE_BATCH];
+	std::vector<std::vector<uint8_t>> controls(MAX_WRITE_BATCH);
+
+	bool failed = false;
+	size_t sent = 0;
+	while (sent < batch.size() && !failed) {
+		int n = std::min(batch.size() - sent, (size_t) MAX_WRITE_BATCH);
+		memset(msgs, 0, sizeof(struct mmsghdr) * n);
+		for (int i = 0; i < n; i++) {
+			queued_packet &packet = batch[sent + i];
+			iovs[i].iov_base = packet.buf.data();
+			iovs[i].iov_len = packet.buf.size();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			if (!packet.fds.empty()) {
+				std::vector<uint8_t> &control = controls[i];
+				control.assign(CMSG_SPACE(sizeof(int) * packet.fds.size()), 0);
+				msgs[i].msg_hdr.msg_control = control.data();
+				msgs[i].msg_hdr.msg_controllen = control.size();
+
+				struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+				cmsg->cmsg_level = SOL_SOCKET;
+				cmsg->cmsg_type = SCM_RIGHTS;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(int) * packet.fds.size());
+				memcpy(CMSG_DATA(cmsg), packet.fds.data(), sizeof(int) * packet.fds.size());
 			}
-			stopInternal();
-		} else {
-			if (debug_socket) {
-				pdebug("wrote " + std::to_string(len) + " bytes to " + getName());
-				phex(bufCpy.get(), len);
+		}
+
+		int offset = 0;
+		while (offset < n) {
+			int m = sendmmsg(sockfd, msgs + offset, n - offset, MSG_NOSIGNAL);
+			if (m < 0 && errno == EINTR) {
+				continue;
+			} else if (m <= 0) {
+				if (debug_socket) {
+					std::stringstream ss;
+					ss << "socket write failed : " << strerror(errno);
+					pdebug(ss.str());
+				}
+				failed = true;
+				break;
+			}
+			for (int i = offset; i < offset + m; i++) {
+				traffic->bytesOut->add(iovs[i].iov_len);
 			}
+			traffic->packetsOut->add(m);
+			offset += m;
 		}
-		pendingWrites.decrement();
-	});
-	return true;
+
+		if (debug_socket && !failed) {
+			pdebug("wrote " + std::to_string(n) + " packets to " + getName());
+			for (int i = 0; i < n; i++) {
+				phex(batch[sent + i].buf.data(), batch[sent + i].buf.size());
+			}
+		}
+		sent += n;
+	}
+
+	if (failed) {
+		stopInternal();
+	}
+
+	uint64_t now = 0;
+	std::lock_guard<std::mutex> lg(writeMutex);
+	for (queued_packet &packet : batch) {
+		if (packet.traceId != 0 && !failed) {
+			if (now == 0) {
+				now = traceNow();
+			}
+			traceRecord(packet.traceId, "write", packet.traceTime, now, getId());
+		}
+		for (int fd : packet.fds) {
+			close(fd);
+		}
+		packet.fds.clear();
+		if (sparePackets.size() < MAX_SPARE_PACKETS) {
+			sparePackets.push_back(std::move(packet));
+		}
+	}
 }
 
 void SeqPacketConnection::stopInternal() {
@@ -12,6 +12,7 @@
 #include <cassert>
 #include <cstring>
 #include <errno.h>
+#include <ctime>
 #include <iostream>
 #include <openssl/ossl_typ.h>
 #include <sstream>
@@ -21,6 +22,10 @@
 #include "ble/att.h"
 #include "Debug.h"
 #include "sync/OrderedThreadPool.h"
+#include "tcp/GatewaySession.h"
+#include "tcp/TCPFraming.h"
+#include "Trace.h"
+#include "util/file.h"
 #include "util/write.h"
 
 TCPConnection::TCPConnection(Beetle &beetle, SSL *ssl_, int sockfd_, struct sockaddr_in sockaddr_, bool isEndpoint,
@@ -29,12 +34,35 @@ TCPConnection::TCPConnection(Beetle &beetle, SSL *ssl_, int sockfd_, struct sock
 	ssl = ssl_;
 	sockfd = sockfd_;
 	sockaddr = sockaddr_;
+	framing = TCP_FRAMING_V1;
 	stopped = false;
+	flushScheduled = false;
+	channel = 0;
+	traffic = &beetle.metrics.transport("tcp");
+}
+
+TCPConnection::TCPConnection(Beetle &beetle, std::shared_ptr<GatewaySession> session_, uint32_t channel_,
+		struct sockaddr_in sockaddr_, bool isEndpoint, HandleAllocationTable *hat) :
+		VirtualDevice(beetle, isEndpoint, hat) {
+	ssl = NULL;
+	sockfd = -1;
+	sockaddr = sockaddr_;
+	session = session_;
+	channel = channel_;
+	framing = TCP_FRAMING_V2;
+	stopped = false;
+	flushScheduled = false;
+	traffic = NULL;
 }
 
 TCPConnection::~TCPConnection() {
 	stopped = true;
 
+	if (session) {
+		session->detach(channel);
+		return;
+	}
+
 	pendingWrites.wait();
 
 	beetle.readers.remove(sockfd);
@@ -49,95 +77,104 @@ TCPConnection::~TCPConnection() {
 	close(sockfd);
 }
 
+void TCPConnection::setFramingVersion(int version) {
+	framing = version;
+	decoder.setVersion(version);
+}
+
+int TCPConnection::getFramingVersion() {
+	return framing;
+}
+
+std::shared_ptr<GatewaySession> TCPConnection::getSession() {
+	return session;
+}
+
+int TCPConnection::getMaxMTU() {
+	return (framing >= TCP_FRAMING_V2) ? ATT_MAX_LE_MTU : ATT_DEFAULT_LE_MTU;
+}
+
+static uint64_t getCurrentTimeMicros() {
+	struct timespec spec;
+	clock_gettime(CLOCK_REALTIME, &spec);
+	return (uint64_t) spec.tv_sec * 1000000 + spec.tv_nsec / 1000;
+}
+
 void TCPConnection::startInternal() {
+	if (session) {
+		session->attach(channel, [this](uint8_t *buf, int len) {
+			readHandler(buf, len);
+		}, [this] {
+			stopInternal();
+		});
+		return;
+	}
+
+	if (!fd_set_blocking(sockfd, false)) {
+		throw DeviceException("could not make socket nonblocking");
+	}
+
 	beetle.readers.add(sockfd, [this] {
-		if (stopped) {
+		readAvailable();
+	});
+}
+
+void TCPConnection::readAvailable() {
+	uint8_t buf[16384];
+	for (int i = 0; !stopped; i++) {
+		/*
+		 * Records already decrypted by openssl do not wake up select.
+		 */
+		if (i >= MAX_READS_PER_WAKEUP && SSL_pending(ssl) <= 0) {
 			return;
 		}
 
-		uint8_t buf[256];
-		uint8_t len;
-
-		// read length of ATT message
-		int bytesRead = SSL_read(ssl, &len, sizeof(len));
-		if (bytesRead <= 0) {
+		int n = SSL_read(ssl, buf, sizeof(buf));
+		if (n <= 0) {
+			int err = SSL_get_error(ssl, n);
+			if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+				return;
+			}
 			if (debug_socket) {
 				std::stringstream ss;
 				ss << "socket errno: " << strerror(errno);
 				pdebug(ss.str());
 			}
 			stopInternal();
-		} else {
-			assert(bytesRead == 1);
-			if (debug_socket) {
-				pdebug("tcp expecting " + std::to_string(len) + " bytes");
-			}
-
-			time_t startTime = time(NULL);
-
-			struct timeval defaultTimeout;
-			defaultTimeout.tv_sec = 0;
-			defaultTimeout.tv_usec = 100000;
-
-			fd_set fdSet;
-			FD_ZERO(&fdSet);
-			FD_SET(sockfd, &fdSet);
+			return;
+		}
+		traffic->bytesIn->add(n);
+		decoder.append(buf, n);
 
-			// read payload ATT message
-			bytesRead = 0;
-			while (!stopped && bytesRead < len) {
-				if (difftime(time(NULL), startTime) > TIMEOUT_PAYLOAD) {
-					if (debug_socket) {
-						pdebug("timed out reading payload");
-					}
-					stopInternal();
-					break;
+		uint64_t timestamp;
+		std::vector<std::pair<uint8_t *, int>> pdus;
+		try {
+			while (!stopped && decoder.next(timestamp, pdus)) {
+				if (debug_socket) {
+					pdebug("read " + std::to_string(pdus.size()) + " pdus from " + getName());
 				}
-
-				int result = SSL_pending(ssl);
-
-				if (result <= 0) {
-					struct timeval timeout = defaultTimeout;
-					fd_set readFds = fdSet;
-					fd_set exceptFds = fdSet;
-					result = select(sockfd + 1, &readFds, NULL, &exceptFds, &timeout);
-					if (result < 0) {
-						if (debug_socket) {
-							std::stringstream ss;
-							ss << "select failed : " << strerror(errno);
-							pdebug(ss.str());
-						}
-						stopInternal();
-						break;
-					}
+				if (debug_performance && timestamp != 0) {
+					std::stringstream ss;
+					ss << "frame from " << getName() << " in transit "
+							<< (int64_t) (getCurrentTimeMicros() - timestamp) << " us";
+					pdebug(ss.str());
 				}
-
-				if (result > 0) {
-					int n = SSL_read(ssl, buf + bytesRead, len - bytesRead);
-					if (n < 0) {
-						if (debug_socket) {
-							std::cerr << "socket errno: " << strerror(errno) << std::endl;
-						}
-						stopInternal();
-						break;
-					} else {
-						bytesRead += n;
+				traffic->packetsIn->add(pdus.size());
+				for (auto &pdu : pdus) {
+					if (debug_socket) {
+						phex(pdu.first, pdu.second);
 					}
+					readHandler(pdu.first, pdu.second);
 				}
 			}
-
-			if (bytesRead < len) {
-				return;
-			}
-
+		} catch (std::exception &e) {
 			if (debug_socket) {
-				phex(buf, bytesRead);
-				pdebug("read " + std::to_string(bytesRead) + " bytes from " + getName());
+				pexcept(e);
 			}
-
-			readHandler(buf, bytesRead);
+			stopInternal();
+			return;
 		}
-	});
+	}
 }
 
 bool TCPConnection::write(uint8_t *buf, int len) {
@@ -148,30 +185,81 @@ bool TCPConnection::write(uint8_t *buf, int len) {
 	assert(buf);
 	assert(len > 0);
 
-	boost::shared_array<uint8_t> bufCpy(new uint8_t[len]);
+	if (framing < TCP_FRAMING_V2 && len > TCP_FRAME_V1_MAX_PDU) {
+		if (debug_socket) {
+			pwarn("pdu too long for " + getName() + ": " + std::to_string(len));
+		}
+		return false;
+	}
 
-	memcpy(bufCpy.get(), buf, len);
-	pendingWrites.increment();
-	beetle.writers.schedule(getId(), [this, bufCpy, len] {
-		uint8_t bufLen = len;
-		if (SSL_write_all(ssl, &bufLen, 1) != 1 || SSL_write_all(ssl, bufCpy.get(), len) != len) {
-			if (debug_socket) {
-				std::stringstream ss;
-				ss << "socket write failed : " << strerror(errno);
-				pdebug(ss.str());
-			}
-			stopInternal();
-		} else {
+	if (session) {
+		if (!session->send(channel, buf, len)) {
 			if (debug_socket) {
-				pdebug("wrote " + std::to_string(len) + " bytes to " + getName());
-				phex(bufCpy.get(), len);
+				pwarn("could not write to channel of " + getName());
 			}
+			return false;
 		}
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lg(writeMutex);
+	writeQueue.push_back(std::vector<uint8_t>(buf, buf + len));
+	if (tracing() && trace_current != 0) {
+		tracedWrites.push_back(std::make_pair(trace_current, traceNow()));
+	}
+	if (flushScheduled) {
+		return true;
+	}
+
+	flushScheduled = true;
+	pendingWrites.increment();
+	beetle.writers.schedule(getId(), [this] {
+		flush();
 		pendingWrites.decrement();
 	});
 	return true;
 }
 
+void TCPConnection::flush() {
+	std::vector<std::vector<uint8_t>> pdus;
+	std::vector<std::pair<uint64_t, uint64_t>> traced;
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		pdus.swap(writeQueue);
+		traced.swap(tracedWrites);
+		flushScheduled = false;
+	}
+
+	std::vector<uint8_t> out;
+	if (framing >= TCP_FRAMING_V2) {
+		appendFramesV2(out, pdus, debug_performance ? getCurrentTimeMicros() : 0);
+	} else {
+		appendFramesV1(out, pdus);
+	}
+
+	if (SSL_write_all(ssl, out.data(), out.size()) != (int) out.size()) {
+		if (debug_socket) {
+			std::stringstream ss;
+			ss << "socket write failed : " << strerror(errno);
+			pdebug(ss.str());
+		}
+		stopInternal();
+	} else {
+		traffic->bytesOut->add(out.size());
+		traffic->packetsOut->add(pdus.size());
+		if (!traced.empty()) {
+			uint64_t now = traceNow();
+			for (auto &kv : traced) {
+				traceRecord(kv.first, "write", kv.second, now, getId());
+			}
+		}
+		if (debug_socket) {
+			pdebug("wrote " + std::to_string(pdus.size()) + " pdus to " + getName());
+			phex(out.data(), out.size());
+		}
+	}
+}
+
 struct sockaddr_in TCPConnection::getSockaddr() {
 	return sockaddr;
 }
@@ -184,4 +272,3 @@ void TCPConnection::stopInternal() {
 		beetle.removeDevice(getId());
 	}
 }
-
@@ -19,12 +19,34 @@
 #include "hat/SingleAllocator.h"
 #include "BeetleTypes.h"
 #include "Device.h"
+#include "tcp/GatewaySession.h"
 
 
 TCPClientProxy::TCPClientProxy(Beetle &beetle, SSL *ssl, int sockfd, std::string clientGateway_,
 		struct sockaddr_in clientGatewaySockAddr_, device_t localProxyFor_) :
 		TCPConnection(beetle, ssl, sockfd, clientGatewaySockAddr_, false, new SingleAllocator(localProxyFor_)) {
+	init(clientGateway_, localProxyFor_);
+}
+
+TCPClientProxy::TCPClientProxy(Beetle &beetle, std::shared_ptr<GatewaySession> session, uint32_t channel,
+		device_t localProxyFor_) :
+		TCPConnection(beetle, session, channel, session->getSockaddr(), false, new SingleAllocator(localProxyFor_)) {
+	init(session->getRemoteGateway(), localProxyFor_);
+}
+
+TCPClientProxy::~TCPClientProxy() {
+	// Nothing to do, handled by superclass
+}
 
+device_t TCPClientProxy::getLocalDeviceId() {
+	return localProxyFor;
+}
+
+std::string TCPClientProxy::getClientGateway() {
+	return clientGateway;
+}
+
+void TCPClientProxy::init(std::string clientGateway_, device_t localProxyFor_) {
 	name = "Proxy for " + std::to_string(localProxyFor_) + " to " + clientGateway_;
 	type = TCP_CLIENT_PROXY;
 	clientGateway = clientGateway_;
@@ -50,15 +72,3 @@ TCPClientProxy::TCPClientProxy(Beetle &beetle, SSL *ssl, int sockfd, std::string
 		throw DeviceException("cannot proxy to device type");
 	}
 }
-
-TCPClientProxy::~TCPClientProxy() {
-	// Nothing to do, handled by superclass
-}
-
-device_t TCPClientProxy::getLocalDeviceId() {
-	return localProxyFor;
-}
-
-std::string TCPClientProxy::getClientGateway() {
-	return clientGateway;
-}
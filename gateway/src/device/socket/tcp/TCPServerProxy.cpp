@@ -8,12 +8,14 @@
 #include "device/socket/tcp/TCPServerProxy.h"
 
 #include <arpa/inet.h>
-#include <netdb.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <string.h>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <map>
@@ -25,7 +27,10 @@
 #include "Debug.h"
 #include "Device.h"
 #include "hat/SingleAllocator.h"
+#include "tcp/GatewaySession.h"
+#include "tcp/HostResolver.h"
 #include "tcp/TCPConnParams.h"
+#include "tcp/TCPFraming.h"
 #include "tcp/SSLConfig.h"
 #include "util/file.h"
 #include "util/write.h"
@@ -42,6 +47,19 @@ TCPServerProxy::TCPServerProxy(Beetle &beetle, SSL *ssl, int sockfd, std::string
 	remoteProxyTo = remoteProxyTo_;
 }
 
+TCPServerProxy::TCPServerProxy(Beetle &beetle, std::shared_ptr<GatewaySession> session, uint32_t channel,
+		device_t remoteProxyTo_) :
+		TCPConnection(beetle, session, channel, session->getSockaddr(), false,
+				new SingleAllocator(NULL_RESERVED_DEVICE)) {
+	type = TCP_SERVER_PROXY;
+
+	createdAt = time(NULL);
+
+	name = "Proxy to " + std::to_string(remoteProxyTo_) + " from " + session->getRemoteGateway();
+	serverGateway = session->getRemoteGateway();
+	remoteProxyTo = remoteProxyTo_;
+}
+
 TCPServerProxy::~TCPServerProxy() {
 	// Nothing to do, handled by superclass
 }
@@ -54,6 +72,13 @@ std::string TCPServerProxy::getServerGateway() {
 	return serverGateway;
 }
 
+std::string TCPServerProxy::getHandleTableKey() {
+	if (getSession() == NULL && getFramingVersion() < TCP_FRAMING_V2) {
+		return "";
+	}
+	return serverGateway + "/" + std::to_string(remoteProxyTo);
+}
+
 bool TCPServerProxy::isLive() {
 	std::unique_lock<std::mutex> mappedToLk(mappedToMutex);
 	if (mappedTo.empty() && difftime(time(NULL), createdAt) > PROXY_UNUSED_TIMEOUT) {
@@ -79,30 +104,69 @@ void TCPServerProxy::initSSL(SSLConfig *sslConfig_) {
 	sslConfig = sslConfig_;
 }
 
-TCPServerProxy *TCPServerProxy::connectRemote(Beetle &beetle, std::string host, int port, device_t remoteProxyTo) {
-	struct sockaddr_in serv_addr = { 0 };
-	if (inet_pton(AF_INET, host.c_str(), &serv_addr.sin_addr.s_addr) != 1) {
-		/*
-		 * TODO: this can block for a while
-		 */
-		struct hostent *server = gethostbyname(host.c_str());
-		if (server == NULL) {
-			throw DeviceException("could not get host");
+/*
+ * Wait until the socket is ready or the deadline passes.
+ */
+static bool waitSocket(int sockfd, short events, std::chrono::steady_clock::time_point deadline) {
+	while (true) {
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now()).count();
+		if (remaining <= 0) {
+			return false;
 		}
-		bcopy((char *) server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
+		struct pollfd pfd;
+		pfd.fd = sockfd;
+		pfd.events = events;
+		pfd.revents = 0;
+		int result = poll(&pfd, 1, (int) remaining);
+		if (result > 0) {
+			return true;
+		} else if (result < 0 && errno != EINTR) {
+			return false;
+		}
+	}
+}
+
+/*
+ * Resolve host, connect, and complete the SSL handshake, resuming the last
+ * session with peer if there is one. The socket is nonblocking throughout,
+ * so a dead host fails after TIMEOUT_CONNECT rather than the kernel's
+ * connect timeout.
+ */
+static SSL *connectSSL(SSLConfig *sslConfig, std::string host, int port, std::string peer,
+		struct sockaddr_in &serv_addr, int &sockfd) {
+	auto deadline = std::chrono::steady_clock::now()
+			+ std::chrono::seconds(TCPServerProxy::TIMEOUT_CONNECT);
+
+	if (!HostResolver::resolve(host, serv_addr.sin_addr)) {
+		throw DeviceException("could not get host");
 	}
 	serv_addr.sin_family = AF_INET;
 	serv_addr.sin_port = htons(port);
 
-	int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
 	if (sockfd < 0) {
 		throw DeviceException("error opening socket");
 	}
 
-	if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
+	int err = 0;
+	socklen_t errLen = sizeof(err);
+	if (!fd_set_blocking(sockfd, false)) {
+		err = errno;
+	} else if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
+		if (errno != EINPROGRESS) {
+			err = errno;
+		} else if (!waitSocket(sockfd, POLLOUT, deadline)) {
+			err = ETIMEDOUT;
+		} else if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0) {
+			err = errno;
+		}
+	}
+	if (err != 0) {
 		shutdown(sockfd, SHUT_RDWR);
 		close(sockfd);
-		throw DeviceException("error connecting");
+		HostResolver::invalidate(host);
+		throw DeviceException("error connecting: " + std::string(strerror(err)));
 	}
 
 	/*
@@ -110,7 +174,34 @@ TCPServerProxy *TCPServerProxy::connectRemote(Beetle &beetle, std::string host,
 	 */
 	SSL *ssl = SSL_new(sslConfig->getCtx());
 	SSL_set_fd(ssl, sockfd);
-	if (SSL_connect(ssl) <= 0) {
+	if (peer != "") {
+		sslConfig->resumeSession(ssl, peer);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	bool connected = false;
+	while (true) {
+		int ret = SSL_connect(ssl);
+		if (ret > 0) {
+			connected = true;
+			break;
+		}
+		int sslErr = SSL_get_error(ssl, ret);
+		if (sslErr == SSL_ERROR_WANT_READ) {
+			if (waitSocket(sockfd, POLLIN, deadline)) {
+				continue;
+			}
+		} else if (sslErr == SSL_ERROR_WANT_WRITE) {
+			if (waitSocket(sockfd, POLLOUT, deadline)) {
+				continue;
+			}
+		}
+		break;
+	}
+	sslConfig->recordHandshake(ssl, connected, std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count());
+
+	if (!connected) {
 		ERR_print_errors_fp(stderr);
 		SSL_shutdown(ssl);
 		shutdown(sockfd, SHUT_RDWR);
@@ -118,16 +209,132 @@ TCPServerProxy *TCPServerProxy::connectRemote(Beetle &beetle, std::string host,
 		close(sockfd);
 		throw DeviceException("error on ssl connect");
 	}
+	return ssl;
+}
+
+/*
+ * Open a channel on the session, and a proxy around it.
+ */
+static TCPServerProxy *openChannel(Beetle &beetle, std::shared_ptr<GatewaySession> session,
+		device_t remoteProxyTo) {
+	uint32_t channel = session->open(remoteProxyTo);
+	try {
+		return new TCPServerProxy(beetle, session, channel, remoteProxyTo);
+	} catch (std::exception &e) {
+		session->detach(channel);
+		throw;
+	}
+}
+
+std::map<std::string, std::weak_ptr<GatewaySession>> TCPServerProxy::sessions;
+std::set<std::string> TCPServerProxy::noSessionHosts;
+std::set<std::string> TCPServerProxy::connectingHosts;
+std::map<std::string, std::string> TCPServerProxy::gatewayNames;
+std::mutex TCPServerProxy::sessionsMutex;
+std::condition_variable TCPServerProxy::sessionsCv;
+
+std::string TCPServerProxy::getGatewayName(std::string host, int port) {
+	std::lock_guard<std::mutex> lg(sessionsMutex);
+	auto it = gatewayNames.find(host + ":" + std::to_string(port));
+	return (it != gatewayNames.end()) ? it->second : "";
+}
+
+TCPServerProxy *TCPServerProxy::connectRemote(Beetle &beetle, std::string host, int port, device_t remoteProxyTo) {
+	std::string key = host + ":" + std::to_string(port);
+
+	/*
+	 * Reuse the session to the gateway if there is one.
+	 */
+	std::shared_ptr<GatewaySession> existing;
+	bool offerSession;
+	bool connecting = false;
+	std::string peer;
+	{
+		std::unique_lock<std::mutex> lk(sessionsMutex);
+		sessionsCv.wait(lk, [&key] {
+			return connectingHosts.find(key) == connectingHosts.end();
+		});
+		auto it = sessions.find(key);
+		if (it != sessions.end()) {
+			existing = it->second.lock();
+			if (!existing || existing->isStopped()) {
+				existing.reset();
+				sessions.erase(it);
+			}
+		}
+		offerSession = noSessionHosts.find(key) == noSessionHosts.end();
+		if (gatewayNames.find(key) != gatewayNames.end()) {
+			peer = gatewayNames[key];
+		}
+		if (!existing && offerSession) {
+			connectingHosts.insert(key);
+			connecting = true;
+		}
+	}
+	if (existing) {
+		if (debug_socket) {
+			pdebug("reusing session with " + existing->getRemoteGateway());
+		}
+		return openChannel(beetle, existing, remoteProxyTo);
+	}
+
+	std::shared_ptr<GatewaySession> session;
+	TCPServerProxy *proxy = NULL;
+	try {
+		proxy = connectNew(beetle, host, port, peer, offerSession, remoteProxyTo, session);
+	} catch (std::exception &e) {
+		if (connecting) {
+			std::lock_guard<std::mutex> lg(sessionsMutex);
+			connectingHosts.erase(key);
+			sessionsCv.notify_all();
+		}
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> lg(sessionsMutex);
+		if (session) {
+			sessions[key] = session;
+		} else if (offerSession) {
+			noSessionHosts.insert(key);
+		}
+		if (connecting) {
+			connectingHosts.erase(key);
+			sessionsCv.notify_all();
+		}
+	}
+
+	if (session) {
+		if (debug) {
+			pdebug("started session with " + session->getRemoteGateway());
+		}
+		return openChannel(beetle, session, remoteProxyTo);
+	}
+	return proxy;
+}
+
+TCPServerProxy *TCPServerProxy::connectNew(Beetle &beetle, std::string host, int port, std::string peer,
+		bool offerSession, device_t remoteProxyTo, std::shared_ptr<GatewaySession> &session) {
+	std::string key = host + ":" + std::to_string(port);
+
+	struct sockaddr_in serv_addr = { 0 };
+	int sockfd;
+	SSL *ssl = connectSSL(sslConfig, host, port, peer, serv_addr, sockfd);
 
 	/*
-	 * Format the plaintext parameters.
+	 * Format the plaintext parameters. The device is still sent with a
+	 * session, for servers that predate them.
 	 */
 	std::stringstream ss;
 	ss << TCP_PARAM_GATEWAY << " " << beetle.name << "\n" << TCP_PARAM_DEVICE << " " << std::to_string(remoteProxyTo);
+	ss << "\n" << TCP_PARAM_FRAMING << " " << TCP_FRAMING_MAX_VERSION;
+	if (offerSession) {
+		ss << "\n" << TCP_PARAM_SESSION << " " << GATEWAY_SESSION_VERSION;
+	}
 
 	std::string clientParams = ss.str();
 	uint32_t clientParamsLen = htonl(clientParams.length());
-	if (SSL_write_all(ssl, (uint8_t *) &clientParamsLen, sizeof(clientParamsLen)) == false) {
+	if (SSL_write_all(ssl, (uint8_t *) &clientParamsLen, sizeof(clientParamsLen)) != (int) sizeof(clientParamsLen)) {
 		ERR_print_errors_fp(stderr);
 		SSL_shutdown(ssl);
 		shutdown(sockfd, SHUT_RDWR);
@@ -136,7 +343,7 @@ TCPServerProxy *TCPServerProxy::connectRemote(Beetle &beetle, std::string host,
 		throw DeviceException("could not write params length");
 	}
 
-	if (SSL_write_all(ssl, (uint8_t *) clientParams.c_str(), clientParams.length()) == false) {
+	if (SSL_write_all(ssl, (uint8_t *) clientParams.c_str(), clientParams.length()) != (int) clientParams.length()) {
 		ERR_print_errors_fp(stderr);
 		SSL_shutdown(ssl);
 		shutdown(sockfd, SHUT_RDWR);
@@ -175,8 +382,27 @@ TCPServerProxy *TCPServerProxy::connectRemote(Beetle &beetle, std::string host,
 	}
 
 	/*
-	 * Instantiate the virtual device around the client socket.
+	 * Tickets have been read along with the params.
 	 */
-	return new TCPServerProxy(beetle, ssl, sockfd, serverParams[TCP_PARAM_GATEWAY], serv_addr, remoteProxyTo);
-}
+	sslConfig->saveSession(ssl, serverParams[TCP_PARAM_GATEWAY]);
+	{
+		std::lock_guard<std::mutex> lg(sessionsMutex);
+		gatewayNames[key] = serverParams[TCP_PARAM_GATEWAY];
+	}
 
+	if (serverParams.find(TCP_PARAM_SESSION) != serverParams.end()) {
+		session = std::make_shared<GatewaySession>(beetle, ssl, sockfd, serverParams[TCP_PARAM_GATEWAY],
+				serv_addr);
+		session->start();
+		return NULL;
+	}
+
+	/*
+	 * Instantiate the virtual device around the client socket. Servers that
+	 * predate framing v2 do not reply with a version.
+	 */
+	TCPServerProxy *proxy = new TCPServerProxy(beetle, ssl, sockfd, serverParams[TCP_PARAM_GATEWAY], serv_addr,
+			remoteProxyTo);
+	proxy->setFramingVersion(negotiateFraming(serverParams));
+	return proxy;
+}
@@ -64,7 +64,9 @@ handle_range_t BlockAllocator::getHandleRange(uint16_t handle) {
 }
 
 handle_range_t BlockAllocator::reserve(device_t d, int n) {
-	assert(n < blockSize);
+	if (n > blockSize) {
+		return handle_range_t { 0, 0 };
+	}
 	for (int i = 1; i < numBlocks; i++) {
 		if (blocks.get()[i] == NULL_RESERVED_DEVICE) {
 			blocks.get()[i] = d;
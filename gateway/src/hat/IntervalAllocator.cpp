@@ -0,0 +1,165 @@
+/*
+ * IntervalAllocator.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "hat/IntervalAllocator.h"
+
+#include <assert.h>
+#include <iterator>
+#include <utility>
+
+#define MAX_HANDLE 0xFFFF
+
+static int roundSize(int n) {
+	if (n <= 0) {
+		n = IntervalAllocator::DEFAULT_RANGE_SIZE;
+	}
+	int rem = n % IntervalAllocator::RANGE_ALIGNMENT;
+	if (rem != 0) {
+		n += IntervalAllocator::RANGE_ALIGNMENT - rem;
+	}
+	return n;
+}
+
+IntervalAllocator::IntervalAllocator(int reservedSize) {
+	assert(reservedSize > 0 && reservedSize <= MAX_HANDLE);
+	uint16_t end = reservedSize - 1;
+	ranges[0] = std::make_pair(end, BEETLE_RESERVED_DEVICE);
+	deviceRanges[BEETLE_RESERVED_DEVICE] = handle_range_t { 0, end };
+}
+
+IntervalAllocator::~IntervalAllocator() {
+
+}
+
+std::set<device_t> IntervalAllocator::getDevices() {
+	std::set<device_t> ret;
+	for (auto &kv : deviceRanges) {
+		ret.insert(kv.first);
+	}
+	return ret;
+}
+
+handle_range_t IntervalAllocator::getDeviceRange(device_t d) {
+	auto it = deviceRanges.find(d);
+	if (it == deviceRanges.end()) {
+		return handle_range_t { 0, 0 };
+	}
+	return it->second;
+}
+
+std::map<uint16_t, std::pair<uint16_t, device_t>>::iterator IntervalAllocator::find(uint16_t h) {
+	auto it = ranges.upper_bound(h);
+	if (it == ranges.begin()) {
+		return ranges.end();
+	}
+	--it;
+	if (h > it->second.first) {
+		return ranges.end();
+	}
+	return it;
+}
+
+device_t IntervalAllocator::getDeviceForHandle(uint16_t h) {
+	auto it = find(h);
+	if (it == ranges.end()) {
+		return NULL_RESERVED_DEVICE;
+	}
+	return it->second.second;
+}
+
+/*
+ * Handles that are not allocated return the enclosing free range, so that
+ * callers iterating over the handle space can skip it in one step.
+ */
+handle_range_t IntervalAllocator::getHandleRange(uint16_t h) {
+	auto next = ranges.upper_bound(h);
+	uint16_t start = 0;
+	if (next != ranges.begin()) {
+		auto prev = std::prev(next);
+		if (h <= prev->second.first) {
+			return handle_range_t { prev->first, prev->second.first };
+		}
+		start = prev->second.first + 1;
+	}
+	uint16_t end = (next == ranges.end()) ? MAX_HANDLE : next->first - 1;
+	return handle_range_t { start, end };
+}
+
+handle_range_t IntervalAllocator::findFree(int n) {
+	int base = 0;
+	for (auto &kv : ranges) {
+		if (kv.first - base >= n) {
+			break;
+		}
+		base = kv.second.first + 1;
+	}
+	if (base + n - 1 > MAX_HANDLE) {
+		return handle_range_t { 0, 0 };
+	}
+	return handle_range_t { (uint16_t) base, (uint16_t) (base + n - 1) };
+}
+
+handle_range_t IntervalAllocator::reserve(device_t d, int n) {
+	if (deviceRanges.find(d) != deviceRanges.end()) {
+		return handle_range_t { 0, 0 };
+	}
+
+	handle_range_t range = findFree(roundSize(n));
+	if (range.isNull()) {
+		return range;
+	}
+	ranges[range.start] = std::make_pair(range.end, d);
+	deviceRanges[d] = range;
+	return range;
+}
+
+/*
+ * Grow the range in place if the space after it is free, otherwise move it.
+ * Ranges are never shrunk, since the client may have cached handles.
+ */
+handle_range_t IntervalAllocator::resize(device_t d, int n) {
+	auto it = deviceRanges.find(d);
+	if (it == deviceRanges.end() || d == BEETLE_RESERVED_DEVICE) {
+		return handle_range_t { 0, 0 };
+	}
+
+	handle_range_t current = it->second;
+	n = roundSize(n);
+	if (n <= current.end - current.start + 1) {
+		return current;
+	}
+
+	auto next = ranges.upper_bound(current.start);
+	int limit = (next == ranges.end()) ? MAX_HANDLE : next->first - 1;
+	if (current.start + n - 1 <= limit) {
+		handle_range_t grown = { current.start, (uint16_t) (current.start + n - 1) };
+		ranges[grown.start].first = grown.end;
+		it->second = grown;
+		return grown;
+	}
+
+	ranges.erase(current.start);
+	handle_range_t moved = findFree(n);
+	if (moved.isNull()) {
+		ranges[current.start] = std::make_pair(current.end, d);
+		return moved;
+	}
+	ranges[moved.start] = std::make_pair(moved.end, d);
+	it->second = moved;
+	return moved;
+}
+
+handle_range_t IntervalAllocator::free(device_t d) {
+	auto it = deviceRanges.find(d);
+	if (it == deviceRanges.end() || d == BEETLE_RESERVED_DEVICE) {
+		return handle_range_t { 0, 0 };
+	}
+	handle_range_t range = it->second;
+	ranges.erase(range.start);
+	deviceRanges.erase(it);
+	return range;
+}
@@ -0,0 +1,201 @@
+/*
+ * ShmRing.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "ipc/ShmRing.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+static inline uint32_t align8(uint32_t n) {
+	return (n + 7) & ~7u;
+}
+
+ShmRing::ShmRing(void *region, uint32_t capacity_) {
+	header = (shm_ring_header_t *) region;
+	data = (uint8_t *) region + sizeof(shm_ring_header_t);
+	capacity = capacity_;
+	next = header->tail.load(std::memory_order_relaxed);
+	produced = header->head.load(std::memory_order_relaxed);
+}
+
+size_t ShmRing::regionSize(uint32_t capacity) {
+	return sizeof(shm_ring_header_t) + capacity;
+}
+
+bool ShmRing::push(const ring_record_t &record, const uint8_t *buf, bool &wake) {
+	wake = false;
+
+	uint32_t head = produced;
+	uint32_t tail = header->tail.load(std::memory_order_acquire);
+	uint32_t used = head - tail;
+	if (used > capacity) {
+		return false;
+	}
+
+	uint32_t total = align8(sizeof(ring_record_t) + record.len);
+	uint32_t pos = head & (capacity - 1);
+	uint32_t pad = (pos + total > capacity) ? capacity - pos : 0;
+	if (used + pad + total > capacity) {
+		return false;
+	}
+
+	if (pad > 0) {
+		ring_record_t padRecord = { 0 };
+		padRecord.type = RING_RECORD_PAD;
+		padRecord.len = pad - sizeof(ring_record_t);
+		memcpy(data + pos, &padRecord, sizeof(padRecord));
+		pos = 0;
+	}
+	memcpy(data + pos, &record, sizeof(record));
+	memcpy(data + pos + sizeof(record), buf, record.len);
+
+	produced = head + pad + total;
+	header->head.store(produced, std::memory_order_seq_cst);
+
+	/*
+	 * The consumer may be asleep only if it had caught up.
+	 */
+	wake = header->tail.load(std::memory_order_seq_cst) == head;
+	return true;
+}
+
+bool ShmRing::peek(ring_record_t &record, uint8_t *&buf) {
+	uint32_t tail = header->tail.load(std::memory_order_relaxed);
+	while (true) {
+		uint32_t head = header->head.load(std::memory_order_seq_cst);
+		if (head == tail) {
+			return false;
+		}
+
+		uint32_t available = head - tail;
+		uint32_t pos = tail & (capacity - 1);
+		if (available > capacity || (pos & 7) != 0 || available < sizeof(ring_record_t)) {
+			throw std::runtime_error("corrupt ring");
+		}
+
+		memcpy(&record, data + pos, sizeof(record));
+		if (record.type == RING_RECORD_PAD) {
+			if (available < capacity - pos) {
+				throw std::runtime_error("corrupt ring padding");
+			}
+			tail += capacity - pos;
+			header->tail.store(tail, std::memory_order_seq_cst);
+			continue;
+		}
+
+		uint32_t total = align8(sizeof(ring_record_t) + record.len);
+		if (total > capacity - pos || total > available) {
+			throw std::runtime_error("corrupt ring record");
+		}
+		buf = data + pos + sizeof(ring_record_t);
+		next = tail + total;
+		return true;
+	}
+}
+
+void ShmRing::pop() {
+	header->tail.store(next, std::memory_order_seq_cst);
+}
+
+uint32_t ShmRing::getTail() {
+	return header->tail.load(std::memory_order_acquire);
+}
+
+uint32_t ShmRing::getHead() {
+	return produced;
+}
+
+ShmSlotPool::ShmSlotPool(uint16_t numSlots_, uint16_t slotSize_) {
+	numSlots = numSlots_;
+	slotSize = slotSize_;
+	lastSlot = -1;
+
+	size_t len = (size_t) numSlots * slotSize;
+	fd = memfd_create("beetle-slots", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		throw std::runtime_error("could not create memfd: " + std::string(strerror(errno)));
+	}
+	if (ftruncate(fd, len) < 0) {
+		close(fd);
+		throw std::runtime_error("could not size memfd: " + std::string(strerror(errno)));
+	}
+	region = (uint8_t *) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (region == MAP_FAILED) {
+		close(fd);
+		throw std::runtime_error("could not map memfd: " + std::string(strerror(errno)));
+	}
+
+	/*
+	 * Applications may only map the slots to read them.
+	 */
+	int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+#ifdef F_SEAL_FUTURE_WRITE
+	seals |= F_SEAL_FUTURE_WRITE;
+#endif
+	fcntl(fd, F_ADD_SEALS, seals | F_SEAL_SEAL);
+
+	refs.resize(numSlots, 0);
+	lens.resize(numSlots, 0);
+	for (int i = numSlots - 1; i >= 0; i--) {
+		freeSlots.push_back(i);
+	}
+}
+
+ShmSlotPool::~ShmSlotPool() {
+	munmap(region, (size_t) numSlots * slotSize);
+	close(fd);
+}
+
+int ShmSlotPool::getFd() {
+	return fd;
+}
+
+uint16_t ShmSlotPool::getNumSlots() {
+	return numSlots;
+}
+
+uint16_t ShmSlotPool::getSlotSize() {
+	return slotSize;
+}
+
+int ShmSlotPool::publish(const uint8_t *buf, int len) {
+	if (len > slotSize) {
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> lg(m);
+	if (lastSlot >= 0 && lens[lastSlot] == len && memcmp(region + lastSlot * slotSize, buf, len) == 0) {
+		refs[lastSlot]++;
+		return lastSlot;
+	}
+	if (freeSlots.empty()) {
+		return -1;
+	}
+
+	int slot = freeSlots.back();
+	freeSlots.pop_back();
+	memcpy(region + slot * slotSize, buf, len);
+	refs[slot] = 1;
+	lens[slot] = len;
+	lastSlot = slot;
+	return slot;
+}
+
+void ShmSlotPool::release(int slot) {
+	std::lock_guard<std::mutex> lg(m);
+	if (--refs[slot] == 0) {
+		freeSlots.push_back(slot);
+		if (lastSlot == slot) {
+			lastSlot = -1;
+		}
+	}
+}
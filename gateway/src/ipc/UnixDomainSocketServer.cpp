@@ -20,10 +20,14 @@
 #include "Debug.h"
 
 static void startIPCDeviceHelper(Beetle &beetle, int clifd, struct sockaddr_un cliaddr,
-		struct ucred clicred);
+		struct ucred clicred, uint32_t ringCapacity, uint16_t ringSlots);
 
-UnixDomainSocketServer::UnixDomainSocketServer(Beetle &beetle, std::string path) :
+UnixDomainSocketServer::UnixDomainSocketServer(Beetle &beetle, std::string path, uint32_t ringCapacity_,
+		int ringSlots_) :
 		beetle(beetle) {
+	ringCapacity = ringCapacity_;
+	ringSlots = ringSlots_;
+
 	unlink(path.c_str());
 
 	serverFd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
@@ -52,7 +56,9 @@ UnixDomainSocketServer::UnixDomainSocketServer(Beetle &beetle, std::string path)
 	 * Add to sockets managed by select
 	 */
 	int fdShared = serverFd;
-	beetle.readers.add(serverFd, [&beetle, fdShared] {
+	uint32_t ringCapacityShared = ringCapacity;
+	uint16_t ringSlotsShared = ringSlots;
+	beetle.readers.add(serverFd, [&beetle, fdShared, ringCapacityShared, ringSlotsShared] {
 		struct sockaddr_un cliaddr;
 		socklen_t clilen = sizeof(cliaddr);
 
@@ -74,8 +80,8 @@ UnixDomainSocketServer::UnixDomainSocketServer(Beetle &beetle, std::string path)
 			return;
 		}
 
-		beetle.workers.schedule([&beetle, clifd, cliaddr, clicred] {
-			startIPCDeviceHelper(beetle, clifd, cliaddr, clicred);
+		beetle.workers.schedule([&beetle, clifd, cliaddr, clicred, ringCapacityShared, ringSlotsShared] {
+			startIPCDeviceHelper(beetle, clifd, cliaddr, clicred, ringCapacityShared, ringSlotsShared);
 		});
 	});
 
@@ -92,14 +98,14 @@ UnixDomainSocketServer::~UnixDomainSocketServer() {
 }
 
 static void startIPCDeviceHelper(Beetle &beetle, int clifd, struct sockaddr_un cliaddr,
-		struct ucred clicred) {
+		struct ucred clicred, uint32_t ringCapacity, uint16_t ringSlots) {
 	std::shared_ptr<VirtualDevice> device = NULL;
 	try {
 		/*
 		 * Takes over the clifd
 		 */
 		device = std::make_shared<IPCApplication>(beetle, clifd,
-				"PID-" + std::to_string(clicred.pid), cliaddr, clicred);
+				"PID-" + std::to_string(clicred.pid), cliaddr, clicred, ringCapacity, ringSlots);
 
 		boost::shared_lock<boost::shared_mutex> devicesLk;
 		beetle.addDevice(device, devicesLk);
@@ -19,6 +19,7 @@
 #include "BeetleConfig.h"
 #include "BeetleTypes.h"
 #include "CLI.h"
+#include "ConnIntervalController.h"
 #include "controller/AccessControl.h"
 #include "controller/ControllerClient.h"
 #include "controller/ControllerConnection.h"
@@ -31,21 +32,12 @@
 #include "StaticTopo.h"
 #include "scan/AutoConnect.h"
 #include "scan/Scanner.h"
+#include "ServiceIndex.h"
 #include "sync/TimedDaemon.h"
+#include "tcp/MetricsServer.h"
 #include "tcp/SSLConfig.h"
 #include "tcp/TCPDeviceServer.h"
 
-/* Global debug variables */
-bool debug;
-bool debug_scan;
-bool debug_topology;
-bool debug_discovery;
-bool debug_router;
-bool debug_socket;
-bool debug_controller;
-bool debug_performance;
-bool debug_advertise;
-
 void setDebugAll() {
 	debug = true;
 	debug_scan = true;
@@ -181,27 +173,39 @@ int main(int argc, char *argv[]) {
 	SSLConfig clientSSLConfig(
 			config.sslVerifyPeers, false, config.sslCert,
 			config.sslKey, config.sslCaCert);
+	if (!clientSSLConfig.setKtls(config.sslKtls)) {
+		std::cout << "warning: openssl built without kernel tls" << std::endl;
+	}
 	TCPServerProxy::initSSL(&clientSSLConfig);
 	signal(SIGPIPE, sigpipe_handler_ignore);
 
 	try {
 		Beetle beetle(config.name, config.dev);
+		beetle.setServiceIndex(std::make_shared<ServiceIndex>(beetle));
 
 		/* Listen for remote connections */
 		std::unique_ptr<TCPDeviceServer> tcpServer;
 		if (config.tcpEnabled || enableTcp) {
 			std::cout << "using certificate: " << config.sslCert << std::endl;
 			std::cout << "using key: " << config.sslKey << std::endl;
-			tcpServer = std::make_unique<TCPDeviceServer>(beetle,
-					new SSLConfig(verifyCerts && config.sslVerifyPeers, true, config.sslCert,
-							config.sslKey, config.sslCaCert),
-					config.tcpPort);
+			SSLConfig *serverSSLConfig = new SSLConfig(verifyCerts && config.sslVerifyPeers, true,
+					config.sslCert, config.sslKey, config.sslCaCert);
+			serverSSLConfig->setKtls(config.sslKtls);
+			tcpServer = std::make_unique<TCPDeviceServer>(beetle, serverSSLConfig, config.tcpPort,
+					config.tcpBacklog, config.tcpMaxHandshakes, config.tcpHandshakeTimeout);
 		}
 
 		/* Listen for local applications */
 		std::unique_ptr<UnixDomainSocketServer> ipcServer;
 		if (config.ipcEnabled || enableIpc) {
-			ipcServer.reset(new UnixDomainSocketServer(beetle, config.ipcPath));
+			ipcServer.reset(new UnixDomainSocketServer(beetle, config.ipcPath, config.ipcRingSize,
+					config.ipcRingSlots));
+		}
+
+		/* Export metrics to local scrapers */
+		std::unique_ptr<MetricsServer> metricsServer;
+		if (config.metricsPort != 0 || config.metricsPath != "") {
+			metricsServer = std::make_unique<MetricsServer>(beetle, config.metricsPort, config.metricsPath);
 		}
 
 		/* Listen for ble centrals */
@@ -220,30 +224,33 @@ int main(int argc, char *argv[]) {
 		std::shared_ptr<NetworkDiscoveryClient> networkDiscovery;
 		std::shared_ptr<ControllerConnection> controllerConnection;
 		if (config.controllerEnabled || enableController) {
-			controllerClient = std::make_shared<ControllerClient>(beetle, config.controllerHost,
-					config.controllerApiPort, config.controllerControlPort,
-					verifyCerts && config.sslVerifyPeers, config.sslCert, config.sslKey,
-					config.sslCaCert);
+			controllerClient = std::make_shared<ControllerClient>(beetle, config,
+					verifyCerts && config.sslVerifyPeers);
 
 			/*
 			 * Informs controller of gateway events. Also, adds session token to controller client.
 			 */
-			networkState = std::make_shared<NetworkStateClient>(beetle, controllerClient, config.tcpPort);
+			networkState = std::make_shared<NetworkStateClient>(beetle, controllerClient, config);
 			beetle.registerAddDeviceHandler(networkState->getAddDeviceHandler());
-			beetle.registerRemoveDeviceHandler(networkState->getRemoveDeviceHandler());
 			beetle.registerUpdateDeviceHandler(networkState->getUpdateDeviceHandler());
+			beetle.registerRemoveDeviceHandler(networkState->getRemoveDeviceHandler());
 			beetle.registerMapDevicesHandler(networkState->getMapDevicesHandler());
 			beetle.registerUnmapDevicesHandler(networkState->getUnmapDevicesHandler());
 
-			networkDiscovery = std::make_shared<NetworkDiscoveryClient>(beetle, controllerClient);
+			networkDiscovery = std::make_shared<NetworkDiscoveryClient>(beetle, controllerClient, config);
 			beetle.setDiscoveryClient(networkDiscovery);
 
-			accessControl = std::make_shared<AccessControl>(beetle, controllerClient);
+			accessControl = std::make_shared<AccessControl>(beetle, controllerClient, config);
 			beetle.setAccessControl(accessControl);
 
+			/*
+			 * Access decisions depend on the services reported to the controller.
+			 */
+			networkState->setDeviceReportedHandler(accessControl->getUpdateDeviceHandler());
+
 			if (config.controllerControlEnabled) {
 				controllerConnection = std::make_shared<ControllerConnection>(beetle, controllerClient,
-						config.controllerControlMaxReconnect);
+						config.controllerControlMaxReconnect, config.controllerCommandWorkers);
 			}
 		}
 
@@ -254,6 +261,13 @@ int main(int argc, char *argv[]) {
 			beetle.registerUpdateDeviceHandler(staticTopo->getUpdateDeviceHandler());
 		}
 
+		/* Adapt LE connection intervals to traffic */
+		std::unique_ptr<ConnIntervalController> connIntervalController;
+		if (config.connIntervalEnabled) {
+			connIntervalController = std::make_unique<ConnIntervalController>(beetle, config);
+			beetle.registerRemoveDeviceHandler(connIntervalController->getRemoveDeviceHandler());
+		}
+
 		/* Make a CLI if remote control is disabled */
 		std::unique_ptr<CLI> cli;
 		if (config.cliEnabled) {
@@ -284,6 +298,15 @@ int main(int argc, char *argv[]) {
 		if (autoConnect) {
 			timers.repeat(autoConnect->getDaemon(), 5);
 		}
+		if (connIntervalController) {
+			timers.repeat(connIntervalController->getDaemon(), config.connIntervalPeriod);
+		}
+		if (controllerClient) {
+			timers.repeat(controllerClient->getDaemon(), 60);
+		}
+		if (tcpServer) {
+			timers.repeat(tcpServer->getDaemon(), 1);
+		}
 
 		/* Block on exit */
 		if (cli) {
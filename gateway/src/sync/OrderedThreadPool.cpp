@@ -43,6 +43,11 @@ void OrderedThreadPool::schedule(long id, std::function<void()> task) {
 	}
 }
 
+size_t OrderedThreadPool::size() {
+	std::lock_guard<std::mutex> lg(m);
+	return queue.size();
+}
+
 void OrderedThreadPool::workerDaemon() {
 	while (running) {
 		s.wait();
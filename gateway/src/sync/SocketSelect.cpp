@@ -16,6 +16,7 @@
 #include <utility>
 
 #include "Debug.h"
+#include "Trace.h"
 
 SocketSelect::SocketSelect(unsigned int n) : daemonThread() {
 	FD_ZERO(&activeFds);
@@ -81,12 +82,14 @@ void SocketSelect::daemon() {
 			int fd = kv.first;
 			if (FD_ISSET(fd, &readFds) || FD_ISSET(fd, &exceptFds)) {
 				auto cb = kv.second;
+				uint64_t ready = tracing() ? traceNow() : 0;
 
 				if (workers) {
 					fdsInUseMutex->lock();
 					if (fdsInUse->find(fd) == fdsInUse->end()) {
 						fdsInUse->insert(fd);
-						workers->schedule([this, fd, cb, fdsInUse, fdsInUseMutex]{
+						workers->schedule([this, fd, cb, fdsInUse, fdsInUseMutex, ready]{
+							trace_ready = ready;
 							try {
 								cb();
 							} catch (std::exception &e) {
@@ -99,6 +102,7 @@ void SocketSelect::daemon() {
 					}
 					fdsInUseMutex->unlock();
 				} else {
+					trace_ready = ready;
 					try {
 						cb();
 					} catch (std::exception &e) {
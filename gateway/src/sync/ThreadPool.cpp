@@ -38,6 +38,10 @@ void ThreadPool::schedule(std::function<void()> task) {
 	queue.push(task);
 }
 
+size_t ThreadPool::size() {
+	return queue.size();
+}
+
 void ThreadPool::workerDaemon() {
 	while (running) {
 		try {
@@ -0,0 +1,749 @@
+/*
+ * GatewaySession.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "tcp/GatewaySession.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <utility>
+#include <openssl/ssl.h>
+
+#include "Beetle.h"
+#include "Debug.h"
+#include "sync/OrderedThreadPool.h"
+#include "sync/SocketSelect.h"
+#include "sync/ThreadPool.h"
+#include "tcp/TCPFraming.h"
+#include "util/file.h"
+#include "util/write.h"
+
+/*
+ * Control messages on channel 0:
+ *
+ *   uint8_t	type
+ *   varint		channel
+ *   varint		value (device id for OPEN, number of PDUs for CREDIT)
+ *				reason, for OPEN_FAIL
+ */
+enum {
+	CONTROL_OPEN = 1,
+	CONTROL_OPEN_OK = 2,
+	CONTROL_OPEN_FAIL = 3,
+	CONTROL_CLOSE = 4,
+	CONTROL_CREDIT = 5,
+};
+
+static std::atomic<long> sessionCount(0);
+
+GatewaySession::GatewaySession(Beetle &beetle, SSL *ssl_, int sockfd_, std::string remoteGateway_,
+		struct sockaddr_in sockaddr_) :
+		beetle(beetle), deliverers(NUM_DELIVERY_THREADS) {
+	ssl = ssl_;
+	sockfd = sockfd_;
+	remoteGateway = remoteGateway_;
+	sockaddr = sockaddr_;
+	stopped = false;
+	nextChannel = 1;
+	flushScheduled = false;
+	traffic = &beetle.metrics.transport("session");
+
+	/*
+	 * Write ordering ids counting down, to stay clear of device ids.
+	 */
+	writerId = std::numeric_limits<long>::max() - sessionCount++;
+}
+
+GatewaySession::~GatewaySession() {
+	stopped = true;
+
+	beetle.readers.remove(sockfd);
+
+	if (debug_socket) {
+		pdebug("shutting down session with " + remoteGateway);
+	}
+
+	SSL_shutdown(ssl);
+	shutdown(sockfd, SHUT_RDWR);
+	SSL_free(ssl);
+	close(sockfd);
+}
+
+void GatewaySession::start() {
+	if (!fd_set_blocking(sockfd, false)) {
+		throw SessionException("could not make socket nonblocking");
+	}
+
+	std::weak_ptr<GatewaySession> weak = shared_from_this();
+	Beetle &beetle_ = beetle;
+	beetle.readers.add(sockfd, [weak, &beetle_] {
+		auto session = weak.lock();
+		if (!session) {
+			return;
+		}
+		session->readHandler();
+
+		/*
+		 * Do not destroy the session on the reader, which removes it from
+		 * the readers.
+		 */
+		if (session.use_count() == 1) {
+			beetle_.workers.schedule([session] {});
+		}
+	});
+}
+
+void GatewaySession::stop() {
+	if (stopped.exchange(true)) {
+		return;
+	}
+
+	if (debug) {
+		pdebug("stopping session with " + remoteGateway);
+	}
+
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		sendStates.clear();
+	}
+
+	/*
+	 * Deliveries check stopped, so none start after those in progress finish.
+	 * Channels stay claimed by this thread while their close handlers run.
+	 */
+	std::vector<std::function<void()>> closeHandlers;
+	{
+		std::unique_lock<std::mutex> lk(channelsMutex);
+		std::thread::id self = std::this_thread::get_id();
+		deliveredCv.wait(lk, [this, self] {
+			for (auto &kv : channels) {
+				if (kv.second.deliverer != std::thread::id() && kv.second.deliverer != self) {
+					return false;
+				}
+			}
+			return true;
+		});
+		for (auto &kv : channels) {
+			kv.second.deliverer = self;
+			if (kv.second.closeHandler) {
+				closeHandlers.push_back(kv.second.closeHandler);
+			}
+		}
+	}
+	for (auto &h : closeHandlers) {
+		try {
+			h();
+		} catch (std::exception &e) {
+			pexcept(e);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		channels.clear();
+		openCv.notify_all();
+		deliveredCv.notify_all();
+	}
+
+	/*
+	 * Let the peer know, the socket is closed when the session is destroyed.
+	 */
+	shutdown(sockfd, SHUT_RDWR);
+
+	std::lock_guard<std::mutex> lg(stopHandlerMutex);
+	if (stopHandler) {
+		stopHandler();
+	}
+}
+
+bool GatewaySession::isStopped() {
+	return stopped;
+}
+
+std::string GatewaySession::getRemoteGateway() {
+	return remoteGateway;
+}
+
+struct sockaddr_in GatewaySession::getSockaddr() {
+	return sockaddr;
+}
+
+void GatewaySession::setOpenHandler(OpenHandler handler) {
+	openHandler = handler;
+}
+
+void GatewaySession::setStopHandler(std::function<void()> handler) {
+	std::lock_guard<std::mutex> lg(stopHandlerMutex);
+	stopHandler = handler;
+}
+
+void GatewaySession::addChannel(uint32_t channel, ChannelState state) {
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		struct channel c;
+		c.state = state;
+		c.draining = false;
+		c.consumed = 0;
+		channels[channel] = c;
+	}
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		sendStates[channel].credits = INITIAL_CREDITS;
+	}
+}
+
+uint32_t GatewaySession::open(device_t device, double timeout) {
+	if (device < 0 || device > UINT32_MAX) {
+		throw SessionException("device id out of range: " + std::to_string(device));
+	}
+
+	uint32_t ch;
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		ch = nextChannel++;
+	}
+	addChannel(ch, OPENING);
+	sendControl(CONTROL_OPEN, ch, device);
+
+	auto deadline = std::chrono::steady_clock::now()
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(timeout));
+
+	std::unique_lock<std::mutex> lk(channelsMutex);
+	openCv.wait_until(lk, deadline, [this, ch] {
+		auto it = channels.find(ch);
+		return it == channels.end() || it->second.state != OPENING;
+	});
+
+	auto it = channels.find(ch);
+	if (it != channels.end() && it->second.state == OPEN) {
+		return ch;
+	}
+
+	std::string err;
+	bool timedOut = false;
+	if (it == channels.end()) {
+		err = "session with " + remoteGateway + " stopped";
+	} else if (it->second.state == FAILED) {
+		err = "could not open channel to " + std::to_string(device) + ": " + it->second.error;
+		channels.erase(it);
+	} else {
+		err = "timed out opening channel to " + std::to_string(device);
+		channels.erase(it);
+		timedOut = true;
+	}
+	lk.unlock();
+
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		sendStates.erase(ch);
+	}
+	if (timedOut) {
+		sendControl(CONTROL_CLOSE, ch, 0);
+	}
+	throw SessionException(err);
+}
+
+void GatewaySession::acceptOpen(uint32_t channel) {
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		if (channels.find(channel) == channels.end()) {
+			return;
+		}
+	}
+	sendControl(CONTROL_OPEN_OK, channel, 0);
+}
+
+void GatewaySession::rejectOpen(uint32_t channel, std::string reason) {
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		channels.erase(channel);
+	}
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		sendStates.erase(channel);
+	}
+	sendControl(CONTROL_OPEN_FAIL, channel, 0, reason);
+}
+
+void GatewaySession::attach(uint32_t channel, std::function<void(uint8_t *, int)> dataHandler,
+		std::function<void()> closeHandler) {
+	std::lock_guard<std::mutex> lg(channelsMutex);
+	auto it = channels.find(channel);
+	if (it == channels.end() || it->second.state == FAILED || it->second.state == CLOSED) {
+		throw SessionException("channel " + std::to_string(channel) + " to " + remoteGateway + " is closed");
+	}
+
+	struct channel &c = it->second;
+	c.state = OPEN;
+	c.dataHandler = dataHandler;
+	c.closeHandler = closeHandler;
+
+	if (!c.pending.empty() && !c.draining) {
+		c.draining = true;
+		scheduleOnChannel(channel, &GatewaySession::drainPending);
+	}
+}
+
+void GatewaySession::detach(uint32_t channel) {
+	/*
+	 * A channel still opening is answered by acceptOpen() or rejectOpen().
+	 */
+	bool wasOpen = false;
+	{
+		std::unique_lock<std::mutex> lk(channelsMutex);
+		auto it = waitForHandlers(lk, channel);
+		if (it != channels.end()) {
+			wasOpen = it->second.state == OPEN;
+			channels.erase(it);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		sendStates.erase(channel);
+	}
+	if (wasOpen) {
+		sendControl(CONTROL_CLOSE, channel, 0);
+	}
+}
+
+bool GatewaySession::send(uint32_t channel, uint8_t *buf, int len) {
+	if (stopped || len <= 0 || (size_t) len > MAX_FRAME_LEN - VARINT_MAX_LEN) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lg(writeMutex);
+	auto it = sendStates.find(channel);
+	if (it == sendStates.end()) {
+		return false;
+	}
+
+	send_state &s = it->second;
+	if (s.credits > 0 && s.backlog.empty()) {
+		s.credits--;
+		appendFrame(channel, buf, len);
+		scheduleFlush();
+	} else if (s.backlog.size() < MAX_BACKLOG) {
+		s.backlog.emplace_back(buf, buf + len);
+	} else {
+		if (debug_socket) {
+			pwarn("backlog full on channel " + std::to_string(channel) + " to " + remoteGateway);
+		}
+		return false;
+	}
+	return true;
+}
+
+void GatewaySession::sendControl(uint8_t type, uint32_t channel, uint32_t value, const std::string &reason) {
+	uint8_t buf[1 + 2 * VARINT_MAX_LEN];
+	size_t len = 0;
+	buf[len++] = type;
+	len += encodeVarint(channel, buf + len);
+	len += encodeVarint(value, buf + len);
+
+	std::vector<uint8_t> payload(buf, buf + len);
+	payload.insert(payload.end(), reason.begin(), reason.end());
+
+	std::lock_guard<std::mutex> lg(writeMutex);
+	if (stopped) {
+		return;
+	}
+	appendFrame(0, payload.data(), payload.size());
+	scheduleFlush();
+}
+
+void GatewaySession::appendFrame(uint32_t channel, const uint8_t *buf, size_t len) {
+	uint8_t channelBuf[VARINT_MAX_LEN];
+	size_t channelLen = encodeVarint(channel, channelBuf);
+
+	uint8_t lenBuf[VARINT_MAX_LEN];
+	size_t lenLen = encodeVarint(channelLen + len, lenBuf);
+
+	writeBuffer.insert(writeBuffer.end(), lenBuf, lenBuf + lenLen);
+	writeBuffer.insert(writeBuffer.end(), channelBuf, channelBuf + channelLen);
+	writeBuffer.insert(writeBuffer.end(), buf, buf + len);
+	traffic->packetsOut->add();
+}
+
+void GatewaySession::scheduleFlush() {
+	if (flushScheduled) {
+		return;
+	}
+	flushScheduled = true;
+	auto self = shared_from_this();
+	beetle.writers.schedule(writerId, [self] {
+		self->flush();
+	});
+}
+
+void GatewaySession::flush() {
+	std::vector<uint8_t> out;
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		out.swap(writeBuffer);
+		flushScheduled = false;
+	}
+
+	if (stopped || out.empty()) {
+		return;
+	}
+
+	if (SSL_write_all(ssl, out.data(), out.size()) != (int) out.size()) {
+		if (debug_socket) {
+			std::stringstream ss;
+			ss << "session write failed : " << strerror(errno);
+			pdebug(ss.str());
+		}
+		stop();
+	} else {
+		traffic->bytesOut->add(out.size());
+		if (debug_socket) {
+			pdebug("wrote " + std::to_string(out.size()) + " bytes to session with " + remoteGateway);
+		}
+	}
+}
+
+void GatewaySession::readHandler() {
+	if (stopped) {
+		return;
+	}
+
+	uint8_t buf[16384];
+	for (int i = 0; !stopped; i++) {
+		/*
+		 * Records already decrypted by openssl do not wake up select.
+		 */
+		if (i >= MAX_READS_PER_WAKEUP && SSL_pending(ssl) <= 0) {
+			return;
+		}
+
+		int n = SSL_read(ssl, buf, sizeof(buf));
+		if (n <= 0) {
+			int err = SSL_get_error(ssl, n);
+			if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+				return;
+			}
+			if (debug_socket) {
+				std::stringstream ss;
+				ss << "session read failed : " << strerror(errno);
+				pdebug(ss.str());
+			}
+			stop();
+			return;
+		}
+		traffic->bytesIn->add(n);
+		readBuffer.insert(readBuffer.end(), buf, buf + n);
+		handleFrames();
+	}
+}
+
+void GatewaySession::handleFrames() {
+	size_t offset = 0;
+	try {
+		while (!stopped && offset < readBuffer.size()) {
+			uint32_t len;
+			size_t n = decodeVarint(readBuffer.data() + offset, readBuffer.size() - offset, len);
+			if (n == 0) {
+				break;
+			}
+			if (len > MAX_FRAME_LEN) {
+				throw SessionException("frame too long: " + std::to_string(len));
+			}
+			if (readBuffer.size() - offset - n < len) {
+				break;
+			}
+			handleFrame(readBuffer.data() + offset + n, len);
+			traffic->packetsIn->add();
+			offset += n + len;
+		}
+	} catch (std::exception &e) {
+		if (debug_socket) {
+			pexcept(e);
+		}
+		stop();
+		return;
+	}
+	readBuffer.erase(readBuffer.begin(), readBuffer.begin() + offset);
+}
+
+void GatewaySession::handleFrame(uint8_t *buf, size_t len) {
+	uint32_t channel;
+	size_t n = decodeVarint(buf, len, channel);
+	if (n == 0) {
+		throw SessionException("truncated frame");
+	}
+	if (channel == 0) {
+		handleControl(buf + n, len - n);
+	} else if (len > n) {
+		deliver(channel, buf + n, len - n);
+	} else {
+		throw SessionException("empty pdu on channel " + std::to_string(channel));
+	}
+}
+
+void GatewaySession::handleControl(uint8_t *buf, size_t len) {
+	if (len < 1) {
+		throw SessionException("empty control message");
+	}
+	uint8_t type = buf[0];
+	size_t offset = 1;
+
+	uint32_t channel;
+	size_t n = decodeVarint(buf + offset, len - offset, channel);
+	if (n == 0) {
+		throw SessionException("truncated control message");
+	}
+	offset += n;
+
+	uint32_t value;
+	n = decodeVarint(buf + offset, len - offset, value);
+	if (n == 0) {
+		throw SessionException("truncated control message");
+	}
+	offset += n;
+
+	if (debug_socket) {
+		std::stringstream ss;
+		ss << "session control " << (int) type << " on channel " << channel << " (" << value << ") from "
+				<< remoteGateway;
+		pdebug(ss.str());
+	}
+
+	switch (type) {
+	case CONTROL_OPEN: {
+		bool inUse;
+		{
+			std::lock_guard<std::mutex> lg(channelsMutex);
+			inUse = channels.find(channel) != channels.end();
+		}
+		if (inUse || channel == 0 || !openHandler) {
+			sendControl(CONTROL_OPEN_FAIL, channel, 0, inUse ? "channel in use" : "not accepting channels");
+		} else {
+			addChannel(channel, OPENING);
+			openHandler(channel, value);
+		}
+		break;
+	}
+	case CONTROL_OPEN_OK:
+	case CONTROL_OPEN_FAIL: {
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		auto it = channels.find(channel);
+		if (it != channels.end() && it->second.state == OPENING) {
+			if (type == CONTROL_OPEN_OK) {
+				it->second.state = OPEN;
+			} else {
+				it->second.state = FAILED;
+				it->second.error = std::string((char *) buf + offset, len - offset);
+			}
+			openCv.notify_all();
+		}
+		break;
+	}
+	case CONTROL_CLOSE:
+		closeChannel(channel);
+		break;
+	case CONTROL_CREDIT: {
+		std::lock_guard<std::mutex> lg(writeMutex);
+		auto it = sendStates.find(channel);
+		if (it == sendStates.end()) {
+			break;
+		}
+		send_state &s = it->second;
+		s.credits = (int) std::min((long long) s.credits + value, (long long) INT_MAX);
+		bool appended = false;
+		while (s.credits > 0 && !s.backlog.empty()) {
+			appendFrame(channel, s.backlog.front().data(), s.backlog.front().size());
+			s.backlog.pop_front();
+			s.credits--;
+			appended = true;
+		}
+		if (appended) {
+			scheduleFlush();
+		}
+		break;
+	}
+	default:
+		if (debug_socket) {
+			pdebug("unknown session control " + std::to_string(type));
+		}
+		break;
+	}
+}
+
+void GatewaySession::closeChannel(uint32_t channel) {
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		auto it = channels.find(channel);
+		if (it == channels.end() || it->second.state == CLOSED) {
+			return;
+		}
+		if (it->second.state == OPENING) {
+			/*
+			 * Fail the open, whoever is waiting on it cleans up.
+			 */
+			it->second.state = FAILED;
+			it->second.error = "closed by peer";
+			openCv.notify_all();
+		} else {
+			/*
+			 * Close after the PDUs before it are delivered.
+			 */
+			it->second.state = CLOSED;
+			scheduleOnChannel(channel, &GatewaySession::finishClose);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lg(writeMutex);
+		sendStates.erase(channel);
+	}
+}
+
+void GatewaySession::deliver(uint32_t channel, uint8_t *buf, size_t len) {
+	std::lock_guard<std::mutex> lg(channelsMutex);
+	auto it = channels.find(channel);
+	if (it == channels.end() || it->second.state == CLOSED) {
+		if (debug_socket) {
+			pdebug("dropping pdu on closed channel " + std::to_string(channel));
+		}
+		return;
+	}
+
+	/*
+	 * Credits are returned after handling, so a peer within its credits never
+	 * has more than INITIAL_CREDITS waiting.
+	 */
+	struct channel &c = it->second;
+	if (c.pending.size() >= (size_t) INITIAL_CREDITS) {
+		throw SessionException("peer exceeded credits on channel " + std::to_string(channel));
+	}
+	c.pending.emplace_back(buf, buf + len);
+
+	/*
+	 * Hold PDUs until attached.
+	 */
+	if (c.dataHandler && !c.draining) {
+		c.draining = true;
+		scheduleOnChannel(channel, &GatewaySession::drainPending);
+	}
+}
+
+std::map<uint32_t, GatewaySession::channel>::iterator GatewaySession::waitForHandlers(
+		std::unique_lock<std::mutex> &lk, uint32_t channel) {
+	/*
+	 * Handlers may close their own channel.
+	 */
+	std::thread::id self = std::this_thread::get_id();
+	deliveredCv.wait(lk, [this, channel, self] {
+		auto it = channels.find(channel);
+		return it == channels.end() || it->second.deliverer == std::thread::id() || it->second.deliverer == self;
+	});
+	return channels.find(channel);
+}
+
+void GatewaySession::scheduleOnChannel(uint32_t channel, void (GatewaySession::*task)(uint32_t)) {
+	std::weak_ptr<GatewaySession> weak = shared_from_this();
+	deliverers.schedule(channel, [weak, channel, task] {
+		auto session = weak.lock();
+		if (!session) {
+			return;
+		}
+		((*session).*task)(channel);
+
+		/*
+		 * Do not destroy the session on its own delivery threads.
+		 */
+		if (session.use_count() == 1) {
+			session->beetle.workers.schedule([session] {});
+		}
+	});
+}
+
+void GatewaySession::drainPending(uint32_t channel) {
+	while (true) {
+		std::vector<uint8_t> pdu;
+		std::function<void(uint8_t *, int)> dataHandler;
+		{
+			std::unique_lock<std::mutex> lk(channelsMutex);
+			auto it = waitForHandlers(lk, channel);
+			if (it == channels.end()) {
+				return;
+			}
+			struct channel &c = it->second;
+			if (stopped || !c.dataHandler || c.pending.empty()) {
+				c.draining = false;
+				return;
+			}
+			pdu.swap(c.pending.front());
+			c.pending.pop_front();
+			dataHandler = c.dataHandler;
+			c.deliverer = std::this_thread::get_id();
+		}
+
+		try {
+			dataHandler(pdu.data(), pdu.size());
+		} catch (std::exception &e) {
+			pexcept(e);
+		}
+
+		{
+			std::lock_guard<std::mutex> lg(channelsMutex);
+			auto it = channels.find(channel);
+			if (it != channels.end()) {
+				it->second.deliverer = std::thread::id();
+			}
+			deliveredCv.notify_all();
+		}
+		consumed(channel);
+	}
+}
+
+void GatewaySession::finishClose(uint32_t channel) {
+	std::function<void()> closeHandler;
+	{
+		std::unique_lock<std::mutex> lk(channelsMutex);
+		auto it = waitForHandlers(lk, channel);
+		if (it == channels.end() || stopped) {
+			return;
+		}
+		closeHandler = it->second.closeHandler;
+		it->second.deliverer = std::this_thread::get_id();
+	}
+
+	if (closeHandler) {
+		try {
+			closeHandler();
+		} catch (std::exception &e) {
+			pexcept(e);
+		}
+	}
+
+	std::lock_guard<std::mutex> lg(channelsMutex);
+	channels.erase(channel);
+	deliveredCv.notify_all();
+}
+
+void GatewaySession::consumed(uint32_t channel) {
+	uint32_t credits = 0;
+	{
+		std::lock_guard<std::mutex> lg(channelsMutex);
+		auto it = channels.find(channel);
+		if (it == channels.end() || it->second.state == CLOSED) {
+			return;
+		}
+		if (++it->second.consumed >= INITIAL_CREDITS / 2) {
+			credits = it->second.consumed;
+			it->second.consumed = 0;
+		}
+	}
+	if (credits > 0) {
+		sendControl(CONTROL_CREDIT, channel, credits);
+	}
+}
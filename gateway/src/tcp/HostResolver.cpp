@@ -0,0 +1,83 @@
+/*
+ * HostResolver.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "tcp/HostResolver.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <cstring>
+
+#include "Debug.h"
+
+std::map<std::string, HostResolver::entry> HostResolver::cache;
+std::mutex HostResolver::cacheMutex;
+std::condition_variable HostResolver::cacheCv;
+
+bool HostResolver::resolve(std::string host, struct in_addr &addr) {
+	if (inet_pton(AF_INET, host.c_str(), &addr) == 1) {
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lk(cacheMutex);
+	while (true) {
+		auto it = cache.find(host);
+		if (it == cache.end()) {
+			break;
+		} else if (it->second.resolving) {
+			cacheCv.wait(lk);
+		} else if (difftime(it->second.expires, time(NULL)) > 0) {
+			addr = it->second.addr;
+			return it->second.found;
+		} else {
+			break;
+		}
+	}
+	cache[host].resolving = true;
+	lk.unlock();
+
+	/*
+	 * getaddrinfo is thread safe, unlike gethostbyname.
+	 */
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *result = NULL;
+	int err = getaddrinfo(host.c_str(), NULL, &hints, &result);
+
+	entry resolved;
+	resolved.resolving = false;
+	resolved.found = (err == 0 && result != NULL);
+	if (resolved.found) {
+		resolved.addr = ((struct sockaddr_in *) result->ai_addr)->sin_addr;
+		resolved.expires = time(NULL) + CACHE_TTL;
+	} else {
+		memset(&resolved.addr, 0, sizeof(resolved.addr));
+		resolved.expires = time(NULL) + NEGATIVE_TTL;
+		if (debug_socket) {
+			pdebug("could not resolve " + host + " : " + gai_strerror(err));
+		}
+	}
+	if (result) {
+		freeaddrinfo(result);
+	}
+
+	lk.lock();
+	cache[host] = resolved;
+	cacheCv.notify_all();
+	addr = resolved.addr;
+	return resolved.found;
+}
+
+void HostResolver::invalidate(std::string host) {
+	std::lock_guard<std::mutex> lg(cacheMutex);
+	auto it = cache.find(host);
+	if (it != cache.end() && !it->second.resolving) {
+		cache.erase(it);
+	}
+}
@@ -0,0 +1,187 @@
+/*
+ * MetricsServer.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "tcp/MetricsServer.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "Beetle.h"
+#include "Debug.h"
+#include "Metrics.h"
+#include "tcp/TCPDeviceServer.h"
+#include "util/file.h"
+#include "util/write.h"
+
+MetricsServer::MetricsServer(Beetle &beetle, int port, std::string path_) :
+		beetle(beetle), servers(NUM_SERVER_THREADS) {
+	tcpFd = -1;
+	unixFd = -1;
+	path = path_;
+
+	if (port != 0) {
+		tcpFd = socket(AF_INET, SOCK_STREAM, 0);
+		if (tcpFd < 0) {
+			throw ServerException("error creating metrics socket");
+		}
+
+		int unused = 1;
+		if (setsockopt(tcpFd, SOL_SOCKET, SO_REUSEADDR, &unused, sizeof(int)) < 0) {
+			close(tcpFd);
+			throw ServerException("error setting metrics socket to reuse");
+		}
+
+		struct sockaddr_in addr = { 0 };
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(port);
+		if (bind(tcpFd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+			close(tcpFd);
+			throw ServerException("error on metrics bind");
+		}
+		startListening(tcpFd);
+		std::cout << "metrics server started on port: " << port << std::endl;
+	}
+
+	if (path != "") {
+		/* The destructor will not run, so do not leave the tcp listener behind */
+		try {
+			unlink(path.c_str());
+
+			unixFd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (unixFd < 0) {
+				throw ServerException("error creating metrics socket");
+			}
+
+			struct sockaddr_un addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+			if (bind(unixFd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+				close(unixFd);
+				throw ServerException("error on metrics bind");
+			}
+			startListening(unixFd);
+		} catch (ServerException &e) {
+			if (tcpFd >= 0) {
+				stopListening(tcpFd);
+			}
+			throw;
+		}
+		std::cout << "metrics server started at path: " << path << std::endl;
+	}
+}
+
+MetricsServer::~MetricsServer() {
+	for (int fd : { tcpFd, unixFd }) {
+		if (fd >= 0) {
+			stopListening(fd);
+		}
+	}
+	if (unixFd >= 0) {
+		unlink(path.c_str());
+	}
+	if (debug) {
+		pdebug("metrics server stopped");
+	}
+}
+
+void MetricsServer::startListening(int fd) {
+	if (listen(fd, 16) < 0) {
+		close(fd);
+		throw ServerException("error on metrics listen");
+	}
+	if (!fd_set_blocking(fd, false)) {
+		close(fd);
+		throw ServerException("error setting metrics socket to nonblocking");
+	}
+	beetle.readers.add(fd, [this, fd] {
+		acceptClient(fd);
+	});
+}
+
+void MetricsServer::stopListening(int fd) {
+	beetle.readers.remove(fd);
+	shutdown(fd, SHUT_RDWR);
+	close(fd);
+}
+
+void MetricsServer::acceptClient(int fd) {
+	int clifd = accept(fd, NULL, NULL);
+	if (clifd < 0) {
+		if (debug && errno != EAGAIN && errno != EWOULDBLOCK) {
+			pwarn("error on metrics accept");
+		}
+		return;
+	}
+
+	servers.schedule([this, clifd] {
+		handleClient(clifd);
+		close(clifd);
+	});
+}
+
+void MetricsServer::handleClient(int clifd) {
+	if (!fd_set_blocking(clifd, true)) {
+		return;
+	}
+	struct timeval timeout = { CLIENT_TIMEOUT, 0 };
+	setsockopt(clifd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(clifd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	/*
+	 * Only the request line matters. The rest of the headers are read, so
+	 * that closing does not reset the connection before the response.
+	 */
+	std::string request;
+	char buf[512];
+	while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+		if (request.size() > MAX_REQUEST_LEN) {
+			return;
+		}
+		int n = read(clifd, buf, sizeof(buf));
+		if (n <= 0) {
+			return;
+		}
+		request.append(buf, n);
+	}
+
+	std::string method;
+	std::string target;
+	std::stringstream(request.substr(0, request.find('\n'))) >> method >> target;
+
+	std::string status;
+	std::string body;
+	if (method != "GET" && method != "HEAD") {
+		status = "405 Method Not Allowed";
+	} else if (target != "/metrics" && target != "/") {
+		status = "404 Not Found";
+	} else {
+		status = "200 OK";
+		body = beetle.metrics.prometheus();
+	}
+
+	std::stringstream ss;
+	ss << "HTTP/1.0 " << status << "\r\n";
+	ss << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+	ss << "Content-Length: " << body.size() << "\r\n";
+	ss << "Connection: close\r\n\r\n";
+	if (method != "HEAD") {
+		ss << body;
+	}
+	std::string response = ss.str();
+	if (send_all(clifd, (uint8_t *) response.data(), response.size()) < 0 && debug) {
+		pwarn("error writing metrics response");
+	}
+}
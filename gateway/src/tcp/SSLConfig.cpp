@@ -7,13 +7,23 @@
 
 #include "tcp/SSLConfig.h"
 
+#include <openssl/bio.h>
 #include <openssl/ssl.h>
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <unistd.h>
 #include <cassert>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 
@@ -22,24 +32,124 @@
 
 bool SSLConfig::initialized = false;
 std::mutex SSLConfig::initMutex;
+int SSLConfig::ctxIndex = -1;
 
-SSLConfig::SSLConfig(bool verifyPeers, bool isServer, std::string cert, std::string key,
+std::set<SSLConfig *> SSLConfig::instances;
+std::mutex SSLConfig::instancesMutex;
+
+/*
+ * Encrypts and decrypts session tickets with the server's rotating keys.
+ */
+struct TicketKeyCallback {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	typedef EVP_MAC_CTX hmac_ctx_t;
+
+	static int initHmac(EVP_MAC_CTX *hctx, uint8_t *key) {
+		OSSL_PARAM params[2];
+		params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0);
+		params[1] = OSSL_PARAM_construct_end();
+		return EVP_MAC_init(hctx, key, 32, params);
+	}
+#else
+	typedef HMAC_CTX hmac_ctx_t;
+
+	static int initHmac(HMAC_CTX *hctx, uint8_t *key) {
+		return HMAC_Init_ex(hctx, key, 32, EVP_sha256(), NULL);
+	}
+#endif
+
+	/*
+	 * Returns 1 after encrypting, 2 after decrypting to renew the ticket, 0 if
+	 * the key is unknown and -1 on error. Clients use TLS 1.3 tickets once,
+	 * so every resumption is given a new one.
+	 */
+	static int callback(SSL *ssl, unsigned char *keyName, unsigned char *iv, EVP_CIPHER_CTX *cctx,
+			hmac_ctx_t *hctx, int enc) {
+		SSLConfig *config = (SSLConfig *) SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), SSLConfig::ctxIndex);
+		if (config == NULL) {
+			return -1;
+		}
+
+		std::lock_guard<std::mutex> lg(config->ticketKeyMutex);
+		if (difftime(time(NULL), config->currentTicketKey.created) > SSLConfig::TICKET_KEY_LIFETIME) {
+			config->previousTicketKey = config->currentTicketKey;
+			config->hasPreviousTicketKey = true;
+			config->newTicketKey(config->currentTicketKey);
+			if (debug) {
+				pdebug("rotated session ticket key");
+			}
+		}
+
+		if (enc) {
+			SSLConfig::ticket_key &key = config->currentTicketKey;
+			if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+				return -1;
+			}
+			memcpy(keyName, key.name, sizeof(key.name));
+			if (EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aesKey, iv) != 1
+					|| initHmac(hctx, key.hmacKey) != 1) {
+				return -1;
+			}
+			return 1;
+		}
+
+		SSLConfig::ticket_key *key;
+		if (memcmp(keyName, config->currentTicketKey.name, sizeof(key->name)) == 0) {
+			key = &config->currentTicketKey;
+		} else if (config->hasPreviousTicketKey
+				&& memcmp(keyName, config->previousTicketKey.name, sizeof(key->name)) == 0) {
+			key = &config->previousTicketKey;
+		} else {
+			return 0;
+		}
+		if (initHmac(hctx, key->hmacKey) != 1
+				|| EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key->aesKey, iv) != 1) {
+			return -1;
+		}
+		return 2;
+	}
+};
+
+SSLConfig::SSLConfig(bool verifyPeers, bool isServer_, std::string cert, std::string key,
 		std::string caCert) {
 	initMutex.lock();
 	if (!initialized) {
 		SSL_load_error_strings();
 		SSL_library_init();
+		ctxIndex = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
 		initialized = true;
 	}
 	initMutex.unlock();
 
+	isServer = isServer_;
+	handshakes = 0;
+	resumed = 0;
+	failed = 0;
+	ktls = 0;
+	totalMicros = 0;
+	maxMicros = 0;
+
+	/*
+	 * TLS 1.2 or above, 1.3 where openssl supports it.
+	 */
 	const SSL_METHOD *method;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	if (isServer) {
+		method = TLS_server_method();
+	} else {
+		method = TLS_client_method();
+	}
+	ctx = SSL_CTX_new(method);
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+#else
 	if (isServer) {
 		method = TLSv1_2_server_method();
 	} else {
 		method = TLSv1_2_client_method();
 	}
 	ctx = SSL_CTX_new(method);
+#endif
+	SSL_CTX_set_ex_data(ctx, ctxIndex, this);
 	SSL_CTX_load_verify_locations(ctx, caCert.c_str(), NULL);
 	if (verifyPeers) {
 		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
@@ -73,7 +183,7 @@ SSLConfig::SSLConfig(bool verifyPeers, bool isServer, std::string cert, std::str
 			 */
 			if (!preverify_ok && (err == X509_V_ERR_UNABLE_TO_GET_ISSUER_CERT))
 			{
-				X509_NAME_oneline(X509_get_issuer_name(ctx->current_cert), buf, sizeof(buf));
+				X509_NAME_oneline(X509_get_issuer_name(err_cert), buf, sizeof(buf));
 				printf("issuer= %s\n", buf);
 			}
 
@@ -82,7 +192,6 @@ SSLConfig::SSLConfig(bool verifyPeers, bool isServer, std::string cert, std::str
 	} else {
 		SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
 	}
-	SSL_CTX_set_timeout(ctx, 6);
 	SSL_CTX_set_verify_depth(ctx, 2);
 	SSL_CTX_set_cipher_list(ctx, "HIGH");
 	SSL_CTX_set_options(ctx, SSL_OP_SINGLE_DH_USE);
@@ -104,9 +213,43 @@ SSLConfig::SSLConfig(bool verifyPeers, bool isServer, std::string cert, std::str
 		ERR_print_errors_fp(stderr);
 		exit(EXIT_FAILURE);
 	}
+
+	/*
+	 * Resumption. Servers issue stateless tickets, and clients keep the
+	 * last session per peer in saveSession().
+	 */
+	SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+	if (isServer) {
+		const unsigned char sidCtx[] = "beetle";
+		SSL_CTX_set_session_id_context(ctx, sidCtx, sizeof(sidCtx) - 1);
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+		newTicketKey(currentTicketKey);
+		hasPreviousTicketKey = false;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, TicketKeyCallback::callback);
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb(ctx, TicketKeyCallback::callback);
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+		SSL_CTX_set_num_tickets(ctx, 1);
+#endif
+	} else {
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		hasPreviousTicketKey = false;
+	}
+
+	std::lock_guard<std::mutex> lg(instancesMutex);
+	instances.insert(this);
 }
 
 SSLConfig::~SSLConfig() {
+	{
+		std::lock_guard<std::mutex> lg(instancesMutex);
+		instances.erase(this);
+	}
+	for (auto &kv : sessions) {
+		SSL_SESSION_free(kv.second);
+	}
 	SSL_CTX_free(ctx);
 	ERR_free_strings();
 	EVP_cleanup();
@@ -116,3 +259,130 @@ SSL_CTX *SSLConfig::getCtx() {
 	return ctx;
 }
 
+void SSLConfig::newTicketKey(ticket_key &key) {
+	if (RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1
+			|| RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1) {
+		ERR_print_errors_fp(stderr);
+		exit(EXIT_FAILURE);
+	}
+	key.created = time(NULL);
+}
+
+int SSLConfig::handshake(SSL *ssl) {
+	auto start = std::chrono::steady_clock::now();
+	int ret = isServer ? SSL_accept(ssl) : SSL_connect(ssl);
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	recordHandshake(ssl, ret > 0, us);
+	return ret;
+}
+
+void SSLConfig::recordHandshake(SSL *ssl, bool success, uint64_t us) {
+	if (!success) {
+		failed++;
+		return;
+	}
+
+	handshakes++;
+	bool isResumed = SSL_session_reused(ssl);
+	if (isResumed) {
+		resumed++;
+	}
+	bool isKtls = isKtlsSend(ssl);
+	if (isKtls) {
+		ktls++;
+	}
+	totalMicros += us;
+	uint64_t prevMax = maxMicros;
+	while (us > prevMax && !maxMicros.compare_exchange_weak(prevMax, us));
+
+	if (debug_performance) {
+		std::stringstream ss;
+		ss << (isServer ? "accepted " : "connected ") << SSL_get_version(ssl) << (isResumed ? " (resumed)" : "")
+				<< (isKtls ? " (ktls)" : "") << " in " << us << " us";
+		pdebug(ss.str());
+	}
+}
+
+bool SSLConfig::setKtls(bool enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+	if (enable) {
+		SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+	} else {
+		SSL_CTX_clear_options(ctx, SSL_OP_ENABLE_KTLS);
+	}
+	return true;
+#else
+	return !enable;
+#endif
+}
+
+bool SSLConfig::isKtlsSend(SSL *ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+	return BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+#else
+	return false;
+#endif
+}
+
+void SSLConfig::resumeSession(SSL *ssl, std::string peer) {
+	std::lock_guard<std::mutex> lg(sessionsMutex);
+	auto it = sessions.find(peer);
+	if (it != sessions.end()) {
+		SSL_set_session(ssl, it->second);
+	}
+}
+
+void SSLConfig::saveSession(SSL *ssl, std::string peer) {
+	SSL_SESSION *session = SSL_get1_session(ssl);
+	if (session == NULL) {
+		return;
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!SSL_SESSION_is_resumable(session)) {
+		SSL_SESSION_free(session);
+		return;
+	}
+#endif
+
+	std::lock_guard<std::mutex> lg(sessionsMutex);
+	auto it = sessions.find(peer);
+	if (it != sessions.end()) {
+		SSL_SESSION_free(it->second);
+		it->second = session;
+	} else {
+		if (sessions.size() >= MAX_CACHED_SESSIONS) {
+			SSL_SESSION_free(sessions.begin()->second);
+			sessions.erase(sessions.begin());
+		}
+		sessions[peer] = session;
+	}
+}
+
+handshake_stats_t SSLConfig::getHandshakeStats() {
+	handshake_stats_t ret;
+	ret.handshakes = handshakes;
+	ret.resumed = resumed;
+	ret.failed = failed;
+	ret.ktls = ktls;
+	ret.totalMicros = totalMicros;
+	ret.maxMicros = maxMicros;
+	return ret;
+}
+
+std::string SSLConfig::getAllHandshakeStats() {
+	std::stringstream ss;
+	std::lock_guard<std::mutex> lg(instancesMutex);
+	for (SSLConfig *config : instances) {
+		handshake_stats_t stats = config->getHandshakeStats();
+		ss << (config->isServer ? "server" : "client") << "\thandshakes " << stats.handshakes << "\tresumed "
+				<< stats.resumed;
+		if (stats.handshakes > 0) {
+			ss << std::fixed << std::setprecision(1) << " (" << (100.0 * stats.resumed / stats.handshakes)
+					<< "%)\tavg " << (stats.totalMicros / 1000.0 / stats.handshakes) << " ms\tmax "
+					<< (stats.maxMicros / 1000.0) << " ms";
+		}
+		ss << "\tktls " << stats.ktls << "\tfailed " << stats.failed << std::endl;
+	}
+	return ss.str();
+}
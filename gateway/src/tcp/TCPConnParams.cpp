@@ -15,62 +15,88 @@
 #include <netinet/in.h>
 #include <openssl/ossl_typ.h>
 #include <openssl/ssl.h>
+#include <poll.h>
 #include <sstream>
 #include <stddef.h>
 #include <string>
-#include <sys/select.h>
-#include <sys/time.h>
+#include <vector>
 
 #include "Debug.h"
 
-bool readParamsHelper(SSL *ssl, int fd, std::map<std::string, std::string> &params, double timeout) {
-	time_t startTime = time(NULL);
-
-	struct timeval defaultTimeout;
-	defaultTimeout.tv_sec = 0;
-	defaultTimeout.tv_usec = 100000;
-
-	fd_set fdSet;
-	FD_ZERO(&fdSet);
-	FD_SET(fd, &fdSet);
+/*
+ * Largest block of parameters accepted.
+ */
+static const uint32_t MAX_PARAMS_LEN = 1 << 16;
 
-	uint32_t paramsLen;
-	int paramsLenRead = 0;
-	while (paramsLenRead < (int)sizeof(uint32_t)) {
-		if (difftime(time(NULL), startTime) > timeout) {
-			if (debug) {
-				pdebug("timed out reading connection parameters length");
+/*
+ * Read exactly len bytes, so that nothing after the parameters is consumed.
+ * Works whether or not the socket is blocking.
+ */
+static bool readExactly(SSL *ssl, int fd, uint8_t *buf, int len, time_t deadline) {
+	int bytesRead = 0;
+	while (bytesRead < len) {
+		if (SSL_pending(ssl) <= 0) {
+			int remaining = (int)difftime(deadline, time(NULL));
+			if (remaining <= 0) {
+				if (debug) {
+					pdebug("timed out reading connection parameters");
+				}
+				return false;
 			}
-			return false;
-		}
-
-		int result = SSL_pending(ssl);
 
-		if (result <= 0) {
-			struct timeval timeout = defaultTimeout;
-			fd_set readFds = fdSet;
-			fd_set exceptFds = fdSet;
-			result = select(fd+1, &readFds, NULL, &exceptFds, &timeout);
-			if (result < 0) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			int result = poll(&pfd, 1, remaining * 1000);
+			if (result < 0 && errno != EINTR) {
 				if (debug) {
 					std::stringstream ss;
-					ss << "select failed : " << strerror(errno);
+					ss << "poll failed : " << strerror(errno);
 					pdebug(ss.str());
 				}
 				return false;
+			} else if (result <= 0) {
+				continue;
 			}
 		}
 
-		if (result > 0) {
-			int n = SSL_read(ssl, ((uint8_t *)&paramsLen) + paramsLenRead, (int)sizeof(uint32_t) - paramsLenRead);
-			if (n <= 0) {
-				if (debug) {
-					pdebug("could not finish reading tcp connection parameters length");
-				}
-				return false;
+		int n = SSL_read(ssl, buf + bytesRead, len - bytesRead);
+		if (n <= 0) {
+			int err = SSL_get_error(ssl, n);
+			if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+				continue;
+			}
+			if (debug) {
+				pdebug("could not finish reading tcp connection parameters");
 			}
-			paramsLenRead += n;
+			return false;
 		}
+		bytesRead += n;
+	}
+	return true;
+}
+
+static bool parseParamLine(std::string line, std::map<std::string, std::string> &params) {
+	size_t splitIdx = line.find(' ');
+	if (splitIdx == std::string::npos) {
+		if (debug) {
+			pdebug("unable to parse parameters: " + line);
+		}
+		return false;
+	}
+	std::string paramName = line.substr(0, splitIdx);
+	std::string paramValue = line.substr(splitIdx + 1, line.length());
+	params[paramName] = paramValue;
+	return true;
+}
+
+bool readParamsHelper(SSL *ssl, int fd, std::map<std::string, std::string> &params, double timeout) {
+	time_t deadline = time(NULL) + (time_t)timeout;
+
+	uint32_t paramsLen;
+	if (!readExactly(ssl, fd, (uint8_t *)&paramsLen, sizeof(uint32_t), deadline)) {
+		return false;
 	}
 
 	/*
@@ -80,86 +106,31 @@ bool readParamsHelper(SSL *ssl, int fd, std::map<std::string, std::string> &para
 	if (debug) {
 		pdebug("expecting " + std::to_string(paramsLen) + " bytes of parameters");
 	}
-
-	int bytesRead = 0;
-	char lineBuffer[2048];
-	int lineIndex = 0;
-	while (bytesRead < (int)paramsLen) {
-		if (difftime(time(NULL), startTime) > timeout) {
-			if (debug) {
-				pdebug("timed out reading connection parameters");
-			}
-			return false;
+	if (paramsLen > MAX_PARAMS_LEN) {
+		if (debug) {
+			pdebug("connection parameters too long");
 		}
+		return false;
+	}
 
-		int result = SSL_pending(ssl);
-
-		if (result <= 0) {
-			struct timeval timeout = defaultTimeout;
-			fd_set readFds = fdSet;
-			fd_set exceptFds = fdSet;
-			result = select(fd+1, &readFds, NULL, &exceptFds, &timeout);
-			if (result < 0) {
-				if (debug) {
-					std::stringstream ss;
-					ss << "select failed : " << strerror(errno);
-					pdebug(ss.str());
-				}
-				return false;
-			}
-		}
+	std::vector<uint8_t> block(paramsLen);
+	if (paramsLen > 0 && !readExactly(ssl, fd, block.data(), paramsLen, deadline)) {
+		return false;
+	}
 
-		if (result > 0) {
-			char ch;
-			int n = SSL_read(ssl, &ch, 1);
-			if (n <= 0) {
-				if (debug) {
-					pdebug("could not finish reading tcp connection parameters");
-				}
+	std::string line;
+	for (uint8_t ch : block) {
+		if (ch == '\n') {
+			if (line.length() != 0 && !parseParamLine(line, params)) {
 				return false;
 			}
-
-			/* advance */
-			bytesRead += n;
-
-			if (ch == '\n') {
-				lineBuffer[lineIndex] = '\0';
-				lineIndex = 0;
-				std::string line = std::string(lineBuffer);
-				if (line.length() == 0) {
-					continue;
-				}
-				size_t splitIdx = line.find(' ');
-				if (splitIdx == std::string::npos) {
-					if (debug) {
-						pdebug("unable to parse parameters: " + line);
-					}
-					return false;
-				}
-				std::string paramName = line.substr(0, splitIdx);
-				std::string paramValue = line.substr(splitIdx + 1, line.length());
-				params[paramName] = paramValue;
-			} else if (ch != '\0') {
-				lineBuffer[lineIndex] = ch;
-				lineIndex++;
-			}
+			line.clear();
+		} else if (ch != '\0') {
+			line += (char)ch;
 		}
 	}
-
-	if (lineIndex != 0) {
-		lineBuffer[lineIndex] = '\0';
-		std::string line = std::string(lineBuffer);
-		size_t splitIdx = line.find(' ');
-		if (splitIdx == std::string::npos) {
-			if (debug) {
-				pdebug("unable to parse parameters: " + line);
-			}
-			return false;
-		}
-		std::string paramName = line.substr(0, splitIdx);
-		std::string paramValue = line.substr(splitIdx + 1, line.length());
-		params[paramName] = paramValue;
+	if (line.length() != 0 && !parseParamLine(line, params)) {
+		return false;
 	}
 	return true;
 }
-
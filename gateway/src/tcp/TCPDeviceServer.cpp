@@ -8,12 +8,16 @@
 #include "tcp/TCPDeviceServer.h"
 
 #include <netinet/in.h>
+#include <poll.h>
 #include <stddef.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <utility>
+#include <vector>
 #include <openssl/bio.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
@@ -23,14 +27,16 @@
 #include "device/socket/tcp/TCPClient.h"
 #include "device/socket/tcp/TCPClientProxy.h"
 #include "Debug.h"
+#include "tcp/GatewaySession.h"
 #include "tcp/TCPConnParams.h"
+#include "tcp/TCPFraming.h"
 #include "util/file.h"
 #include "util/write.h"
 
-static void startTcpDeviceHelper(Beetle &, SSL *ssl, int clifd, struct sockaddr_in cliaddr);
-
-TCPDeviceServer::TCPDeviceServer(Beetle &beetle, SSLConfig *sslConfig_, int port) :
-		beetle(beetle), sslConfig(sslConfig_) {
+TCPDeviceServer::TCPDeviceServer(Beetle &beetle, SSLConfig *sslConfig_, int port, int backlog,
+		int maxHandshakes, int handshakeTimeout) :
+		beetle(beetle), sslConfig(sslConfig_), maxHandshakes(maxHandshakes),
+		handshakeTimeout(handshakeTimeout), acceptPaused(false) {
 	serverFd = socket(AF_INET, SOCK_STREAM, 0);
 
 	if (serverFd < 0) {
@@ -51,57 +57,225 @@ TCPDeviceServer::TCPDeviceServer(Beetle &beetle, SSLConfig *sslConfig_, int port
 		throw ServerException("error on bind");
 	}
 
-	listen(serverFd, 5);
+	if (listen(serverFd, backlog) < 0) {
+		throw ServerException("error on listen");
+	}
+
+	if (!fd_set_blocking(serverFd, false)) {
+		throw ServerException("error setting socket to nonblocking");
+	}
 
 	/*
 	 * Add to sockets managed by select
 	 */
-	int sockfdShared = serverFd;
-	auto sslConfigShared = sslConfig;
-	beetle.readers.add(serverFd, [&beetle, sockfdShared, sslConfigShared] {
+	beetle.readers.add(serverFd, [this] {
+		acceptClients();
+	});
+
+	std::cout << "tcp server started on port: " << port << std::endl;
+}
+
+TCPDeviceServer::~TCPDeviceServer() {
+	beetle.readers.remove(serverFd);
+	shutdown(serverFd, SHUT_RDWR);
+	close(serverFd);
+
+	std::map<int, std::shared_ptr<pending_handshake>> remaining;
+	handshakesMutex.lock();
+	remaining.swap(handshakes);
+	handshakesMutex.unlock();
+	for (auto &kv : remaining) {
+		beetle.readers.remove(kv.first);
+		std::lock_guard<std::mutex> lg(kv.second->m);
+		if (!kv.second->done) {
+			kv.second->done = true;
+			SSL_free(kv.second->ssl);
+			close(kv.second->fd);
+		}
+	}
+
+	/*
+	 * Stop handlers take sessionsMutex. Clearing a handler waits for one
+	 * running on a reader, and none run afterwards.
+	 */
+	std::map<GatewaySession *, std::shared_ptr<GatewaySession>> remainingSessions;
+	sessionsMutex.lock();
+	remainingSessions.swap(sessions);
+	sessionsMutex.unlock();
+	for (auto &kv : remainingSessions) {
+		kv.second->setStopHandler(NULL);
+		kv.second->stop();
+	}
+	remainingSessions.clear();
+	if (debug) {
+		pdebug("tcp server stopped");
+	}
+}
+
+std::function<void()> TCPDeviceServer::getDaemon() {
+	return [this] {
+		auto now = std::chrono::steady_clock::now();
+		std::vector<std::shared_ptr<pending_handshake>> expired;
+		handshakesMutex.lock();
+		for (auto &kv : handshakes) {
+			if (now - kv.second->started > std::chrono::seconds(handshakeTimeout)) {
+				expired.push_back(kv.second);
+			}
+		}
+		handshakesMutex.unlock();
+
+		for (auto &hs : expired) {
+			std::lock_guard<std::mutex> lg(hs->m);
+			if (!hs->done) {
+				if (debug) {
+					pwarn("ssl accept timed out");
+				}
+				endHandshake(hs, false);
+			}
+		}
+	};
+}
+
+void TCPDeviceServer::acceptClients() {
+	while (true) {
+		std::unique_lock<std::mutex> lk(handshakesMutex);
+		if (handshakes.size() >= maxHandshakes) {
+			/*
+			 * Leave the rest in the backlog until a handshake ends.
+			 */
+			if (!acceptPaused) {
+				acceptPaused = true;
+				beetle.readers.remove(serverFd);
+				if (debug) {
+					pwarn("too many concurrent handshakes, pausing accept");
+				}
+			}
+			return;
+		}
+
 		struct sockaddr_in client_addr;
 		socklen_t clilen = sizeof(client_addr);
-
-		int clifd = accept(sockfdShared, (struct sockaddr *) &client_addr, &clilen);
+		int clifd = accept(serverFd, (struct sockaddr *) &client_addr, &clilen);
 		if (clifd < 0) {
-			if (debug) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && debug) {
 				pwarn("error on accept");
 			}
 			return;
 		}
 
-		SSL *ssl = SSL_new(sslConfigShared->getCtx());
-		SSL_set_fd(ssl, clifd);
-		if (SSL_accept(ssl) <= 0) {
+		SSL *ssl = SSL_new(sslConfig->getCtx());
+		if (ssl == NULL || !fd_set_blocking(clifd, false)) {
 			if (debug) {
-				pwarn("error on ssl accept");
+				pwarn("could not set up ssl for client");
 			}
-			ERR_print_errors_fp(stderr);
-			SSL_shutdown(ssl);
-			shutdown(clifd, SHUT_RDWR);
 			SSL_free(ssl);
 			close(clifd);
-			return;
+			continue;
 		}
+		SSL_set_fd(ssl, clifd);
+		SSL_set_accept_state(ssl);
+
+		auto hs = std::make_shared<pending_handshake>();
+		hs->ssl = ssl;
+		hs->fd = clifd;
+		hs->addr = client_addr;
+		hs->started = std::chrono::steady_clock::now();
+		hs->done = false;
+		handshakes[clifd] = hs;
+		lk.unlock();
 
-		beetle.workers.schedule([&beetle, ssl, clifd, client_addr]{
-			startTcpDeviceHelper(beetle, ssl, clifd, client_addr);
+		beetle.readers.add(clifd, [this, clifd] {
+			continueHandshake(clifd);
 		});
-	});
+	}
+}
 
-	std::cout << "tcp server started on port: " << port << std::endl;
+void TCPDeviceServer::continueHandshake(int fd) {
+	std::shared_ptr<pending_handshake> hs;
+	handshakesMutex.lock();
+	auto it = handshakes.find(fd);
+	if (it != handshakes.end()) {
+		hs = it->second;
+	}
+	handshakesMutex.unlock();
+	if (!hs) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lg(hs->m);
+	if (hs->done) {
+		return;
+	}
+
+	while (true) {
+		int ret = SSL_do_handshake(hs->ssl);
+		if (ret > 0) {
+			break;
+		}
+
+		int err = SSL_get_error(hs->ssl, ret);
+		if (err == SSL_ERROR_WANT_READ) {
+			return;
+		}
+
+		/*
+		 * The readers only wait for input. Handshake messages are small, so
+		 * a full send buffer drains quickly.
+		 */
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		if (err != SSL_ERROR_WANT_WRITE || poll(&pfd, 1, TIMEOUT_HANDSHAKE_WRITE) <= 0) {
+			if (debug) {
+				pwarn("error on ssl accept");
+			}
+			ERR_print_errors_fp(stderr);
+			endHandshake(hs, false);
+			return;
+		}
+	}
+
+	endHandshake(hs, true);
 }
 
-TCPDeviceServer::~TCPDeviceServer() {
-	beetle.readers.remove(serverFd);
-	shutdown(serverFd, SHUT_RDWR);
-	close(serverFd);
-	if (debug) {
-		pdebug("tcp server stopped");
+/*
+ * Called with hs->m held.
+ */
+void TCPDeviceServer::endHandshake(std::shared_ptr<pending_handshake> hs, bool success) {
+	hs->done = true;
+	beetle.readers.remove(hs->fd);
+
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - hs->started).count();
+	sslConfig->recordHandshake(hs->ssl, success, us);
+
+	handshakesMutex.lock();
+	handshakes.erase(hs->fd);
+	if (acceptPaused && handshakes.size() < maxHandshakes) {
+		acceptPaused = false;
+		beetle.readers.add(serverFd, [this] {
+			acceptClients();
+		});
+	}
+	handshakesMutex.unlock();
+
+	SSL *ssl = hs->ssl;
+	int clifd = hs->fd;
+	struct sockaddr_in cliaddr = hs->addr;
+	if (success) {
+		beetle.workers.schedule([this, ssl, clifd, cliaddr] {
+			startDevice(ssl, clifd, cliaddr);
+		});
+	} else {
+		SSL_shutdown(ssl);
+		shutdown(clifd, SHUT_RDWR);
+		SSL_free(ssl);
+		close(clifd);
 	}
 }
 
-static void startTcpDeviceHelper(Beetle &beetle, SSL *ssl, int clifd, struct sockaddr_in cliaddr) {
+void TCPDeviceServer::startDevice(SSL *ssl, int clifd, struct sockaddr_in cliaddr) {
 	std::map<std::string, std::string> clientParams;
 	if (!readParamsHelper(ssl, clifd, clientParams)) {
 		if (debug) {
@@ -124,12 +298,21 @@ static void startTcpDeviceHelper(Beetle &beetle, SSL *ssl, int clifd, struct soc
 	/*
 	 * Send params to the client.
 	 */
+	int framing = negotiateFraming(clientParams);
+	bool isSession = clientParams.find(TCP_PARAM_GATEWAY) != clientParams.end()
+			&& clientParams.find(TCP_PARAM_SESSION) != clientParams.end();
 	std::stringstream ss;
 	ss << TCP_PARAM_GATEWAY << " " << beetle.name;
+	if (clientParams.find(TCP_PARAM_FRAMING) != clientParams.end()) {
+		ss << "\n" << TCP_PARAM_FRAMING << " " << framing;
+	}
+	if (isSession) {
+		ss << "\n" << TCP_PARAM_SESSION << " " << GATEWAY_SESSION_VERSION;
+	}
 	std::string serverParams = ss.str();
 	uint32_t serverParamsLen = htonl(serverParams.length());
 
-	if (SSL_write_all(ssl, (uint8_t *) &serverParamsLen, sizeof(serverParamsLen)) == false) {
+	if (SSL_write_all(ssl, (uint8_t *) &serverParamsLen, sizeof(serverParamsLen)) != (int) sizeof(serverParamsLen)) {
 		ERR_print_errors_fp(stderr);
 		SSL_shutdown(ssl);
 		shutdown(clifd, SHUT_RDWR);
@@ -138,9 +321,10 @@ static void startTcpDeviceHelper(Beetle &beetle, SSL *ssl, int clifd, struct soc
 		if (debug) {
 			pdebug("could not write server params length");
 		}
+		return;
 	}
 
-	if (SSL_write_all(ssl, (uint8_t *) serverParams.c_str(), serverParams.length()) == false) {
+	if (SSL_write_all(ssl, (uint8_t *) serverParams.c_str(), serverParams.length()) != (int) serverParams.length()) {
 		ERR_print_errors_fp(stderr);
 		SSL_shutdown(ssl);
 		shutdown(clifd, SHUT_RDWR);
@@ -149,12 +333,18 @@ static void startTcpDeviceHelper(Beetle &beetle, SSL *ssl, int clifd, struct soc
 		if (debug) {
 			pdebug("could not write server params");
 		}
+		return;
+	}
+
+	if (isSession) {
+		startSession(ssl, clifd, cliaddr, clientParams[TCP_PARAM_GATEWAY]);
+		return;
 	}
 
 	/*
 	 * Instantiate the virtual device around the client socket.
 	 */
-	std::shared_ptr<VirtualDevice> device = NULL;
+	std::shared_ptr<TCPConnection> device = NULL;
 	try {
 		/*
 		 * Takes over the clifd
@@ -169,6 +359,7 @@ static void startTcpDeviceHelper(Beetle &beetle, SSL *ssl, int clifd, struct soc
 			device_t deviceId = std::stol(clientParams[TCP_PARAM_DEVICE]);
 			device = std::make_shared<TCPClientProxy>(beetle, ssl, clifd, client, cliaddr, deviceId);
 		}
+		device->setFramingVersion(framing);
 
 		boost::shared_lock<boost::shared_mutex> devicesLk;
 		beetle.addDevice(device, devicesLk);
@@ -184,3 +375,65 @@ static void startTcpDeviceHelper(Beetle &beetle, SSL *ssl, int clifd, struct soc
 		}
 	}
 }
+
+void TCPDeviceServer::startSession(SSL *ssl, int clifd, struct sockaddr_in cliaddr, std::string clientGateway) {
+	auto session = std::make_shared<GatewaySession>(beetle, ssl, clifd, clientGateway, cliaddr);
+	std::weak_ptr<GatewaySession> weak = session;
+
+	/*
+	 * Proxy each channel the client opens, off the reader.
+	 */
+	session->setOpenHandler([this, weak](uint32_t channel, device_t deviceId) {
+		beetle.workers.schedule([this, weak, channel, deviceId] {
+			auto session = weak.lock();
+			if (!session) {
+				return;
+			}
+
+			std::shared_ptr<TCPConnection> device = NULL;
+			try {
+				device = std::make_shared<TCPClientProxy>(beetle, session, channel, deviceId);
+
+				boost::shared_lock<boost::shared_mutex> devicesLk;
+				beetle.addDevice(device, devicesLk);
+				device->start(false);
+				session->acceptOpen(channel);
+
+				if (debug) {
+					pdebug(device->getName() + " has handle range [0,"
+							+ std::to_string(device->getHighestHandle()) + "]");
+				}
+			} catch (std::exception& e) {
+				pexcept(e);
+				session->rejectOpen(channel, e.what());
+				if (device) {
+					beetle.removeDevice(device->getId());
+				}
+			}
+		});
+	});
+
+	GatewaySession *key = session.get();
+	session->setStopHandler([this, key] {
+		/*
+		 * Release the session off its reader.
+		 */
+		std::lock_guard<std::mutex> lg(sessionsMutex);
+		auto it = sessions.find(key);
+		if (it != sessions.end()) {
+			auto session = it->second;
+			sessions.erase(it);
+			beetle.workers.schedule([session] {});
+		}
+	});
+
+	{
+		std::lock_guard<std::mutex> lg(sessionsMutex);
+		sessions[key] = session;
+	}
+	session->start();
+
+	if (debug) {
+		pdebug("started session with " + clientGateway);
+	}
+}
@@ -0,0 +1,183 @@
+/*
+ * TCPFraming.cpp
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: James Hong
+ */
+
+#include "tcp/TCPFraming.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "tcp/TCPConnParams.h"
+
+size_t encodeVarint(uint32_t value, uint8_t *out) {
+	size_t n = 0;
+	while (value >= 0x80) {
+		out[n++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (uint8_t) value;
+	return n;
+}
+
+size_t decodeVarint(const uint8_t *buf, size_t len, uint32_t &value) {
+	value = 0;
+	for (size_t i = 0; i < std::min(len, VARINT_MAX_LEN); i++) {
+		value |= (uint32_t) (buf[i] & 0x7F) << (7 * i);
+		if ((buf[i] & 0x80) == 0) {
+			return i + 1;
+		}
+	}
+	if (len >= VARINT_MAX_LEN) {
+		throw std::runtime_error("varint too long");
+	}
+	return 0;
+}
+
+int negotiateFraming(const std::map<std::string, std::string> &params) {
+	auto it = params.find(TCP_PARAM_FRAMING);
+	if (it == params.end()) {
+		return TCP_FRAMING_V1;
+	}
+	int offered;
+	try {
+		offered = std::stoi(it->second);
+	} catch (std::exception &e) {
+		return TCP_FRAMING_V1;
+	}
+	return std::max(TCP_FRAMING_V1, std::min(offered, TCP_FRAMING_MAX_VERSION));
+}
+
+bool appendFramesV1(std::vector<uint8_t> &out, const std::vector<std::vector<uint8_t>> &pdus) {
+	for (auto &pdu : pdus) {
+		if (pdu.size() > (size_t) TCP_FRAME_V1_MAX_PDU) {
+			return false;
+		}
+		out.push_back((uint8_t) pdu.size());
+		out.insert(out.end(), pdu.begin(), pdu.end());
+	}
+	return true;
+}
+
+static void finishFrameV2(std::vector<uint8_t> &out, std::vector<uint8_t> &body) {
+	uint8_t len[VARINT_MAX_LEN];
+	size_t n = encodeVarint(body.size(), len);
+	out.insert(out.end(), len, len + n);
+	out.insert(out.end(), body.begin(), body.end());
+}
+
+void appendFramesV2(std::vector<uint8_t> &out, const std::vector<std::vector<uint8_t>> &pdus,
+		uint64_t timestamp) {
+	std::vector<uint8_t> body;
+	for (auto &pdu : pdus) {
+		if (body.size() > 0 && body.size() + VARINT_MAX_LEN + pdu.size() > TCP_FRAME_V2_MAX_LEN) {
+			finishFrameV2(out, body);
+			body.clear();
+		}
+		if (body.size() == 0) {
+			body.push_back(timestamp ? TCP_FRAME_FLAG_TIMESTAMP : 0);
+			for (int i = sizeof(uint64_t) - 1; timestamp && i >= 0; i--) {
+				body.push_back((uint8_t) (timestamp >> (8 * i)));
+			}
+		}
+
+		uint8_t len[VARINT_MAX_LEN];
+		size_t n = encodeVarint(pdu.size(), len);
+		body.insert(body.end(), len, len + n);
+		body.insert(body.end(), pdu.begin(), pdu.end());
+	}
+	if (body.size() > 0) {
+		finishFrameV2(out, body);
+	}
+}
+
+void parseFrameV2(uint8_t *body, size_t len, uint64_t &timestamp, std::vector<std::pair<uint8_t *, int>> &pdus) {
+	if (len < 1) {
+		throw std::runtime_error("empty frame");
+	}
+	uint8_t flags = body[0];
+	size_t offset = 1;
+
+	timestamp = 0;
+	if (flags & TCP_FRAME_FLAG_TIMESTAMP) {
+		if (len < offset + sizeof(uint64_t)) {
+			throw std::runtime_error("frame too short for timestamp");
+		}
+		for (size_t i = 0; i < sizeof(uint64_t); i++) {
+			timestamp = (timestamp << 8) | body[offset++];
+		}
+	}
+
+	while (offset < len) {
+		uint32_t pduLen;
+		size_t n = decodeVarint(body + offset, len - offset, pduLen);
+		if (n == 0 || pduLen == 0 || pduLen > len - offset - n) {
+			throw std::runtime_error("bad pdu length in frame");
+		}
+		offset += n;
+		pdus.push_back(std::make_pair(body + offset, (int) pduLen));
+		offset += pduLen;
+	}
+}
+
+TCPFrameDecoder::TCPFrameDecoder(int version_) {
+	version = version_;
+	offset = 0;
+}
+
+void TCPFrameDecoder::setVersion(int version_) {
+	version = version_;
+}
+
+void TCPFrameDecoder::append(const uint8_t *buf, size_t len) {
+	if (offset > 0) {
+		buffer.erase(buffer.begin(), buffer.begin() + offset);
+		offset = 0;
+	}
+	buffer.insert(buffer.end(), buf, buf + len);
+}
+
+bool TCPFrameDecoder::next(uint64_t &timestamp, std::vector<std::pair<uint8_t *, int>> &pdus) {
+	timestamp = 0;
+	pdus.clear();
+
+	uint8_t *start = buffer.data() + offset;
+	size_t available = buffer.size() - offset;
+	if (available == 0) {
+		return false;
+	}
+
+	if (version < TCP_FRAMING_V2) {
+		size_t len = start[0];
+		if (available < 1 + len) {
+			return false;
+		}
+		if (len > 0) {
+			pdus.push_back(std::make_pair(start + 1, (int) len));
+		}
+		offset += 1 + len;
+		return true;
+	}
+
+	uint32_t len;
+	size_t n = decodeVarint(start, available, len);
+	if (n == 0) {
+		return false;
+	}
+	if (len > TCP_FRAME_V2_MAX_LEN) {
+		throw std::runtime_error("frame too long: " + std::to_string(len));
+	}
+	if (available - n < len) {
+		return false;
+	}
+	parseFrameV2(start + n, len, timestamp, pdus);
+	offset += n + len;
+	return true;
+}
+
+size_t TCPFrameDecoder::buffered() {
+	return buffer.size() - offset;
+}